@@ -128,7 +128,9 @@ void main(void)
             if (!rc)
             {
                 svc_dbg_print("UART configured\n");
-                PSPUartWrite(&Uart, "Hello World!\n", sizeof("Hello World!\n") - 1, NULL);
+                rc = PSPUartWrite(&Uart, "Hello World!\n", sizeof("Hello World!\n") - 1, NULL);
+                if (!rc) /* The write only queues the data, the UART instance goes out of scope below. */
+                    rc = PSPUartTxFlush(&Uart);
             }
 
             svc_dbg_print("UART done\n");
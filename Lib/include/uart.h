@@ -73,6 +73,34 @@ typedef enum PSPUARTSTOPBITS
 } PSPUARTSTOPBITS;
 
 
+/**
+ * UART receive FIFO trigger level config enum.
+ */
+typedef enum PSPUARTRXTRIGLVL
+{
+    /** Invalid value, do not use. */
+    PSPUARTRXTRIGLVL_INVALID = 0,
+    /** Trigger after 1 byte. */
+    PSPUARTRXTRIGLVL_1BYTE,
+    /** Trigger after 4 bytes. */
+    PSPUARTRXTRIGLVL_4BYTES,
+    /** Trigger after 8 bytes. */
+    PSPUARTRXTRIGLVL_8BYTES,
+    /** Trigger after 14 bytes. */
+    PSPUARTRXTRIGLVL_14BYTES,
+    /** 32bit hack. */
+    PSPUARTRXTRIGLVL_32BIT_HACK = 0x7fffffff
+} PSPUARTRXTRIGLVL;
+
+
+/** The input clock of PC compatible UARTs (1.8432 MHz crystal). */
+#define PSP_UART_CLOCK_HZ_DEFAULT   1843200
+/** Size of the software receive ring in bytes (power of two). */
+#define PSP_UART_RX_RING_SZ         256
+/** Size of the software transmit ring in bytes (power of two). */
+#define PSP_UART_TX_RING_SZ         256
+
+
 /**
  * UART driver instance state, treat as private.
  */
@@ -80,7 +108,35 @@ typedef struct PSPUART
 {
     /** Pointer to the device I/O interface given during construction. */
     PCPSPIODEVIF        pIfDevIo;
-    /** @todo State members. */
+    /** The input clock of the UART in Hz used to derive the divisor. */
+    uint32_t            uClkHz;
+    /** Number of bytes which can be written after the transmitter holding register was found empty (FIFO depth, 1 without FIFO). */
+    uint32_t            cbTxBurst;
+    /** Free running read offset into the receive ring. */
+    volatile uint32_t   offRxRingRead;
+    /** Free running write offset into the receive ring (advanced from the interrupt handler in interrupt mode). */
+    volatile uint32_t   offRxRingWrite;
+    /** Free running read offset into the transmit ring (advanced from the interrupt handler in interrupt mode). */
+    volatile uint32_t   offTxRingRead;
+    /** Free running write offset into the transmit ring. */
+    volatile uint32_t   offTxRingWrite;
+    /** Flag whether reception is interrupt driven, the receive FIFO is only touched by PSPUartIrqHandler() then. */
+    volatile bool       fRxIrq;
+    /** Flag whether the interrupt handler masked the receive interrupt because the ring is full, only the main context unmasks it. */
+    volatile bool       fRxIrqThrottled;
+    /** Flag whether the transmit interrupt is enabled because data is queued in interrupt mode, set by the main context
+     * and cleared by the interrupt handler once the ring drained. */
+    volatile bool       fTxIrq;
+    /** Padding. */
+    uint8_t             bPad0;
+    /** Number of interrupts serviced. */
+    volatile uint32_t   cIrqs;
+    /** Number of receiver overruns detected (data lost in the hardware). */
+    volatile uint32_t   cRxOverruns;
+    /** The software receive ring, filled from the receive FIFO whenever the driver is called. */
+    uint8_t             abRxRing[PSP_UART_RX_RING_SZ];
+    /** The software transmit ring, drained into the transmit FIFO whenever the driver is called. */
+    uint8_t             abTxRing[PSP_UART_TX_RING_SZ];
 } PSPUART;
 /** Pointer to a UART driver instance. */
 typedef PSPUART *PPSPUART;
@@ -121,10 +177,61 @@ int PSPUartParamsSet(PPSPUART pUart, uint32_t uBps, PSPUARTDATABITS enmDataBits,
                      PSPUARTPARITY enmParity, PSPUARTSTOPBITS enmStopBits);
 
 
+/**
+ * Sets the input clock of the UART used to calculate the divisor for a baud rate,
+ * needs to be called before PSPUartParamsSet() if the UART is not clocked from the standard 1.8432 MHz crystal
+ * (for example when a high speed clock was selected in the Super I/O).
+ *
+ * @returns nothing.
+ * @param   pUart                   The UART driver instance.
+ * @param   uClkHz                  The input clock in Hz.
+ */
+void PSPUartClockSet(PPSPUART pUart, uint32_t uClkHz);
+
+
+/**
+ * Configures the FIFOs of the UART.
+ *
+ * @returns Status code.
+ * @param   pUart                   The UART driver instance.
+ * @param   fEnable                 Flag whether to enable or disable the FIFOs.
+ * @param   enmRxTrigLvl            The receive FIFO trigger level, ignored when disabling the FIFOs.
+ *
+ * @note The FIFOs are reset. If the UART has no FIFOs this falls back to single byte transfers.
+ */
+int PSPUartFifoSet(PPSPUART pUart, bool fEnable, PSPUARTRXTRIGLVL enmRxTrigLvl);
+
+
+/**
+ * Switches between interrupt driven and polled reception.
+ *
+ * In interrupt mode PSPUartIrqHandler() also moves queued data into the transmitter, the transmitter holding
+ * register empty interrupt is only enabled while there is something queued.
+ *
+ * @returns Status code.
+ * @param   pUart                   The UART driver instance.
+ * @param   fEnable                 Flag whether to enable interrupt driven reception.
+ *
+ * @note Enabling arms the transmitter holding register empty interrupt once even with nothing queued, so the caller can
+ *       verify that interrupts of the UART reach PSPUartIrqHandler() (see PSPUART::cIrqs).
+ *       Interrupts of the UART have to be masked when disabling.
+ */
+int PSPUartRxIrqSet(PPSPUART pUart, bool fEnable);
+
+
+/**
+ * Services pending interrupts of the UART, to be called from the interrupt handler.
+ *
+ * @returns Flag whether the UART had an interrupt pending.
+ * @param   pUart                   The UART driver instance.
+ */
+bool PSPUartIrqHandler(PPSPUART pUart);
+
+
 /**
  * Returns the number of bytes available for reading.
  *
- * @returns Number of bytes available for reading, 0 if nothing is available.
+ * @returns Exact number of bytes available for reading, 0 if nothing is available.
  * @param   pUart                   The UART driver instance.
  */
 size_t PSPUartGetDataAvail(PPSPUART pUart);
@@ -139,6 +246,34 @@ size_t PSPUartGetDataAvail(PPSPUART pUart);
 size_t PSPUartGetTxSpaceAvail(PPSPUART pUart);
 
 
+/**
+ * Moves queued data to the hardware if the transmitter can take more, never blocks.
+ * Should be called regularly while data is queued (main loops, delay loops).
+ *
+ * @returns Status code.
+ * @param   pUart                   The UART driver instance.
+ */
+int PSPUartTxPump(PPSPUART pUart);
+
+
+/**
+ * Returns whether everything written was transmitted completely.
+ *
+ * @returns Flag whether the transmit queue and the transmitter are empty, false if the UART couldn't be accessed.
+ * @param   pUart                   The UART driver instance.
+ */
+bool PSPUartTxIsDone(PPSPUART pUart);
+
+
+/**
+ * Waits until everything written was transmitted completely.
+ *
+ * @returns Status code, the error of the register access if the UART couldn't be accessed.
+ * @param   pUart                   The UART driver instance.
+ */
+int PSPUartTxFlush(PPSPUART pUart);
+
+
 /**
  * Read the given amount of data from the given UART device instance.
  *
@@ -152,7 +287,8 @@ int PSPUartRead(PPSPUART pUart, void *pvBuf, size_t cbRead, size_t *pcbRead);
 
 
 /**
- * Read the given amount of data from the given UART device instance - non blocking.
+ * Read the given amount of data from the given UART device instance - non blocking,
+ * drains everything available from the receive FIFO up to the given amount.
  *
  * @returns Status code.
  * @param   pUart                   The UART driver instance.
@@ -164,7 +300,8 @@ int PSPUartReadNB(PPSPUART pUart, void *pvBuf, size_t cbRead, size_t *pcbRead);
 
 
 /**
- * Write the given amount of data to the given UART device instance.
+ * Write the given amount of data to the given UART device instance,
+ * returns as soon as everything was queued for transmission (see PSPUartTxFlush()).
  *
  * @returns Status code.
  * @param   pUart                   The UART driver instance.
@@ -176,7 +313,8 @@ int PSPUartWrite(PPSPUART pUart, const void *pvBuf, size_t cbWrite, size_t *pcbW
 
 
 /**
- * Write the given amount of data to the given UART device instance - non blocking.
+ * Write the given amount of data to the given UART device instance - non blocking,
+ * queues as much as fits into the transmit queue.
  *
  * @returns Status code.
  * @param   pUart                   The UART driver instance.
@@ -23,9 +23,59 @@
 #include <x86/uart.h>
 
 #include <err.h>
+#include <string.h>
 #include <uart.h>
 
 
+/** FIFO control register: enable the FIFOs. */
+#define PSP_UART_FCR_FIFO_EN            0x01
+/** FIFO control register: reset the receive FIFO. */
+#define PSP_UART_FCR_RX_FIFO_RST        0x02
+/** FIFO control register: reset the transmit FIFO. */
+#define PSP_UART_FCR_TX_FIFO_RST        0x04
+/** FIFO control register: receive trigger level shift. */
+#define PSP_UART_FCR_RX_TRIG_SHIFT      6
+/** Interrupt identification register: FIFOs enabled mask (both bits set for a working 16550A FIFO). */
+#define PSP_UART_IIR_FIFO_EN_MASK       0xc0
+/** Depth of the 16550A transmit FIFO. */
+#define PSP_UART_FIFO_SZ                16
+/** Line status register: transmitter (holding and shift register) empty. */
+#define PSP_UART_LSR_TEMT               0x40
+/** Maximum baud rate error in percent accepted for a divisor. */
+#define PSP_UART_BAUD_ERR_PCT_MAX       3
+/** Line status register: overrun error. */
+#define PSP_UART_LSR_OE                 0x02
+/** Interrupt enable register: received data available. */
+#define PSP_UART_IER_ERBFI              0x01
+/** Interrupt enable register: transmitter holding register empty. */
+#define PSP_UART_IER_ETBEI              0x02
+/** Interrupt enable register: receiver line status. */
+#define PSP_UART_IER_ELSI               0x04
+/** Interrupt enable register value for interrupt driven reception. */
+#define PSP_UART_IER_RX_IRQ             (PSP_UART_IER_ERBFI | PSP_UART_IER_ELSI)
+/** Interrupt identification register: no interrupt pending. */
+#define PSP_UART_IIR_NO_INT             0x01
+/** Interrupt identification register: interrupt ID mask. */
+#define PSP_UART_IIR_ID_MASK            0x0e
+/** Interrupt identification register: modem status changed. */
+#define PSP_UART_IIR_ID_MSR             0x00
+/** Interrupt identification register: transmitter holding register empty. */
+#define PSP_UART_IIR_ID_THRE            0x02
+/** Interrupt identification register: received data available. */
+#define PSP_UART_IIR_ID_RDA             0x04
+/** Interrupt identification register: receiver line status. */
+#define PSP_UART_IIR_ID_RLS             0x06
+/** Interrupt identification register: character timeout (data left in the receive FIFO below the trigger level). */
+#define PSP_UART_IIR_ID_CTI             0x0c
+/** Modem control register: OUT2, gates the interrupt line on PC compatible UARTs. */
+#define PSP_UART_MCR_OUT2               0x08
+/** Modem status register offset (not used otherwise). */
+#define PSP_UART_REG_MSR_OFF            6
+
+/** Keeps the compiler from moving ring accesses across updates of the ring offsets shared with the interrupt handler. */
+#define PSP_UART_COMPILER_BARRIER()     __asm__ __volatile__("" : : : "memory")
+
+
 /**
  * Sets the UART divisor.
  *
@@ -63,19 +113,176 @@ static int pspUartDivisorSet(PPSPUART pUart, uint32_t uDivisor)
 }
 
 
+/**
+ * Moves everything available in the receive FIFO into the software receive ring.
+ *
+ * @returns Status code.
+ * @param   pUart                   The UART driver instance.
+ */
+static int pspUartRxRingFill(PPSPUART pUart)
+{
+    int rc = INF_SUCCESS;
+
+    while (pUart->offRxRingWrite - pUart->offRxRingRead < sizeof(pUart->abRxRing))
+    {
+        uint8_t uLsr = 0;
+        rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_LSR_OFF, &uLsr, sizeof(uLsr));
+        if (rc != INF_SUCCESS)
+            break;
+        if (uLsr & PSP_UART_LSR_OE)
+            pUart->cRxOverruns++;
+        if (!(uLsr & X86_UART_REG_LSR_DR))
+            break;
+
+        rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_RBR_OFF,
+                             &pUart->abRxRing[pUart->offRxRingWrite & (sizeof(pUart->abRxRing) - 1)], 1);
+        if (rc != INF_SUCCESS)
+            break;
+
+        PSP_UART_COMPILER_BARRIER();
+        pUart->offRxRingWrite++;
+    }
+
+    return rc;
+}
+
+
+/**
+ * Writes the interrupt enable register derived from the current interrupt state.
+ *
+ * There is no shadow copy to read-modify-write, the value is built from the flags instead. The interrupt handler
+ * masks the receive interrupt when the ring is full (fRxIrqThrottled set) and disables the transmit interrupt once
+ * the transmit ring drained (fTxIrq cleared), only the main context undoes either. A write from the main context
+ * racing with the handler can only re-enable an interrupt the handler just turned off, the condition is still
+ * present in the UART then so the interrupt fires again right away and the handler turns it off again.
+ *
+ * @returns Status code.
+ * @param   pUart                   The UART driver instance.
+ */
+static int pspUartIerUpdate(PPSPUART pUart)
+{
+    uint8_t uIer = 0;
+
+    if (pUart->fRxIrq)
+    {
+        uIer = PSP_UART_IER_RX_IRQ;
+        if (pUart->fRxIrqThrottled)
+            uIer &= ~PSP_UART_IER_ERBFI;
+        if (pUart->fTxIrq)
+            uIer |= PSP_UART_IER_ETBEI;
+    }
+
+    return PSPIoDevRegWrite(pUart->pIfDevIo, X86_UART_REG_IER_OFF, &uIer, sizeof(uIer));
+}
+
+
+/**
+ * Moves data from the software transmit ring into the transmit FIFO if it is empty.
+ *
+ * @returns Status code.
+ * @param   pUart                   The UART driver instance.
+ */
+static int pspUartTxFifoFill(PPSPUART pUart)
+{
+    uint32_t cbUsed = pUart->offTxRingWrite - pUart->offTxRingRead;
+    if (!cbUsed)
+        return INF_SUCCESS;
+
+    uint8_t uLsr = 0;
+    int rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_LSR_OFF, &uLsr, sizeof(uLsr));
+    if (   rc == INF_SUCCESS
+        && (uLsr & X86_UART_REG_LSR_THRE))
+    {
+        /* An empty transmitter can take a whole FIFO worth of data without checking again. */
+        uint32_t cbBurst = cbUsed < pUart->cbTxBurst ? cbUsed : pUart->cbTxBurst;
+        while (cbBurst--)
+        {
+            rc = PSPIoDevRegWrite(pUart->pIfDevIo, X86_UART_REG_THR_OFF,
+                                  &pUart->abTxRing[pUart->offTxRingRead & (sizeof(pUart->abTxRing) - 1)], 1);
+            if (rc != INF_SUCCESS)
+                break;
+
+            pUart->offTxRingRead++;
+        }
+    }
+
+    return rc;
+}
+
+
+/**
+ * Keeps the transmitter going from the main context.
+ *
+ * @returns Status code.
+ * @param   pUart                   The UART driver instance.
+ */
+static int pspUartTxRingPump(PPSPUART pUart)
+{
+    if (!pUart->fRxIrq)
+        return pspUartTxFifoFill(pUart);
+
+    /* The interrupt handler owns the transmitter in interrupt mode, only make sure it gets called while data is queued. */
+    if (   pUart->offTxRingWrite != pUart->offTxRingRead
+        && !pUart->fTxIrq)
+    {
+        pUart->fTxIrq = true;
+        PSP_UART_COMPILER_BARRIER();
+        return pspUartIerUpdate(pUart);
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Moves queued data to the transmitter and checks whether everything was transmitted completely.
+ *
+ * @returns Status code.
+ * @param   pUart                   The UART driver instance.
+ * @param   pfDone                  Where to store whether the transmit queue and the transmitter are empty.
+ */
+static int pspUartTxDoneQuery(PPSPUART pUart, bool *pfDone)
+{
+    *pfDone = false;
+
+    int rc = pspUartTxRingPump(pUart);
+    if (   rc != INF_SUCCESS
+        || pUart->offTxRingWrite != pUart->offTxRingRead)
+        return rc;
+
+    uint8_t uLsr = 0;
+    rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_LSR_OFF, &uLsr, sizeof(uLsr));
+    if (rc == INF_SUCCESS)
+        *pfDone = (uLsr & PSP_UART_LSR_TEMT) != 0;
+
+    return rc;
+}
+
+
 int PSPUartCreate(PPSPUART pUart, PCPSPIODEVIF pIfDevIo)
 {
-    pUart->pIfDevIo = pIfDevIo;
+    pUart->pIfDevIo        = pIfDevIo;
+    pUart->uClkHz          = PSP_UART_CLOCK_HZ_DEFAULT;
+    pUart->cbTxBurst       = 1;
+    pUart->offRxRingRead   = 0;
+    pUart->offRxRingWrite  = 0;
+    pUart->offTxRingRead   = 0;
+    pUart->offTxRingWrite  = 0;
+    pUart->fRxIrq          = false;
+    pUart->fRxIrqThrottled = false;
+    pUart->fTxIrq          = false;
+    pUart->bPad0           = 0;
+    pUart->cIrqs           = 0;
+    pUart->cRxOverruns     = 0;
 
     /* Bring the device into a known state. */
 
     /* Disable all interrupts. */
-    uint8_t uTmp = 0;
-    int rc = PSPIoDevRegWrite(pIfDevIo, X86_UART_REG_IER_OFF, &uTmp, sizeof(uTmp));
+    int rc = pspUartIerUpdate(pUart);
     if (rc == INF_SUCCESS)
     {
-        /* Disable FIFO. */
-        rc = PSPIoDevRegWrite(pIfDevIo, X86_UART_REG_FCR_OFF, &uTmp, sizeof(uTmp));
+        /* Enable and reset the FIFOs. */
+        rc = PSPUartFifoSet(pUart, true /*fEnable*/, PSPUARTRXTRIGLVL_8BYTES);
         if (rc == INF_SUCCESS)
         {
             /* Set known line parameters. */
@@ -97,7 +304,22 @@ void PSPUartDestroy(PPSPUART pUart)
 int PSPUartParamsSet(PPSPUART pUart, uint32_t uBps, PSPUARTDATABITS enmDataBits,
                      PSPUARTPARITY enmParity, PSPUARTSTOPBITS enmStopBits)
 {
-    uint32_t uDivisor = 115200 / uBps; /* For PC compatible UARTs using a 1.8432 MHz crystal. */
+    /* Anything above an eighth of the clock rounds to a divisor of 0, rejecting it early keeps the math below from overflowing. */
+    if (   !uBps
+        || uBps > pUart->uClkHz / 8)
+        return ERR_INVALID_PARAMETER;
+
+    /* The UART samples with 16 times the baud rate, round to the nearest divisor and reject rates too far off. */
+    uint32_t uDivisor = (pUart->uClkHz + 8 * uBps) / (16 * uBps);
+    if (   !uDivisor
+        || uDivisor > 0xffff)
+        return ERR_INVALID_PARAMETER;
+
+    uint32_t uBpsActual = pUart->uClkHz / (16 * uDivisor);
+    uint32_t uBpsDiff = uBpsActual > uBps ? uBpsActual - uBps : uBps - uBpsActual;
+    if (uBpsDiff * 100 > uBps * PSP_UART_BAUD_ERR_PCT_MAX)
+        return ERR_INVALID_PARAMETER;
+
     uint8_t uLcr = 0;
 
     switch (enmDataBits)
@@ -127,7 +349,10 @@ int PSPUartParamsSet(PPSPUART pUart, uint32_t uBps, PSPUARTDATABITS enmDataBits,
             return ERR_INVALID_PARAMETER;
     }
 
-    int rc = PSPIoDevRegWrite(pUart->pIfDevIo, X86_UART_REG_LCR_OFF, &uLcr, sizeof(uLcr));
+    /* Let everything written so far leave at the old rate. */
+    int rc = PSPUartTxFlush(pUart);
+    if (!rc)
+        rc = PSPIoDevRegWrite(pUart->pIfDevIo, X86_UART_REG_LCR_OFF, &uLcr, sizeof(uLcr));
     if (!rc)
         rc = pspUartDivisorSet(pUart, uDivisor);
 
@@ -135,29 +360,219 @@ int PSPUartParamsSet(PPSPUART pUart, uint32_t uBps, PSPUARTDATABITS enmDataBits,
 }
 
 
-size_t PSPUartGetDataAvail(PPSPUART pUart)
+void PSPUartClockSet(PPSPUART pUart, uint32_t uClkHz)
 {
-    size_t cbAvail = 0;
-    uint8_t uLsr = 0;
-    int rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_LSR_OFF, &uLsr, sizeof(uLsr));
+    pUart->uClkHz = uClkHz;
+}
+
+
+int PSPUartFifoSet(PPSPUART pUart, bool fEnable, PSPUARTRXTRIGLVL enmRxTrigLvl)
+{
+    uint8_t uFcr = 0;
+
+    pUart->cbTxBurst = 1;
+
+    if (fEnable)
+    {
+        uint8_t uTrig = 0;
+        switch (enmRxTrigLvl)
+        {
+            case PSPUARTRXTRIGLVL_1BYTE:
+                uTrig = 0;
+                break;
+            case PSPUARTRXTRIGLVL_4BYTES:
+                uTrig = 1;
+                break;
+            case PSPUARTRXTRIGLVL_8BYTES:
+                uTrig = 2;
+                break;
+            case PSPUARTRXTRIGLVL_14BYTES:
+                uTrig = 3;
+                break;
+            default:
+                return ERR_INVALID_PARAMETER;
+        }
+
+        uFcr =   PSP_UART_FCR_FIFO_EN | PSP_UART_FCR_RX_FIFO_RST | PSP_UART_FCR_TX_FIFO_RST
+               | (uTrig << PSP_UART_FCR_RX_TRIG_SHIFT);
+    }
+
+    int rc = PSPIoDevRegWrite(pUart->pIfDevIo, X86_UART_REG_FCR_OFF, &uFcr, sizeof(uFcr));
     if (   rc == INF_SUCCESS
-        && uLsr & X86_UART_REG_LSR_DR)
-        cbAvail++;
+        && fEnable)
+    {
+        /* Only burst if the FIFO is really there (16450 and broken 16550 report otherwise). */
+        uint8_t uIir = 0;
+        rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_IIR_OFF, &uIir, sizeof(uIir));
+        if (   rc == INF_SUCCESS
+            && (uIir & PSP_UART_IIR_FIFO_EN_MASK) == PSP_UART_IIR_FIFO_EN_MASK)
+            pUart->cbTxBurst = PSP_UART_FIFO_SZ;
+    }
+
+    return rc;
+}
+
+
+int PSPUartRxIrqSet(PPSPUART pUart, bool fEnable)
+{
+    uint8_t uMcr = 0;
+    int rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_MCR_OFF, &uMcr, sizeof(uMcr));
+    if (rc != INF_SUCCESS)
+        return rc;
+
+    if (fEnable)
+    {
+        /* Move whatever arrived so far into the ring before handing the receive FIFO over to the interrupt handler. */
+        rc = pspUartRxRingFill(pUart);
+        if (rc == INF_SUCCESS)
+        {
+            /* The transmit interrupt is armed once to let the caller see an interrupt, the handler disarms it when idle. */
+            pUart->fRxIrqThrottled = false;
+            pUart->fTxIrq          = true;
+            pUart->fRxIrq          = true;
+            uMcr |= PSP_UART_MCR_OUT2;
+            rc = PSPIoDevRegWrite(pUart->pIfDevIo, X86_UART_REG_MCR_OFF, &uMcr, sizeof(uMcr));
+            if (rc == INF_SUCCESS)
+                rc = pspUartIerUpdate(pUart);
+        }
+    }
+    else
+    {
+        /* Anything still queued is pumped from the main context again afterwards. */
+        pUart->fRxIrq          = false;
+        pUart->fRxIrqThrottled = false;
+        pUart->fTxIrq          = false;
+        rc = pspUartIerUpdate(pUart);
+        if (rc == INF_SUCCESS)
+        {
+            uMcr &= ~PSP_UART_MCR_OUT2;
+            rc = PSPIoDevRegWrite(pUart->pIfDevIo, X86_UART_REG_MCR_OFF, &uMcr, sizeof(uMcr));
+        }
+    }
 
-    return cbAvail;
+    return rc;
+}
+
+
+bool PSPUartIrqHandler(PPSPUART pUart)
+{
+    bool fServiced = false;
+
+    for (;;)
+    {
+        uint8_t uIir = 0;
+        int rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_IIR_OFF, &uIir, sizeof(uIir));
+        if (   rc != INF_SUCCESS
+            || (uIir & PSP_UART_IIR_NO_INT))
+            break;
+
+        fServiced = true;
+
+        uint8_t uTmp = 0;
+        switch (uIir & PSP_UART_IIR_ID_MASK)
+        {
+            case PSP_UART_IIR_ID_RLS:
+            {
+                /* Reading the line status register acknowledges the interrupt. */
+                rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_LSR_OFF, &uTmp, sizeof(uTmp));
+                if (   rc == INF_SUCCESS
+                    && (uTmp & PSP_UART_LSR_OE))
+                    pUart->cRxOverruns++;
+                break;
+            }
+            case PSP_UART_IIR_ID_RDA:
+            case PSP_UART_IIR_ID_CTI:
+            {
+                rc = pspUartRxRingFill(pUart);
+                if (pUart->offRxRingWrite - pUart->offRxRingRead == sizeof(pUart->abRxRing))
+                {
+                    /* Ring is full, leave the rest in the FIFO and mask the interrupt until the reader catches up. */
+                    pUart->fRxIrqThrottled = true;
+                    rc = pspUartIerUpdate(pUart);
+                }
+                break;
+            }
+            case PSP_UART_IIR_ID_THRE:
+            {
+                /* Refill the transmitter and turn the interrupt off once everything queued was handed over. */
+                rc = pspUartTxFifoFill(pUart);
+                if (   rc == INF_SUCCESS
+                    && pUart->offTxRingWrite == pUart->offTxRingRead)
+                {
+                    pUart->fTxIrq = false;
+                    rc = pspUartIerUpdate(pUart);
+                }
+                break;
+            }
+            case PSP_UART_IIR_ID_MSR:
+            default:
+                rc = PSPIoDevRegRead(pUart->pIfDevIo, PSP_UART_REG_MSR_OFF, &uTmp, sizeof(uTmp));
+                break;
+        }
+
+        if (rc != INF_SUCCESS)
+            break;
+    }
+
+    if (fServiced)
+        pUart->cIrqs++;
+
+    return fServiced;
+}
+
+
+size_t PSPUartGetDataAvail(PPSPUART pUart)
+{
+    if (!pUart->fRxIrq)
+        pspUartRxRingFill(pUart);
+    else if (   pUart->fRxIrqThrottled
+             && pUart->offRxRingWrite - pUart->offRxRingRead < sizeof(pUart->abRxRing))
+    {
+        /*
+         * The reader made room, let the interrupt handler continue. The flag is cleared first, the handler
+         * can't mask the receive interrupt again before it gets unmasked below.
+         */
+        pUart->fRxIrqThrottled = false;
+        PSP_UART_COMPILER_BARRIER();
+        pspUartIerUpdate(pUart);
+    }
+
+    return pUart->offRxRingWrite - pUart->offRxRingRead;
 }
 
 
 size_t PSPUartGetTxSpaceAvail(PPSPUART pUart)
 {
-    size_t cbAvail = 0;
-    uint8_t uLsr = 0;
-    int rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_LSR_OFF, &uLsr, sizeof(uLsr));
-    if (   rc == INF_SUCCESS
-        && uLsr & X86_UART_REG_LSR_THRE)
-        cbAvail++;
+    pspUartTxRingPump(pUart);
+    return sizeof(pUart->abTxRing) - (pUart->offTxRingWrite - pUart->offTxRingRead);
+}
 
-    return cbAvail;
+
+int PSPUartTxPump(PPSPUART pUart)
+{
+    return pspUartTxRingPump(pUart);
+}
+
+
+bool PSPUartTxIsDone(PPSPUART pUart)
+{
+    bool fDone = false;
+    int rc = pspUartTxDoneQuery(pUart, &fDone);
+    return    rc == INF_SUCCESS
+           && fDone;
+}
+
+
+int PSPUartTxFlush(PPSPUART pUart)
+{
+    /* Wait until the last bit left the shift register, bailing out if the UART can't be accessed. */
+    bool fDone = false;
+    int rc = INF_SUCCESS;
+    while (   rc == INF_SUCCESS
+           && !fDone)
+        rc = pspUartTxDoneQuery(pUart, &fDone);
+
+    return rc;
 }
 
 
@@ -194,14 +609,30 @@ int PSPUartReadNB(PPSPUART pUart, void *pvBuf, size_t cbRead, size_t *pcbRead)
 {
     int rc = INF_SUCCESS;
 
-    *pcbRead = 0;
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    size_t cbAvail = PSPUartGetDataAvail(pUart);
+    size_t cbActuallyRead = cbAvail < cbRead ? cbAvail : cbRead;
 
-    if (PSPUartGetDataAvail(pUart) > 0)
+    /* Serve the read from the ring, at most in two pieces when wrapping around. */
+    for (size_t cbLeft = cbActuallyRead; cbLeft; )
     {
-        rc = PSPIoDevRegRead(pUart->pIfDevIo, X86_UART_REG_RBR_OFF, pvBuf, 1);
-        *pcbRead = 1;
+        uint32_t offRing = pUart->offRxRingRead & (sizeof(pUart->abRxRing) - 1);
+        size_t cbThisRead = sizeof(pUart->abRxRing) - offRing;
+        if (cbThisRead > cbLeft)
+            cbThisRead = cbLeft;
+
+        PSP_UART_COMPILER_BARRIER();
+        memcpy(pbBuf, &pUart->abRxRing[offRing], cbThisRead);
+        PSP_UART_COMPILER_BARRIER();
+
+        pbBuf                += cbThisRead;
+        cbLeft               -= cbThisRead;
+        pUart->offRxRingRead += cbThisRead;
     }
-    else
+
+    *pcbRead = cbActuallyRead;
+    if (   rc == INF_SUCCESS
+        && !cbActuallyRead)
         rc = INF_TRY_AGAIN;
 
     return rc;
@@ -216,7 +647,12 @@ int PSPUartWrite(PPSPUART pUart, const void *pvBuf, size_t cbWrite, size_t *pcbW
 
     do
     {
-        while (PSPUartGetTxSpaceAvail(pUart) == 0); /* Wait until there is room to write. */
+        /* Wait until there is room to write. */
+        while (   rc == INF_SUCCESS
+               && pUart->offTxRingWrite - pUart->offTxRingRead == sizeof(pUart->abTxRing))
+            rc = pspUartTxRingPump(pUart);
+        if (rc != INF_SUCCESS)
+            break;
 
         size_t cbThisWritten = 0;
         rc = PSPUartWriteNB(pUart, pbBuf, cbWrite, &cbThisWritten);
@@ -239,18 +675,31 @@ int PSPUartWrite(PPSPUART pUart, const void *pvBuf, size_t cbWrite, size_t *pcbW
 
 int PSPUartWriteNB(PPSPUART pUart, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
 {
-    int rc = INF_SUCCESS;
-
-    *pcbWritten = 0;
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    size_t cbFree = PSPUartGetTxSpaceAvail(pUart);
+    size_t cbActuallyWritten = cbFree < cbWrite ? cbFree : cbWrite;
 
-    if (PSPUartGetTxSpaceAvail(pUart) > 0)
+    /* Queue as much as fits into the ring, at most in two pieces when wrapping around. */
+    for (size_t cbLeft = cbActuallyWritten; cbLeft; )
     {
-        rc = PSPIoDevRegWrite(pUart->pIfDevIo, X86_UART_REG_THR_OFF, pvBuf, 1);
-        *pcbWritten = 1;
+        uint32_t offRing = pUart->offTxRingWrite & (sizeof(pUart->abTxRing) - 1);
+        size_t cbThisWrite = sizeof(pUart->abTxRing) - offRing;
+        if (cbThisWrite > cbLeft)
+            cbThisWrite = cbLeft;
+
+        PSP_UART_COMPILER_BARRIER();
+        memcpy(&pUart->abTxRing[offRing], pbBuf, cbThisWrite);
+        PSP_UART_COMPILER_BARRIER();
+
+        pbBuf                 += cbThisWrite;
+        cbLeft                -= cbThisWrite;
+        pUart->offTxRingWrite += cbThisWrite;
     }
-    else
-        rc = INF_TRY_AGAIN;
 
-    return rc;
-}
+    *pcbWritten = cbActuallyWritten;
+    if (!cbActuallyWritten)
+        return INF_TRY_AGAIN;
 
+    /* Get the transmitter going right away. */
+    return pspUartTxRingPump(pUart);
+}
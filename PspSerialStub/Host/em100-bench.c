@@ -0,0 +1,363 @@
+/** @file
+ * PSP serial stub host build - Benchmark of the EM100 transport against the SPI master and EM100 model.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <types.h>
+#include <cdefs.h>
+#include <err.h>
+#include <string.h>
+
+#include "pdu-transp.h"
+#include "psp-serial-stub-internal.h"
+#include "spi-em100.h"
+
+/*
+ * Runs the EM100 transport unmodified against the SPI master and EM100 model, including the clock
+ * calibration during initialization, and reports what a transfer costs in simulated time, SPI
+ * transactions and register accesses. The host side polls the EM100 at a fixed interval like the
+ * EM100 software does, so the results show how much of the link the flow control leaves unused.
+ */
+
+/** Default number of bytes transferred in each direction. */
+#define EM100_BENCH_XFER_DEFAULT        (16 * _1K)
+/** Largest transfer possible, limited by the line buffers of the model. */
+#define EM100_BENCH_XFER_MAX            PSP_HOST_EM100_LINE_SZ
+/** Size of the writes issued to the transport, about what a PDU is. */
+#define EM100_BENCH_WRITE_CHUNK         256
+/** Chunk size the host writes to the dFIFO, what the transport expects. */
+#define EM100_BENCH_DFIFO_CHUNK         64
+
+
+/**
+ * A benchmarked configuration.
+ */
+typedef struct EM100BENCHCFG
+{
+    /** Description. */
+    const char                  *pszDesc;
+    /** The model configuration. */
+    PSPHOSTEM100CFG             Cfg;
+} EM100BENCHCFG;
+/** Pointer to a const benchmarked configuration. */
+typedef const EM100BENCHCFG *PCEM100BENCHCFG;
+
+
+/**
+ * The configurations benchmarked.
+ */
+static const EM100BENCHCFG g_aCfgs[] =
+{
+    /* pszDesc                          cbUFifo cbDFifoChunk             cNsRegAccess cNsXactOverhead cNsHostPoll cNsDFifoByte uSpiHzMax  uSpiHzMaxToggle fEcho */
+    { "poll 125us 33M max 1us/reg",   { 512,    EM100_BENCH_DFIFO_CHUNK, 1000,        500,            125000,     100,         33333333,  0,               true  } },
+    { "poll 1ms   33M max 1us/reg",   { 512,    EM100_BENCH_DFIFO_CHUNK, 1000,        500,            1000000,    100,         33333333,  0,               true  } },
+    { "poll 125us 100M max 1us/reg",  { 512,    EM100_BENCH_DFIFO_CHUNK, 1000,        500,            125000,     100,         100000000, 0,               true  } },
+    { "poll 125us 33M max 250ns/reg", { 512,    EM100_BENCH_DFIFO_CHUNK, 250,         500,            125000,     100,         33333333,  0,               true  } },
+    { "poll 125us slow dFIFO 2us/b",  { 512,    EM100_BENCH_DFIFO_CHUNK, 1000,        500,            125000,     2000,        33333333,  0,               true  } },
+    { "poll 125us no echo 33M max",   { 512,    EM100_BENCH_DFIFO_CHUNK, 1000,        500,            125000,     100,         33333333,  0,               false } },
+    { "poll 125us 22M toggle 33M max", { 512,    EM100_BENCH_DFIFO_CHUNK, 1000,        500,            125000,     100,         33333333,  22222222,       true  } },
+};
+
+
+/** The model the transport talks to. */
+static PSPHOSTEM100 g_Em100;
+/** Stands in for the SMN mapping of the SPI master, never accessed. */
+static uint8_t g_abSmnDummy[PSP_HOST_SPI_MASTER_REGS_SZ];
+/** The EM100 transport. */
+extern const PSPPDUTRANSPIF g_SpiFlashTranspEm100;
+
+
+PCPSPIODEVIF pspStubHostSpiMasterIoDevGet(void)
+{
+    return &g_Em100.IfIoDev;
+}
+
+
+uint32_t pspSerialStubTicksGet(void)
+{
+    /* Stall times are accounted in simulated time as well. */
+    return (uint32_t)(g_Em100.nsNow / 10);
+}
+
+
+void pspSerialStubDelayUs(uint64_t cMicros)
+{
+    pspHostEm100TimeAdvance(&g_Em100, cMicros * 1000);
+}
+
+
+int pspSerialStubSmnMap(SMNADDR SmnAddr, void **ppv)
+{
+    *ppv = &g_abSmnDummy[0];
+    return INF_SUCCESS;
+}
+
+
+int pspSerialStubSmnUnmapByPtr(void *pv)
+{
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Prints the results of a single direction.
+ *
+ * @returns nothing.
+ * @param   pszDir                  The direction.
+ * @param   cbXfer                  Number of bytes transferred.
+ * @param   nsXfer                  Simulated time the transfer took.
+ * @param   cXacts                  Number of SPI transactions during the transfer.
+ * @param   cRegAccesses            Number of register accesses during the transfer.
+ * @param   cTicksStall             Stall time reported by the transport.
+ * @param   cbLost                  Number of bytes lost.
+ */
+static void em100BenchReport(const char *pszDir, size_t cbXfer, uint64_t nsXfer, uint64_t cXacts,
+                             uint64_t cRegAccesses, uint64_t cTicksStall, uint64_t cbLost)
+{
+    printf("    %-5s %8.2f KB/s %6.3f xacts/byte %6.2f regs/byte %6.1f%% stalled %8llu lost\n",
+           pszDir, nsXfer ? (cbXfer * 1000000000.0 / nsXfer) / 1024.0 : 0.0,
+           cbXfer ? (double)cXacts / cbXfer : 0.0,
+           cbXfer ? (double)cRegAccesses / cbXfer : 0.0,
+           nsXfer ? (cTicksStall * 10 * 100.0) / nsXfer : 0.0,
+           (unsigned long long)cbLost);
+}
+
+
+/**
+ * Transmits the given data through the transport and checks what arrived at the host.
+ *
+ * @returns Status code.
+ * @param   hPduTransp              The transport instance.
+ * @param   pbData                  The data to transmit.
+ * @param   cbXfer                  Number of bytes to transmit.
+ * @param   pbCheck                 Scratch buffer of cbXfer bytes for checking.
+ */
+static int em100BenchTx(PSPPDUTRANSP hPduTransp, const uint8_t *pbData, size_t cbXfer, uint8_t *pbCheck)
+{
+    PSPPDUTRANSPSTATS Stats;
+    uint64_t nsStart = g_Em100.nsNow;
+    uint64_t cXactsStart = g_Em100.cXacts;
+    uint64_t cRegsStart = g_Em100.cRegAccesses;
+    uint64_t cbLostStart = g_Em100.cbUFifoLost;
+    int rc = INF_SUCCESS;
+
+    g_SpiFlashTranspEm100.pfnStatsQuery(hPduTransp, &Stats, true /*fReset*/);
+    for (size_t off = 0; off < cbXfer && !rc; off += EM100_BENCH_WRITE_CHUNK)
+        rc = g_SpiFlashTranspEm100.pfnWrite(hPduTransp, pbData + off, MIN(cbXfer - off, EM100_BENCH_WRITE_CHUNK), NULL /*pcbWritten*/);
+    if (rc)
+        return rc;
+
+    /* The transfer is done once the host drained the uFIFO, give it a few polls. */
+    size_t cbHost = 0;
+    for (uint32_t i = 0; i < 4 && cbHost < cbXfer; i++)
+    {
+        cbHost += pspHostEm100PeerRead(&g_Em100, pbCheck + cbHost, cbXfer - cbHost);
+        if (cbHost < cbXfer)
+            pspHostEm100TimeAdvance(&g_Em100, g_Em100.Cfg.cNsHostPoll);
+    }
+
+    uint64_t nsXfer = g_Em100.nsNow - nsStart;
+    g_SpiFlashTranspEm100.pfnStatsQuery(hPduTransp, &Stats, true /*fReset*/);
+
+    uint64_t cbLost = g_Em100.cbUFifoLost - cbLostStart;
+    em100BenchReport("tx", cbXfer, nsXfer, g_Em100.cXacts - cXactsStart, g_Em100.cRegAccesses - cRegsStart,
+                     Stats.cTicksStallWrite, cbLost);
+    if (cbLost)
+    {
+        printf("    tx    uFIFO overflows, the credit estimate is off\n");
+        return ERR_BUFFER_OVERFLOW;
+    }
+    if (   cbHost != cbXfer
+        || memcmp(pbCheck, pbData, cbXfer))
+    {
+        printf("    tx    data mismatch, %zu of %zu bytes arrived\n", cbHost, cbXfer);
+        return ERR_INVALID_STATE;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Receives the given data sent by the host through the transport.
+ *
+ * @returns Status code.
+ * @param   hPduTransp              The transport instance.
+ * @param   pbData                  The data the host sends.
+ * @param   cbXfer                  Number of bytes to receive.
+ * @param   pbCheck                 Buffer of cbXfer bytes to receive into.
+ */
+static int em100BenchRx(PSPPDUTRANSP hPduTransp, const uint8_t *pbData, size_t cbXfer, uint8_t *pbCheck)
+{
+    PSPPDUTRANSPSTATS Stats;
+    uint64_t nsStart = g_Em100.nsNow;
+    uint64_t cXactsStart = g_Em100.cXacts;
+    uint64_t cRegsStart = g_Em100.cRegAccesses;
+    uint64_t cbLostStart = g_Em100.cbDFifoLost;
+    /* Every chunk needs at most two host polls (chunk and acknowledge), anything beyond means data got lost. */
+    uint64_t nsDeadline = nsStart + 4 * (cbXfer / EM100_BENCH_DFIFO_CHUNK + 1) * g_Em100.Cfg.cNsHostPoll + 10000000;
+    size_t cbRecv = 0;
+    int rc = INF_SUCCESS;
+
+    g_SpiFlashTranspEm100.pfnStatsQuery(hPduTransp, &Stats, true /*fReset*/);
+    pspHostEm100PeerWrite(&g_Em100, pbData, cbXfer);
+    while (   cbRecv < cbXfer
+           && g_Em100.nsNow < nsDeadline
+           && !rc)
+    {
+        /* Only read what is there, a blocking read never returns if something was lost. */
+        size_t cbAvail = g_SpiFlashTranspEm100.pfnPeek(hPduTransp);
+        if (cbAvail)
+        {
+            size_t cbThisRead = MIN(cbAvail, cbXfer - cbRecv);
+            rc = g_SpiFlashTranspEm100.pfnRead(hPduTransp, pbCheck + cbRecv, cbThisRead, NULL /*pcbRead*/);
+            if (!rc)
+                cbRecv += cbThisRead;
+        }
+    }
+    if (rc)
+        return rc;
+
+    uint64_t nsXfer = g_Em100.nsNow - nsStart;
+    g_SpiFlashTranspEm100.pfnStatsQuery(hPduTransp, &Stats, true /*fReset*/);
+
+    uint64_t cbLost = g_Em100.cbDFifoLost - cbLostStart;
+    em100BenchReport("rx", cbRecv, nsXfer, g_Em100.cXacts - cXactsStart, g_Em100.cRegAccesses - cRegsStart,
+                     Stats.cTicksStallRead, cbLost);
+    if (cbLost)
+    {
+        printf("    rx    dFIFO read early, the chunk size sampling is too eager for the link\n");
+        return ERR_BUFFER_OVERFLOW;
+    }
+    if (   cbRecv != cbXfer
+        || memcmp(pbCheck, pbData, cbXfer))
+    {
+        printf("    rx    data mismatch, %zu of %zu bytes arrived\n", cbRecv, cbXfer);
+        return ERR_INVALID_STATE;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Runs the benchmark for a single configuration.
+ *
+ * @returns Status code.
+ * @param   pCfg                    The configuration.
+ * @param   pbData                  The data to transfer.
+ * @param   cbXfer                  Number of bytes to transfer in each direction.
+ * @param   pbCheck                 Scratch buffer of cbXfer bytes.
+ */
+static int em100BenchRun(PCEM100BENCHCFG pCfg, const uint8_t *pbData, size_t cbXfer, uint8_t *pbCheck)
+{
+    int rc = pspHostEm100Init(&g_Em100, &pCfg->Cfg);
+    if (rc)
+        return rc;
+
+    void *pvTransp = calloc(1, g_SpiFlashTranspEm100.cbState);
+    if (!pvTransp)
+        return ERR_BUFFER_OVERFLOW;
+
+    PSPPDUTRANSP hPduTransp = NULL;
+    rc = g_SpiFlashTranspEm100.pfnInit(pvTransp, g_SpiFlashTranspEm100.cbState, &hPduTransp);
+    if (!rc)
+    {
+        uint32_t uBps = 0;
+        uint32_t cbPerSec = 0;
+        bool fCalibrated = false;
+        g_SpiFlashTranspEm100.pfnLinkSpeedGet(hPduTransp, &uBps, &cbPerSec, &fCalibrated);
+        printf("%s (SPI clock %u Hz%s, %llu corrupted transactions and %llu echoed patterns during calibration)\n",
+               pCfg->pszDesc, uBps, fCalibrated ? "" : " uncalibrated", (unsigned long long)g_Em100.cXactsCorrupted,
+               (unsigned long long)g_Em100.cEchoFrames);
+
+        /* The host has to see the test patterns if it echoes them and the calibration must not leave anything behind. */
+        uint32_t uHzMax = pCfg->Cfg.uSpiHzMax;
+        if (   pCfg->Cfg.fEcho
+            && pCfg->Cfg.uSpiHzMaxToggle)
+            uHzMax = MIN(uHzMax, pCfg->Cfg.uSpiHzMaxToggle);
+        if (   !fCalibrated
+            || uBps > uHzMax
+            || (pCfg->Cfg.fEcho && !g_Em100.cEchoFrames)
+            || g_Em100.cbHostGarbage)
+        {
+            printf("    calibration failed\n");
+            rc = ERR_INVALID_STATE;
+        }
+
+        /* After a uFIFO overflow the host lost track of the framing, the dFIFO acknowledges would go unnoticed. */
+        if (!rc)
+            rc = em100BenchTx(hPduTransp, pbData, cbXfer, pbCheck);
+        if (!rc)
+            rc = em100BenchRx(hPduTransp, pbData, cbXfer, pbCheck);
+
+        if (   !rc
+            && g_Em100.cXactsInvalid)
+        {
+            printf("    %llu transactions exceeded the SPI master FIFO\n", (unsigned long long)g_Em100.cXactsInvalid);
+            rc = ERR_INVALID_STATE;
+        }
+
+        g_SpiFlashTranspEm100.pfnTerm(hPduTransp);
+    }
+
+    free(pvTransp);
+    return rc;
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t cbXfer = EM100_BENCH_XFER_DEFAULT;
+
+    if (argc > 1)
+        cbXfer = strtoul(argv[1], NULL, 0);
+    if (   !cbXfer
+        || cbXfer > EM100_BENCH_XFER_MAX)
+    {
+        fprintf(stderr, "Usage: %s [bytes (up to %u)]\n", argv[0], EM100_BENCH_XFER_MAX);
+        return 1;
+    }
+
+    uint8_t *pbData = (uint8_t *)malloc(cbXfer);
+    uint8_t *pbCheck = (uint8_t *)malloc(cbXfer);
+    if (!pbData || !pbCheck)
+        return 1;
+
+    for (size_t i = 0; i < cbXfer; i++)
+        pbData[i] = (uint8_t)(i * 7 + (i >> 8));
+
+    int rcExit = 0;
+    for (uint32_t i = 0; i < ELEMENTS(g_aCfgs); i++)
+    {
+        int rc = em100BenchRun(&g_aCfgs[i], pbData, cbXfer, pbCheck);
+        if (rc)
+        {
+            printf("    failed with %d\n", rc);
+            rcExit = 1;
+        }
+    }
+
+    free(pbCheck);
+    free(pbData);
+    return rcExit;
+}
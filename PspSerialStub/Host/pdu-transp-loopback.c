@@ -0,0 +1,301 @@
+/** @file
+ * PSP serial stub host build - In process loopback PDU transport channel.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <sched.h>
+
+#include <types.h>
+#include <cdefs.h>
+#include <err.h>
+#include <string.h>
+
+#include "pdu-transp-loopback.h"
+
+
+/**
+ * Single producer/single consumer byte ring.
+ */
+typedef struct PSPSTUBLOOPBACKRING
+{
+    /** Free running write offset, only modified by the producer. */
+    volatile uint32_t           offWrite;
+    /** Free running read offset, only modified by the consumer. */
+    volatile uint32_t           offRead;
+    /** The ring buffer. */
+    uint8_t                     abRing[PSP_STUB_LOOPBACK_RING_SIZE];
+} PSPSTUBLOOPBACKRING;
+/** Pointer to a loopback ring. */
+typedef PSPSTUBLOOPBACKRING *PPSPSTUBLOOPBACKRING;
+
+
+/**
+ * Loopback PDU transport channel instance.
+ */
+typedef struct PSPPDUTRANSPINT
+{
+    /** Ring the stub reads from (written by the peer). */
+    PPSPSTUBLOOPBACKRING        pRingRx;
+    /** Ring the stub writes to (read by the peer). */
+    PPSPSTUBLOOPBACKRING        pRingTx;
+} PSPPDUTRANSPINT;
+/** Pointer to the loopback PDU transport channel instance. */
+typedef PSPPDUTRANSPINT *PPSPPDUTRANSPINT;
+
+
+/** Peer to stub direction. */
+static PSPSTUBLOOPBACKRING g_RingPeer2Stub;
+/** Stub to peer direction. */
+static PSPSTUBLOOPBACKRING g_RingStub2Peer;
+
+
+/**
+ * Returns the number of bytes available for reading from the given ring.
+ *
+ * @returns Number of bytes available.
+ * @param   pRing                   The ring to query.
+ */
+static size_t pspStubLoopbackRingUsed(PPSPSTUBLOOPBACKRING pRing)
+{
+    uint32_t offWrite = __atomic_load_n(&pRing->offWrite, __ATOMIC_ACQUIRE);
+    return offWrite - pRing->offRead;
+}
+
+
+/**
+ * Reads as much as possible from the given ring.
+ *
+ * @returns Number of bytes read.
+ * @param   pRing                   The ring to read from.
+ * @param   pvBuf                   Where to store the data.
+ * @param   cbRead                  Maximum number of bytes to read.
+ */
+static size_t pspStubLoopbackRingRead(PPSPSTUBLOOPBACKRING pRing, void *pvBuf, size_t cbRead)
+{
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    uint32_t offRead = pRing->offRead;
+    size_t cbUsed = pspStubLoopbackRingUsed(pRing);
+    size_t cbThis = MIN(cbRead, cbUsed);
+    size_t cbLeft = cbThis;
+
+    while (cbLeft)
+    {
+        uint32_t offRing = offRead % sizeof(pRing->abRing);
+        size_t cbChunk = MIN(cbLeft, sizeof(pRing->abRing) - offRing);
+
+        memcpy(pbBuf, &pRing->abRing[offRing], cbChunk);
+        pbBuf   += cbChunk;
+        offRead += cbChunk;
+        cbLeft  -= cbChunk;
+    }
+
+    __atomic_store_n(&pRing->offRead, offRead, __ATOMIC_RELEASE);
+    return cbThis;
+}
+
+
+/**
+ * Writes as much as possible to the given ring.
+ *
+ * @returns Number of bytes written.
+ * @param   pRing                   The ring to write to.
+ * @param   pvBuf                   The data to write.
+ * @param   cbWrite                 Maximum number of bytes to write.
+ */
+static size_t pspStubLoopbackRingWrite(PPSPSTUBLOOPBACKRING pRing, const void *pvBuf, size_t cbWrite)
+{
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    uint32_t offWrite = pRing->offWrite;
+    uint32_t offRead = __atomic_load_n(&pRing->offRead, __ATOMIC_ACQUIRE);
+    size_t cbThis = MIN(cbWrite, sizeof(pRing->abRing) - (offWrite - offRead));
+    size_t cbLeft = cbThis;
+
+    while (cbLeft)
+    {
+        uint32_t offRing = offWrite % sizeof(pRing->abRing);
+        size_t cbChunk = MIN(cbLeft, sizeof(pRing->abRing) - offRing);
+
+        memcpy(&pRing->abRing[offRing], pbBuf, cbChunk);
+        pbBuf    += cbChunk;
+        offWrite += cbChunk;
+        cbLeft   -= cbChunk;
+    }
+
+    __atomic_store_n(&pRing->offWrite, offWrite, __ATOMIC_RELEASE);
+    return cbThis;
+}
+
+
+size_t pspStubLoopbackPeerPeek(void)
+{
+    return pspStubLoopbackRingUsed(&g_RingStub2Peer);
+}
+
+
+int pspStubLoopbackPeerRead(void *pvBuf, size_t cbRead, size_t *pcbRead)
+{
+    *pcbRead = pspStubLoopbackRingRead(&g_RingStub2Peer, pvBuf, cbRead);
+    return *pcbRead ? INF_SUCCESS : INF_TRY_AGAIN;
+}
+
+
+int pspStubLoopbackPeerWrite(const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    *pcbWritten = pspStubLoopbackRingWrite(&g_RingPeer2Stub, pvBuf, cbWrite);
+    return *pcbWritten || !cbWrite ? INF_SUCCESS : INF_TRY_AGAIN;
+}
+
+
+static int pspStubLoopbackTranspWrite(PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    size_t cbLeft = cbWrite;
+
+    /* Blocks until the peer made room for everything. */
+    while (cbLeft)
+    {
+        size_t cbThis = pspStubLoopbackRingWrite(pThis->pRingTx, pbBuf, cbLeft);
+        if (!cbThis)
+            sched_yield();
+        pbBuf  += cbThis;
+        cbLeft -= cbThis;
+    }
+
+    if (pcbWritten)
+        *pcbWritten = cbWrite;
+    return INF_SUCCESS;
+}
+
+
+static int pspStubLoopbackTranspWriteNB(PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    *pcbWritten = pspStubLoopbackRingWrite(pThis->pRingTx, pvBuf, cbWrite);
+    return *pcbWritten || !cbWrite ? INF_SUCCESS : INF_TRY_AGAIN;
+}
+
+
+static int pspStubLoopbackTranspRead(PSPPDUTRANSP hPduTransp, void *pvBuf, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    size_t cbLeft = cbRead;
+
+    /* Blocks until everything arrived. */
+    while (cbLeft)
+    {
+        size_t cbThis = pspStubLoopbackRingRead(pThis->pRingRx, pbBuf, cbLeft);
+        if (!cbThis)
+            sched_yield();
+        pbBuf  += cbThis;
+        cbLeft -= cbThis;
+    }
+
+    if (pcbRead)
+        *pcbRead = cbRead;
+    return INF_SUCCESS;
+}
+
+
+static size_t pspStubLoopbackTranspPeek(PSPPDUTRANSP hPduTransp)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    /* The stub polls in a tight loop, let the peer run if it shares the CPU with us. */
+    size_t cbAvail = pspStubLoopbackRingUsed(pThis->pRingRx);
+    if (!cbAvail)
+        sched_yield();
+
+    return cbAvail;
+}
+
+
+static int pspStubLoopbackTranspEnd(PSPPDUTRANSP hPduTransp)
+{
+    /* Nothing to do. */
+    return INF_SUCCESS;
+}
+
+
+static int pspStubLoopbackTranspBegin(PSPPDUTRANSP hPduTransp)
+{
+    /* Nothing to do. */
+    return INF_SUCCESS;
+}
+
+
+static void pspStubLoopbackTranspTerm(PSPPDUTRANSP hPduTransp)
+{
+    /* Nothing to do. */
+}
+
+
+static int pspStubLoopbackTranspInit(void *pvMem, size_t cbMem, PPSPPDUTRANSP phPduTransp)
+{
+    if (cbMem < sizeof(PSPPDUTRANSPINT))
+        return ERR_INVALID_PARAMETER;
+
+    PPSPPDUTRANSPINT pThis = (PPSPPDUTRANSPINT)pvMem;
+
+    pThis->pRingRx = &g_RingPeer2Stub;
+    pThis->pRingTx = &g_RingStub2Peer;
+    *phPduTransp   = pThis;
+    return INF_SUCCESS;
+}
+
+
+const PSPPDUTRANSPIF g_LoopbackTransp =
+{
+    /** cbState */
+    sizeof(PSPPDUTRANSPINT),
+    /** pfnInit */
+    pspStubLoopbackTranspInit,
+    /** pfnTerm */
+    pspStubLoopbackTranspTerm,
+    /** pfnBegin */
+    pspStubLoopbackTranspBegin,
+    /** pfnEnd */
+    pspStubLoopbackTranspEnd,
+    /** pfnPeek */
+    pspStubLoopbackTranspPeek,
+    /** pfnRead */
+    pspStubLoopbackTranspRead,
+    /** pfnWrite */
+    pspStubLoopbackTranspWrite,
+    /** pfnLinkSpeedSet */
+    NULL,
+    /** pfnWriteNB */
+    pspStubLoopbackTranspWriteNB,
+    /** pfnPoll */
+    NULL,
+    /** pfnFlush */
+    NULL,
+    /** pfnIrqSet */
+    NULL,
+    /** pfnIrq */
+    NULL,
+    /** pfnLinkSpeedGet */
+    NULL,
+    /** pfnLinkCalibrate */
+    NULL,
+    /** pfnStatsQuery */
+    NULL
+};
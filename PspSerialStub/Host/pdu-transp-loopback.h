@@ -0,0 +1,75 @@
+/** @file
+ * PSP serial stub host build - In process loopback PDU transport channel.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __include_pdu_transp_loopback_h
+#define __include_pdu_transp_loopback_h
+
+#if defined(IN_PSP)
+# include <common/types.h>
+#else
+# error "Invalid environment"
+#endif
+
+#include "pdu-transp.h"
+
+/*
+ * The loopback transport connects the stub core to a peer (the external host side) running in
+ * another thread of the same process through two single producer/single consumer byte rings.
+ */
+
+/** Size of each direction of the loopback channel in bytes (power of two). */
+#define PSP_STUB_LOOPBACK_RING_SIZE     (64 * _1K)
+
+
+/** The loopback transport interface for the stub core. */
+extern const PSPPDUTRANSPIF g_LoopbackTransp;
+
+
+/**
+ * Returns the number of bytes the stub sent which are available for reading by the peer.
+ *
+ * @returns Number of bytes available.
+ */
+size_t pspStubLoopbackPeerPeek(void);
+
+
+/**
+ * Reads data the stub sent, doesn't block.
+ *
+ * @returns Status code, INF_TRY_AGAIN if nothing is available.
+ * @param   pvBuf                   Where to store the data.
+ * @param   cbRead                  Maximum number of bytes to read.
+ * @param   pcbRead                 Where to store the number of bytes read.
+ */
+int pspStubLoopbackPeerRead(void *pvBuf, size_t cbRead, size_t *pcbRead);
+
+
+/**
+ * Writes data for the stub to receive, doesn't block.
+ *
+ * @returns Status code, INF_TRY_AGAIN if the ring is full.
+ * @param   pvBuf                   The data to write.
+ * @param   cbWrite                 Number of bytes to write.
+ * @param   pcbWritten              Where to store the number of bytes written.
+ */
+int pspStubLoopbackPeerWrite(const void *pvBuf, size_t cbWrite, size_t *pcbWritten);
+
+#endif /* !__include_pdu_transp_loopback_h */
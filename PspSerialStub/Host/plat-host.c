@@ -0,0 +1,363 @@
+/** @file
+ * PSP serial stub host build - Platform layer on top of a simulated address space.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#define _GNU_SOURCE
+#include <sys/mman.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <types.h>
+#include <cdefs.h>
+#include <err.h>
+#include <string.h>
+
+#include "psp-serial-stub-plat.h"
+
+/*
+ * The simulated PSP address space is a 4GB reservation where every byte reads as zero until written.
+ * The x86 and SMN mapping windows are placed at the same offsets as on the real PSP and alias the
+ * simulated x86 and SMN address spaces, so everything reachable through a window is also reachable
+ * through the PSP address of the window, like on the real hardware.
+ */
+
+/** Start of the x86 mapping windows in the PSP address space. */
+#define PSP_PLAT_X86_WINDOW_BASE        0x04000000
+/** Number of x86 mapping windows. */
+#define PSP_PLAT_X86_WINDOW_COUNT       15
+/** Start of the SMN mapping windows in the PSP address space. */
+#define PSP_PLAT_SMN_WINDOW_BASE        0x01000000
+/** Number of SMN mapping windows. */
+#define PSP_PLAT_SMN_WINDOW_COUNT       32
+/** Size of the simulated x86 physical address space (48 bits). */
+#define PSP_PLAT_X86_ADDR_SPACE_SIZE    (1ULL << 48)
+/** Size of the simulated SMN address space. */
+#define PSP_PLAT_SMN_ADDR_SPACE_SIZE    (1ULL << 32)
+/** Size of the simulated PSP address space. */
+#define PSP_PLAT_PSP_ADDR_SPACE_SIZE    (1ULL << 32)
+
+
+/**
+ * The simulated address spaces.
+ */
+typedef struct PSPPLATHOST
+{
+    /** Start of the simulated PSP address space. */
+    uint8_t                     *pbPspAddrSpace;
+    /** File descriptor backing the simulated x86 physical address space. */
+    int                         iFdX86;
+    /** File descriptor backing the simulated SMN address space. */
+    int                         iFdSmn;
+    /** Timestamp when the timer was started in nanoseconds. */
+    uint64_t                    tsNsStart;
+    /** The native function executed for code modules. */
+    PFNCMENTRY                  pfnCmEntry;
+} PSPPLATHOST;
+/** Pointer to the simulated address spaces. */
+typedef PSPPLATHOST *PPSPPLATHOST;
+
+
+/** The host platform state. */
+static PSPPLATHOST g_PlatHost = { NULL, -1, -1, 0, NULL };
+/** Creates the simulated address spaces exactly once, the benchmarks access them from another thread. */
+static pthread_once_t g_PlatHostOnce = PTHREAD_ONCE_INIT;
+
+
+/**
+ * Creates the simulated address spaces.
+ *
+ * @returns nothing.
+ */
+static void pspStubPlatHostInit(void)
+{
+    PPSPPLATHOST pThis = &g_PlatHost;
+
+    pThis->iFdX86 = memfd_create("psp-stub-x86", 0);
+    pThis->iFdSmn = memfd_create("psp-stub-smn", 0);
+    if (   pThis->iFdX86 == -1
+        || pThis->iFdSmn == -1
+        || ftruncate(pThis->iFdX86, PSP_PLAT_X86_ADDR_SPACE_SIZE) == -1
+        || ftruncate(pThis->iFdSmn, PSP_PLAT_SMN_ADDR_SPACE_SIZE) == -1)
+        abort();
+
+    void *pv = mmap(NULL, PSP_PLAT_PSP_ADDR_SPACE_SIZE, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (pv == MAP_FAILED)
+        abort();
+    pThis->pbPspAddrSpace = (uint8_t *)pv;
+}
+
+
+/**
+ * Returns the host platform state, creating the simulated address spaces on first use.
+ *
+ * @returns Pointer to the host platform state.
+ */
+static PPSPPLATHOST pspStubPlatHostGet(void)
+{
+    pthread_once(&g_PlatHostOnce, pspStubPlatHostInit);
+    return &g_PlatHost;
+}
+
+
+/**
+ * Places the given part of a backing file at the given offset of the simulated PSP address space.
+ *
+ * @returns Pointer to the start of the window, NULL on failure.
+ * @param   pThis                   The host platform state.
+ * @param   offWindow               Offset of the window in the PSP address space.
+ * @param   cbWindow                Size of the window.
+ * @param   iFd                     The backing file, -1 to make the window read as zero again.
+ * @param   offFile                 Offset into the backing file.
+ */
+static void *pspStubPlatHostWindowSet(PPSPPLATHOST pThis, uint32_t offWindow, size_t cbWindow, int iFd, uint64_t offFile)
+{
+    void *pvWindow = pThis->pbPspAddrSpace + offWindow;
+    void *pv =   iFd != -1
+               ? mmap(pvWindow, cbWindow, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, iFd, offFile)
+               : mmap(pvWindow, cbWindow, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+
+    return pv == MAP_FAILED ? NULL : pv;
+}
+
+
+void *pspStubPlatX86WindowMap(uint32_t idxSlot, X86PADDR PhysX86AddrBase, uint32_t uMemType)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+
+    if (   idxSlot >= PSP_PLAT_X86_WINDOW_COUNT
+        || PhysX86AddrBase >= PSP_PLAT_X86_ADDR_SPACE_SIZE)
+        return NULL;
+
+    return pspStubPlatHostWindowSet(pThis, PSP_PLAT_X86_WINDOW_BASE + idxSlot * _64M, _64M, pThis->iFdX86, PhysX86AddrBase);
+}
+
+
+void pspStubPlatX86WindowUnmap(uint32_t idxSlot)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+
+    pspStubPlatHostWindowSet(pThis, PSP_PLAT_X86_WINDOW_BASE + idxSlot * _64M, _64M, -1 /*iFd*/, 0 /*offFile*/);
+}
+
+
+uint32_t pspStubPlatX86WindowFromPtr(const void *pv)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+    uintptr_t off = (uintptr_t)pv - (uintptr_t)pThis->pbPspAddrSpace;
+
+    if (   (uintptr_t)pv < (uintptr_t)pThis->pbPspAddrSpace
+        || off < PSP_PLAT_X86_WINDOW_BASE
+        || off >= PSP_PLAT_X86_WINDOW_BASE + PSP_PLAT_X86_WINDOW_COUNT * _64M)
+        return UINT32_MAX;
+
+    return (off - PSP_PLAT_X86_WINDOW_BASE) / _64M;
+}
+
+
+void *pspStubPlatSmnWindowMap(uint32_t idxSlot, SMNADDR SmnAddrBase)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+
+    if (idxSlot >= PSP_PLAT_SMN_WINDOW_COUNT)
+        return NULL;
+
+    return pspStubPlatHostWindowSet(pThis, PSP_PLAT_SMN_WINDOW_BASE + idxSlot * _1M, _1M, pThis->iFdSmn, SmnAddrBase);
+}
+
+
+void pspStubPlatSmnWindowUnmap(uint32_t idxSlot)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+
+    pspStubPlatHostWindowSet(pThis, PSP_PLAT_SMN_WINDOW_BASE + idxSlot * _1M, _1M, -1 /*iFd*/, 0 /*offFile*/);
+}
+
+
+uint32_t pspStubPlatSmnWindowFromPtr(const void *pv)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+    uintptr_t off = (uintptr_t)pv - (uintptr_t)pThis->pbPspAddrSpace;
+
+    if (   (uintptr_t)pv < (uintptr_t)pThis->pbPspAddrSpace
+        || off < PSP_PLAT_SMN_WINDOW_BASE
+        || off >= PSP_PLAT_SMN_WINDOW_BASE + PSP_PLAT_SMN_WINDOW_COUNT * _1M)
+        return UINT32_MAX;
+
+    return (off - PSP_PLAT_SMN_WINDOW_BASE) / _1M;
+}
+
+
+void *pspStubPlatPspAddrToPtr(PSPADDR PspAddr)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+
+    return pThis->pbPspAddrSpace + PspAddr;
+}
+
+
+PSPADDR pspStubPlatPtrToPspAddr(const void *pv)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+
+    /* The stub state lives outside of the simulated address space, so the scratch buffer has no PSP address. */
+    if (   (uintptr_t)pv < (uintptr_t)pThis->pbPspAddrSpace
+        || (uintptr_t)pv - (uintptr_t)pThis->pbPspAddrSpace >= PSP_PLAT_PSP_ADDR_SPACE_SIZE)
+        return 0;
+
+    return (PSPADDR)((uintptr_t)pv - (uintptr_t)pThis->pbPspAddrSpace);
+}
+
+
+PSPADDR pspStubPlatStubEndGet(void)
+{
+    /* The stub doesn't occupy any of the simulated PSP memory. */
+    return 0;
+}
+
+
+PSPADDR pspStubPlatSramEndGet(void)
+{
+    /* Same as on the real PSP, everything above is MMIO and the mapping windows. */
+    return 256 * _1K;
+}
+
+
+void pspStubPlatMemBarrier(void)
+{
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+
+void pspStubPlatDCacheCleanInvalidate(void *pv, size_t cb)
+{
+    /* Coherent. */
+}
+
+
+void pspStubPlatTimerStart(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    g_PlatHost.tsNsStart = (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+}
+
+
+uint32_t pspStubPlatTimerRead(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    uint64_t tsNs = (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+    return (uint32_t)((tsNs - g_PlatHost.tsNsStart) / 10);
+}
+
+
+void pspStubPlatIrqEnable(void)
+{
+    /* No interrupts on the host. */
+}
+
+
+void pspStubPlatIrqDisable(void)
+{
+    /* No interrupts on the host. */
+}
+
+
+void pspStubPlatIrqCheck(bool *pfIrq, bool *pfFiq)
+{
+    *pfIrq = false;
+    *pfFiq = false;
+}
+
+
+int pspStubPlatCoProcRw(uint8_t u8CoProc, uint8_t u8Crn, uint8_t u8Crm, uint8_t u8Opc1, uint8_t u8Opc2,
+                        bool fWrite, uint32_t *pu32Val)
+{
+    return ERR_NOT_IMPLEMENTED;
+}
+
+
+int pspStubPlatMemCopyProbe(void *pvDst, const void *pvSrc, size_t cb)
+{
+    /* The simulated address space never faults. */
+    memcpy(pvDst, pvSrc, cb);
+    return 0;
+}
+
+
+void pspStubHostCmEntrySet(PFNCMENTRY pfnEntry)
+{
+    g_PlatHost.pfnCmEntry = pfnEntry;
+}
+
+
+int pspStubHostX86MemRead(X86PADDR PhysX86Addr, void *pvBuf, size_t cbRead)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+
+    if (   PhysX86Addr >= PSP_PLAT_X86_ADDR_SPACE_SIZE
+        || cbRead > PSP_PLAT_X86_ADDR_SPACE_SIZE - PhysX86Addr)
+        return ERR_INVALID_PARAMETER;
+
+    return pread(pThis->iFdX86, pvBuf, cbRead, PhysX86Addr) == (ssize_t)cbRead ? INF_SUCCESS : ERR_INVALID_STATE;
+}
+
+
+int pspStubHostX86MemWrite(X86PADDR PhysX86Addr, const void *pvBuf, size_t cbWrite)
+{
+    PPSPPLATHOST pThis = pspStubPlatHostGet();
+
+    if (   PhysX86Addr >= PSP_PLAT_X86_ADDR_SPACE_SIZE
+        || cbWrite > PSP_PLAT_X86_ADDR_SPACE_SIZE - PhysX86Addr)
+        return ERR_INVALID_PARAMETER;
+
+    return pwrite(pThis->iFdX86, pvBuf, cbWrite, PhysX86Addr) == (ssize_t)cbWrite ? INF_SUCCESS : ERR_INVALID_STATE;
+}
+
+
+int pspStubPlatCmExec(CMIF *pCmIf, PSPADDR PspAddrEntry, uint32_t u32Arg0, uint32_t u32Arg1,
+                      uint32_t u32Arg2, uint32_t u32Arg3, uint32_t *pu32CmRet)
+{
+    /* The loaded flat binary is ARM code, run whatever native function the host registered instead. */
+    if (!g_PlatHost.pfnCmEntry)
+        return ERR_NOT_IMPLEMENTED;
+
+    pCmIf->pfnInBufPeek   = pspStubCmIfInBufPeek;
+    pCmIf->pfnInBufPoll   = pspStubCmIfInBufPoll;
+    pCmIf->pfnInBufRead   = pspStubCmIfInBufRead;
+    pCmIf->pfnOutBufWrite = pspStubCmIfOutBufWrite;
+    pCmIf->pfnDelayMs     = pspStubCmIfDelayMs;
+    pCmIf->pfnTsGetMilli  = pspStubCmIfTsGetMilli;
+
+    *pu32CmRet = g_PlatHost.pfnCmEntry(pCmIf, u32Arg0, u32Arg1, u32Arg2, u32Arg3);
+    return INF_SUCCESS;
+}
+
+
+void pspStubPlatBranchTo(PSPADDR PspAddrPc, const uint32_t *pau32Gprs)
+{
+    /* There is nothing to branch to, the stub just stops. */
+    pthread_exit(NULL);
+}
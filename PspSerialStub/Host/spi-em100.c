@@ -0,0 +1,437 @@
+/** @file
+ * PSP serial stub host build - SPI master and EM100 model.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <types.h>
+#include <cdefs.h>
+#include <err.h>
+#include <string.h>
+
+#include "spi-em100.h"
+
+
+#define SPI_MASTER_SPEED_EN             0x20
+#define SPI_MASTER_SPEED_CFG            0x22
+#define SPI_MASTER_CMD_CODE             0x45
+#define SPI_MASTER_CMD_TRIG             0x47
+# define SPI_MASTER_CMD_TRIG_BIT        BIT(7)
+#define SPI_MASTER_TX_CNT               0x48
+#define SPI_MASTER_RX_CNT               0x4b
+#define SPI_MASTER_STATUS               0x4c
+# define SPI_MASTER_STATUS_BSY          BIT(31)
+#define SPI_MASTER_FIFO_START           0x80
+/**
+ * Size of the SPI master FIFO shared by the transmitted and received bytes of a transaction, the FIFO of the
+ * FCH SPI controller spans 0x80 - 0xc6. Kept separate from the transport so the model catches it going wrong.
+ */
+#define SPI_MASTER_FIFO_SZ              71
+/** SPI clock used until the speed select is enabled. */
+#define SPI_MASTER_HZ_DEFAULT           33333333
+
+/** The EM100 hyper terminal command. */
+#define EM100_CMD_HT                    0x11
+/** The identifier the EM100 returns in register 3. */
+#define EM100_ID                        0xaa
+/** uFIFO tag of a data frame, followed by the length and the data. */
+#define EM100_UFIFO_TAG_DATA            0xef
+/** uFIFO tag of a calibration frame, followed by the length and the data to echo. */
+#define EM100_UFIFO_TAG_ECHO            0xcf
+/** uFIFO tag acknowledging that the dFIFO was read. */
+#define EM100_UFIFO_TAG_DFIFO_CLEARED   0xdf
+/** What the bus reads as when nothing drives it. */
+#define EM100_BUS_IDLE                  0xff
+/** Pattern received bytes are garbled with when the clock is too fast. */
+#define EM100_CORRUPT_XOR               0x5a
+
+
+/** SPI clocks selected by the speed config fields. */
+static const uint32_t g_auSpiHz[] =
+{
+    66666666,
+    33333333,
+    22222222,
+    16666666,
+    100000000,
+    800000
+};
+
+
+uint32_t pspHostEm100SpiHzGet(PPSPHOSTEM100 pEm100)
+{
+    if (!pEm100->abRegs[SPI_MASTER_SPEED_EN])
+        return SPI_MASTER_HZ_DEFAULT;
+
+    uint32_t uSel = pEm100->abRegs[SPI_MASTER_SPEED_CFG] & 0xf;
+    return uSel < ELEMENTS(g_auSpiHz) ? g_auSpiHz[uSel] : g_auSpiHz[ELEMENTS(g_auSpiHz) - 1];
+}
+
+
+/**
+ * Returns the number of dFIFO bytes visible to the stub at the current time.
+ *
+ * @returns Number of bytes.
+ * @param   pEm100                  The model instance.
+ */
+static uint32_t pspHostEm100DFifoVisible(PPSPHOSTEM100 pEm100)
+{
+    if (!pEm100->Cfg.cNsDFifoByte)
+        return pEm100->cbDFifo;
+
+    uint64_t cbLanded = (pEm100->nsNow - pEm100->nsDFifoStart) / pEm100->Cfg.cNsDFifoByte;
+    return (uint32_t)MIN(cbLanded, (uint64_t)pEm100->cbDFifo);
+}
+
+
+/**
+ * Runs a single poll of the host software, draining the uFIFO and writing the next chunk.
+ *
+ * @returns nothing.
+ * @param   pEm100                  The model instance.
+ * @param   nsPoll                  Time of the poll.
+ */
+static void pspHostEm100HostPoll(PPSPHOSTEM100 pEm100, uint64_t nsPoll)
+{
+    for (uint32_t i = 0; i < pEm100->cbUFifo; i++)
+    {
+        uint8_t b = pEm100->abUFifo[i];
+
+        if (pEm100->cbHostFrameLeft)
+        {
+            if (pEm100->fHostFrameEcho)
+            {
+                if (   pEm100->Cfg.fEcho
+                    && pEm100->cbEcho < sizeof(pEm100->abEcho))
+                    pEm100->abEcho[pEm100->cbEcho++] = b;
+            }
+            else if (pEm100->offLineUpWrite - pEm100->offLineUpRead < sizeof(pEm100->abLineUp))
+                pEm100->abLineUp[pEm100->offLineUpWrite++ % sizeof(pEm100->abLineUp)] = b;
+            pEm100->cbHostFrameLeft--;
+        }
+        else if (pEm100->fHostFrameLen)
+        {
+            pEm100->cbHostFrameLeft = b;
+            pEm100->fHostFrameLen   = false;
+        }
+        else if (   b == EM100_UFIFO_TAG_DATA
+                 || b == EM100_UFIFO_TAG_ECHO)
+        {
+            pEm100->fHostFrameLen  = true;
+            pEm100->fHostFrameEcho = b == EM100_UFIFO_TAG_ECHO;
+            if (pEm100->fHostFrameEcho)
+                pEm100->cEchoFrames++;
+        }
+        else if (b == EM100_UFIFO_TAG_DFIFO_CLEARED)
+            pEm100->fHostChunkPending = false;
+        else
+            pEm100->cbHostGarbage++;
+    }
+    pEm100->cbUFifo = 0;
+
+    /* The next chunk goes out only after the stub acknowledged the previous one, echoes go first. */
+    uint32_t cbDown = pEm100->offLineDownWrite - pEm100->offLineDownRead;
+    if (   !pEm100->fHostChunkPending
+        && !pEm100->cbDFifo
+        && (cbDown || pEm100->cbEcho))
+    {
+        uint32_t cbChunk = 0;
+        if (pEm100->cbEcho)
+        {
+            cbChunk = MIN(pEm100->cbEcho, pEm100->Cfg.cbDFifoChunk);
+            memcpy(&pEm100->abDFifo[0], &pEm100->abEcho[0], cbChunk);
+            pEm100->cbEcho -= cbChunk;
+            for (uint32_t i = 0; i < pEm100->cbEcho; i++)
+                pEm100->abEcho[i] = pEm100->abEcho[i + cbChunk];
+        }
+        else
+        {
+            cbChunk = MIN(cbDown, pEm100->Cfg.cbDFifoChunk);
+            for (uint32_t i = 0; i < cbChunk; i++)
+                pEm100->abDFifo[i] = pEm100->abLineDown[pEm100->offLineDownRead++ % sizeof(pEm100->abLineDown)];
+        }
+
+        pEm100->cbDFifo           = cbChunk;
+        pEm100->nsDFifoStart      = nsPoll;
+        pEm100->fHostChunkPending = true;
+    }
+}
+
+
+/**
+ * Brings the host side up to the current simulated time.
+ *
+ * @returns nothing.
+ * @param   pEm100                  The model instance.
+ */
+static void pspHostEm100Sync(PPSPHOSTEM100 pEm100)
+{
+    while (pEm100->nsHostPollNext <= pEm100->nsNow)
+    {
+        pspHostEm100HostPoll(pEm100, pEm100->nsHostPollNext);
+        pEm100->nsHostPollNext += pEm100->Cfg.cNsHostPoll;
+    }
+}
+
+
+/**
+ * Returns the value of the given EM100 register.
+ *
+ * @returns Register value.
+ * @param   pEm100                  The model instance.
+ * @param   idxReg                  The register index.
+ */
+static uint8_t pspHostEm100RegGet(PPSPHOSTEM100 pEm100, uint8_t idxReg)
+{
+    uint32_t cbDFifo = pspHostEm100DFifoVisible(pEm100);
+
+    switch (idxReg)
+    {
+        case 0:
+        {
+            uint8_t bMain = 0;
+            if (!pEm100->cbUFifo)
+                bMain |= BIT(5);
+            if (pEm100->cbUFifo & BIT(8))
+                bMain |= BIT(1);
+            if (!cbDFifo)
+                bMain |= BIT(6);
+            if (cbDFifo & BIT(8))
+                bMain |= BIT(3);
+            return bMain;
+        }
+        case 1:
+            return pEm100->cbUFifo & 0xff;
+        case 2:
+            return cbDFifo & 0xff;
+        case 3:
+            return EM100_ID;
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * Executes the hyper terminal command of the EM100.
+ *
+ * @returns nothing.
+ * @param   pEm100                  The model instance.
+ * @param   pbTx                    The bytes transmitted.
+ * @param   cbTx                    Number of bytes transmitted.
+ * @param   pbRx                    Where to store the bytes received.
+ * @param   cbRx                    Number of bytes received.
+ */
+static void pspHostEm100HtExec(PPSPHOSTEM100 pEm100, const uint8_t *pbTx, uint32_t cbTx, uint8_t *pbRx, uint32_t cbRx)
+{
+    if (cbTx < 2)
+        return;
+
+    uint8_t bOp = pbTx[1];
+    switch (bOp & 0xf0)
+    {
+        case 0xa0:
+            /* None of the registers the transport writes has an effect on the model. */
+            break;
+        case 0xb0:
+            if (cbRx > 1)
+                pbRx[1] = pspHostEm100RegGet(pEm100, bOp & 0xf);
+            break;
+        case 0xc0:
+            for (uint32_t i = 2; i < cbTx; i++)
+            {
+                if (pEm100->cbUFifo < pEm100->Cfg.cbUFifo)
+                    pEm100->abUFifo[pEm100->cbUFifo++] = pbTx[i];
+                else
+                    pEm100->cbUFifoLost++;
+            }
+            break;
+        case 0xd0:
+        {
+            /* Reading clears the dFIFO no matter how much was read or had landed so far. */
+            uint32_t cbRead = MIN(pspHostEm100DFifoVisible(pEm100), cbRx);
+            memcpy(pbRx, &pEm100->abDFifo[0], cbRead);
+            pEm100->cbDFifoLost += pEm100->cbDFifo - cbRead;
+            pEm100->cbDFifo      = 0;
+            break;
+        }
+        default:
+            break;
+    }
+}
+
+
+/**
+ * Runs the transaction programmed into the SPI master.
+ *
+ * @returns nothing.
+ * @param   pEm100                  The model instance.
+ */
+static void pspHostEm100XactStart(PPSPHOSTEM100 pEm100)
+{
+    uint8_t bCmd = pEm100->abRegs[SPI_MASTER_CMD_CODE];
+    uint32_t cbTx = pEm100->abRegs[SPI_MASTER_TX_CNT];
+    uint32_t cbRx = pEm100->abRegs[SPI_MASTER_RX_CNT];
+    uint32_t uHz = pspHostEm100SpiHzGet(pEm100);
+
+    if (cbTx + cbRx > SPI_MASTER_FIFO_SZ)
+    {
+        /* Whatever the controller makes of this, the data doesn't go where the stub expects it. */
+        pEm100->cXactsInvalid++;
+        cbTx = MIN(cbTx, SPI_MASTER_FIFO_SZ);
+        cbRx = SPI_MASTER_FIFO_SZ - cbTx;
+    }
+
+    uint8_t *pbTx = &pEm100->abRegs[SPI_MASTER_FIFO_START];
+    uint8_t *pbRx = pbTx + cbTx;
+    memset(pbRx, EM100_BUS_IDLE, cbRx);
+    if (bCmd == EM100_CMD_HT)
+        pspHostEm100HtExec(pEm100, pbTx, cbTx, pbRx, cbRx);
+
+    if (uHz > pEm100->Cfg.uSpiHzMax)
+    {
+        for (uint32_t i = 0; i < cbRx; i++)
+            pbRx[i] ^= EM100_CORRUPT_XOR;
+        pEm100->cXactsCorrupted++;
+    }
+    else if (   pEm100->Cfg.uSpiHzMaxToggle
+             && uHz > pEm100->Cfg.uSpiHzMaxToggle)
+    {
+        /* Only bytes with lots of transitions suffer, a constant value read over and over doesn't show it. */
+        bool fCorrupted = false;
+        uint8_t bPrev = EM100_BUS_IDLE;
+        for (uint32_t i = 0; i < cbRx; i++)
+        {
+            uint8_t bThis = pbRx[i];
+            if (__builtin_popcount(bThis ^ bPrev) > 4)
+            {
+                pbRx[i] ^= EM100_CORRUPT_XOR;
+                fCorrupted = true;
+            }
+            bPrev = bThis;
+        }
+        if (fCorrupted)
+            pEm100->cXactsCorrupted++;
+    }
+
+    uint32_t cbBus = 1 + cbTx + cbRx;
+    pEm100->nsXactDone = pEm100->nsNow + pEm100->Cfg.cNsXactOverhead + (cbBus * 8ULL * 1000000000ULL) / uHz;
+    pEm100->cXacts++;
+    pEm100->cbSpi += cbBus;
+}
+
+
+/**
+ * Register read callback.
+ */
+static int pspHostEm100RegRead(PCPSPIODEVIF pIfIoDev, uint32_t offReg, void *pvBuf, size_t cbRead)
+{
+    PPSPHOSTEM100 pEm100 = (PPSPHOSTEM100)pIfIoDev;
+
+    if (   offReg >= sizeof(pEm100->abRegs)
+        || cbRead > sizeof(pEm100->abRegs) - offReg)
+        return ERR_INVALID_PARAMETER;
+
+    pEm100->nsNow += pEm100->Cfg.cNsRegAccess;
+    pEm100->cRegAccesses++;
+    pspHostEm100Sync(pEm100);
+
+    uint32_t u32Sts = pEm100->nsNow < pEm100->nsXactDone ? SPI_MASTER_STATUS_BSY : 0;
+    memcpy(&pEm100->abRegs[SPI_MASTER_STATUS], &u32Sts, sizeof(u32Sts));
+    memcpy(pvBuf, &pEm100->abRegs[offReg], cbRead);
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Register write callback.
+ */
+static int pspHostEm100RegWrite(PCPSPIODEVIF pIfIoDev, uint32_t offReg, const void *pvBuf, size_t cbWrite)
+{
+    PPSPHOSTEM100 pEm100 = (PPSPHOSTEM100)pIfIoDev;
+
+    if (   offReg >= sizeof(pEm100->abRegs)
+        || cbWrite > sizeof(pEm100->abRegs) - offReg)
+        return ERR_INVALID_PARAMETER;
+
+    pEm100->nsNow += pEm100->Cfg.cNsRegAccess;
+    pEm100->cRegAccesses++;
+    pspHostEm100Sync(pEm100);
+
+    memcpy(&pEm100->abRegs[offReg], pvBuf, cbWrite);
+    if (   offReg <= SPI_MASTER_CMD_TRIG
+        && offReg + cbWrite > SPI_MASTER_CMD_TRIG
+        && (pEm100->abRegs[SPI_MASTER_CMD_TRIG] & SPI_MASTER_CMD_TRIG_BIT))
+    {
+        pEm100->abRegs[SPI_MASTER_CMD_TRIG] &= ~SPI_MASTER_CMD_TRIG_BIT;
+        pspHostEm100XactStart(pEm100);
+    }
+
+    return INF_SUCCESS;
+}
+
+
+int pspHostEm100Init(PPSPHOSTEM100 pEm100, PCPSPHOSTEM100CFG pCfg)
+{
+    if (   !pCfg->cbUFifo
+        || pCfg->cbUFifo > PSP_HOST_EM100_FIFO_MAX
+        || !pCfg->cbDFifoChunk
+        || pCfg->cbDFifoChunk > PSP_HOST_EM100_FIFO_MAX
+        || !pCfg->cNsHostPoll)
+        return ERR_INVALID_PARAMETER;
+
+    memset(pEm100, 0, sizeof(*pEm100));
+    pEm100->IfIoDev.pfnRegRead  = pspHostEm100RegRead;
+    pEm100->IfIoDev.pfnRegWrite = pspHostEm100RegWrite;
+    pEm100->Cfg                 = *pCfg;
+    pEm100->nsHostPollNext      = pCfg->cNsHostPoll;
+    return INF_SUCCESS;
+}
+
+
+void pspHostEm100TimeAdvance(PPSPHOSTEM100 pEm100, uint64_t cNs)
+{
+    pEm100->nsNow += cNs;
+    pspHostEm100Sync(pEm100);
+}
+
+
+size_t pspHostEm100PeerWrite(PPSPHOSTEM100 pEm100, const void *pvBuf, size_t cbWrite)
+{
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    size_t cbFree = sizeof(pEm100->abLineDown) - (pEm100->offLineDownWrite - pEm100->offLineDownRead);
+    size_t cbThis = MIN(cbWrite, cbFree);
+
+    for (size_t i = 0; i < cbThis; i++)
+        pEm100->abLineDown[pEm100->offLineDownWrite++ % sizeof(pEm100->abLineDown)] = pbBuf[i];
+
+    return cbThis;
+}
+
+
+size_t pspHostEm100PeerRead(PPSPHOSTEM100 pEm100, void *pvBuf, size_t cbRead)
+{
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    size_t cbUsed = pEm100->offLineUpWrite - pEm100->offLineUpRead;
+    size_t cbThis = MIN(cbRead, cbUsed);
+
+    for (size_t i = 0; i < cbThis; i++)
+        pbBuf[i] = pEm100->abLineUp[pEm100->offLineUpRead++ % sizeof(pEm100->abLineUp)];
+
+    return cbThis;
+}
@@ -0,0 +1,221 @@
+/** @file
+ * PSP serial stub host build - SPI master and EM100 model.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __include_spi_em100_h
+#define __include_spi_em100_h
+
+#if defined(IN_PSP)
+# include <common/types.h>
+#else
+# error "Invalid environment"
+#endif
+
+#include <io.h>
+
+/*
+ * Models the PSP SPI master register block behind PSPIODEVIF with a Dediprog EM100 attached,
+ * including the host software on the other end of the EM100 USB link. Like the 16550 model
+ * everything runs on a simulated clock advancing with every register access, SPI transactions
+ * keep the master busy for the time the bytes take on the bus at the configured clock.
+ *
+ * The EM100 side implements the hyper terminal command (0x11):
+ *     0x00 0xa0|reg val        register write
+ *     0x00 0xb0|reg            register read, the value is the second byte received
+ *     0x00 0xc0 bytes...       append the bytes to the uFIFO (EM100 to host)
+ *     0x00 0xd0 x              read the dFIFO (host to EM100), clears it completely
+ * The host polls the EM100 periodically, drains the uFIFO and writes the next chunk to the dFIFO
+ * once the stub acknowledged the previous one with a 0xdf tag in the uFIFO. Data in the uFIFO is
+ * framed as 0xef len bytes. Chunk bytes become visible in the dFIFO one after another, reading
+ * the dFIFO before the chunk landed completely loses the rest. Calibration frames are tagged 0xcf
+ * instead, the host writes their payload back to the dFIFO ahead of everything else if configured to.
+ */
+
+/** Size of the SPI master register block. */
+#define PSP_HOST_SPI_MASTER_REGS_SZ     256
+/** Maximum size of the FIFOs of the EM100. */
+#define PSP_HOST_EM100_FIFO_MAX         512
+/** Size of the buffers holding the data of the host in each direction (power of two). */
+#define PSP_HOST_EM100_LINE_SZ          (64 * _1K)
+
+
+/**
+ * SPI master and EM100 model configuration.
+ */
+typedef struct PSPHOSTEM100CFG
+{
+    /** Size of the uFIFO in bytes, the transport assumes the 512 bytes of the real EM100. */
+    uint32_t                    cbUFifo;
+    /** Size of the chunks the host writes to the dFIFO in bytes. */
+    uint32_t                    cbDFifoChunk;
+    /** Simulated time a single register access takes in nanoseconds. */
+    uint32_t                    cNsRegAccess;
+    /** Fixed overhead of a SPI transaction in nanoseconds, on top of the time the bytes take on the bus. */
+    uint32_t                    cNsXactOverhead;
+    /** Interval in which the host polls the EM100 in nanoseconds. */
+    uint32_t                    cNsHostPoll;
+    /** Time each byte of a chunk takes to land in the dFIFO in nanoseconds. */
+    uint32_t                    cNsDFifoByte;
+    /** Fastest SPI clock in Hz the link works at, received bytes are corrupted above it. */
+    uint32_t                    uSpiHzMax;
+    /** Fastest SPI clock in Hz received bytes toggling more than half of the bits against the previous byte survive,
+     * 0 for the same as uSpiHzMax. */
+    uint32_t                    uSpiHzMaxToggle;
+    /** Flag whether the host echoes calibration frames. */
+    bool                        fEcho;
+} PSPHOSTEM100CFG;
+/** Pointer to a SPI master and EM100 model configuration. */
+typedef PSPHOSTEM100CFG *PPSPHOSTEM100CFG;
+/** Pointer to a const SPI master and EM100 model configuration. */
+typedef const PSPHOSTEM100CFG *PCPSPHOSTEM100CFG;
+
+
+/**
+ * SPI master and EM100 model instance, treat as private except for the counters.
+ */
+typedef struct PSPHOSTEM100
+{
+    /** Device I/O interface handed to the transport, must come first. */
+    PSPIODEVIF                  IfIoDev;
+    /** The configuration. */
+    PSPHOSTEM100CFG             Cfg;
+    /** Simulated time in nanoseconds. */
+    uint64_t                    nsNow;
+    /** Time the running SPI transaction completes. */
+    uint64_t                    nsXactDone;
+    /** Time of the next host poll. */
+    uint64_t                    nsHostPollNext;
+    /** Time the chunk written last to the dFIFO started landing. */
+    uint64_t                    nsDFifoStart;
+    /** The SPI master register block. */
+    uint8_t                     abRegs[PSP_HOST_SPI_MASTER_REGS_SZ];
+    /** Number of bytes in the uFIFO. */
+    uint32_t                    cbUFifo;
+    /** Number of bytes of the chunk in the dFIFO (visible or not). */
+    uint32_t                    cbDFifo;
+    /** Flag whether the host waits for the acknowledge of the last chunk. */
+    bool                        fHostChunkPending;
+    /** The uFIFO. */
+    uint8_t                     abUFifo[PSP_HOST_EM100_FIFO_MAX];
+    /** The dFIFO. */
+    uint8_t                     abDFifo[PSP_HOST_EM100_FIFO_MAX];
+    /** Partially received uFIFO frame on the host side: bytes still expected, 0 if waiting for a tag. */
+    uint32_t                    cbHostFrameLeft;
+    /** Flag whether the host expects the length byte of a data frame next. */
+    bool                        fHostFrameLen;
+    /** Flag whether the frame being received is a calibration frame. */
+    bool                        fHostFrameEcho;
+    /** Number of bytes of calibration frames waiting to be echoed. */
+    uint32_t                    cbEcho;
+    /** Payload of calibration frames waiting to be echoed. */
+    uint8_t                     abEcho[PSP_HOST_EM100_FIFO_MAX];
+    /** Free running offsets of the data the host sends to the stub. */
+    uint32_t                    offLineDownWrite;
+    uint32_t                    offLineDownRead;
+    /** Free running offsets of the data the host received from the stub. */
+    uint32_t                    offLineUpWrite;
+    uint32_t                    offLineUpRead;
+    /** Data the host sends to the stub. */
+    uint8_t                     abLineDown[PSP_HOST_EM100_LINE_SZ];
+    /** Data the host received from the stub. */
+    uint8_t                     abLineUp[PSP_HOST_EM100_LINE_SZ];
+    /** Number of register accesses. */
+    uint64_t                    cRegAccesses;
+    /** Number of SPI transactions. */
+    uint64_t                    cXacts;
+    /** Number of bytes clocked over the SPI bus. */
+    uint64_t                    cbSpi;
+    /** Number of transactions corrupted because of a too fast clock. */
+    uint64_t                    cXactsCorrupted;
+    /** Number of transactions exceeding the SPI master FIFO. */
+    uint64_t                    cXactsInvalid;
+    /** Number of bytes lost because the uFIFO was full. */
+    uint64_t                    cbUFifoLost;
+    /** Number of bytes lost because the dFIFO was read before the chunk landed completely. */
+    uint64_t                    cbDFifoLost;
+    /** Number of uFIFO bytes the host could not make sense of. */
+    uint64_t                    cbHostGarbage;
+    /** Number of calibration frames received. */
+    uint64_t                    cEchoFrames;
+} PSPHOSTEM100;
+/** Pointer to a SPI master and EM100 model instance. */
+typedef PSPHOSTEM100 *PPSPHOSTEM100;
+
+
+/**
+ * Initializes the given SPI master and EM100 model instance.
+ *
+ * @returns Status code.
+ * @param   pEm100                  The model instance to initialize.
+ * @param   pCfg                    The configuration to use.
+ */
+int pspHostEm100Init(PPSPHOSTEM100 pEm100, PCPSPHOSTEM100CFG pCfg);
+
+
+/**
+ * Advances the simulated clock, letting the host make progress.
+ *
+ * @returns nothing.
+ * @param   pEm100                  The model instance.
+ * @param   cNs                     Number of nanoseconds to advance.
+ */
+void pspHostEm100TimeAdvance(PPSPHOSTEM100 pEm100, uint64_t cNs);
+
+
+/**
+ * Returns the SPI clock currently configured in the SPI master.
+ *
+ * @returns SPI clock in Hz.
+ * @param   pEm100                  The model instance.
+ */
+uint32_t pspHostEm100SpiHzGet(PPSPHOSTEM100 pEm100);
+
+
+/**
+ * Queues data the host sends to the stub through the dFIFO.
+ *
+ * @returns Number of bytes accepted (limited by the line buffer).
+ * @param   pEm100                  The model instance.
+ * @param   pvBuf                   The data to send.
+ * @param   cbWrite                 Number of bytes to send.
+ */
+size_t pspHostEm100PeerWrite(PPSPHOSTEM100 pEm100, const void *pvBuf, size_t cbWrite);
+
+
+/**
+ * Takes data the host received from the stub through the uFIFO.
+ *
+ * @returns Number of bytes read.
+ * @param   pEm100                  The model instance.
+ * @param   pvBuf                   Where to store the data.
+ * @param   cbRead                  Maximum number of bytes to read.
+ */
+size_t pspHostEm100PeerRead(PPSPHOSTEM100 pEm100, void *pvBuf, size_t cbRead);
+
+
+/**
+ * Returns the device I/O interface the EM100 transport uses in the host build instead of
+ * the SPI master MMIO mapping, provided by the program embedding the transport.
+ *
+ * @returns Device I/O interface.
+ */
+PCPSPIODEVIF pspStubHostSpiMasterIoDevGet(void);
+
+#endif /* !__include_spi_em100_h */
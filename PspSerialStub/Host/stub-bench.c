@@ -0,0 +1,1041 @@
+/** @file
+ * PSP serial stub host build - Latency and throughput benchmark of the stub core over the loopback transport.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+#include <types.h>
+#include <cdefs.h>
+#include <err.h>
+#include <string.h>
+
+#include <psp-stub/psp-serial-stub.h>
+
+#include "psp-serial-stub-ext.h"
+#include "psp-serial-stub-plat.h"
+#include "pdu-transp-loopback.h"
+
+/*
+ * Runs the stub core in a separate thread and plays the external host on the other end of the
+ * loopback transport. Each benchmark issues the same read request back to back and reports the
+ * round trip latency and the resulting payload throughput, which covers PDU framing, validation,
+ * dispatch and the address space handling of the core without any link in the way.
+ *
+ * Before measuring anything the data moved by the requests is checked against the simulated
+ * x86 address space, which is accessed directly through the backing file of the platform layer.
+ * The checks also cover the order of PDUs leaving the transmit queue, striped and sparse reads
+ * and the request journal.
+ */
+
+/** How long to wait for a response before giving up in milliseconds. */
+#define STUB_BENCH_TIMEOUT_MS           5000
+/** Default number of requests per benchmark. */
+#define STUB_BENCH_ITERATIONS_DEFAULT   10000
+/** Largest transfer measured. */
+#define STUB_BENCH_XFER_MAX             (2 * _1K)
+/** x86 physical address of the boundary between two 64MB mapping windows used for the checks. */
+#define STUB_BENCH_X86_SEAM             (0x100000000ULL + _64M)
+/** Size of the area around the window boundary used for the checks. */
+#define STUB_BENCH_X86_SEAM_AREA        (2 * _1K)
+/** x86 physical address of the unaligned striped read, crossing the next window boundary. */
+#define STUB_BENCH_X86_STRIPED          (STUB_BENCH_X86_SEAM + _64M - 10 * _1K - 3)
+/** Size of the striped read. */
+#define STUB_BENCH_X86_STRIPED_SZ       (24 * _1K)
+/** x86 physical address of the reads queued back to back. */
+#define STUB_BENCH_X86_QUEUED           0x200000000ULL
+/** Number of reads queued back to back, more than the stub has transmit buffers. */
+#define STUB_BENCH_QUEUED_READS         8
+
+
+/**
+ * The external host side of the connection.
+ */
+typedef struct STUBBENCH
+{
+    /** Number of PDUs sent so far. */
+    uint32_t                    cPdusSent;
+    /** PDU counter value expected for the next PDU received from the stub, 0 if not known yet. */
+    uint32_t                    cPdusRecvNext;
+    /** Checksum of the last request sent. */
+    uint32_t                    u32ChkSumLast;
+    /** Buffer for the PDU being assembled or received. */
+    uint8_t                     abPdu[_4K + 2 * _1K];
+    /** Expected content of the area around the window boundary. */
+    uint8_t                     abSeamExp[STUB_BENCH_X86_SEAM_AREA];
+    /** Actual content of the area around the window boundary. */
+    uint8_t                     abSeamAct[STUB_BENCH_X86_SEAM_AREA];
+    /** Request being assembled for the checks. */
+    uint8_t                     abReq[_4K];
+    /** Content of the x86 memory read by the striped and queued reads. */
+    uint8_t                     abX86[STUB_BENCH_X86_STRIPED_SZ];
+} STUBBENCH;
+/** Pointer to the external host side of the connection. */
+typedef STUBBENCH *PSTUBBENCH;
+
+
+/**
+ * Returns the current timestamp in nanoseconds.
+ *
+ * @returns Timestamp in nanoseconds.
+ */
+static uint64_t stubBenchNanoTs(void)
+{
+    struct timespec Ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &Ts);
+    return (uint64_t)Ts.tv_sec * 1000000000ULL + Ts.tv_nsec;
+}
+
+
+/**
+ * Reads exactly the given amount of data from the stub.
+ *
+ * @returns Status code.
+ * @param   pvBuf                   Where to store the data.
+ * @param   cbRead                  How much to read.
+ * @param   tsNsDeadline            Timestamp after which to give up.
+ */
+static int stubBenchRead(void *pvBuf, size_t cbRead, uint64_t tsNsDeadline)
+{
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+
+    while (cbRead)
+    {
+        size_t cbThis = 0;
+        int rc = pspStubLoopbackPeerRead(pbBuf, cbRead, &cbThis);
+        if (rc == INF_TRY_AGAIN)
+        {
+            if (stubBenchNanoTs() > tsNsDeadline)
+                return ERR_INVALID_STATE;
+            sched_yield();
+            continue;
+        }
+
+        pbBuf  += cbThis;
+        cbRead -= cbThis;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Sends a request PDU to the stub.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   enmRrnId                The request ID.
+ * @param   pvPayload               The request payload.
+ * @param   cbPayload               Size of the payload in bytes.
+ */
+static int stubBenchReqSend(PSTUBBENCH pThis, PSPSERIALPDURRNID enmRrnId, const void *pvPayload, size_t cbPayload)
+{
+    PPSPSERIALPDUHDR pHdr = (PPSPSERIALPDUHDR)&pThis->abPdu[0];
+    uint8_t *pbPayload = (uint8_t *)(pHdr + 1);
+    size_t cbPad = ((cbPayload + 7) & ~7) - cbPayload;
+
+    memset(pHdr, 0, sizeof(*pHdr));
+    pHdr->u32Magic           = PSP_SERIAL_EXT_2_PSP_PDU_START_MAGIC;
+    pHdr->u.Fields.cbPdu     = cbPayload;
+    pHdr->u.Fields.cPdus     = ++pThis->cPdusSent;
+    pHdr->u.Fields.enmRrnId  = enmRrnId;
+    memcpy(pbPayload, pvPayload, cbPayload);
+    memset(pbPayload + cbPayload, 0, cbPad);
+
+    uint32_t uChkSum = 0;
+    for (uint32_t i = 0; i < ELEMENTS(pHdr->u.ab); i++)
+        uChkSum += pHdr->u.ab[i];
+    for (size_t i = 0; i < cbPayload; i++)
+        uChkSum += pbPayload[i];
+
+    PPSPSERIALPDUFOOTER pFooter = (PPSPSERIALPDUFOOTER)(pbPayload + cbPayload + cbPad);
+    pFooter->u32ChkSum = (0xffffffff - uChkSum) + 1;
+    pFooter->u32Magic  = PSP_SERIAL_EXT_2_PSP_PDU_END_MAGIC;
+    pThis->u32ChkSumLast = pFooter->u32ChkSum;
+
+    const uint8_t *pbPdu = &pThis->abPdu[0];
+    size_t cbLeft = sizeof(*pHdr) + cbPayload + cbPad + sizeof(*pFooter);
+    while (cbLeft)
+    {
+        size_t cbThis = 0;
+        if (pspStubLoopbackPeerWrite(pbPdu, cbLeft, &cbThis) == INF_TRY_AGAIN)
+            sched_yield();
+        pbPdu  += cbThis;
+        cbLeft -= cbThis;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Receives the next PDU from the stub.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   tsNsDeadline            Timestamp after which to give up.
+ * @param   ppHdr                   Where to store the pointer to the PDU.
+ */
+static int stubBenchPduRecv(PSTUBBENCH pThis, uint64_t tsNsDeadline, PCPSPSERIALPDUHDR *ppHdr)
+{
+    PPSPSERIALPDUHDR pHdr = (PPSPSERIALPDUHDR)&pThis->abPdu[0];
+
+    int rc = stubBenchRead(pHdr, sizeof(*pHdr), tsNsDeadline);
+    if (rc)
+        return rc;
+
+    if (   pHdr->u32Magic != PSP_SERIAL_PSP_2_EXT_PDU_START_MAGIC
+        || pHdr->u.Fields.cbPdu > sizeof(pThis->abPdu) - sizeof(*pHdr) - sizeof(PSPSERIALPDUFOOTER))
+        return ERR_INVALID_STATE;
+
+    size_t cbPayload = (pHdr->u.Fields.cbPdu + 7) & ~7;
+    rc = stubBenchRead(pHdr + 1, cbPayload + sizeof(PSPSERIALPDUFOOTER), tsNsDeadline);
+    if (rc)
+        return rc;
+
+    uint32_t uChkSum = 0;
+    const uint8_t *pbPayload = (const uint8_t *)(pHdr + 1);
+    for (uint32_t i = 0; i < ELEMENTS(pHdr->u.ab); i++)
+        uChkSum += pHdr->u.ab[i];
+    for (size_t i = 0; i < cbPayload; i++)
+        uChkSum += pbPayload[i];
+
+    PCPSPSERIALPDUFOOTER pFooter = (PCPSPSERIALPDUFOOTER)(pbPayload + cbPayload);
+    if (   uChkSum + pFooter->u32ChkSum != 0
+        || pFooter->u32Magic != PSP_SERIAL_PSP_2_EXT_PDU_END_MAGIC)
+        return ERR_INVALID_STATE;
+
+    /* The counter is assigned when a PDU gets queued, so a gap means the transmit queue reordered or lost PDUs. */
+    if (   pThis->cPdusRecvNext
+        && pHdr->u.Fields.cPdus != pThis->cPdusRecvNext)
+    {
+        printf("PDU %#x arrived with counter %u, expected %u\n", pHdr->u.Fields.enmRrnId, pHdr->u.Fields.cPdus,
+               pThis->cPdusRecvNext);
+        return ERR_INVALID_STATE;
+    }
+    if (pThis->cPdusRecvNext)
+        pThis->cPdusRecvNext++;
+
+    *ppHdr = pHdr;
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Waits for the response to the last request, skipping any notifications in between.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   enmRrnId                The expected response ID.
+ * @param   ppHdr                   Where to store the pointer to the response PDU.
+ */
+static int stubBenchRespWait(PSTUBBENCH pThis, PSPSERIALPDURRNID enmRrnId, PCPSPSERIALPDUHDR *ppHdr)
+{
+    uint64_t tsNsDeadline = stubBenchNanoTs() + STUB_BENCH_TIMEOUT_MS * 1000000ULL;
+
+    for (;;)
+    {
+        PCPSPSERIALPDUHDR pHdr = NULL;
+        int rc = stubBenchPduRecv(pThis, tsNsDeadline, &pHdr);
+        if (rc)
+            return rc;
+
+        if (pHdr->u.Fields.enmRrnId == enmRrnId)
+        {
+            *ppHdr = pHdr;
+            return INF_SUCCESS;
+        }
+        /* else: Beacon, log message or another notification, skip. */
+    }
+}
+
+
+/**
+ * Connects to the stub.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ */
+static int stubBenchConnect(PSTUBBENCH pThis)
+{
+    PCPSPSERIALPDUHDR pHdr = NULL;
+
+    pThis->cPdusSent     = 0;
+    pThis->cPdusRecvNext = 0;
+    int rc = stubBenchReqSend(pThis, PSPSERIALPDURRNID_REQUEST_CONNECT, NULL, 0);
+    if (!rc)
+        rc = stubBenchRespWait(pThis, PSPSERIALPDURRNID_RESPONSE_CONNECT, &pHdr);
+    if (!rc)
+        rc = pHdr->u.Fields.rcReq;
+    if (!rc) /* The stub restarts counting with the connect response. */
+        pThis->cPdusRecvNext = pHdr->u.Fields.cPdus + 1;
+
+    return rc;
+}
+
+
+/**
+ * Issues the given request once and waits for the response.
+ *
+ * @returns Status code of the exchange or the request.
+ * @param   pThis                   The benchmark state.
+ * @param   enmReq                  The request ID.
+ * @param   enmResp                 The expected response ID.
+ * @param   pvReq                   The request payload.
+ * @param   cbReq                   Size of the request payload.
+ * @param   ppHdr                   Where to store the pointer to the response PDU, optional.
+ */
+static int stubBenchReq(PSTUBBENCH pThis, PSPSERIALPDURRNID enmReq, PSPSERIALPDURRNID enmResp,
+                        const void *pvReq, size_t cbReq, PCPSPSERIALPDUHDR *ppHdr)
+{
+    PCPSPSERIALPDUHDR pHdr = NULL;
+
+    int rc = stubBenchReqSend(pThis, enmReq, pvReq, cbReq);
+    if (!rc)
+        rc = stubBenchRespWait(pThis, enmResp, &pHdr);
+    if (!rc)
+        rc = pHdr->u.Fields.rcReq;
+    if (   !rc
+        && ppHdr)
+        *ppHdr = pHdr;
+
+    return rc;
+}
+
+
+/**
+ * Queries the most recent entry of the request journal.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   pEntry                  Where to store the entry.
+ */
+static int stubBenchJournalLastGet(PSTUBBENCH pThis, PPSPSERIALJOURNALENTRY pEntry)
+{
+    PSPSERIALJOURNALREADREQ Req;
+    PCPSPSERIALPDUHDR pHdr = NULL;
+
+    Req.cEntriesMax = 1;
+    Req.u32Pad0     = 0;
+    int rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_JOURNAL_READ, PSPSERIALPDURRNID_RESPONSE_JOURNAL_READ,
+                          &Req, sizeof(Req), &pHdr);
+    if (rc)
+        return rc;
+
+    PCPSPSERIALJOURNALREADRESP pResp = (PCPSPSERIALJOURNALREADRESP)(pHdr + 1);
+    if (   pHdr->u.Fields.cbPdu != sizeof(*pResp) + sizeof(*pEntry)
+        || pResp->cEntries != 1)
+        return ERR_INVALID_STATE;
+
+    memcpy(pEntry, pResp + 1, sizeof(*pEntry));
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Fills the given buffer with a pattern derived from the given seed.
+ *
+ * @returns nothing.
+ * @param   pvBuf                   The buffer to fill.
+ * @param   cbBuf                   Size of the buffer in bytes.
+ * @param   uSeed                   The seed selecting the pattern.
+ */
+static void stubBenchPatternFill(void *pvBuf, size_t cbBuf, uint32_t uSeed)
+{
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+
+    for (size_t i = 0; i < cbBuf; i++)
+    {
+        uSeed = uSeed * 1103515245 + 12345;
+        pbBuf[i] = (uint8_t)(uSeed >> 16);
+    }
+}
+
+
+/**
+ * Compares the area around the window boundary with the expected content.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   pszDesc                 Description of the check.
+ */
+static int stubBenchSeamVerify(PSTUBBENCH pThis, const char *pszDesc)
+{
+    int rc = pspStubHostX86MemRead(STUB_BENCH_X86_SEAM - STUB_BENCH_X86_SEAM_AREA / 2, &pThis->abSeamAct[0],
+                                   sizeof(pThis->abSeamAct));
+    if (rc)
+        return rc;
+
+    for (size_t i = 0; i < sizeof(pThis->abSeamAct); i++)
+    {
+        if (pThis->abSeamAct[i] != pThis->abSeamExp[i])
+        {
+            printf("%-24s x86 memory differs at window boundary %+d: %#x, expected %#x\n", pszDesc,
+                   (int)i - STUB_BENCH_X86_SEAM_AREA / 2, pThis->abSeamAct[i], pThis->abSeamExp[i]);
+            return ERR_INVALID_STATE;
+        }
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Checks that the response data matches the expected content of the area around the window boundary.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   pszDesc                 Description of the check.
+ * @param   pHdr                    The response PDU.
+ * @param   offSeam                 Offset of the read start into the area.
+ * @param   cbRead                  Number of bytes read.
+ */
+static int stubBenchSeamRespVerify(PSTUBBENCH pThis, const char *pszDesc, PCPSPSERIALPDUHDR pHdr, size_t offSeam, size_t cbRead)
+{
+    const uint8_t *pbResp = (const uint8_t *)(pHdr + 1);
+
+    if (pHdr->u.Fields.cbPdu != cbRead)
+    {
+        printf("%-24s returned %u bytes, expected %zu\n", pszDesc, pHdr->u.Fields.cbPdu, cbRead);
+        return ERR_INVALID_STATE;
+    }
+
+    for (size_t i = 0; i < cbRead; i++)
+    {
+        if (pbResp[i] != pThis->abSeamExp[offSeam + i])
+        {
+            printf("%-24s returned %#x at window boundary %+d, expected %#x\n", pszDesc, pbResp[i],
+                   (int)(offSeam + i) - STUB_BENCH_X86_SEAM_AREA / 2, pThis->abSeamExp[offSeam + i]);
+            return ERR_INVALID_STATE;
+        }
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Checks that a request was rejected as invalid without touching the area around the window boundary.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   pszDesc                 Description of the check.
+ * @param   enmReq                  The request ID.
+ * @param   pvReq                   The request payload.
+ * @param   cbReq                   Size of the request payload.
+ */
+static int stubBenchSeamRejectVerify(PSTUBBENCH pThis, const char *pszDesc, PSPSERIALPDURRNID enmReq,
+                                     const void *pvReq, size_t cbReq)
+{
+    PSPSERIALJOURNALENTRY Entry;
+
+    /* Invalid requests don't get a response, the journal tells how they ended. */
+    int rc = stubBenchReqSend(pThis, enmReq, pvReq, cbReq);
+    if (!rc)
+        rc = stubBenchJournalLastGet(pThis, &Entry);
+    if (rc)
+        return rc;
+
+    if (   Entry.enmReqId != enmReq
+        || Entry.cMillies == PSP_SERIAL_JOURNAL_MILLIES_PENDING
+        || Entry.rcReq != ERR_INVALID_PARAMETER)
+    {
+        printf("%-24s completed with %d, expected %d\n", pszDesc, Entry.rcReq, ERR_INVALID_PARAMETER);
+        return ERR_INVALID_STATE;
+    }
+
+    return stubBenchSeamVerify(pThis, pszDesc);
+}
+
+
+/**
+ * Checks that reads, writes and memsets straddling a 64MB x86 mapping window boundary move the right data.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ */
+static int stubBenchCheckX86Seam(PSTUBBENCH pThis)
+{
+    PSPSERIALX86MEMXFERREQ *pX86Req = (PSPSERIALX86MEMXFERREQ *)&pThis->abReq[0];
+    PSPSERIALDATAXFERREQ *pDataReq = (PSPSERIALDATAXFERREQ *)&pThis->abReq[0];
+    X86PADDR PhysX86Area = STUB_BENCH_X86_SEAM - STUB_BENCH_X86_SEAM_AREA / 2;
+    PCPSPSERIALPDUHDR pHdr = NULL;
+
+    stubBenchPatternFill(&pThis->abSeamExp[0], sizeof(pThis->abSeamExp), 1);
+    int rc = pspStubHostX86MemWrite(PhysX86Area, &pThis->abSeamExp[0], sizeof(pThis->abSeamExp));
+    if (rc)
+        return rc;
+
+    /* Unaligned read of everything but the first and last byte. */
+    pX86Req->PhysX86Start = PhysX86Area + 1;
+    pX86Req->cbXfer       = STUB_BENCH_X86_SEAM_AREA - 2;
+    pX86Req->u32Pad0      = 0;
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ, PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ,
+                      pX86Req, sizeof(*pX86Req), &pHdr);
+    if (!rc)
+        rc = stubBenchSeamRespVerify(pThis, "x86 read across windows", pHdr, 1, STUB_BENCH_X86_SEAM_AREA - 2);
+    if (rc)
+        return rc;
+
+    /* Unaligned write not centered on the boundary. */
+    pX86Req->PhysX86Start = STUB_BENCH_X86_SEAM - 701;
+    pX86Req->cbXfer       = 1500;
+    stubBenchPatternFill(pX86Req + 1, pX86Req->cbXfer, 2);
+    memcpy(&pThis->abSeamExp[STUB_BENCH_X86_SEAM_AREA / 2 - 701], pX86Req + 1, pX86Req->cbXfer);
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE, PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_WRITE,
+                      pX86Req, sizeof(*pX86Req) + pX86Req->cbXfer, NULL /*ppHdr*/);
+    if (!rc)
+        rc = stubBenchSeamVerify(pThis, "x86 write across windows");
+    if (rc)
+        return rc;
+
+    /* The payload lacks the last 4 bytes of the data, the request must not be executed at all. */
+    pX86Req->PhysX86Start = STUB_BENCH_X86_SEAM - 16;
+    pX86Req->cbXfer       = 64;
+    stubBenchPatternFill(pX86Req + 1, pX86Req->cbXfer, 3);
+    rc = stubBenchSeamRejectVerify(pThis, "x86 short write", PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE,
+                                   pX86Req, sizeof(*pX86Req) + pX86Req->cbXfer - 4);
+    if (rc)
+        return rc;
+
+    memset(pDataReq, 0, sizeof(*pDataReq));
+    pDataReq->enmAddrSpace           = PSPADDRSPACE_X86_MEM;
+    pDataReq->fFlags                 = PSP_SERIAL_DATA_XFER_F_READ | PSP_SERIAL_DATA_XFER_F_INCR_ADDR;
+    pDataReq->cbStride               = 4;
+    pDataReq->cbXfer                 = STUB_BENCH_X86_SEAM_AREA;
+    pDataReq->u.X86.PhysX86AddrStart = PhysX86Area;
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER, PSPSERIALPDURRNID_RESPONSE_PSP_DATA_XFER,
+                      pDataReq, sizeof(*pDataReq), &pHdr);
+    if (!rc)
+        rc = stubBenchSeamRespVerify(pThis, "DataXfer read", pHdr, 0, STUB_BENCH_X86_SEAM_AREA);
+    if (rc)
+        return rc;
+
+    pDataReq->fFlags                 = PSP_SERIAL_DATA_XFER_F_WRITE | PSP_SERIAL_DATA_XFER_F_INCR_ADDR;
+    pDataReq->cbXfer                 = _1K;
+    pDataReq->u.X86.PhysX86AddrStart = STUB_BENCH_X86_SEAM - 260;
+    stubBenchPatternFill(pDataReq + 1, pDataReq->cbXfer, 4);
+    memcpy(&pThis->abSeamExp[STUB_BENCH_X86_SEAM_AREA / 2 - 260], pDataReq + 1, pDataReq->cbXfer);
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER, PSPSERIALPDURRNID_RESPONSE_PSP_DATA_XFER,
+                      pDataReq, sizeof(*pDataReq) + pDataReq->cbXfer, NULL /*ppHdr*/);
+    if (!rc)
+        rc = stubBenchSeamVerify(pThis, "DataXfer write");
+    if (rc)
+        return rc;
+
+    pDataReq->fFlags                 = PSP_SERIAL_DATA_XFER_F_MEMSET | PSP_SERIAL_DATA_XFER_F_INCR_ADDR;
+    pDataReq->cbXfer                 = 256;
+    pDataReq->u.X86.PhysX86AddrStart = STUB_BENCH_X86_SEAM - 128;
+    stubBenchPatternFill(pDataReq + 1, pDataReq->cbStride, 5);
+    for (uint32_t i = 0; i < pDataReq->cbXfer; i++)
+        pThis->abSeamExp[STUB_BENCH_X86_SEAM_AREA / 2 - 128 + i] = ((const uint8_t *)(pDataReq + 1))[i % pDataReq->cbStride];
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER, PSPSERIALPDURRNID_RESPONSE_PSP_DATA_XFER,
+                      pDataReq, sizeof(*pDataReq) + pDataReq->cbStride, NULL /*ppHdr*/);
+    if (!rc)
+        rc = stubBenchSeamVerify(pThis, "DataXfer memset");
+    if (rc)
+        return rc;
+
+    pDataReq->fFlags                 = PSP_SERIAL_DATA_XFER_F_WRITE | PSP_SERIAL_DATA_XFER_F_INCR_ADDR;
+    pDataReq->cbXfer                 = 64;
+    pDataReq->u.X86.PhysX86AddrStart = STUB_BENCH_X86_SEAM - 32;
+    stubBenchPatternFill(pDataReq + 1, pDataReq->cbXfer, 6);
+    rc = stubBenchSeamRejectVerify(pThis, "DataXfer short write", PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER,
+                                   pDataReq, sizeof(*pDataReq) + pDataReq->cbXfer - pDataReq->cbStride);
+    if (rc)
+        return rc;
+
+    pDataReq->fFlags = PSP_SERIAL_DATA_XFER_F_MEMSET | PSP_SERIAL_DATA_XFER_F_INCR_ADDR;
+    rc = stubBenchSeamRejectVerify(pThis, "DataXfer short memset", PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER,
+                                   pDataReq, sizeof(*pDataReq) + pDataReq->cbStride - 1);
+    if (!rc)
+        printf("%-24s data matches across window boundaries, short writes rejected\n", "x86 window checks");
+
+    return rc;
+}
+
+
+/**
+ * Compares data returned by the stub with the expected content.
+ *
+ * @returns Status code.
+ * @param   pszDesc                 Description of the check.
+ * @param   pvAct                   The data returned by the stub.
+ * @param   pvExp                   The expected data.
+ * @param   cb                      Number of bytes to compare.
+ * @param   offData                 Offset of the data from the start of the read, for reporting.
+ */
+static int stubBenchDataVerify(const char *pszDesc, const void *pvAct, const void *pvExp, size_t cb, uint64_t offData)
+{
+    const uint8_t *pbAct = (const uint8_t *)pvAct;
+    const uint8_t *pbExp = (const uint8_t *)pvExp;
+
+    for (size_t i = 0; i < cb; i++)
+    {
+        if (pbAct[i] != pbExp[i])
+        {
+            printf("%-24s returned %#x at offset %#llx, expected %#x\n", pszDesc, pbAct[i],
+                   (unsigned long long)(offData + i), pbExp[i]);
+            return ERR_INVALID_STATE;
+        }
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Checks that reads queued back to back are answered in order with the right data, which needs
+ * more transmit buffers than the stub has.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ */
+static int stubBenchCheckTxQueue(PSTUBBENCH pThis)
+{
+    size_t cbRead = STUB_BENCH_X86_STRIPED_SZ / STUB_BENCH_QUEUED_READS;
+    PSPSERIALX86MEMXFERREQ Req;
+
+    stubBenchPatternFill(&pThis->abX86[0], sizeof(pThis->abX86), 7);
+    int rc = pspStubHostX86MemWrite(STUB_BENCH_X86_QUEUED, &pThis->abX86[0], sizeof(pThis->abX86));
+    if (rc)
+        return rc;
+
+    /* Issue all reads in reverse address order before collecting any response. */
+    Req.cbXfer  = cbRead;
+    Req.u32Pad0 = 0;
+    for (uint32_t i = 0; i < STUB_BENCH_QUEUED_READS && !rc; i++)
+    {
+        Req.PhysX86Start = STUB_BENCH_X86_QUEUED + (STUB_BENCH_QUEUED_READS - 1 - i) * cbRead;
+        rc = stubBenchReqSend(pThis, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ, &Req, sizeof(Req));
+    }
+
+    for (uint32_t i = 0; i < STUB_BENCH_QUEUED_READS && !rc; i++)
+    {
+        PCPSPSERIALPDUHDR pHdr = NULL;
+        size_t offRead = (STUB_BENCH_QUEUED_READS - 1 - i) * cbRead;
+
+        rc = stubBenchRespWait(pThis, PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ, &pHdr);
+        if (!rc)
+            rc = pHdr->u.Fields.rcReq;
+        if (   !rc
+            && pHdr->u.Fields.cbPdu != cbRead)
+        {
+            printf("%-24s response %u has %u bytes, expected %zu\n", "Queued reads", i, pHdr->u.Fields.cbPdu, cbRead);
+            rc = ERR_INVALID_STATE;
+        }
+        if (!rc)
+            rc = stubBenchDataVerify("Queued reads", pHdr + 1, &pThis->abX86[offRead], cbRead, offRead);
+    }
+
+    return rc;
+}
+
+
+/**
+ * Checks that a striped read delivers every chunk exactly once and in order over the single loopback link.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ */
+static int stubBenchCheckStripedRead(PSTUBBENCH pThis)
+{
+    uint64_t tsNsDeadline = stubBenchNanoTs() + STUB_BENCH_TIMEOUT_MS * 1000000ULL;
+    PSPSERIALSTRIPEDREADREQ Req;
+    uint64_t offNext = 0;
+
+    stubBenchPatternFill(&pThis->abX86[0], sizeof(pThis->abX86), 8);
+    int rc = pspStubHostX86MemWrite(STUB_BENCH_X86_STRIPED, &pThis->abX86[0], sizeof(pThis->abX86));
+    if (rc)
+        return rc;
+
+    memset(&Req, 0, sizeof(Req));
+    Req.enmAddrSpace       = PSPADDRSPACE_X86_MEM;
+    Req.cbChunk            = 0;
+    Req.u.PhysX86AddrStart = STUB_BENCH_X86_STRIPED;
+    Req.cbRead             = STUB_BENCH_X86_STRIPED_SZ;
+    rc = stubBenchReqSend(pThis, PSPSERIALPDURRNID_REQUEST_STRIPED_READ, &Req, sizeof(Req));
+    while (!rc)
+    {
+        PCPSPSERIALPDUHDR pHdr = NULL;
+        rc = stubBenchPduRecv(pThis, tsNsDeadline, &pHdr);
+        if (rc)
+            break;
+
+        if (pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_NOTIFICATION_STRIPED_READ_DATA)
+        {
+            PCPSPSERIALSTRIPEDREADDATANOT pNot = (PCPSPSERIALSTRIPEDREADDATANOT)(pHdr + 1);
+            if (   pHdr->u.Fields.cbPdu < sizeof(*pNot)
+                || pHdr->u.Fields.cbPdu - sizeof(*pNot) != pNot->cbChunk
+                || pNot->offChunk != offNext
+                || pNot->cbChunk > STUB_BENCH_X86_STRIPED_SZ - offNext
+                || pNot->idLink != 0)
+            {
+                printf("%-24s got chunk at %#llx with %u bytes on link %u, expected offset %#llx\n", "Striped read",
+                       (unsigned long long)pNot->offChunk, pNot->cbChunk, pNot->idLink, (unsigned long long)offNext);
+                rc = ERR_INVALID_STATE;
+                break;
+            }
+
+            rc = stubBenchDataVerify("Striped read", pNot + 1, &pThis->abX86[offNext], pNot->cbChunk, offNext);
+            offNext += pNot->cbChunk;
+        }
+        else if (pHdr->u.Fields.enmRrnId == PSPSERIALPDURRNID_RESPONSE_STRIPED_READ)
+        {
+            PCPSPSERIALSTRIPEDREADRESP pResp = (PCPSPSERIALSTRIPEDREADRESP)(pHdr + 1);
+            PCPSPSERIALSTRIPEDREADLINK paLinks = (PCPSPSERIALSTRIPEDREADLINK)(pResp + 1);
+            uint64_t cbSent = 0;
+
+            rc = pHdr->u.Fields.rcReq;
+            if (   !rc
+                && (   pHdr->u.Fields.cbPdu < sizeof(*pResp)
+                    || pHdr->u.Fields.cbPdu != sizeof(*pResp) + pResp->cLinks * sizeof(*paLinks)))
+                rc = ERR_INVALID_STATE;
+            for (uint32_t i = 0; i < pResp->cLinks && !rc; i++)
+                cbSent += paLinks[i].cbSent;
+            if (   !rc
+                && (   pResp->cbRead != STUB_BENCH_X86_STRIPED_SZ
+                    || offNext != STUB_BENCH_X86_STRIPED_SZ
+                    || cbSent != STUB_BENCH_X86_STRIPED_SZ))
+            {
+                printf("%-24s completed with %llu bytes read, %llu sent and %llu received, expected %u\n", "Striped read",
+                       (unsigned long long)pResp->cbRead, (unsigned long long)cbSent, (unsigned long long)offNext,
+                       STUB_BENCH_X86_STRIPED_SZ);
+                rc = ERR_INVALID_STATE;
+            }
+            break;
+        }
+        /* else: Log message or another notification, skip. */
+    }
+
+    return rc;
+}
+
+
+/**
+ * Checks the bitmap and the data returned by a sparse read straddling the window boundary.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   fProbeOnly              Flag whether to only probe the pages.
+ */
+static int stubBenchCheckSparseRead(PSTUBBENCH pThis, bool fProbeOnly)
+{
+    const uint32_t cbPage = 256;
+    const uint32_t cPages = STUB_BENCH_X86_SEAM_AREA / cbPage;
+    PSPSERIALSPARSEREADREQ Req;
+    PCPSPSERIALPDUHDR pHdr = NULL;
+
+    Req.enmAddrSpace       = PSPADDRSPACE_X86_MEM;
+    Req.fFlags             = fProbeOnly ? PSP_SERIAL_SPARSE_READ_F_PROBE_ONLY : 0;
+    Req.cbPage             = cbPage;
+    Req.cPages             = cPages;
+    Req.u.PhysX86AddrStart = STUB_BENCH_X86_SEAM - STUB_BENCH_X86_SEAM_AREA / 2;
+    int rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_SPARSE_READ, PSPSERIALPDURRNID_RESPONSE_SPARSE_READ,
+                          &Req, sizeof(Req), &pHdr);
+    if (rc)
+        return rc;
+
+    /* The simulated address space never faults, so every page is readable. */
+    PCPSPSERIALSPARSEREADRESP pResp = (PCPSPSERIALSPARSEREADRESP)(pHdr + 1);
+    const uint32_t *pau32Bitmap = (const uint32_t *)(pResp + 1);
+    size_t cbResp = sizeof(*pResp) + sizeof(uint32_t) + (fProbeOnly ? 0 : STUB_BENCH_X86_SEAM_AREA);
+    if (   pHdr->u.Fields.cbPdu != cbResp
+        || pResp->cPages != cPages
+        || pResp->cPagesReadable != cPages
+        || pau32Bitmap[0] != (uint32_t)(BIT(cPages) - 1))
+    {
+        printf("%-24s returned %u of %u pages readable with bitmap %#x in %u bytes\n", "Sparse read",
+               pResp->cPagesReadable, pResp->cPages, pau32Bitmap[0], pHdr->u.Fields.cbPdu);
+        return ERR_INVALID_STATE;
+    }
+
+    if (fProbeOnly)
+        return INF_SUCCESS;
+
+    return stubBenchDataVerify("Sparse read", pau32Bitmap + 1, &pThis->abSeamExp[0], STUB_BENCH_X86_SEAM_AREA, 0);
+}
+
+
+/**
+ * Checks the journal entries recorded for a small and a large write and that reads are not recorded.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ */
+static int stubBenchCheckJournal(PSTUBBENCH pThis)
+{
+    uint8_t abReq[sizeof(PSPSERIALX86MEMXFERREQ) + 64];
+    PSPSERIALPSPMEMXFERREQ *pPspReq = (PSPSERIALPSPMEMXFERREQ *)&abReq[0];
+    PSPSERIALX86MEMXFERREQ *pX86Req = (PSPSERIALX86MEMXFERREQ *)&abReq[0];
+    PSPSERIALJOURNALENTRY EntryFirst;
+    uint32_t u32Val = 0xc0ffee42;
+
+    int rc = stubBenchJournalLastGet(pThis, &EntryFirst);
+    if (rc)
+        return rc;
+
+    /* Small values are recorded directly. */
+    pPspReq->PspAddrStart = 0x20000;
+    pPspReq->cbXfer       = sizeof(u32Val);
+    memcpy(pPspReq + 1, &u32Val, sizeof(u32Val));
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE, PSPSERIALPDURRNID_RESPONSE_PSP_MEM_WRITE,
+                      pPspReq, sizeof(*pPspReq) + sizeof(u32Val), NULL /*ppHdr*/);
+    if (rc)
+        return rc;
+
+    /* Larger ones by the hash of the request header and the PDU checksum. */
+    pX86Req->PhysX86Start = STUB_BENCH_X86_QUEUED;
+    pX86Req->cbXfer       = sizeof(abReq) - sizeof(*pX86Req);
+    pX86Req->u32Pad0      = 0;
+    stubBenchPatternFill(pX86Req + 1, pX86Req->cbXfer, 9);
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE, PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_WRITE,
+                      pX86Req, sizeof(abReq), NULL /*ppHdr*/);
+    if (rc)
+        return rc;
+
+    uint32_t uHash = 0x811c9dc5;
+    for (size_t i = 0; i < sizeof(*pX86Req); i++)
+        uHash = (uHash ^ abReq[i]) * 0x01000193;
+    for (uint32_t i = 0; i < sizeof(pThis->u32ChkSumLast); i++)
+        uHash = (uHash ^ ((pThis->u32ChkSumLast >> (i * 8)) & 0xff)) * 0x01000193;
+
+    /* Not recorded. */
+    pX86Req->cbXfer = 16;
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ, PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ,
+                      pX86Req, sizeof(*pX86Req), NULL /*ppHdr*/);
+    if (rc)
+        return rc;
+
+    PSPSERIALJOURNALREADREQ Req;
+    PCPSPSERIALPDUHDR pHdr = NULL;
+    Req.cEntriesMax = 2;
+    Req.u32Pad0     = 0;
+    rc = stubBenchReq(pThis, PSPSERIALPDURRNID_REQUEST_JOURNAL_READ, PSPSERIALPDURRNID_RESPONSE_JOURNAL_READ,
+                      &Req, sizeof(Req), &pHdr);
+    if (rc)
+        return rc;
+
+    PCPSPSERIALJOURNALREADRESP pResp = (PCPSPSERIALJOURNALREADRESP)(pHdr + 1);
+    PCPSPSERIALJOURNALENTRY paEntries = (PCPSPSERIALJOURNALENTRY)(pResp + 1);
+    if (   pHdr->u.Fields.cbPdu != sizeof(*pResp) + 2 * sizeof(*paEntries)
+        || pResp->cEntries != 2
+        || pResp->cEntriesTotal != EntryFirst.uSeq + 2)
+    {
+        printf("%-24s returned %u entries of %u, expected 2 of %u\n", "Journal", pResp->cEntries, pResp->cEntriesTotal,
+               EntryFirst.uSeq + 2);
+        return ERR_INVALID_STATE;
+    }
+
+    /* Oldest first. */
+    PCPSPSERIALJOURNALENTRY pEntry = &paEntries[0];
+    if (   pEntry->uSeq != EntryFirst.uSeq + 1
+        || pEntry->enmReqId != PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE
+        || pEntry->enmAddrSpace != PSPADDRSPACE_PSP_MEM
+        || pEntry->u64Addr != 0x20000
+        || pEntry->cb != sizeof(u32Val)
+        || pEntry->u32ValOrHash != u32Val
+        || pEntry->rcReq != INF_SUCCESS
+        || pEntry->cMillies == PSP_SERIAL_JOURNAL_MILLIES_PENDING)
+        rc = ERR_INVALID_STATE;
+
+    if (!rc)
+    {
+        pEntry = &paEntries[1];
+        if (   pEntry->uSeq != EntryFirst.uSeq + 2
+            || pEntry->enmReqId != PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE
+            || pEntry->enmAddrSpace != PSPADDRSPACE_X86_MEM
+            || pEntry->u64Addr != STUB_BENCH_X86_QUEUED
+            || pEntry->cb != sizeof(abReq) - sizeof(*pX86Req)
+            || pEntry->u32ValOrHash != uHash
+            || pEntry->rcReq != INF_SUCCESS
+            || pEntry->cMillies == PSP_SERIAL_JOURNAL_MILLIES_PENDING
+            || pEntry->tsMillies < paEntries[0].tsMillies)
+            rc = ERR_INVALID_STATE;
+    }
+
+    if (rc)
+        printf("%-24s entry %u: request %#x space %u addr %#llx cb %u val %#x rc %d after %u ms\n", "Journal",
+               pEntry->uSeq, pEntry->enmReqId, pEntry->enmAddrSpace, (unsigned long long)pEntry->u64Addr, pEntry->cb,
+               pEntry->u32ValOrHash, pEntry->rcReq, pEntry->cMillies);
+    return rc;
+}
+
+
+/**
+ * Runs all behavior checks.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ */
+static int stubBenchCheck(PSTUBBENCH pThis)
+{
+    int rc = stubBenchCheckX86Seam(pThis);
+    if (!rc)
+        rc = stubBenchCheckTxQueue(pThis);
+    if (!rc)
+        rc = stubBenchCheckStripedRead(pThis);
+    if (!rc)
+        rc = stubBenchCheckSparseRead(pThis, false /*fProbeOnly*/);
+    if (!rc)
+        rc = stubBenchCheckSparseRead(pThis, true /*fProbeOnly*/);
+    if (!rc)
+        rc = stubBenchCheckJournal(pThis);
+    if (!rc)
+        printf("%-24s queued, striped and sparse reads and the journal match\n", "Core checks");
+
+    return rc;
+}
+
+
+/**
+ * Issues the given request repeatedly and reports latency and throughput.
+ *
+ * @returns Status code.
+ * @param   pThis                   The benchmark state.
+ * @param   pszDesc                 Description of the benchmark.
+ * @param   enmReq                  The request ID.
+ * @param   enmResp                 The expected response ID.
+ * @param   pvReq                   The request payload.
+ * @param   cbReq                   Size of the request payload.
+ * @param   cbXfer                  Number of payload bytes transferred by each request.
+ * @param   cIterations             How often to issue the request.
+ */
+static int stubBenchRun(PSTUBBENCH pThis, const char *pszDesc, PSPSERIALPDURRNID enmReq, PSPSERIALPDURRNID enmResp,
+                        const void *pvReq, size_t cbReq, size_t cbXfer, uint32_t cIterations)
+{
+    uint64_t cNsMin = UINT64_MAX;
+    uint64_t cNsMax = 0;
+    uint64_t tsNsStart = stubBenchNanoTs();
+
+    for (uint32_t i = 0; i < cIterations; i++)
+    {
+        PCPSPSERIALPDUHDR pHdr = NULL;
+        uint64_t tsNsReq = stubBenchNanoTs();
+
+        int rc = stubBenchReqSend(pThis, enmReq, pvReq, cbReq);
+        if (!rc)
+            rc = stubBenchRespWait(pThis, enmResp, &pHdr);
+        if (!rc && pHdr->u.Fields.rcReq)
+            rc = pHdr->u.Fields.rcReq;
+        if (rc)
+        {
+            printf("%-24s failed with %d after %u requests\n", pszDesc, rc, i);
+            return rc;
+        }
+
+        uint64_t cNs = stubBenchNanoTs() - tsNsReq;
+        cNsMin = MIN(cNsMin, cNs);
+        cNsMax = MAX(cNsMax, cNs);
+    }
+
+    uint64_t cNsTotal = stubBenchNanoTs() - tsNsStart;
+    printf("%-24s %6zu bytes: avg %8.2fus min %8.2fus max %8.2fus %10.2f MB/s\n",
+           pszDesc, cbXfer, (double)cNsTotal / cIterations / 1000.0, cNsMin / 1000.0, cNsMax / 1000.0,
+           cbXfer ? (double)cbXfer * cIterations / ((double)cNsTotal / 1000000000.0) / (1024.0 * 1024.0) : 0.0);
+    return INF_SUCCESS;
+}
+
+
+/**
+ * The stub core thread.
+ */
+static void *stubBenchStubThread(void *pvUser)
+{
+    int rc = pspSerialStubHostMain();
+    fprintf(stderr, "stub-bench: The stub core exited with %d\n", rc);
+    return NULL;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static STUBBENCH s_Bench;
+    PSTUBBENCH pThis = &s_Bench;
+    uint32_t cIterations = STUB_BENCH_ITERATIONS_DEFAULT;
+    pthread_t hThreadStub;
+
+    if (argc > 1)
+        cIterations = strtoul(argv[1], NULL, 0);
+    if (!cIterations)
+    {
+        fprintf(stderr, "Usage: %s [iterations]\n", argv[0]);
+        return 1;
+    }
+
+    if (pthread_create(&hThreadStub, NULL, stubBenchStubThread, NULL))
+    {
+        fprintf(stderr, "stub-bench: Failed to start the stub core\n");
+        return 1;
+    }
+
+    int rc = stubBenchConnect(pThis);
+    if (rc)
+    {
+        fprintf(stderr, "stub-bench: Connecting to the stub failed with %d\n", rc);
+        return 1;
+    }
+
+    rc = stubBenchCheck(pThis);
+    if (rc)
+    {
+        fprintf(stderr, "stub-bench: Checking the stub behavior failed with %d\n", rc);
+        return 1;
+    }
+
+    for (size_t cbXfer = 4; cbXfer <= STUB_BENCH_XFER_MAX && !rc; cbXfer *= 8)
+    {
+        PSPSERIALPSPMEMXFERREQ PspReq;
+        PspReq.PspAddrStart = 0x10000;
+        PspReq.cbXfer       = cbXfer;
+        rc = stubBenchRun(pThis, "PSP memory read", PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ,
+                          PSPSERIALPDURRNID_RESPONSE_PSP_MEM_READ, &PspReq, sizeof(PspReq), cbXfer, cIterations);
+        if (rc)
+            break;
+
+        PSPSERIALX86MEMXFERREQ X86Req;
+        X86Req.PhysX86Start = 0x100000000ULL;
+        X86Req.cbXfer       = cbXfer;
+        X86Req.u32Pad0      = 0;
+        rc = stubBenchRun(pThis, "x86 memory read", PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ,
+                          PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ, &X86Req, sizeof(X86Req), cbXfer, cIterations);
+        if (rc)
+            break;
+
+        /* Same size straddling the end of a 64MB window, walking two mapping slots. */
+        X86Req.PhysX86Start = 0x100000000ULL + _64M - cbXfer / 2 - 1;
+        rc = stubBenchRun(pThis, "x86 read across windows", PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_READ,
+                          PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ, &X86Req, sizeof(X86Req), cbXfer, cIterations);
+        if (rc)
+            break;
+
+        PSPSERIALSMNMEMXFERREQ SmnReq;
+        SmnReq.SmnAddrStart = 0x02dc4000;
+        SmnReq.cbXfer       = MIN(cbXfer, 4);
+        rc = stubBenchRun(pThis, "SMN read", PSPSERIALPDURRNID_REQUEST_PSP_SMN_READ,
+                          PSPSERIALPDURRNID_RESPONSE_PSP_SMN_READ, &SmnReq, sizeof(SmnReq), SmnReq.cbXfer, cIterations);
+    }
+
+    return rc ? 1 : 0;
+}
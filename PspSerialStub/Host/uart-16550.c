@@ -0,0 +1,428 @@
+/** @file
+ * PSP serial stub host build - 16550 UART model.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <x86/uart.h>
+
+#include <types.h>
+#include <cdefs.h>
+#include <err.h>
+#include <string.h>
+
+#include "uart-16550.h"
+
+
+/** Modem status register offset. */
+#define UART16550_REG_MSR_OFF           6
+/** Scratch register offset. */
+#define UART16550_REG_SCR_OFF           7
+/** FIFO control register: enable the FIFOs. */
+#define UART16550_FCR_FIFO_EN           0x01
+/** FIFO control register: reset the receive FIFO. */
+#define UART16550_FCR_RX_FIFO_RST       0x02
+/** FIFO control register: reset the transmit FIFO. */
+#define UART16550_FCR_TX_FIFO_RST       0x04
+/** FIFO control register: receive trigger level shift. */
+#define UART16550_FCR_RX_TRIG_SHIFT     6
+/** Interrupt identification register: FIFOs enabled. */
+#define UART16550_IIR_FIFO_EN           0xc0
+/** Interrupt identification register: no interrupt pending. */
+#define UART16550_IIR_NO_INT            0x01
+/** Interrupt identification register: transmitter holding register empty. */
+#define UART16550_IIR_ID_THRE           0x02
+/** Interrupt identification register: received data available. */
+#define UART16550_IIR_ID_RDA            0x04
+/** Interrupt identification register: receiver line status. */
+#define UART16550_IIR_ID_RLS            0x06
+/** Interrupt identification register: character timeout. */
+#define UART16550_IIR_ID_CTI            0x0c
+/** Line status register: overrun error. */
+#define UART16550_LSR_OE                0x02
+/** Line status register: transmitter (holding and shift register) empty. */
+#define UART16550_LSR_TEMT              0x40
+/** Modem status register value reported: CTS, DSR and DCD asserted. */
+#define UART16550_MSR_DEFAULT           0xb0
+/** Number of bits a character occupies on the line (start bit, 8 data bits, stop bit). */
+#define UART16550_CHAR_BITS             10
+/** Number of character times without receive FIFO activity raising the character timeout. */
+#define UART16550_CTI_CHARS             4
+
+
+/**
+ * Returns the depth of the FIFOs currently in effect.
+ *
+ * @returns FIFO depth in bytes.
+ * @param   pUart                   The model instance.
+ */
+static inline uint32_t pspHostUart16550FifoDepth(PPSPHOSTUART16550 pUart)
+{
+    return pUart->fFifo ? pUart->Cfg.cbFifo : 1;
+}
+
+
+uint64_t pspHostUart16550CharTimeGet(PPSPHOSTUART16550 pUart)
+{
+    if (!pUart->uDivisor)
+        return 0;
+
+    return (UART16550_CHAR_BITS * 16ULL * pUart->uDivisor * 1000000000ULL) / pUart->Cfg.uClkHz;
+}
+
+
+/**
+ * Loads the next character from the transmit FIFO into the shift register.
+ *
+ * @returns nothing.
+ * @param   pUart                   The model instance.
+ * @param   nsStart                 Time the character starts going out.
+ */
+static void pspHostUart16550TsrLoad(PPSPHOSTUART16550 pUart, uint64_t nsStart)
+{
+    pUart->bTsr      = pUart->abTxFifo[pUart->offTxFifo];
+    pUart->offTxFifo = (pUart->offTxFifo + 1) % PSP_HOST_UART16550_FIFO_MAX;
+    pUart->cTxFifo--;
+    pUart->fTsrBusy  = true;
+    pUart->nsTsrDone = nsStart + pspHostUart16550CharTimeGet(pUart);
+    if (!pUart->cTxFifo)
+        pUart->fThrePending = true;
+}
+
+
+/**
+ * Brings the line up to the current simulated time.
+ *
+ * @returns nothing.
+ * @param   pUart                   The model instance.
+ */
+static void pspHostUart16550Sync(PPSPHOSTUART16550 pUart)
+{
+    uint64_t nsChar = pspHostUart16550CharTimeGet(pUart);
+    if (!nsChar)
+        return; /* The line is dead without a divisor. */
+
+    /* Transmitter. */
+    while (   pUart->fTsrBusy
+           && pUart->nsTsrDone <= pUart->nsNow)
+    {
+        if (pUart->offLineTxWrite - pUart->offLineTxRead < sizeof(pUart->abLineTx))
+            pUart->abLineTx[pUart->offLineTxWrite++ % sizeof(pUart->abLineTx)] = pUart->bTsr;
+        pUart->cbTx++;
+
+        if (pUart->cTxFifo)
+            pspHostUart16550TsrLoad(pUart, pUart->nsTsrDone);
+        else
+            pUart->fTsrBusy = false;
+    }
+
+    /* Receiver. */
+    while (   pUart->offLineRxRead != pUart->offLineRxWrite
+           && pUart->nsRxNext <= pUart->nsNow)
+    {
+        uint8_t bRx = pUart->abLineRx[pUart->offLineRxRead++ % sizeof(pUart->abLineRx)];
+        if (pUart->cRxFifo < pspHostUart16550FifoDepth(pUart))
+        {
+            pUart->abRxFifo[(pUart->offRxFifo + pUart->cRxFifo) % PSP_HOST_UART16550_FIFO_MAX] = bRx;
+            pUart->cRxFifo++;
+            pUart->cbRx++;
+        }
+        else
+        {
+            pUart->fOverrun = true;
+            pUart->cbRxLost++;
+        }
+
+        pUart->nsRxLast  = pUart->nsRxNext;
+        pUart->nsRxNext += nsChar;
+    }
+}
+
+
+/**
+ * Returns the interrupt identification register value.
+ *
+ * @returns IIR value.
+ * @param   pUart                   The model instance.
+ */
+static uint8_t pspHostUart16550IirGet(PPSPHOSTUART16550 pUart)
+{
+    uint8_t uIir = pUart->fFifo ? UART16550_IIR_FIFO_EN : 0;
+
+    if (   (pUart->uIer & UART16550_IER_ELSI)
+        && pUart->fOverrun)
+        return uIir | UART16550_IIR_ID_RLS;
+
+    if (pUart->uIer & UART16550_IER_ERBFI)
+    {
+        if (pUart->cRxFifo >= (pUart->fFifo ? pUart->cbRxTrig : 1))
+            return uIir | UART16550_IIR_ID_RDA;
+        if (   pUart->fFifo
+            && pUart->cRxFifo
+            && pUart->nsNow - pUart->nsRxLast >= UART16550_CTI_CHARS * pspHostUart16550CharTimeGet(pUart))
+            return uIir | UART16550_IIR_ID_CTI;
+    }
+
+    if (   (pUart->uIer & UART16550_IER_ETBEI)
+        && pUart->fThrePending)
+    {
+        pUart->fThrePending = false; /* Reading IIR acknowledges the interrupt. */
+        return uIir | UART16550_IIR_ID_THRE;
+    }
+
+    return uIir | UART16550_IIR_NO_INT;
+}
+
+
+/**
+ * Returns the line status register value.
+ *
+ * @returns LSR value.
+ * @param   pUart                   The model instance.
+ */
+static uint8_t pspHostUart16550LsrGet(PPSPHOSTUART16550 pUart)
+{
+    uint8_t uLsr = 0;
+
+    if (pUart->cRxFifo)
+        uLsr |= X86_UART_REG_LSR_DR;
+    if (pUart->fOverrun)
+        uLsr |= UART16550_LSR_OE;
+    if (!pUart->cTxFifo)
+    {
+        uLsr |= X86_UART_REG_LSR_THRE;
+        if (!pUart->fTsrBusy)
+            uLsr |= UART16550_LSR_TEMT;
+    }
+
+    pUart->fOverrun = false; /* Cleared by reading. */
+    return uLsr;
+}
+
+
+/**
+ * Handles a write to the FIFO control register.
+ *
+ * @returns nothing.
+ * @param   pUart                   The model instance.
+ * @param   uFcr                    The value written.
+ */
+static void pspHostUart16550FcrWrite(PPSPHOSTUART16550 pUart, uint8_t uFcr)
+{
+    static const uint8_t s_acbTrig[] = { 1, 4, 8, 14 };
+    bool fFifo = (uFcr & UART16550_FCR_FIFO_EN) && pUart->Cfg.cbFifo > 1;
+
+    /* Toggling the FIFO enable clears both FIFOs. */
+    if (   fFifo != pUart->fFifo
+        || (uFcr & UART16550_FCR_RX_FIFO_RST))
+    {
+        pUart->cRxFifo   = 0;
+        pUart->offRxFifo = 0;
+    }
+    if (   fFifo != pUart->fFifo
+        || (uFcr & UART16550_FCR_TX_FIFO_RST))
+    {
+        pUart->cTxFifo   = 0;
+        pUart->offTxFifo = 0;
+    }
+
+    pUart->fFifo    = fFifo;
+    pUart->cbRxTrig = MIN(s_acbTrig[uFcr >> UART16550_FCR_RX_TRIG_SHIFT], pUart->Cfg.cbFifo);
+}
+
+
+/**
+ * Register read callback.
+ */
+static int pspHostUart16550RegRead(PCPSPIODEVIF pIfIoDev, uint32_t offReg, void *pvBuf, size_t cbRead)
+{
+    PPSPHOSTUART16550 pUart = (PPSPHOSTUART16550)pIfIoDev;
+    uint8_t *pbVal = (uint8_t *)pvBuf;
+
+    if (cbRead != 1)
+        return ERR_INVALID_STATE;
+
+    pUart->nsNow += pUart->Cfg.cNsRegAccess;
+    pUart->cRegReads++;
+    pspHostUart16550Sync(pUart);
+
+    bool fDlab = (pUart->uLcr & X86_UART_REG_LCR_DLAB) != 0;
+    switch (offReg)
+    {
+        case X86_UART_REG_RBR_OFF:
+            if (fDlab)
+                *pbVal = pUart->uDivisor & 0xff;
+            else if (pUart->cRxFifo)
+            {
+                *pbVal = pUart->abRxFifo[pUart->offRxFifo];
+                pUart->offRxFifo = (pUart->offRxFifo + 1) % PSP_HOST_UART16550_FIFO_MAX;
+                pUart->cRxFifo--;
+                pUart->nsRxLast = pUart->nsNow;
+            }
+            else
+                *pbVal = 0;
+            break;
+        case X86_UART_REG_IER_OFF:
+            *pbVal = fDlab ? pUart->uDivisor >> 8 : pUart->uIer;
+            break;
+        case X86_UART_REG_IIR_OFF:
+            *pbVal = pspHostUart16550IirGet(pUart);
+            break;
+        case X86_UART_REG_LCR_OFF:
+            *pbVal = pUart->uLcr;
+            break;
+        case X86_UART_REG_MCR_OFF:
+            *pbVal = pUart->uMcr;
+            break;
+        case X86_UART_REG_LSR_OFF:
+            *pbVal = pspHostUart16550LsrGet(pUart);
+            if (*pbVal == pUart->uLsrLast)
+                pUart->cLsrPolls++;
+            pUart->uLsrLast = *pbVal;
+            break;
+        case UART16550_REG_MSR_OFF:
+            *pbVal = UART16550_MSR_DEFAULT;
+            break;
+        case UART16550_REG_SCR_OFF:
+            *pbVal = pUart->uScr;
+            break;
+        default:
+            return ERR_INVALID_PARAMETER;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Register write callback.
+ */
+static int pspHostUart16550RegWrite(PCPSPIODEVIF pIfIoDev, uint32_t offReg, const void *pvBuf, size_t cbWrite)
+{
+    PPSPHOSTUART16550 pUart = (PPSPHOSTUART16550)pIfIoDev;
+    uint8_t uVal = *(const uint8_t *)pvBuf;
+
+    if (cbWrite != 1)
+        return ERR_INVALID_STATE;
+
+    pUart->nsNow += pUart->Cfg.cNsRegAccess;
+    pUart->cRegWrites++;
+    pspHostUart16550Sync(pUart);
+
+    bool fDlab = (pUart->uLcr & X86_UART_REG_LCR_DLAB) != 0;
+    switch (offReg)
+    {
+        case X86_UART_REG_THR_OFF:
+            if (fDlab)
+                pUart->uDivisor = (pUart->uDivisor & 0xff00) | uVal;
+            else if (pUart->cTxFifo < pspHostUart16550FifoDepth(pUart))
+            {
+                pUart->abTxFifo[(pUart->offTxFifo + pUart->cTxFifo) % PSP_HOST_UART16550_FIFO_MAX] = uVal;
+                pUart->cTxFifo++;
+                pUart->fThrePending = false;
+                if (!pUart->fTsrBusy)
+                    pspHostUart16550TsrLoad(pUart, pUart->nsNow);
+            }
+            else
+                pUart->cbTxLost++;
+            break;
+        case X86_UART_REG_IER_OFF:
+            if (fDlab)
+                pUart->uDivisor = (pUart->uDivisor & 0x00ff) | ((uint16_t)uVal << 8);
+            else
+            {
+                /* Enabling the THRE interrupt with an empty holding register raises it right away. */
+                if (   !(pUart->uIer & UART16550_IER_ETBEI)
+                    && (uVal & UART16550_IER_ETBEI)
+                    && !pUart->cTxFifo)
+                    pUart->fThrePending = true;
+                pUart->uIer = uVal & 0x0f;
+            }
+            break;
+        case X86_UART_REG_FCR_OFF:
+            pspHostUart16550FcrWrite(pUart, uVal);
+            break;
+        case X86_UART_REG_LCR_OFF:
+            pUart->uLcr = uVal;
+            break;
+        case X86_UART_REG_MCR_OFF:
+            pUart->uMcr = uVal & 0x1f;
+            break;
+        case UART16550_REG_SCR_OFF:
+            pUart->uScr = uVal;
+            break;
+        default:
+            return ERR_INVALID_PARAMETER;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+int pspHostUart16550Init(PPSPHOSTUART16550 pUart, PCPSPHOSTUART16550CFG pCfg)
+{
+    if (   !pCfg->uClkHz
+        || !pCfg->cbFifo
+        || pCfg->cbFifo > PSP_HOST_UART16550_FIFO_MAX)
+        return ERR_INVALID_PARAMETER;
+
+    memset(pUart, 0, sizeof(*pUart));
+    pUart->IfIoDev.pfnRegRead  = pspHostUart16550RegRead;
+    pUart->IfIoDev.pfnRegWrite = pspHostUart16550RegWrite;
+    pUart->Cfg                 = *pCfg;
+    pUart->cbRxTrig            = 1;
+    return INF_SUCCESS;
+}
+
+
+void pspHostUart16550TimeAdvance(PPSPHOSTUART16550 pUart, uint64_t cNs)
+{
+    pUart->nsNow += cNs;
+    pspHostUart16550Sync(pUart);
+}
+
+
+size_t pspHostUart16550PeerWrite(PPSPHOSTUART16550 pUart, const void *pvBuf, size_t cbWrite)
+{
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    size_t cbFree = sizeof(pUart->abLineRx) - (pUart->offLineRxWrite - pUart->offLineRxRead);
+    size_t cbThis = MIN(cbWrite, cbFree);
+
+    /* An idle line starts delivering with the first character written now. */
+    pspHostUart16550Sync(pUart);
+    if (pUart->offLineRxRead == pUart->offLineRxWrite)
+        pUart->nsRxNext = pUart->nsNow + pspHostUart16550CharTimeGet(pUart);
+
+    for (size_t i = 0; i < cbThis; i++)
+        pUart->abLineRx[pUart->offLineRxWrite++ % sizeof(pUart->abLineRx)] = pbBuf[i];
+
+    return cbThis;
+}
+
+
+size_t pspHostUart16550PeerRead(PPSPHOSTUART16550 pUart, void *pvBuf, size_t cbRead)
+{
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    size_t cbUsed = pUart->offLineTxWrite - pUart->offLineTxRead;
+    size_t cbThis = MIN(cbRead, cbUsed);
+
+    for (size_t i = 0; i < cbThis; i++)
+        pbBuf[i] = pUart->abLineTx[pUart->offLineTxRead++ % sizeof(pUart->abLineTx)];
+
+    return cbThis;
+}
@@ -0,0 +1,212 @@
+/** @file
+ * PSP serial stub host build - 16550 UART model.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __include_uart_16550_h
+#define __include_uart_16550_h
+
+#if defined(IN_PSP)
+# include <common/types.h>
+#else
+# error "Invalid environment"
+#endif
+
+#include <io.h>
+
+/*
+ * Models the register set of a 16550A UART behind PSPIODEVIF so Lib/src/uart.c and the UART transport
+ * run unmodified on the host. The model keeps its own simulated clock which advances by a fixed amount
+ * on every register access (the cost of an MMIO access over LPC/eSPI), characters leave and arrive at
+ * the rate given by the input clock and the divisor latch. Nothing runs in the background, the line
+ * only makes progress while the driver accesses the registers or the owner advances the clock.
+ */
+
+/** Maximum FIFO depth the model supports. */
+#define PSP_HOST_UART16550_FIFO_MAX     64
+/** Size of the buffers holding the line data in each direction (power of two). */
+#define PSP_HOST_UART16550_LINE_SZ      (64 * _1K)
+/** Interrupt enable register: received data available. */
+#define UART16550_IER_ERBFI             0x01
+/** Interrupt enable register: transmitter holding register empty. */
+#define UART16550_IER_ETBEI             0x02
+/** Interrupt enable register: receiver line status. */
+#define UART16550_IER_ELSI              0x04
+
+
+/**
+ * 16550 model configuration.
+ */
+typedef struct PSPHOSTUART16550CFG
+{
+    /** The input clock of the UART in Hz. */
+    uint32_t                    uClkHz;
+    /** Depth of the receive and transmit FIFO, 1 models a 16450 without FIFOs. */
+    uint32_t                    cbFifo;
+    /** Simulated time a single register access takes in nanoseconds. */
+    uint32_t                    cNsRegAccess;
+} PSPHOSTUART16550CFG;
+/** Pointer to a 16550 model configuration. */
+typedef PSPHOSTUART16550CFG *PPSPHOSTUART16550CFG;
+/** Pointer to a const 16550 model configuration. */
+typedef const PSPHOSTUART16550CFG *PCPSPHOSTUART16550CFG;
+
+
+/**
+ * 16550 model instance, treat as private except for the counters and the interrupt enable register.
+ */
+typedef struct PSPHOSTUART16550
+{
+    /** Device I/O interface handed to the UART driver, must come first. */
+    PSPIODEVIF                  IfIoDev;
+    /** The configuration. */
+    PSPHOSTUART16550CFG         Cfg;
+    /** Simulated time in nanoseconds. */
+    uint64_t                    nsNow;
+    /** Interrupt enable register. */
+    uint8_t                     uIer;
+    /** Line control register. */
+    uint8_t                     uLcr;
+    /** Modem control register. */
+    uint8_t                     uMcr;
+    /** Scratch register. */
+    uint8_t                     uScr;
+    /** The divisor latch. */
+    uint16_t                    uDivisor;
+    /** Receive FIFO trigger level in bytes. */
+    uint8_t                     cbRxTrig;
+    /** Flag whether the FIFOs are enabled. */
+    bool                        fFifo;
+    /** Flag whether an overrun happened since the line status register was read last. */
+    bool                        fOverrun;
+    /** Flag whether the transmitter holding register empty interrupt is pending. */
+    bool                        fThrePending;
+    /** Flag whether the transmitter shift register holds a character. */
+    bool                        fTsrBusy;
+    /** The character in the transmitter shift register. */
+    uint8_t                     bTsr;
+    /** Value returned by the previous line status register read. */
+    uint8_t                     uLsrLast;
+    /** Time the character in the transmitter shift register is completely on the line. */
+    uint64_t                    nsTsrDone;
+    /** Time the next character from the peer is completely received. */
+    uint64_t                    nsRxNext;
+    /** Time of the last receive FIFO activity, for the character timeout. */
+    uint64_t                    nsRxLast;
+    /** Number of characters in the receive FIFO. */
+    uint32_t                    cRxFifo;
+    /** Read index into the receive FIFO. */
+    uint32_t                    offRxFifo;
+    /** Number of characters in the transmit FIFO. */
+    uint32_t                    cTxFifo;
+    /** Read index into the transmit FIFO. */
+    uint32_t                    offTxFifo;
+    /** The receive FIFO. */
+    uint8_t                     abRxFifo[PSP_HOST_UART16550_FIFO_MAX];
+    /** The transmit FIFO. */
+    uint8_t                     abTxFifo[PSP_HOST_UART16550_FIFO_MAX];
+    /** Free running offsets of the data the peer put on the line towards the UART. */
+    uint32_t                    offLineRxWrite;
+    uint32_t                    offLineRxRead;
+    /** Free running offsets of the data the UART put on the line towards the peer. */
+    uint32_t                    offLineTxWrite;
+    uint32_t                    offLineTxRead;
+    /** Line data from the peer to the UART. */
+    uint8_t                     abLineRx[PSP_HOST_UART16550_LINE_SZ];
+    /** Line data from the UART to the peer. */
+    uint8_t                     abLineTx[PSP_HOST_UART16550_LINE_SZ];
+    /** Number of register reads. */
+    uint64_t                    cRegReads;
+    /** Number of register writes. */
+    uint64_t                    cRegWrites;
+    /** Number of line status register reads returning the same as the previous one (busy polling), included in cRegReads. */
+    uint64_t                    cLsrPolls;
+    /** Number of characters transmitted. */
+    uint64_t                    cbTx;
+    /** Number of characters received into the FIFO. */
+    uint64_t                    cbRx;
+    /** Number of received characters lost because the receive FIFO was full. */
+    uint64_t                    cbRxLost;
+    /** Number of characters lost because the transmit FIFO was full when writing. */
+    uint64_t                    cbTxLost;
+} PSPHOSTUART16550;
+/** Pointer to a 16550 model instance. */
+typedef PSPHOSTUART16550 *PPSPHOSTUART16550;
+
+
+/**
+ * Initializes the given 16550 model instance, the registers are in their reset state afterwards.
+ *
+ * @returns Status code.
+ * @param   pUart                   The model instance to initialize.
+ * @param   pCfg                    The configuration to use.
+ */
+int pspHostUart16550Init(PPSPHOSTUART16550 pUart, PCPSPHOSTUART16550CFG pCfg);
+
+
+/**
+ * Advances the simulated clock, letting the line make progress.
+ *
+ * @returns nothing.
+ * @param   pUart                   The model instance.
+ * @param   cNs                     Number of nanoseconds to advance.
+ */
+void pspHostUart16550TimeAdvance(PPSPHOSTUART16550 pUart, uint64_t cNs);
+
+
+/**
+ * Returns the duration of a single character on the line with the current divisor.
+ *
+ * @returns Duration in nanoseconds, 0 if the divisor latch is not programmed.
+ * @param   pUart                   The model instance.
+ */
+uint64_t pspHostUart16550CharTimeGet(PPSPHOSTUART16550 pUart);
+
+
+/**
+ * Puts data on the line towards the UART, the characters arrive one after another at the line rate.
+ *
+ * @returns Number of bytes accepted (limited by the line buffer).
+ * @param   pUart                   The model instance.
+ * @param   pvBuf                   The data to send.
+ * @param   cbWrite                 Number of bytes to send.
+ */
+size_t pspHostUart16550PeerWrite(PPSPHOSTUART16550 pUart, const void *pvBuf, size_t cbWrite);
+
+
+/**
+ * Takes data the UART transmitted off the line.
+ *
+ * @returns Number of bytes read.
+ * @param   pUart                   The model instance.
+ * @param   pvBuf                   Where to store the data.
+ * @param   cbRead                  Maximum number of bytes to read.
+ */
+size_t pspHostUart16550PeerRead(PPSPHOSTUART16550 pUart, void *pvBuf, size_t cbRead);
+
+
+/**
+ * Returns the device I/O interface the UART transport uses in the host build instead of
+ * the MMIO mapping, provided by the program embedding the transport.
+ *
+ * @returns Device I/O interface.
+ */
+PCPSPIODEVIF pspStubHostUartIoDevGet(void);
+
+#endif /* !__include_uart_16550_h */
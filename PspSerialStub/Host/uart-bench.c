@@ -0,0 +1,384 @@
+/** @file
+ * PSP serial stub host build - Benchmark of the UART driver and transport against the 16550 model.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <types.h>
+#include <cdefs.h>
+#include <err.h>
+#include <string.h>
+
+#include "pdu-transp.h"
+#include "psp-serial-stub-internal.h"
+#include "uart-16550.h"
+
+/*
+ * Runs the UART transport (and with it Lib/src/uart.c) unmodified against the 16550 model and
+ * reports what a transfer costs in simulated time and register accesses. Line status reads which
+ * saw no change since the previous one are busy polling, they only depend on how long the driver
+ * waits and are reported separately from the accesses moving the data. Everything is measured
+ * in the simulated time of the model, so the results don't depend on the host running the benchmark,
+ * only on the configured line rate, FIFO depth and register access cost.
+ */
+
+/** Default number of bytes transferred in each direction. */
+#define UART_BENCH_XFER_DEFAULT         (16 * _1K)
+/** Largest transfer possible, limited by the line buffers of the model. */
+#define UART_BENCH_XFER_MAX             PSP_HOST_UART16550_LINE_SZ
+/** Size of the writes issued to the transport, about what a PDU is. */
+#define UART_BENCH_WRITE_CHUNK          256
+/** Size of the interrupt driven transmission check, fits into the transmit ring as nothing drains it in the background. */
+#define UART_BENCH_IRQ_XFER             128
+
+
+/**
+ * A benchmarked configuration.
+ */
+typedef struct UARTBENCHCFG
+{
+    /** Description. */
+    const char                  *pszDesc;
+    /** The model configuration. */
+    PSPHOSTUART16550CFG         Cfg;
+} UARTBENCHCFG;
+/** Pointer to a const benchmarked configuration. */
+typedef const UARTBENCHCFG *PCUARTBENCHCFG;
+
+
+/**
+ * The configurations benchmarked, the transport keeps the default divisor so the input clock selects the line rate
+ * (the same as selecting a high speed clock in the Super I/O).
+ */
+static const UARTBENCHCFG g_aCfgs[] =
+{
+    /* pszDesc                    uClkHz    cbFifo cNsRegAccess */
+    { "16550A 115200 1us/reg",  { 1843200,  16,    1000 } },
+    { "16450  115200 1us/reg",  { 1843200,  1,     1000 } },
+    { "16550A 1.5M   1us/reg",  { 24000000, 16,    1000 } },
+    { "16450  1.5M   1us/reg",  { 24000000, 1,     1000 } },
+    { "16550A 1.5M   250ns/reg",{ 24000000, 16,    250  } },
+    { "16550A 1.5M   4us/reg",  { 24000000, 16,    4000 } },
+};
+
+
+/** The model the transport talks to. */
+static PSPHOSTUART16550 g_Uart16550;
+/** The UART transport. */
+extern const PSPPDUTRANSPIF g_UartTransp;
+
+
+PCPSPIODEVIF pspStubHostUartIoDevGet(void)
+{
+    return &g_Uart16550.IfIoDev;
+}
+
+
+uint32_t pspSerialStubTicksGet(void)
+{
+    /* Stall times are accounted in simulated time as well. */
+    return (uint32_t)(g_Uart16550.nsNow / 10);
+}
+
+
+/**
+ * Returns the number of register accesses so far, without the busy polling.
+ *
+ * @returns Number of register accesses.
+ */
+static uint64_t uartBenchRegsGet(void)
+{
+    return g_Uart16550.cRegReads + g_Uart16550.cRegWrites - g_Uart16550.cLsrPolls;
+}
+
+
+/**
+ * Prints the results of a single direction.
+ *
+ * @returns nothing.
+ * @param   pszDir                  The direction.
+ * @param   cbXfer                  Number of bytes transferred.
+ * @param   nsXfer                  Simulated time the transfer took.
+ * @param   cRegAccesses            Number of register accesses during the transfer, without the busy polling.
+ * @param   cLsrPolls               Number of line status reads busy polling during the transfer.
+ * @param   cTicksStall             Stall time reported by the transport.
+ * @param   cbLost                  Number of bytes lost.
+ */
+static void uartBenchReport(const char *pszDir, size_t cbXfer, uint64_t nsXfer, uint64_t cRegAccesses,
+                            uint64_t cLsrPolls, uint64_t cTicksStall, uint64_t cbLost)
+{
+    uint64_t nsLine = cbXfer * pspHostUart16550CharTimeGet(&g_Uart16550);
+
+    printf("    %-5s %8.2f KB/s %6.1f%% of line %6.2f regs/byte %7.2f polls/byte %6.1f%% stalled %8llu lost\n",
+           pszDir, nsXfer ? (cbXfer * 1000000000.0 / nsXfer) / 1024.0 : 0.0,
+           nsXfer ? (nsLine * 100.0) / nsXfer : 0.0,
+           cbXfer ? (double)cRegAccesses / cbXfer : 0.0,
+           cbXfer ? (double)cLsrPolls / cbXfer : 0.0,
+           nsXfer ? (cTicksStall * 10 * 100.0) / nsXfer : 0.0,
+           (unsigned long long)cbLost);
+}
+
+
+/**
+ * Transmits the given data through the transport and checks what arrived on the line.
+ *
+ * @returns Status code.
+ * @param   hPduTransp              The transport instance.
+ * @param   pbData                  The data to transmit.
+ * @param   cbXfer                  Number of bytes to transmit.
+ * @param   pbCheck                 Scratch buffer of cbXfer bytes for checking.
+ */
+static int uartBenchTx(PSPPDUTRANSP hPduTransp, const uint8_t *pbData, size_t cbXfer, uint8_t *pbCheck)
+{
+    PSPPDUTRANSPSTATS Stats;
+    uint64_t nsStart = g_Uart16550.nsNow;
+    uint64_t cRegsStart = uartBenchRegsGet();
+    uint64_t cPollsStart = g_Uart16550.cLsrPolls;
+    int rc = INF_SUCCESS;
+
+    g_UartTransp.pfnStatsQuery(hPduTransp, &Stats, true /*fReset*/);
+    for (size_t off = 0; off < cbXfer && !rc; off += UART_BENCH_WRITE_CHUNK)
+        rc = g_UartTransp.pfnWrite(hPduTransp, pbData + off, MIN(cbXfer - off, UART_BENCH_WRITE_CHUNK), NULL /*pcbWritten*/);
+    if (!rc)
+        rc = g_UartTransp.pfnFlush(hPduTransp);
+    if (rc)
+        return rc;
+
+    uint64_t nsXfer = g_Uart16550.nsNow - nsStart;
+    uint64_t cRegs = uartBenchRegsGet() - cRegsStart;
+    uint64_t cPolls = g_Uart16550.cLsrPolls - cPollsStart;
+    g_UartTransp.pfnStatsQuery(hPduTransp, &Stats, true /*fReset*/);
+
+    size_t cbLine = pspHostUart16550PeerRead(&g_Uart16550, pbCheck, cbXfer);
+    uartBenchReport("tx", cbXfer, nsXfer, cRegs, cPolls, Stats.cTicksStallWrite, g_Uart16550.cbTxLost);
+    if (   cbLine != cbXfer
+        || memcmp(pbCheck, pbData, cbXfer))
+    {
+        printf("    tx    data mismatch, %zu of %zu bytes arrived\n", cbLine, cbXfer);
+        return ERR_INVALID_STATE;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Receives the given data sent by the peer through the transport.
+ *
+ * @returns Status code.
+ * @param   hPduTransp              The transport instance.
+ * @param   pbData                  The data the peer sends.
+ * @param   cbXfer                  Number of bytes to receive.
+ * @param   pbCheck                 Buffer of cbXfer bytes to receive into.
+ */
+static int uartBenchRx(PSPPDUTRANSP hPduTransp, const uint8_t *pbData, size_t cbXfer, uint8_t *pbCheck)
+{
+    PSPPDUTRANSPSTATS Stats;
+    uint64_t nsStart = g_Uart16550.nsNow;
+    uint64_t cRegsStart = uartBenchRegsGet();
+    uint64_t cPollsStart = g_Uart16550.cLsrPolls;
+    uint64_t cbLostStart = g_Uart16550.cbRxLost;
+    /* Anything lost on the line is never going to show up, give up after twice the line time. */
+    uint64_t nsDeadline = nsStart + 2 * cbXfer * pspHostUart16550CharTimeGet(&g_Uart16550) + 1000000;
+    size_t cbRecv = 0;
+    int rc = INF_SUCCESS;
+
+    g_UartTransp.pfnStatsQuery(hPduTransp, &Stats, true /*fReset*/);
+    pspHostUart16550PeerWrite(&g_Uart16550, pbData, cbXfer);
+    while (   cbRecv < cbXfer
+           && g_Uart16550.nsNow < nsDeadline
+           && !rc)
+    {
+        /* Only read what is there, a blocking read never returns if something was lost. */
+        size_t cbAvail = g_UartTransp.pfnPeek(hPduTransp);
+        if (cbAvail)
+            rc = g_UartTransp.pfnRead(hPduTransp, pbCheck + cbRecv, MIN(cbAvail, cbXfer - cbRecv), NULL /*pcbRead*/);
+        if (!rc)
+            cbRecv += MIN(cbAvail, cbXfer - cbRecv);
+    }
+    if (rc)
+        return rc;
+
+    uint64_t nsXfer = g_Uart16550.nsNow - nsStart;
+    uint64_t cRegs = uartBenchRegsGet() - cRegsStart;
+    uint64_t cPolls = g_Uart16550.cLsrPolls - cPollsStart;
+    g_UartTransp.pfnStatsQuery(hPduTransp, &Stats, true /*fReset*/);
+
+    uint64_t cbLost = g_Uart16550.cbRxLost - cbLostStart;
+    uartBenchReport("rx", cbRecv, nsXfer, cRegs, cPolls, Stats.cTicksStallRead, cbLost);
+    if (cbLost)
+    {
+        /* A result as well, the driver can't empty the receive FIFO as fast as the line fills it. */
+        printf("    rx    receiver overruns, the driver is too slow for the line\n");
+        return INF_SUCCESS;
+    }
+    if (   cbRecv != cbXfer
+        || memcmp(pbCheck, pbData, cbXfer))
+    {
+        printf("    rx    data mismatch, %zu of %zu bytes arrived\n", cbRecv, cbXfer);
+        return ERR_INVALID_STATE;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Checks interrupt driven transmission, the interrupt handler is called whenever the model would raise an interrupt
+ * and the transmitter holding register empty interrupt must only be enabled while data is queued.
+ *
+ * @returns Status code.
+ * @param   hPduTransp              The transport instance.
+ * @param   pbData                  The data to transmit.
+ * @param   cbXfer                  Number of bytes to transmit, must fit into the transmit ring.
+ * @param   pbCheck                 Scratch buffer of cbXfer bytes for checking.
+ */
+static int uartBenchTxIrq(PSPPDUTRANSP hPduTransp, const uint8_t *pbData, size_t cbXfer, uint8_t *pbCheck)
+{
+    uint64_t nsDeadline = g_Uart16550.nsNow + 2 * cbXfer * pspHostUart16550CharTimeGet(&g_Uart16550) + 1000000;
+    const char *pszErr = NULL;
+
+    int rc = g_UartTransp.pfnIrqSet(hPduTransp, true /*fEnable*/);
+    if (rc)
+        return rc;
+
+    /* Enabling raises the transmit interrupt once for verification, it has to be gone after servicing it. */
+    if (!g_UartTransp.pfnIrq(hPduTransp))
+        pszErr = "no interrupt after enabling";
+    else if (g_Uart16550.uIer & UART16550_IER_ETBEI)
+        pszErr = "transmit interrupt still enabled while idle";
+    else
+    {
+        rc = g_UartTransp.pfnWrite(hPduTransp, pbData, cbXfer, NULL /*pcbWritten*/);
+        if (!rc && !(g_Uart16550.uIer & UART16550_IER_ETBEI))
+            pszErr = "transmit interrupt not enabled with data queued";
+
+        /* Nothing runs in the background, deliver the interrupts while the line makes progress. */
+        while (   !rc
+               && !pszErr
+               && (g_Uart16550.uIer & UART16550_IER_ETBEI)
+               && g_Uart16550.nsNow < nsDeadline)
+        {
+            g_UartTransp.pfnIrq(hPduTransp);
+            pspHostUart16550TimeAdvance(&g_Uart16550, pspHostUart16550CharTimeGet(&g_Uart16550));
+        }
+
+        if (!rc && !pszErr)
+        {
+            rc = g_UartTransp.pfnFlush(hPduTransp);
+            if (!rc && (g_Uart16550.uIer & UART16550_IER_ETBEI))
+                pszErr = "transmit interrupt still enabled after the queue drained";
+            else if (   !rc
+                     && (   pspHostUart16550PeerRead(&g_Uart16550, pbCheck, cbXfer) != cbXfer
+                         || memcmp(pbCheck, pbData, cbXfer)))
+                pszErr = "data mismatch";
+        }
+    }
+
+    int rc2 = g_UartTransp.pfnIrqSet(hPduTransp, false /*fEnable*/);
+    if (!rc)
+        rc = rc2;
+    if (!rc && pszErr)
+    {
+        printf("    irq   %s\n", pszErr);
+        rc = ERR_INVALID_STATE;
+    }
+
+    return rc;
+}
+
+
+/**
+ * Runs the benchmark for a single configuration.
+ *
+ * @returns Status code.
+ * @param   pCfg                    The configuration.
+ * @param   pbData                  The data to transfer.
+ * @param   cbXfer                  Number of bytes to transfer in each direction.
+ * @param   pbCheck                 Scratch buffer of cbXfer bytes.
+ */
+static int uartBenchRun(PCUARTBENCHCFG pCfg, const uint8_t *pbData, size_t cbXfer, uint8_t *pbCheck)
+{
+    int rc = pspHostUart16550Init(&g_Uart16550, &pCfg->Cfg);
+    if (rc)
+        return rc;
+
+    void *pvTransp = calloc(1, g_UartTransp.cbState);
+    if (!pvTransp)
+        return ERR_BUFFER_OVERFLOW;
+
+    PSPPDUTRANSP hPduTransp = NULL;
+    rc = g_UartTransp.pfnInit(pvTransp, g_UartTransp.cbState, &hPduTransp);
+    if (!rc)
+    {
+        printf("%s (line %llu bytes/s)\n", pCfg->pszDesc,
+               1000000000ULL / pspHostUart16550CharTimeGet(&g_Uart16550));
+
+        rc = uartBenchTx(hPduTransp, pbData, cbXfer, pbCheck);
+        if (!rc)
+            rc = uartBenchRx(hPduTransp, pbData, cbXfer, pbCheck);
+        if (!rc)
+            rc = uartBenchTxIrq(hPduTransp, pbData, MIN(cbXfer, UART_BENCH_IRQ_XFER), pbCheck);
+
+        g_UartTransp.pfnTerm(hPduTransp);
+    }
+
+    free(pvTransp);
+    return rc;
+}
+
+
+int main(int argc, char *argv[])
+{
+    size_t cbXfer = UART_BENCH_XFER_DEFAULT;
+
+    if (argc > 1)
+        cbXfer = strtoul(argv[1], NULL, 0);
+    if (   !cbXfer
+        || cbXfer > UART_BENCH_XFER_MAX)
+    {
+        fprintf(stderr, "Usage: %s [bytes (up to %u)]\n", argv[0], UART_BENCH_XFER_MAX);
+        return 1;
+    }
+
+    uint8_t *pbData = (uint8_t *)malloc(cbXfer);
+    uint8_t *pbCheck = (uint8_t *)malloc(cbXfer);
+    if (!pbData || !pbCheck)
+        return 1;
+
+    for (size_t i = 0; i < cbXfer; i++)
+        pbData[i] = (uint8_t)(i * 7 + (i >> 8));
+
+    int rcExit = 0;
+    for (uint32_t i = 0; i < ELEMENTS(g_aCfgs); i++)
+    {
+        int rc = uartBenchRun(&g_aCfgs[i], pbData, cbXfer, pbCheck);
+        if (rc)
+        {
+            printf("    failed with %d\n", rc);
+            rcExit = 1;
+        }
+    }
+
+    free(pbCheck);
+    free(pbData);
+    return rcExit;
+}
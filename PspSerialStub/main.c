@@ -34,13 +34,88 @@
 #include <psp-stub/cm-if.h>
 
 #include "pdu-transp.h"
+#include "psp-serial-stub-ext.h"
+#include "psp-serial-stub-plat.h"
 
-/** Use the SPI message channel instead of the UART. */
-#define PSP_SERIAL_STUB_SPI_MSG_CHAN    1
+/** Use the SPI message channel instead of the UART (the host build always uses the loopback transport). */
+#ifndef PSP_SERIAL_STUB_HOST
+# define PSP_SERIAL_STUB_SPI_MSG_CHAN   1
+#endif
+
+/** Use the ring in reserved x86 DRAM instead of the UART/SPI, requires an agent on the x86 side (see x86-dram-chan.h). */
+/*#define PSP_SERIAL_STUB_X86_DRAM_CHAN   1*/
+
+/** Drive the other transports not blocking during initialization alongside the selected one, used by striped reads. */
+/*#define PSP_SERIAL_STUB_MULTIPATH       1*/
+
+/** Probe all links during connect and move the connection to the fastest one, requires PSP_SERIAL_STUB_MULTIPATH. */
+/*#define PSP_SERIAL_STUB_TRANSP_AUTO     1*/
+
+/** Use interrupt driven reception on the UART transport (Super I/O IRQ4) instead of polling the line status register. */
+/*#define PSP_SERIAL_STUB_UART_RX_IRQ     1*/
+/** How long to wait for the first transport interrupt before falling back to polling. */
+#define PSP_SERIAL_STUB_TRANSP_IRQ_VERIFY_MS 10
 
 /** Indefinite wait. */
 #define PSP_SERIAL_STUB_INDEFINITE_WAIT 0xffffffff
 
+/** Number of transmit buffers taking PDUs of any size, the next response is staged in one while the previous one drains. */
+#define PSP_SERIAL_STUB_TX_BUF_FULL_COUNT 2
+/** Number of transmit buffers, the ones after the full sized buffers only take short PDUs. */
+#define PSP_SERIAL_STUB_TX_BUF_COUNT    3
+/** Maximum payload size of a PDU sent by the stub. */
+#define PSP_SERIAL_STUB_TX_PAYLOAD_MAX  _4K
+/** Maximum payload size of the short transmit buffers taking notifications and log messages. */
+#define PSP_SERIAL_STUB_TX_PAYLOAD_SHORT_MAX 256
+/** Number of bytes handed to the transport at once when draining the transmit queue in the background. */
+#define PSP_SERIAL_STUB_TX_DRAIN_CHUNK  256
+
+/** Number of entries in the request journal (power of two), 1KiB worth of entries. */
+#define PSP_SERIAL_STUB_JOURNAL_ENTRIES 32
+
+/** Size of the private instance data of a transport channel, the UART transport with its rings is the largest. */
+#define PSP_SERIAL_STUB_TRANSP_DATA_SZ  640
+
+/** Size of the scratch space handed to the host (it learns the size from the connect response).
+ * Image, bss and stacks have to fit into the 64K of SRAM given by the linker script, so the
+ * buffers of the additional links and their code are taken from here. */
+#ifndef PSP_SERIAL_STUB_SCRATCH_SZ
+# ifdef PSP_SERIAL_STUB_MULTIPATH
+#  define PSP_SERIAL_STUB_SCRATCH_SZ    (2 * _1K)
+# else
+#  define PSP_SERIAL_STUB_SCRATCH_SZ    (8 * _1K)
+# endif
+#endif
+
+/** Maximum number of links driven in addition to the one requests arrive on. */
+#define PSP_SERIAL_STUB_LINKS_MAX       2
+/** Maximum (and default) chunk size of a striped read, each additional link buffers a whole chunk. */
+#ifdef PSP_SERIAL_STUB_MULTIPATH
+# define PSP_SERIAL_STUB_STRIPE_CHUNK_MAX _1K
+#else
+# define PSP_SERIAL_STUB_STRIPE_CHUNK_MAX (2 * _1K)
+#endif
+/** Throughput assumed for a link until it was measured if the transport can't tell its speed (bytes per second). */
+#define PSP_SERIAL_STUB_LINK_TPUT_DEFAULT 11520
+/** How long the throughput of each link is measured during connect in milliseconds. */
+#define PSP_SERIAL_STUB_LINK_PROBE_MS   20
+/** Maximum number of probe PDUs sent on each link during the throughput measurement. */
+#define PSP_SERIAL_STUB_LINK_PROBE_PDUS 64
+/** Payload size of a probe PDU used for the throughput measurement. */
+#define PSP_SERIAL_STUB_LINK_PROBE_PAYLOAD 512
+/** How long to wait for the host to acknowledge a probe in milliseconds. */
+#define PSP_SERIAL_STUB_LINK_PROBE_ACK_MS 100
+/** How long to wait for the host to show up on the link selected during connect before falling back. */
+#define PSP_SERIAL_STUB_LINK_SWITCH_VERIFY_MS 1000
+
+#if defined(PSP_SERIAL_STUB_TRANSP_AUTO) && !defined(PSP_SERIAL_STUB_MULTIPATH)
+# error "PSP_SERIAL_STUB_TRANSP_AUTO requires PSP_SERIAL_STUB_MULTIPATH"
+#endif
+#if defined(PSP_SERIAL_STUB_HOST) && (   defined(PSP_SERIAL_STUB_MULTIPATH) || defined(PSP_SERIAL_STUB_X86_DRAM_CHAN) \
+                                      || defined(PSP_SERIAL_STUB_SPI_MSG_CHAN))
+# error "The host build only has the loopback transport"
+#endif
+
 
 /**
  * x86 memory mapping slot.
@@ -51,8 +126,12 @@ typedef struct PSPX86MAPPING
     X86PADDR                PhysX86AddrBase;
     /** The memory type being used. */
     uint32_t                uMemType;
-    /** Reference counter for this mapping, the mapping gets cleaned up if it reaches 0. */
+    /** Reference counter for this mapping, the mapping stays live at 0 until the slot is needed for another window. */
     uint32_t                cRefs;
+    /** Value of the LRU clock when the mapping was used last. */
+    uint32_t                uLastUse;
+    /** Start of the mapping window. */
+    void                    *pvWindow;
 } PSPX86MAPPING;
 /** Pointer to an x86 memory mapping slot. */
 typedef PSPX86MAPPING *PPSPX86MAPPING;
@@ -67,8 +146,12 @@ typedef struct PSPSMNMAPPING
 {
     /** Base SMN address being mapped (aligned to a 1MB boundary). */
     SMNADDR                 SmnAddrBase;
-    /* Reference counter for this mapping, the mapping gets cleand up if it reaches 0. */
+    /** Reference counter for this mapping, the mapping stays live at 0 until the slot is needed for another window. */
     uint32_t                cRefs;
+    /** Value of the LRU clock when the mapping was used last. */
+    uint32_t                uLastUse;
+    /** Start of the mapping window, NULL if the slot is free. */
+    void                    *pvWindow;
 } PSPSMNMAPPING;
 /** Pointer to a SMN mapping slot. */
 typedef PSPSMNMAPPING *PPSPSMNMAPPING;
@@ -148,6 +231,121 @@ typedef enum PSPSTUBEXCP
 } PSPSTUBEXCP;
 
 
+/**
+ * Transmit buffer state, denotes the current owner of the buffer.
+ */
+typedef enum PSPSTUBTXBUFSTATE
+{
+    /** Invalid state, do not use. */
+    PSPSTUBTXBUFSTATE_INVALID = 0,
+    /** The buffer is free for use. */
+    PSPSTUBTXBUFSTATE_FREE,
+    /** The buffer is owned by the request currently being processed which stages the response payload in it. */
+    PSPSTUBTXBUFSTATE_STAGING,
+    /** The buffer holds a complete PDU and is owned by the transmit path until everything was written to the transport. */
+    PSPSTUBTXBUFSTATE_QUEUED,
+    /** 32bit hack. */
+    PSPSTUBTXBUFSTATE_32BIT_HACK = 0x7fffffff
+} PSPSTUBTXBUFSTATE;
+
+
+/**
+ * Transmit buffer holding a complete PDU.
+ */
+typedef struct PSPSTUBTXBUF
+{
+    /** Current buffer state. */
+    PSPSTUBTXBUFSTATE           enmState;
+    /** Size of the complete PDU in bytes (valid when queued). */
+    uint32_t                    cbPdu;
+    /** Number of bytes already written to the transport. */
+    uint32_t                    offXmit;
+    /** Maximum payload size the buffer takes. */
+    uint32_t                    cbPayloadMax;
+    /** The PDU, header followed by the payload, padding and footer. */
+    uint8_t                     *pbPdu;
+} PSPSTUBTXBUF;
+/** Pointer to a transmit buffer. */
+typedef PSPSTUBTXBUF *PPSPSTUBTXBUF;
+
+/** Size of the storage for a PDU with the given maximum payload size. */
+#define PSP_STUB_TX_PDU_SZ(a_cbPayloadMax) (sizeof(PSPSERIALPDUHDR) + (a_cbPayloadMax) + sizeof(PSPSERIALPDUFOOTER))
+
+
+/**
+ * Request journal entry as kept by the stub, the sequence number is implied by the position in the ring.
+ */
+typedef struct PSPSTUBJOURNALENTRY
+{
+    /** The request ID. */
+    PSPSERIALPDURRNID           enmReqId;
+    /** Stub timestamp in milliseconds when the request started executing. */
+    uint32_t                    tsMillies;
+    /** The address being modified (request specific for requests not targeting an address space). */
+    uint64_t                    u64Addr;
+    /** Number of bytes being modified. */
+    uint32_t                    cb;
+    /** The value written if the request carries at most 4 bytes of data, the FNV-1a hash of the request header
+     * and PDU checksum otherwise. */
+    uint32_t                    u32ValOrHash;
+    /** Status code the request completed with. */
+    int32_t                     rcReq;
+    /** Execution time in milliseconds, PSP_SERIAL_JOURNAL_MILLIES_PENDING until the request returned. */
+    uint32_t                    cMillies;
+    /** The address space being modified, PSPADDRSPACE_INVALID if the request doesn't target one. */
+    PSPADDRSPACE                enmAddrSpace;
+} PSPSTUBJOURNALENTRY;
+/** Pointer to a request journal entry. */
+typedef PSPSTUBJOURNALENTRY *PPSPSTUBJOURNALENTRY;
+/** Pointer to a const request journal entry. */
+typedef const PSPSTUBJOURNALENTRY *PCPSPSTUBJOURNALENTRY;
+
+
+/**
+ * Link throughput estimation.
+ */
+typedef struct PSPSTUBLINKTPUT
+{
+    /** Estimated throughput in bytes per second. */
+    uint32_t                    cbPerSec;
+    /** Number of bytes handed to the link since it became busy. */
+    uint32_t                    cbBusy;
+    /** Timestamp in microseconds when the link became busy. */
+    uint64_t                    usBusyStart;
+    /** Flag whether the link is currently busy transmitting. */
+    bool                        fBusy;
+} PSPSTUBLINKTPUT;
+/** Pointer to a link throughput estimation. */
+typedef PSPSTUBLINKTPUT *PPSPSTUBLINKTPUT;
+
+
+/**
+ * Additional link driven alongside the one requests arrive on, only ever transmits.
+ */
+typedef struct PSPSTUBLINK
+{
+    /** The transport channel interface. */
+    PCPSPPDUTRANSPIF            pIfTransp;
+    /** Handle to the PDU transport channel. */
+    PSPPDUTRANSP                hPduTransp;
+    /** Throughput estimation. */
+    PSPSTUBLINKTPUT             Tput;
+    /** Number of PDUs sent over this link so far. */
+    uint32_t                    cPdusSent;
+    /** Size of the PDU being transmitted in bytes, 0 if idle. */
+    uint32_t                    cbPdu;
+    /** Number of bytes of the PDU already written to the transport. */
+    uint32_t                    offXmit;
+    /** The PDU being transmitted. */
+    uint8_t                     abPdu[  sizeof(PSPSERIALPDUHDR) + sizeof(PSPSERIALSTRIPEDREADDATANOT)
+                                      + PSP_SERIAL_STUB_STRIPE_CHUNK_MAX + sizeof(PSPSERIALPDUFOOTER)];
+    /** Private transport channel instance data. */
+    uint8_t                     abTranspData[PSP_SERIAL_STUB_TRANSP_DATA_SZ];
+} PSPSTUBLINK;
+/** Pointer to an additional link. */
+typedef PSPSTUBLINK *PPSPSTUBLINK;
+
+
 /**
  * Global stub instance.
  */
@@ -165,12 +363,32 @@ typedef struct PSPSTUBSTATE
     PCPSPPDUTRANSPIF            pIfTransp;
     /** Handle to the PDU transport channel. */
     PSPPDUTRANSP                hPduTransp;
-    /** Private transport channel instance data. */
-    uint8_t                     abTranspData[128];
+    /** Private transport channel instance data (the UART transport carries its receive and transmit rings). */
+    uint8_t                     abTranspData[PSP_SERIAL_STUB_TRANSP_DATA_SZ];
+    /** Flag whether the transport reception is interrupt driven. */
+    volatile bool               fTranspIrq;
+    /** Number of interrupts serviced by the transport. */
+    volatile uint32_t           cTranspIrqs;
+    /** Throughput estimation of the selected transport channel. */
+    PSPSTUBLINKTPUT             TputTransp;
+#ifdef PSP_SERIAL_STUB_MULTIPATH
+    /** Number of additional links attached. */
+    uint32_t                    cLinks;
+    /** The additional links. */
+    PSPSTUBLINK                 aLinks[PSP_SERIAL_STUB_LINKS_MAX];
+#endif
     /** x86 mapping bookkeeping data. */
     PSPX86MAPPING               aX86MapSlots[15];
+    /** Slot of the x86 mapping used last, checked before scanning all slots. */
+    uint32_t                    idxX86MapLast;
+    /** Clock advanced on every x86 mapping use, for evicting unreferenced mappings in LRU order. */
+    uint32_t                    uX86MapLruClock;
     /** SMN mapping bookkeeping data. */
     PSPSMNMAPPING               aSmnMapSlots[32];
+    /** Slot of the SMN mapping used last, checked before scanning all slots. */
+    uint32_t                    idxSmnMapLast;
+    /** Clock advanced on every SMN mapping use, for evicting unreferenced mappings in LRU order. */
+    uint32_t                    uSmnMapLruClock;
     /** Number of CCDs detected. */
     uint32_t                    cCcds;
     /** Flag whether someone is connected. */
@@ -204,26 +422,53 @@ typedef struct PSPSTUBSTATE
     size_t                      cbPduRecvLeft;
     /** Current offset into the PDU buffer. */
     uint32_t                    offPduRecv;
+    /** Request received while finishing a link change which gets processed next instead of receiving one, NULL if none. */
+    PCPSPSERIALPDUHDR           pPduPending;
     /** Input buffer related state. */
     PSPINBUF                    aInBufs[2];
     /** Pending exception. */
     PSPSTUBEXCP                 enmExcpPending;
-    /** Padding to 16byte boundary. */
-    uint8_t                     abPad0[12];
-    /** The PDU receive buffer. */
-    uint8_t                     abPdu[_4K];
-    /** The PDU response buffer. */
-    uint8_t                     abPduResp[_4K];
+    /** The PDU receive buffer, aligned independent of how the members above add up. */
+    uint8_t                     abPdu[_4K] __attribute__ ((aligned (16)));
     /** Scratch space. */
-    uint8_t                     abScratch[16 * _1K];
+    uint8_t                     abScratch[PSP_SERIAL_STUB_SCRATCH_SZ];
+    /** The transmit buffers. */
+    PSPSTUBTXBUF                aTxBufs[PSP_SERIAL_STUB_TX_BUF_COUNT];
+    /** The transmit queue holding the indices of queued buffers in submission order. */
+    uint32_t                    aidxTxQueue[PSP_SERIAL_STUB_TX_BUF_COUNT];
+    /** Index of the oldest entry in the transmit queue. */
+    uint32_t                    idxTxQueueHead;
+    /** Number of entries in the transmit queue. */
+    uint32_t                    cTxQueued;
+    /** Index of the transmit buffer in the staging state, UINT32_MAX if none. */
+    uint32_t                    idxTxBufStaging;
+    /** Flag whether the transmit queue is currently being drained (guards against recursion through logging). */
+    bool                        fTxDraining;
+    /** Storage of the full sized transmit buffers. */
+    uint8_t                     aabTxPdu[PSP_SERIAL_STUB_TX_BUF_FULL_COUNT][PSP_STUB_TX_PDU_SZ(PSP_SERIAL_STUB_TX_PAYLOAD_MAX)]
+                                __attribute__ ((aligned (16)));
+    /** Storage of the short transmit buffers. */
+    uint8_t                     aabTxPduShort[PSP_SERIAL_STUB_TX_BUF_COUNT - PSP_SERIAL_STUB_TX_BUF_FULL_COUNT][PSP_STUB_TX_PDU_SZ(PSP_SERIAL_STUB_TX_PAYLOAD_SHORT_MAX)]
+                                __attribute__ ((aligned (16)));
+    /** Status of the request currently being processed, the first failure status sent while processing it. */
+    int32_t                     rcReqCur;
+    /** Sequence number of the next journal entry. */
+    uint32_t                    uJournalSeqNext;
+    /** The request journal ring, indexed by the sequence number. */
+    PSPSTUBJOURNALENTRY         aJournal[PSP_SERIAL_STUB_JOURNAL_ENTRIES];
 } PSPSTUBSTATE;
 /** Pointer to the binary loader state. */
 typedef PSPSTUBSTATE *PPSPSTUBSTATE;
 
 #ifdef __GNUC__
 _Static_assert((__builtin_offsetof(PSPSTUBSTATE, abPdu) & 0xf) == 0);
-_Static_assert((__builtin_offsetof(PSPSTUBSTATE, abPduResp) & 0xf) == 0);
 _Static_assert((__builtin_offsetof(PSPSTUBSTATE, abScratch) & 0xf) == 0);
+_Static_assert((PSP_STUB_TX_PDU_SZ(PSP_SERIAL_STUB_TX_PAYLOAD_MAX) & 0x7) == 0); /* Keeps the payload of every transmit buffer 8 byte aligned. */
+_Static_assert((PSP_STUB_TX_PDU_SZ(PSP_SERIAL_STUB_TX_PAYLOAD_SHORT_MAX) & 0x7) == 0);
+_Static_assert(PSP_SERIAL_STUB_TX_BUF_FULL_COUNT >= 2 && PSP_SERIAL_STUB_TX_BUF_FULL_COUNT < PSP_SERIAL_STUB_TX_BUF_COUNT);
+_Static_assert(PSP_SERIAL_STUB_TX_PAYLOAD_SHORT_MAX <= PSP_SERIAL_STUB_TX_PAYLOAD_MAX);
+_Static_assert((sizeof(PSPSERIALPDUHDR) & 0x7) == 0); /* Keeps the staged payload 8 byte aligned. */
+_Static_assert((PSP_SERIAL_STUB_JOURNAL_ENTRIES & (PSP_SERIAL_STUB_JOURNAL_ENTRIES - 1)) == 0);
 #endif
 
 
@@ -243,44 +488,259 @@ typedef CMEXEC *PCMEXEC;
 typedef const CMEXEC *PCCMEXEC;
 
 
+/**
+ * Single memory test pass over the complete range.
+ */
+typedef struct PSPSTUBMEMTESTPASS
+{
+    /** Flag whether the range is walked from the top down. */
+    bool                        fDescending;
+    /** Flag whether each word is read and verified against the expected value. */
+    bool                        fVerify;
+    /** Flag whether each word is written (after verifying if enabled). */
+    bool                        fWrite;
+    /** Flag whether the address of each word is XORed into the expected and written values. */
+    bool                        fAddrInAddr;
+    /** The value expected when verifying. */
+    uint32_t                    u32Expected;
+    /** The value to write. */
+    uint32_t                    u32Write;
+    /** Flag whether a single set bit is walked through each word instead, verifying it after every write. */
+    bool                        fWalkingOnes;
+} PSPSTUBMEMTESTPASS;
+/** Pointer to a memory test pass. */
+typedef PSPSTUBMEMTESTPASS *PPSPSTUBMEMTESTPASS;
+/** Pointer to a const memory test pass. */
+typedef const PSPSTUBMEMTESTPASS *PCPSPSTUBMEMTESTPASS;
+
+
+/**
+ * Memory test state.
+ */
+typedef struct PSPSTUBMEMTEST
+{
+    /** The memory test request being processed. */
+    PCPSPSERIALMEMTESTREQ       pReq;
+    /** The start address of the range being tested. */
+    uint64_t                    u64AddrStart;
+    /** The test currently running. */
+    uint32_t                    fTest;
+    /** Total number of failures detected so far. */
+    uint32_t                    cFailures;
+    /** Number of failures recorded in the failure array. */
+    uint32_t                    cFailuresRecorded;
+    /** Maximum number of failures the failure array can hold. */
+    uint32_t                    cFailuresRecordMax;
+    /** Where to record the failures. */
+    PPSPSERIALMEMTESTFAILURE    paFailures;
+    /** Total number of bytes processed so far. */
+    uint64_t                    cbProcessed;
+    /** Number of bytes processed when the next progress notification is due. */
+    uint64_t                    cbProgressNext;
+} PSPSTUBMEMTEST;
+/** Pointer to a memory test state. */
+typedef PSPSTUBMEMTEST *PPSPSTUBMEMTEST;
+
+
+/**
+ * Iterator walking an address range in chunks never crossing a mapping window.
+ */
+typedef struct PSPSTUBADDRITER
+{
+    /** The address space the range belongs to. */
+    PSPADDRSPACE                enmAddrSpace;
+    /** Size of the units a chunk must never split. */
+    uint32_t                    cbUnit;
+    /** Size of the mapping windows of the address space. */
+    uint64_t                    cbWindow;
+    /** Address of the next chunk. */
+    uint64_t                    u64AddrNext;
+    /** Number of bytes left after the current chunk. */
+    uint64_t                    cbLeft;
+    /** The mapping of the current chunk. */
+    void                        *pvChunk;
+    /** Size of the current chunk, 0 if nothing is mapped. */
+    size_t                      cbChunk;
+} PSPSTUBADDRITER;
+/** Pointer to an address range iterator. */
+typedef PSPSTUBADDRITER *PPSPSTUBADDRITER;
+
+
+/**
+ * Address space accessed by a hardware init table entry.
+ */
+typedef enum PSPSTUBINITSPACE
+{
+    /** Invalid address space, do not use. */
+    PSPSTUBINITSPACE_INVALID = 0,
+    /** No address space, for delays. */
+    PSPSTUBINITSPACE_NONE,
+    /** PSP MMIO, accessed directly. */
+    PSPSTUBINITSPACE_PSP_MMIO,
+    /** SMN, accessed through a 1MB mapping window. */
+    PSPSTUBINITSPACE_SMN,
+    /** x86 MMIO, accessed through a 64MB mapping window. */
+    PSPSTUBINITSPACE_X86_MMIO,
+    /** 32bit hack. */
+    PSPSTUBINITSPACE_32BIT_HACK = 0x7fffffff
+} PSPSTUBINITSPACE;
+
+
+/**
+ * Operation of a hardware init table entry.
+ */
+typedef enum PSPSTUBINITOP
+{
+    /** Invalid operation, do not use. */
+    PSPSTUBINITOP_INVALID = 0,
+    /** Write the byte in uVal. */
+    PSPSTUBINITOP_WR_U8,
+    /** Write the dword in uVal. */
+    PSPSTUBINITOP_WR_U32,
+    /** Read the dword, AND it with fMask, OR in uVal and write it back. */
+    PSPSTUBINITOP_AND_OR_U32,
+    /** Poll the dword until the bits in fMask equal uVal, giving up after cMsWait. */
+    PSPSTUBINITOP_POLL_U32,
+    /** Wait cMsWait in full, for steps without a known status bit to poll. */
+    PSPSTUBINITOP_DELAY,
+    /** 32bit hack. */
+    PSPSTUBINITOP_32BIT_HACK = 0x7fffffff
+} PSPSTUBINITOP;
+
+
+/**
+ * Hardware init table entry.
+ */
+typedef struct PSPSTUBINITENTRY
+{
+    /** The address space accessed. */
+    PSPSTUBINITSPACE            enmSpace;
+    /** The operation. */
+    PSPSTUBINITOP               enmOp;
+    /** Wait budget in milliseconds for polls and delays. */
+    uint32_t                    cMsWait;
+    /** The address accessed. */
+    uint64_t                    u64Addr;
+    /** AND mask for read-modify-write, bits compared for polls. */
+    uint32_t                    fMask;
+    /** The value written, OR'ed in or polled for. */
+    uint32_t                    uVal;
+} PSPSTUBINITENTRY;
+/** Pointer to a const hardware init table entry. */
+typedef const PSPSTUBINITENTRY *PCPSPSTUBINITENTRY;
+
+/** Initializer for a byte write entry. */
+#define PSP_STUB_INIT_WR_U8(a_enmSpace, a_Addr, a_bVal) \
+    { (a_enmSpace), PSPSTUBINITOP_WR_U8, 0, (a_Addr), 0, (a_bVal) }
+/** Initializer for a dword write entry. */
+#define PSP_STUB_INIT_WR_U32(a_enmSpace, a_Addr, a_u32Val) \
+    { (a_enmSpace), PSPSTUBINITOP_WR_U32, 0, (a_Addr), 0, (a_u32Val) }
+/** Initializer for a dword read-modify-write entry. */
+#define PSP_STUB_INIT_AND_OR_U32(a_enmSpace, a_Addr, a_fAnd, a_fOr) \
+    { (a_enmSpace), PSPSTUBINITOP_AND_OR_U32, 0, (a_Addr), (a_fAnd), (a_fOr) }
+/** Initializer for a dword poll entry. */
+#define PSP_STUB_INIT_POLL_U32(a_enmSpace, a_Addr, a_fMask, a_u32Val, a_cMsBudget) \
+    { (a_enmSpace), PSPSTUBINITOP_POLL_U32, (a_cMsBudget), (a_Addr), (a_fMask), (a_u32Val) }
+/** Initializer for a delay entry. */
+#define PSP_STUB_INIT_DELAY(a_cMs) \
+    { PSPSTUBINITSPACE_NONE, PSPSTUBINITOP_DELAY, (a_cMs), 0, 0, 0 }
+
+
+/**
+ * Hardware init step, a named group of table entries timed and logged as a whole.
+ */
+typedef struct PSPSTUBINITSTEP
+{
+    /** Description for the log. */
+    const char                  *pszDesc;
+    /** The entries, executed in order. */
+    PCPSPSTUBINITENTRY          paEntries;
+    /** Number of entries. */
+    uint32_t                    cEntries;
+} PSPSTUBINITSTEP;
+/** Pointer to a const hardware init step. */
+typedef const PSPSTUBINITSTEP *PCPSPSTUBINITSTEP;
+
+/** Initializer for a step executing the given entry array. */
+#define PSP_STUB_INIT_STEP(a_pszDesc, a_aEntries) \
+    { (a_pszDesc), &(a_aEntries)[0], ELEMENTS(a_aEntries) }
+
+
+/**
+ * Mapping window held by the hardware init engine across entries.
+ */
+typedef struct PSPSTUBINITWND
+{
+    /** Address space of the window, PSPSTUBINITSPACE_INVALID if nothing is mapped. */
+    PSPSTUBINITSPACE            enmSpace;
+    /** Base address of the window. */
+    uint64_t                    u64AddrBase;
+    /** Start of the window mapping. */
+    void                        *pvWindow;
+    /** Number of windows mapped so far. */
+    uint32_t                    cMaps;
+} PSPSTUBINITWND;
+/** Pointer to a hardware init engine mapping window. */
+typedef PSPSTUBINITWND *PPSPSTUBINITWND;
+
+
 #define PSP_SERIAL_STUB_EARLY_SPI_LOG_OFF 0x0
 /** Every PSP gets 1MB for the log buffer in the SPI flash. */
 #define PSP_SERIAL_STUB_EARLY_SPI_LOG_SZ  (1024*1024)
 
+/** Size of a memory test chunk, must divide the SMN and x86 mapping window sizes. */
+#define PSP_SERIAL_STUB_MEMTEST_CHUNK_SZ  _1M
+
 /** The global stub state. */
 static PSPSTUBSTATE g_StubState __attribute__ ((aligned (16)));
 static uint32_t off = 0;
 
 
+#ifdef PSP_SERIAL_STUB_HOST
+extern const PSPPDUTRANSPIF g_LoopbackTransp;
+#else
 extern const PSPPDUTRANSPIF g_UartTransp;
 extern const PSPPDUTRANSPIF g_SpiFlashTransp;
 extern const PSPPDUTRANSPIF g_SpiFlashTranspEm100;
+extern const PSPPDUTRANSPIF g_X86DramTransp;
+
 
 /**
- * Available transport channels.
+ * Available transport channels, indexed by PSP_SERIAL_TRANSP_ID_XXX.
  */
 static PCPSPPDUTRANSPIF g_aPduTransp[] =
 {
     &g_UartTransp,
     &g_SpiFlashTransp,
-    &g_SpiFlashTranspEm100
+    &g_SpiFlashTranspEm100,
+    &g_X86DramTransp
 };
+#endif
 
+#ifdef PSP_SERIAL_STUB_MULTIPATH
+/**
+ * Transports tried as additional links, only the ones not waiting for the host during initialization qualify.
+ */
+static PCPSPPDUTRANSPIF g_aPduTranspMultipath[] =
+{
+    &g_UartTransp,
+    &g_SpiFlashTranspEm100
+};
+#endif
 
-extern size_t pspStubCmIfInBufPeekAsm(PCCMIF pCmIf, uint32_t idInBuf);
-extern int pspStubCmIfInBufPollAsm(PCCMIF pCmIf, uint32_t idInBuf, uint32_t cMillies);
-extern int pspStubCmIfInBufReadAsm(PCCMIF pCmIf, uint32_t idInBuf, void *pvBuf, size_t cbRead, size_t *pcbRead);
-extern int pspStubCmIfOutBufWriteAsm(PCCMIF pCmIf, uint32_t idOutBuf, const void *pvBuf, size_t cbWrite, size_t *pcbWritten);
-extern void pspStubCmIfDelayMsAsm(PCCMIF pCmIf, uint32_t cMillies);
-extern uint32_t pspStubCmIfTsGetMilliAsm(PCCMIF pCmIf);
-
-extern void pspSerialStubCoProcWriteAsm(uint32_t u32Val);
-extern uint32_t pspSerialStubCoProcReadAsm(void);
 
-extern void pspStubBranchToAsm(uint32_t PspAddrPc, const uint32_t *pau32Gprs) __attribute__((noreturn));
+#ifndef PSP_SERIAL_STUB_HOST
+extern void pspStubMemCopyProbeAsmStart(void);
+extern void pspStubMemCopyProbeAsmEnd(void);
+extern void pspStubMemCopyProbeAsmFixup(void);
+#endif
 
 static int pspStubPduProcess(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR pPdu);
 static void pspStubIrqProcess(PPSPSTUBSTATE pThis);
+static void pspStubTranspPoll(PPSPSTUBSTATE pThis);
+#ifdef PSP_SERIAL_STUB_UART_RX_IRQ
+static void pspStubTranspIrqInit(PPSPSTUBSTATE pThis);
+#endif
 
 
 /**
@@ -294,55 +754,88 @@ static void pspStubIrqProcess(PPSPSTUBSTATE pThis);
  */
 static int pspStubX86PhysMap(PPSPSTUBSTATE pThis, X86PADDR PhysX86Addr, bool fMmio, void **ppv)
 {
-    int rc = INF_SUCCESS;
     uint32_t uMemType = fMmio ? 0x6 : 0x4;
 
     /* Split physical address into 64MB aligned base and offset. */
     X86PADDR PhysX86AddrBase = (PhysX86Addr & ~(_64M - 1));
     uint32_t offStart = PhysX86Addr - PhysX86AddrBase;
 
-    PPSPX86MAPPING pMapping = NULL;
-    uint32_t idxSlot = 0;
-    for (uint32_t i = fMmio ? 8 : 0; i < ELEMENTS(pThis->aX86MapSlots); i++)
+    uint32_t idxSlotFirst = fMmio ? 8 : 0;
+    uint32_t idxSlot = pThis->idxX86MapLast;
+    PPSPX86MAPPING pMapping = &pThis->aX86MapSlots[idxSlot];
+
+    /* Back to back accesses mostly go to the window used last. */
+    if (   idxSlot < idxSlotFirst
+        || pMapping->PhysX86AddrBase != PhysX86AddrBase
+        || pMapping->uMemType != uMemType)
     {
-        if (   (   pThis->aX86MapSlots[i].PhysX86AddrBase == NIL_X86PADDR
-                && pThis->aX86MapSlots[i].cRefs == 0)
-            || (   pThis->aX86MapSlots[i].PhysX86AddrBase == PhysX86AddrBase
-                && pThis->aX86MapSlots[i].uMemType == uMemType))
+        /* Look for a live mapping of the window, remembering a free slot and the least recently used idle one. */
+        uint32_t idxSlotFree = UINT32_MAX;
+        uint32_t idxSlotLru = UINT32_MAX;
+
+        pMapping = NULL;
+        for (uint32_t i = idxSlotFirst; i < ELEMENTS(pThis->aX86MapSlots); i++)
         {
-            pMapping = &pThis->aX86MapSlots[i];
-            idxSlot = i;
-            break;
+            PPSPX86MAPPING pCur = &pThis->aX86MapSlots[i];
+
+            if (   pCur->PhysX86AddrBase == PhysX86AddrBase
+                && pCur->uMemType == uMemType)
+            {
+                pMapping = pCur;
+                idxSlot = i;
+                break;
+            }
+
+            if (pCur->PhysX86AddrBase == NIL_X86PADDR)
+            {
+                if (idxSlotFree == UINT32_MAX)
+                    idxSlotFree = i;
+            }
+            else if (   !pCur->cRefs
+                     && (   idxSlotLru == UINT32_MAX
+                         ||   pThis->uX86MapLruClock - pCur->uLastUse
+                            > pThis->uX86MapLruClock - pThis->aX86MapSlots[idxSlotLru].uLastUse))
+                idxSlotLru = i;
         }
-    }
 
-    if (pMapping)
-    {
-        if (pMapping->PhysX86AddrBase == NIL_X86PADDR)
+        if (!pMapping)
         {
+            if (idxSlotFree != UINT32_MAX)
+                idxSlot = idxSlotFree;
+            else if (idxSlotLru != UINT32_MAX)
+            {
+                /* Tear the evicted window down first so it never shows up with the new base and the old memory type. */
+                idxSlot = idxSlotLru;
+                pThis->aX86MapSlots[idxSlot].pvWindow        = NULL;
+                pThis->aX86MapSlots[idxSlot].uMemType        = 0;
+                pThis->aX86MapSlots[idxSlot].PhysX86AddrBase = NIL_X86PADDR;
+                pspStubPlatX86WindowUnmap(idxSlot);
+            }
+            else
+                return ERR_INVALID_STATE;
+
             /* Set up the mapping. */
+            pMapping = &pThis->aX86MapSlots[idxSlot];
+            pMapping->pvWindow = pspStubPlatX86WindowMap(idxSlot, PhysX86AddrBase, uMemType);
+            if (!pMapping->pvWindow)
+            {
+                pMapping->uMemType        = 0;
+                pMapping->PhysX86AddrBase = NIL_X86PADDR;
+                return ERR_INVALID_STATE;
+            }
+
             pMapping->uMemType         = uMemType;
             pMapping->PhysX86AddrBase  = PhysX86AddrBase;
-
-            /* Program base address. */
-            PSPADDR PspAddrSlotBase = 0x03230000 + idxSlot * 4 * sizeof(uint32_t);
-            *(volatile uint32_t *)PspAddrSlotBase        = ((PhysX86AddrBase >> 32) << 6) | ((PhysX86AddrBase >> 26) & 0x3f);
-            *(volatile uint32_t *)(PspAddrSlotBase + 4)  = 0x12; /* Unknown but fixed value. */
-            *(volatile uint32_t *)(PspAddrSlotBase + 8)  = uMemType;
-            *(volatile uint32_t *)(PspAddrSlotBase + 12) = uMemType;
-            *(volatile uint32_t *)(0x032303e0 + idxSlot * sizeof(uint32_t)) = 0xffffffff;
-            *(volatile uint32_t *)(0x032304d8 + idxSlot * sizeof(uint32_t)) = 0xc0000000;
-            *(volatile uint32_t *)0x32305ec = 0x3333;
         }
 
-        asm volatile("dsb #0xf\nisb #0xf\n": : :"memory");
-        pMapping->cRefs++;
-        *ppv = (void *)(0x04000000 + idxSlot * _64M + offStart);
+        pThis->idxX86MapLast = idxSlot;
     }
-    else
-        rc = ERR_INVALID_STATE;
 
-    return rc;
+    pspStubPlatMemBarrier();
+    pMapping->cRefs++;
+    pMapping->uLastUse = ++pThis->uX86MapLruClock;
+    *ppv = (uint8_t *)pMapping->pvWindow + offStart;
+    return INF_SUCCESS;
 }
 
 
@@ -356,34 +849,19 @@ static int pspStubX86PhysMap(PPSPSTUBSTATE pThis, X86PADDR PhysX86Addr, bool fMm
 static int pspStubX86PhysUnmapByPtr(PPSPSTUBSTATE pThis, void *pv)
 {
     int rc = INF_SUCCESS;
-    uintptr_t PspAddrMapBase = ((uintptr_t)pv) & ~(_64M - 1);
-    PspAddrMapBase -= 0x04000000;
-
-    uint32_t idxSlot = PspAddrMapBase / _64M;
-    if (   idxSlot < ELEMENTS(pThis->aX86MapSlots)
-        && PspAddrMapBase % _64M == 0)
+    uint32_t idxSlot = pspStubPlatX86WindowFromPtr(pv);
+    if (idxSlot < ELEMENTS(pThis->aX86MapSlots))
     {
         PPSPX86MAPPING pMapping = &pThis->aX86MapSlots[idxSlot];
 
-        asm volatile("dsb #0xf\nisb #0xf\n": : :"memory");
+        pspStubPlatMemBarrier();
         if (pMapping->cRefs > 0)
         {
+            /*
+             * The window stays mapped without any reference held, reprogramming the slot costs more than
+             * keeping it around until pspStubX86PhysMap() needs the slot for another window.
+             */
             pMapping->cRefs--;
-
-            /* Clear out the mapping if there is no reference held. */
-            if (!pMapping->cRefs)
-            {
-                pMapping->uMemType        = 0;
-                pMapping->PhysX86AddrBase = NIL_X86PADDR;
-
-                PSPADDR PspAddrSlotBase = 0x03230000 + idxSlot * 4 * sizeof(uint32_t);
-                *(volatile uint32_t *)PspAddrSlotBase        = 0;
-                *(volatile uint32_t *)(PspAddrSlotBase + 4)  = 0; /* Unknown but fixed value. */
-                *(volatile uint32_t *)(PspAddrSlotBase + 8)  = 0;
-                *(volatile uint32_t *)(PspAddrSlotBase + 12) = 0;
-                *(volatile uint32_t *)(0x032303e0 + idxSlot * sizeof(uint32_t)) = 0xffffffff;
-                *(volatile uint32_t *)(0x032304d8 + idxSlot * sizeof(uint32_t)) = 0;
-            }
         }
         else
             rc = ERR_INVALID_PARAMETER;
@@ -405,51 +883,75 @@ static int pspStubX86PhysUnmapByPtr(PPSPSTUBSTATE pThis, void *pv)
  */
 static int pspStubSmnMap(PPSPSTUBSTATE pThis, SMNADDR SmnAddr, void **ppv)
 {
-    int rc = INF_SUCCESS;
-
     /* Split physical address into 1MB aligned base and offset. */
     SMNADDR  SmnAddrBase = (SmnAddr & ~(_1M - 1));
     uint32_t offStart = SmnAddr - SmnAddrBase;
 
-    PPSPSMNMAPPING pMapping = NULL;
-    uint32_t idxSlot = 0;
-    for (uint32_t i = 0; i < ELEMENTS(pThis->aSmnMapSlots); i++)
+    /* SMN address 0 is valid, so only the window pointer tells whether a slot is in use. */
+    uint32_t idxSlot = pThis->idxSmnMapLast;
+    PPSPSMNMAPPING pMapping = &pThis->aSmnMapSlots[idxSlot];
+
+    /* Register sequences mostly stay within the window used last. */
+    if (   !pMapping->pvWindow
+        || pMapping->SmnAddrBase != SmnAddrBase)
     {
-        if (   (   pThis->aSmnMapSlots[i].SmnAddrBase == 0
-                && pThis->aSmnMapSlots[i].cRefs == 0)
-            || pThis->aSmnMapSlots[i].SmnAddrBase == SmnAddrBase)
+        /* Look for a live mapping of the window, remembering a free slot and the least recently used idle one. */
+        uint32_t idxSlotFree = UINT32_MAX;
+        uint32_t idxSlotLru = UINT32_MAX;
+
+        pMapping = NULL;
+        for (uint32_t i = 0; i < ELEMENTS(pThis->aSmnMapSlots); i++)
         {
-            pMapping = &pThis->aSmnMapSlots[i];
-            idxSlot = i;
-            break;
+            PPSPSMNMAPPING pCur = &pThis->aSmnMapSlots[i];
+
+            if (!pCur->pvWindow)
+            {
+                if (idxSlotFree == UINT32_MAX)
+                    idxSlotFree = i;
+            }
+            else if (pCur->SmnAddrBase == SmnAddrBase)
+            {
+                pMapping = pCur;
+                idxSlot = i;
+                break;
+            }
+            else if (   !pCur->cRefs
+                     && (   idxSlotLru == UINT32_MAX
+                         ||   pThis->uSmnMapLruClock - pCur->uLastUse
+                            > pThis->uSmnMapLruClock - pThis->aSmnMapSlots[idxSlotLru].uLastUse))
+                idxSlotLru = i;
         }
-    }
 
-    if (pMapping)
-    {
-        if (pMapping->SmnAddrBase == 0)
+        if (!pMapping)
         {
+            if (idxSlotFree != UINT32_MAX)
+                idxSlot = idxSlotFree;
+            else if (idxSlotLru != UINT32_MAX)
+            {
+                /* The slot registers are or'ed into when mapping, so the evicted window has to go first. */
+                idxSlot = idxSlotLru;
+                pThis->aSmnMapSlots[idxSlot].pvWindow = NULL;
+                pspStubPlatSmnWindowUnmap(idxSlot);
+            }
+            else
+                return ERR_INVALID_STATE;
+
             /* Set up the mapping. */
-            pMapping->SmnAddrBase = SmnAddrBase;
+            pMapping = &pThis->aSmnMapSlots[idxSlot];
+            pMapping->pvWindow = pspStubPlatSmnWindowMap(idxSlot, SmnAddrBase);
+            if (!pMapping->pvWindow)
+                return ERR_INVALID_STATE;
 
-            /* Program base address. */
-            PSPADDR PspAddrSlotBase = 0x03220000 + (idxSlot / 2) * sizeof(uint32_t);
-            uint32_t u32RegSmnMapCtrl = *(volatile uint32_t *)PspAddrSlotBase;
-            if (idxSlot & 0x1)
-                u32RegSmnMapCtrl |= ((SmnAddrBase >> 20) << 16);
-            else
-                u32RegSmnMapCtrl |= SmnAddrBase >> 20;
-            *(volatile uint32_t *)PspAddrSlotBase = u32RegSmnMapCtrl;
+            pMapping->SmnAddrBase = SmnAddrBase;
         }
 
-        pMapping->cRefs++;
-        *ppv = (void *)(0x01000000 + idxSlot * _1M + offStart);
+        pThis->idxSmnMapLast = idxSlot;
     }
-    else
-        rc = ERR_INVALID_STATE;
 
-    //LogRel("pspStubSmnUnmapByPtr: SmnAddr=%#x -> rc=%d,pv=%p\n", SmnAddr, rc, *ppv);
-    return rc;
+    pMapping->cRefs++;
+    pMapping->uLastUse = ++pThis->uSmnMapLruClock;
+    *ppv = (uint8_t *)pMapping->pvWindow + offStart;
+    return INF_SUCCESS;
 }
 
 
@@ -463,33 +965,14 @@ static int pspStubSmnMap(PPSPSTUBSTATE pThis, SMNADDR SmnAddr, void **ppv)
 static int pspStubSmnUnmapByPtr(PPSPSTUBSTATE pThis, void *pv)
 {
     int rc = INF_SUCCESS;
-    uintptr_t PspAddrMapBase = ((uintptr_t)pv) & ~(_1M - 1);
-    PspAddrMapBase -= 0x01000000;
-
-    uint32_t idxSlot = PspAddrMapBase / _1M;
-    if (   idxSlot < ELEMENTS(pThis->aSmnMapSlots)
-        && PspAddrMapBase % _1M == 0)
+    uint32_t idxSlot = pspStubPlatSmnWindowFromPtr(pv);
+    if (idxSlot < ELEMENTS(pThis->aSmnMapSlots))
     {
         PPSPSMNMAPPING pMapping = &pThis->aSmnMapSlots[idxSlot];
 
+        /* Like the x86 mappings the window stays mapped until pspStubSmnMap() needs the slot. */
         if (pMapping->cRefs > 0)
-        {
             pMapping->cRefs--;
-
-            /* Clear out the mapping if there is no reference held. */
-            if (!pMapping->cRefs)
-            {
-                pMapping->SmnAddrBase = 0;
-
-                PSPADDR PspAddrSlotBase = 0x03220000 + (idxSlot / 2) * sizeof(uint32_t);
-                uint32_t u32RegSmnMapCtrl = *(volatile uint32_t *)PspAddrSlotBase;
-                if (idxSlot & 0x1)
-                    u32RegSmnMapCtrl &= 0xffff;
-                else
-                    u32RegSmnMapCtrl &= 0xffff0000;
-                *(volatile uint32_t *)PspAddrSlotBase = u32RegSmnMapCtrl;
-            }
-        }
         else
             rc = ERR_INVALID_PARAMETER;
     }
@@ -539,8 +1022,7 @@ static int pspStubTimerInit(PPSPTIMER pTimer)
         /* Initialize the timer. */
         pTimer->cCnts       = 0;
         pTimer->cSubUsTicks = 0;
-        *(volatile uint32_t *)(0x03010424 + 32) = 0;     /* Counter value. */
-        *(volatile uint32_t *)(0x03010424)      = 0x101; /* This starts the timer. */
+        pspStubPlatTimerStart();
     }
 
     return rc;
@@ -555,7 +1037,7 @@ static int pspStubTimerInit(PPSPTIMER pTimer)
  */
 static void pspStubTimerHandle(PPSPTIMER pTimer)
 {
-    uint32_t cCnts = *(volatile uint32_t *)(0x03010424 + 32);
+    uint32_t cCnts = pspStubPlatTimerRead();
     uint32_t cTicksPassed = 0;
 
     /* Check how many ticks we advanced since the last check. */
@@ -624,7 +1106,8 @@ static inline uint64_t pspStubGetMicros(PPSPSTUBSTATE pThis)
 static void pspStubDelayUs(PPSPSTUBSTATE pThis, uint64_t cMicros)
 {
     uint64_t tsStart = pspStubGetMicros(pThis);
-    while (pspStubGetMicros(pThis) <= tsStart + cMicros);
+    while (pspStubGetMicros(pThis) <= tsStart + cMicros)
+        pspStubTranspPoll(pThis); /* Keep the transmitter busy while waiting. */
 }
 
 
@@ -669,7 +1152,8 @@ static inline uint32_t pspStubGetMillies(PPSPSTUBSTATE pThis)
 static void pspStubDelayMs(PPSPSTUBSTATE pThis, uint32_t cMillies)
 {
     uint32_t tsStart = pspStubGetMillies(pThis);
-    while (pspStubGetMillies(pThis) <= tsStart + cMillies);
+    while (pspStubGetMillies(pThis) <= tsStart + cMillies)
+        pspStubTranspPoll(pThis); /* Keep the transmitter busy while waiting. */
 }
 
 
@@ -679,1013 +1163,3083 @@ void pspSerialStubDelayMs(uint32_t cMillies)
 }
 
 
-/**
- * Initializes the selected transport channel.
- *
- * @returns Status code.
- * @param   pThis                   The serial stub instance data.
- */
-static int pspStubTranspInit(PPSPSTUBSTATE pThis)
+uint32_t pspSerialStubTicksGet(void)
 {
-    PCPSPPDUTRANSPIF pTranspIf = NULL;
-
-    if (pThis->fSpiMsgChan)
-        pTranspIf = &g_SpiFlashTranspEm100;
-    else
-        pTranspIf = &g_UartTransp;
-
-    int rc = pTranspIf->pfnInit(&pThis->abTranspData[0], sizeof(pThis->abTranspData), &pThis->hPduTransp);
-    if (rc == INF_SUCCESS)
-        pThis->pIfTransp = pTranspIf;
-
-    return rc;
+    return pspStubPlatTimerRead();
 }
 
 
 /**
- * Terminates the currently used transport channel.
+ * Seeds the throughput estimation of a link from the speed the transport reports.
  *
  * @returns nothing.
- * @param   pThis                   The serial stub instance data.
+ * @param   pTput                   The throughput estimation to initialize.
+ * @param   pIfTransp               The transport channel interface of the link.
+ * @param   hPduTransp              Handle to the PDU transport channel.
  */
-static void pspStubTranspTerm(PPSPSTUBSTATE pThis)
+static void pspStubLinkTputInit(PPSPSTUBLINKTPUT pTput, PCPSPPDUTRANSPIF pIfTransp, PSPPDUTRANSP hPduTransp)
 {
-    PCPSPPDUTRANSPIF pTranspIf = NULL;
-
-    pThis->pIfTransp->pfnTerm(pThis->hPduTransp);
-    pThis->pIfTransp = NULL;
-    memset(&pThis->abTranspData[0], 0, sizeof(pThis->abTranspData[0]));
+    uint32_t uBps = 0;
+    uint32_t cbPerSec = 0;
+    bool fCalibrated = false;
+
+    /* The first measurement corrects this for transports not knowing their speed. */
+    if (   !pIfTransp->pfnLinkSpeedGet
+        || pIfTransp->pfnLinkSpeedGet(hPduTransp, &uBps, &cbPerSec, &fCalibrated)
+        || !cbPerSec)
+        cbPerSec = PSP_SERIAL_STUB_LINK_TPUT_DEFAULT;
+
+    pTput->cbPerSec    = cbPerSec;
+    pTput->cbBusy      = 0;
+    pTput->usBusyStart = 0;
+    pTput->fBusy       = false;
 }
 
 
 /**
- * Returns the number of bytes available for reading.
+ * Returns the number of additional links attached.
  *
- * @returns Number of bytes available for reading.
+ * @returns Number of additional links, always 0 without PSP_SERIAL_STUB_MULTIPATH.
  * @param   pThis                   The serial stub instance data.
  */
-static size_t pspStubTranspPeek(PPSPSTUBSTATE pThis)
+static inline uint32_t pspStubLinksCount(PPSPSTUBSTATE pThis)
 {
-    return pThis->pIfTransp->pfnPeek(pThis->hPduTransp);
+#ifdef PSP_SERIAL_STUB_MULTIPATH
+    return pThis->cLinks;
+#else
+    return 0;
+#endif
 }
 
 
 /**
- * Writes the given data to the underyling transport channel.
+ * Returns the given additional link.
  *
- * @returns Status code.
+ * @returns Pointer to the link.
  * @param   pThis                   The serial stub instance data.
- * @param   pvBuf                   The data to write.
- * @param   cbWrite                 Number of bytes to write.
+ * @param   idxLink                 Index of the additional link, below pspStubLinksCount().
  */
-static int pspStubTranspWrite(PPSPSTUBSTATE pThis, const void *pvBuf, size_t cbWrite)
+static inline PPSPSTUBLINK pspStubLinkGet(PPSPSTUBSTATE pThis, uint32_t idxLink)
 {
-    return pThis->pIfTransp->pfnWrite(pThis->hPduTransp, pvBuf, cbWrite, NULL /*pcbWritten*/);
+#ifdef PSP_SERIAL_STUB_MULTIPATH
+    return &pThis->aLinks[idxLink];
+#else
+    return NULL;
+#endif
 }
 
 
+#ifdef PSP_SERIAL_STUB_MULTIPATH
 /**
- * Reads data from the underyling transport channel.
+ * Attaches every other transport which initializes successfully as an additional link.
  *
- * @returns Status code.
+ * @returns nothing.
  * @param   pThis                   The serial stub instance data.
- * @param   pvBuf                   Where to store the read data.
- * @param   cbRead                  Number of bytes to read.
  */
-static int pspStubTranspRead(PPSPSTUBSTATE pThis, void *pvBuf, size_t cbRead)
+static void pspStubLinksAttach(PPSPSTUBSTATE pThis)
 {
-    return pThis->pIfTransp->pfnRead(pThis->hPduTransp, pvBuf, cbRead, NULL /*pcbRead*/);
+    for (uint32_t i = 0; i < ELEMENTS(g_aPduTranspMultipath) && pThis->cLinks < ELEMENTS(pThis->aLinks); i++)
+    {
+        PCPSPPDUTRANSPIF pIfTransp = g_aPduTranspMultipath[i];
+        if (pIfTransp == pThis->pIfTransp)
+            continue;
+
+        PPSPSTUBLINK pLink = &pThis->aLinks[pThis->cLinks];
+        int rc = pIfTransp->pfnInit(&pLink->abTranspData[0], sizeof(pLink->abTranspData), &pLink->hPduTransp);
+        if (!rc)
+        {
+            pLink->pIfTransp = pIfTransp;
+            pLink->cPdusSent = 0;
+            pLink->cbPdu     = 0;
+            pLink->offXmit   = 0;
+            pspStubLinkTputInit(&pLink->Tput, pIfTransp, pLink->hPduTransp);
+            pThis->cLinks++;
+        }
+    }
 }
 
 
 /**
- * Marks begin of an access to the underyling transport channel.
+ * Detaches all additional links.
  *
- * @returns Status code.
+ * @returns nothing.
  * @param   pThis                   The serial stub instance data.
- * @param   pvBuf                   Where to store the read data.
- * @param   cbRead                  Number of bytes to read.
  */
-static int pspStubTranspBegin(PPSPSTUBSTATE pThis)
+static void pspStubLinksDetach(PPSPSTUBSTATE pThis)
 {
-    return pThis->pIfTransp->pfnBegin(pThis->hPduTransp);
+    for (uint32_t i = 0; i < pThis->cLinks; i++)
+    {
+        PPSPSTUBLINK pLink = &pThis->aLinks[i];
+
+        pLink->pIfTransp->pfnTerm(pLink->hPduTransp);
+        pLink->pIfTransp = NULL;
+    }
+
+    pThis->cLinks = 0;
 }
+#endif
 
 
 /**
- * Marks end of an access to the underyling transport channel.
+ * Initializes the selected transport channel.
  *
  * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   pvBuf                   Where to store the read data.
- * @param   cbRead                  Number of bytes to read.
  */
-static int pspStubTranspEnd(PPSPSTUBSTATE pThis)
+static int pspStubTranspInit(PPSPSTUBSTATE pThis)
 {
-    return pThis->pIfTransp->pfnEnd(pThis->hPduTransp);
-}
+    PCPSPPDUTRANSPIF pTranspIf = NULL;
 
+#if defined(PSP_SERIAL_STUB_HOST)
+    pTranspIf = &g_LoopbackTransp;
+#else
+    if (pThis->fSpiMsgChan)
+        pTranspIf = &g_SpiFlashTranspEm100;
+    else
+        pTranspIf = &g_UartTransp;
+#endif
 
-/**
- * Sends the given PDU - two payload parts.
- *
- * @returns Status code.
- * @param   pThis                   The serial stub instance data.
- * @param   rcReq                   Status code for a sresponse PDU.
- * @param   idCcd                   The CCD ID the PDU is designated for.
- * @param   enmPduRrnId             The Request/Response/Notification ID.
- * @param   pvPayload1              Pointer to the PDU payload to send, optional.
- * @param   cbPayload1              Size of the PDU payload in bytes.
- * @param   pvPayload2              Pointer to the PDU payload to send, optional.
- * @param   cbPayload2              Size of the PDU payload in bytes.
+#ifdef PSP_SERIAL_STUB_X86_DRAM_CHAN
+    /* Prefer the x86 DRAM channel, the transport fails to initialize if the host didn't set it up. */
+    int rc = g_X86DramTransp.pfnInit(&pThis->abTranspData[0], sizeof(pThis->abTranspData), &pThis->hPduTransp);
+    if (rc == INF_SUCCESS)
+        pTranspIf = &g_X86DramTransp;
+    else
+        rc = pTranspIf->pfnInit(&pThis->abTranspData[0], sizeof(pThis->abTranspData), &pThis->hPduTransp);
+#else
+    int rc = pTranspIf->pfnInit(&pThis->abTranspData[0], sizeof(pThis->abTranspData), &pThis->hPduTransp);
+#endif
+    if (rc == INF_SUCCESS)
+    {
+        pThis->pIfTransp = pTranspIf;
+        pspStubLinkTputInit(&pThis->TputTransp, pTranspIf, pThis->hPduTransp);
+#ifdef PSP_SERIAL_STUB_UART_RX_IRQ
+        pspStubTranspIrqInit(pThis);
+#endif
+#ifdef PSP_SERIAL_STUB_MULTIPATH
+        pspStubLinksAttach(pThis);
+#endif
+    }
+
+    return rc;
+}
+
+
+/**
+ * Terminates the currently used transport channel.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
  */
-static int pspStubPduSend2(PPSPSTUBSTATE pThis, int32_t rcReq, uint32_t idCcd, PSPSERIALPDURRNID enmPduRrnId,
-                           const void *pvPayload1, size_t cbPayload1, const void *pvPayload2, size_t cbPayload2)
+static void pspStubTranspTerm(PPSPSTUBSTATE pThis)
 {
-    PSPSERIALPDUHDR PduHdr;
-    PSPSERIALPDUFOOTER PduFooter;
-    uint8_t abPad[7] = { 0 };
-    size_t cbPayload = cbPayload1 + cbPayload2;
-    size_t cbPad = ((cbPayload + 7) & ~7) - cbPayload; /* Pad the payload to an 8 byte alignment so the footer is properly aligned. */
-
-    /* Initialize header and footer. */
-    PduHdr.u32Magic           = PSP_SERIAL_PSP_2_EXT_PDU_START_MAGIC;
-    PduHdr.u.Fields.cbPdu     = cbPayload;
-    PduHdr.u.Fields.cPdus     = ++pThis->cPdusSent;
-    PduHdr.u.Fields.enmRrnId  = enmPduRrnId;
-    PduHdr.u.Fields.idCcd     = idCcd;
-    PduHdr.u.Fields.rcReq     = rcReq;
-    PduHdr.u.Fields.tsMillies = pspStubGetMillies(pThis);
+    PCPSPPDUTRANSPIF pTranspIf = NULL;
 
-    uint32_t uChkSum = 0;
-    for (uint32_t i = 0; i < ELEMENTS(PduHdr.u.ab); i++)
-        uChkSum += PduHdr.u.ab[i];
+    if (pThis->fTranspIrq)
+    {
+        pspStubPlatIrqDisable();
+        pThis->fTranspIrq = false;
+    }
 
-    const uint8_t *pbPayload = (const uint8_t *)pvPayload1;
-    for (size_t i = 0; i < cbPayload1; i++)
-        uChkSum += pbPayload[i];
+#ifdef PSP_SERIAL_STUB_MULTIPATH
+    pspStubLinksDetach(pThis);
+#endif
+    pThis->pIfTransp->pfnTerm(pThis->hPduTransp);
+    pThis->pIfTransp = NULL;
+    memset(&pThis->abTranspData[0], 0, sizeof(pThis->abTranspData[0]));
+}
 
-    pbPayload = (const uint8_t *)pvPayload2;
-    for (size_t i = 0; i < cbPayload2; i++)
-        uChkSum += pbPayload[i];
 
-    /* The padding needs no checksum during generation as it is always 0. */
+#ifdef PSP_SERIAL_STUB_UART_RX_IRQ
+/**
+ * Switches the transport to interrupt driven reception if supported, stays with polling
+ * if the interrupt doesn't arrive.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ */
+static void pspStubTranspIrqInit(PPSPSTUBSTATE pThis)
+{
+    if (!pThis->pIfTransp->pfnIrqSet)
+        return;
 
-    PduFooter.u32ChkSum = (0xffffffff - uChkSum) + 1;
-    PduFooter.u32Magic  = PSP_SERIAL_PSP_2_EXT_PDU_END_MAGIC;
-
-    /* Send everything, header first, then payload and footer last. */
-    pspStubTranspBegin(pThis);
-    int rc = pspStubTranspWrite(pThis, &PduHdr, sizeof(PduHdr));
-    if (!rc && pvPayload1 && cbPayload1)
-        rc = pspStubTranspWrite(pThis, pvPayload1, cbPayload1);
-    if (!rc && pvPayload2 && cbPayload2)
-        rc = pspStubTranspWrite(pThis, pvPayload2, cbPayload2);
-    if (!rc && cbPad)
-        rc = pspStubTranspWrite(pThis, &abPad[0], cbPad);
+    int rc = pThis->pIfTransp->pfnIrqSet(pThis->hPduTransp, true /*fEnable*/);
     if (!rc)
-        rc = pspStubTranspWrite(pThis, &PduFooter, sizeof(PduFooter));
-    pspStubTranspEnd(pThis);
+    {
+        pThis->cTranspIrqs = 0;
+        pThis->fTranspIrq  = true;
+        pspStubPlatIrqEnable();
 
-    return rc;
+        /* The transport raises an interrupt right away, wait for it to show up. */
+        uint32_t cMillies = 0;
+        while (   !pThis->cTranspIrqs
+               && cMillies++ < PSP_SERIAL_STUB_TRANSP_IRQ_VERIFY_MS)
+            pspStubDelayMs(pThis, 1);
+
+        if (pThis->cTranspIrqs)
+        {
+            LogRel("pspStubTranspIrqInit: Interrupt driven reception enabled\n");
+            return;
+        }
+
+        pspStubPlatIrqDisable();
+        pThis->fTranspIrq = false;
+        rc = ERR_INVALID_STATE;
+    }
+
+    pThis->pIfTransp->pfnIrqSet(pThis->hPduTransp, false /*fEnable*/);
+    LogRel("pspStubTranspIrqInit: Interrupt not routed (%d), staying with polled reception\n", rc);
 }
+#endif
 
 
 /**
- * Sends the given PDU.
+ * Lets the transport make progress on queued transmissions without blocking.
  *
- * @returns Status code.
+ * @returns nothing.
  * @param   pThis                   The serial stub instance data.
- * @param   rcReq                   Status code for a sresponse PDU.
- * @param   idCcd                   The CCD ID the PDU is designated for.
- * @param   enmPduRrnId             The Request/Response/Notification ID.
- * @param   pvPayload               Pointer to the PDU payload to send, optional.
- * @param   cbPayload               Size of the PDU payload in bytes.
+ *
+ * @note Safe to call from delay loops as only transports not using delays themselves implement the callback.
  */
-static int pspStubPduSend(PPSPSTUBSTATE pThis, int32_t rcReq, uint32_t idCcd, PSPSERIALPDURRNID enmPduRrnId, const void *pvPayload, size_t cbPayload)
+static void pspStubTranspPoll(PPSPSTUBSTATE pThis)
 {
-    pspStubPduSend2(pThis, rcReq, idCcd, enmPduRrnId, pvPayload, cbPayload, NULL /*pvPayload2*/, 0 /*cbPayload2*/);
+    if (   pThis->pIfTransp
+        && pThis->pIfTransp->pfnPoll)
+        pThis->pIfTransp->pfnPoll(pThis->hPduTransp);
 }
 
 
 /**
- * Resets the PDU receive state machine.
+ * Returns the number of bytes available for reading.
  *
- * @returns nothing.
+ * @returns Number of bytes available for reading.
  * @param   pThis                   The serial stub instance data.
  */
-static void pspStubPduRecvReset(PPSPSTUBSTATE pThis)
+static size_t pspStubTranspPeek(PPSPSTUBSTATE pThis)
 {
-    pThis->enmPduRecvState = PSPSERIALPDURECVSTATE_HDR;
-    pThis->cbPduRecvLeft   = sizeof(PSPSERIALPDUHDR);
-    pThis->offPduRecv      = 0;
+    return pThis->pIfTransp->pfnPeek(pThis->hPduTransp);
 }
 
 
 /**
- * Validates the given PDU header.
+ * Writes the given data to the underyling transport channel.
  *
  * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   pHdr                    PDU header to validate.
+ * @param   pvBuf                   The data to write.
+ * @param   cbWrite                 Number of bytes to write.
  */
-static int pspStubPduHdrValidate(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR pHdr)
+static int pspStubTranspWrite(PPSPSTUBSTATE pThis, const void *pvBuf, size_t cbWrite)
 {
-    if (pHdr->u32Magic != PSP_SERIAL_EXT_2_PSP_PDU_START_MAGIC)
-        return -1;
-    if (pHdr->u.Fields.cbPdu > sizeof(pThis->abPdu) - sizeof(PSPSERIALPDUHDR) - sizeof(PSPSERIALPDUFOOTER))
-        return -1;
-    if (   pHdr->u.Fields.enmRrnId < PSPSERIALPDURRNID_REQUEST_FIRST
-        || pHdr->u.Fields.enmRrnId >= PSPSERIALPDURRNID_REQUEST_INVALID_FIRST)
-        return -1;
-    if (pHdr->u.Fields.cPdus != pThis->cPduRecvNext)
-        return -1;
-    if (pHdr->u.Fields.idCcd >= pThis->cCcds)
-        return -1;
-
-    return 0;
+    return pThis->pIfTransp->pfnWrite(pThis->hPduTransp, pvBuf, cbWrite, NULL /*pcbWritten*/);
 }
 
 
 /**
- * Validates the complete PDU, the header was validated mostly at an earlier stage already.
+ * Reads data from the underyling transport channel.
  *
  * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   pHdr                    The header of the PDU to validate.
+ * @param   pvBuf                   Where to store the read data.
+ * @param   cbRead                  Number of bytes to read.
  */
-static int pspStubPduValidate(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR pHdr)
+static int pspStubTranspRead(PPSPSTUBSTATE pThis, void *pvBuf, size_t cbRead)
 {
-    uint32_t uChkSum = 0;
-    size_t cbPad = ((pHdr->u.Fields.cbPdu + 7) & ~7) - pHdr->u.Fields.cbPdu;
+    return pThis->pIfTransp->pfnRead(pThis->hPduTransp, pvBuf, cbRead, NULL /*pcbRead*/);
+}
 
-    for (uint32_t i = 0; i < ELEMENTS(pHdr->u.ab); i++)
-        uChkSum += pHdr->u.ab[i];
 
-    /* Verify padding is all 0 by including it in the checksum. */
-    uint8_t *pbPayload = (uint8_t *)(pHdr + 1);
-    for (uint32_t i = 0; i < pHdr->u.Fields.cbPdu + cbPad; i++)
-        uChkSum += *pbPayload++;
+/**
+ * Marks begin of an access to the underyling transport channel.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvBuf                   Where to store the read data.
+ * @param   cbRead                  Number of bytes to read.
+ */
+static int pspStubTranspBegin(PPSPSTUBSTATE pThis)
+{
+    return pThis->pIfTransp->pfnBegin(pThis->hPduTransp);
+}
 
-    /* Check whether the footer magic and checksum are valid. */
-    PCPSPSERIALPDUFOOTER pFooter = (PCPSPSERIALPDUFOOTER)pbPayload;
-    if (   uChkSum + pFooter->u32ChkSum != 0
-        || pFooter->u32Magic != PSP_SERIAL_EXT_2_PSP_PDU_END_MAGIC)
-        return -1;
 
-    return 0;
+/**
+ * Marks end of an access to the underyling transport channel.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvBuf                   Where to store the read data.
+ * @param   cbRead                  Number of bytes to read.
+ */
+static int pspStubTranspEnd(PPSPSTUBSTATE pThis)
+{
+    return pThis->pIfTransp->pfnEnd(pThis->hPduTransp);
 }
 
 
 /**
- * Processes the current state and advances to the next one.
+ * Writes up to the given amount of bytes from the transmit queue to the transport, oldest PDU first.
  *
  * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   ppPduRcvd               Where to store the pointer to the received complete PDU on success.
+ * @param   cbMax                   Maximum number of bytes to write.
  */
-static int pspStubPduRecvAdvance(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR *ppPduRcvd)
+static int pspStubTxQueueDrain(PPSPSTUBSTATE pThis, size_t cbMax)
 {
     int rc = INF_SUCCESS;
 
-    *ppPduRcvd = NULL;
+    /* Logging from inside the transport would end up here again and interleave PDUs. */
+    if (pThis->fTxDraining)
+        return INF_SUCCESS;
 
-    switch (pThis->enmPduRecvState)
+    pThis->fTxDraining = true;
+
+    /* Let the transport move previously queued data along. */
+    pspStubTranspPoll(pThis);
+
+    while (   pThis->cTxQueued
+           && cbMax)
     {
-        case PSPSERIALPDURECVSTATE_HDR:
-        {
-            /* Validate header. */
-            PCPSPSERIALPDUHDR pHdr = (PCPSPSERIALPDUHDR)&pThis->abPdu[0];
+        PPSPSTUBTXBUF pTxBuf = &pThis->aTxBufs[pThis->aidxTxQueue[pThis->idxTxQueueHead]];
+        size_t cbThisXmit = MIN(cbMax, pTxBuf->cbPdu - pTxBuf->offXmit);
+        size_t cbWritten = cbThisXmit;
 
-            int rc2 = pspStubPduHdrValidate(pThis, pHdr);
-            if (!rc2)
-            {
-                /* No payload means going directly to the footer. */
-                if (pHdr->u.Fields.cbPdu)
-                {
-                    size_t cbPad = ((pHdr->u.Fields.cbPdu + 7) & ~7) - pHdr->u.Fields.cbPdu;
-                    pThis->enmPduRecvState = PSPSERIALPDURECVSTATE_PAYLOAD;
-                    pThis->cbPduRecvLeft   = pHdr->u.Fields.cbPdu + cbPad;
-                }
-                else
-                {
-                    pThis->enmPduRecvState = PSPSERIALPDURECVSTATE_FOOTER;
-                    pThis->cbPduRecvLeft   = sizeof(PSPSERIALPDUFOOTER);
-                }
-            }
-            else
+        /* Prefer queueing only what the transport can take right now over waiting for it. */
+        pspStubTranspBegin(pThis);
+        if (pThis->pIfTransp->pfnWriteNB)
+        {
+            rc = pThis->pIfTransp->pfnWriteNB(pThis->hPduTransp, &pTxBuf->pbPdu[pTxBuf->offXmit], cbThisXmit, &cbWritten);
+            if (rc == INF_TRY_AGAIN)
             {
-                /** @todo Send out of band error. */
-                pspStubPduRecvReset(pThis);
+                rc = INF_SUCCESS;
+                cbWritten = 0;
             }
-            break;
         }
-        case PSPSERIALPDURECVSTATE_PAYLOAD:
+        else
+            rc = pspStubTranspWrite(pThis, &pTxBuf->pbPdu[pTxBuf->offXmit], cbThisXmit);
+        pspStubTranspEnd(pThis);
+
+        pTxBuf->offXmit += cbWritten;
+        cbMax           -= cbThisXmit;
+
+        /* The PDU is dropped on an error as the old synchronous send path did. */
+        if (   rc
+            || pTxBuf->offXmit == pTxBuf->cbPdu)
         {
-            /* Just advance to the next state. */
-            pThis->enmPduRecvState = PSPSERIALPDURECVSTATE_FOOTER;
-            pThis->cbPduRecvLeft   = sizeof(PSPSERIALPDUFOOTER);
-            break;
+            pTxBuf->enmState      = PSPSTUBTXBUFSTATE_FREE;
+            pThis->idxTxQueueHead = (pThis->idxTxQueueHead + 1) % ELEMENTS(pThis->aidxTxQueue);
+            pThis->cTxQueued--;
         }
-        case PSPSERIALPDURECVSTATE_FOOTER:
-        {
-            /* Validate the footer and complete PDU. */
-            PCPSPSERIALPDUHDR pHdr = (PCPSPSERIALPDUHDR)&pThis->abPdu[0];
 
-            rc = pspStubPduValidate(pThis, pHdr);
-            if (!rc)
-            {
-                pThis->cPduRecvNext++;
-                *ppPduRcvd = pHdr;
-            }
-            /** @todo Send out of band error. */
-            /* Start receiving a new PDU in any case. */
-            pspStubPduRecvReset(pThis);
+        if (   rc
+            || !cbWritten)
             break;
-        }
-        default:
-            rc = ERR_INVALID_STATE;
     }
+    pThis->fTxDraining = false;
 
     return rc;
 }
 
 
 /**
- * Waits for a PDU to be received or until the given timeout elapsed.
+ * Writes everything in the transmit queue to the transport and waits until it was transmitted completely.
  *
  * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   ppPduRcvd               Where to store the pointer to the received complete PDU on success.
- * @param   cMillies                Amount of milliseconds to wait until a timeout is returned.
  */
-static int pspStubPduRecv(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR *ppPduRcvd, uint32_t cMillies)
+static int pspStubTxQueueFlush(PPSPSTUBSTATE pThis)
 {
     int rc = INF_SUCCESS;
-    uint32_t tsStartMs = pspStubGetMillies(pThis);
-
-    do
-    {
-        /*
-         * Check for pending interrupts and send a notification (needs to be done here
-         * as this is the core runloop during PDU processing and when code modules are executed).
-         */
-        pspStubIrqProcess(pThis);
-
-        size_t cbAvail = pspStubTranspPeek(pThis);
-        if (cbAvail)
-        {
-            /* Only read what is required for the current state. */
-            /** @todo If the connection turns out to be unreliable we have to do a marker search first. */
-            size_t cbThisRecv = MIN(cbAvail, pThis->cbPduRecvLeft);
 
-            rc = pspStubTranspRead(pThis, &pThis->abPdu[pThis->offPduRecv], cbThisRecv);
-            if (!rc)
-            {
-                pThis->offPduRecv    += cbThisRecv;
-                pThis->cbPduRecvLeft -= cbThisRecv;
-
-                /* Advance state machine and process the data if this state is complete. */
-                if (!pThis->cbPduRecvLeft)
-                {
-                    rc = pspStubPduRecvAdvance(pThis, ppPduRcvd);
-                    if (   !rc
-                        && *ppPduRcvd != NULL)
-                        break; /* We received a complete and valid PDU. */
-                }
-            }
-        }
-    } while (   !rc
-             && (   pspStubGetMillies(pThis) - tsStartMs < cMillies
-                 || cMillies == PSP_SERIAL_STUB_INDEFINITE_WAIT));
+    while (   pThis->cTxQueued
+           && !rc)
+        rc = pspStubTxQueueDrain(pThis, SIZE_MAX);
 
     if (   !rc
-        && !*ppPduRcvd
-        && tsStartMs + pspStubGetMillies(pThis) >= cMillies)
-        rc = INF_TRY_AGAIN;
+        && pThis->pIfTransp->pfnFlush)
+        rc = pThis->pIfTransp->pfnFlush(pThis->hPduTransp);
 
     return rc;
 }
 
 
 /**
- * Waits for a connect request PDU.
+ * Finds the smallest free transmit buffer taking the given payload size.
  *
- * @returns Status code.
+ * @returns Index of the buffer or UINT32_MAX if none is free.
  * @param   pThis                   The serial stub instance data.
- * @param   cMillies                Amount of milliseconds to wait.
+ * @param   cbPayload               The payload size the buffer must take.
  */
-static int pspStubCheckConnection(PPSPSTUBSTATE pThis, uint32_t cMillies)
+static uint32_t pspStubTxBufFindFree(PPSPSTUBSTATE pThis, size_t cbPayload)
 {
-    PCPSPSERIALPDUHDR pPdu;
-    int rc = pspStubPduRecv(pThis, &pPdu, cMillies);
-    if (rc == INF_SUCCESS)
+    uint32_t idxTxBuf = UINT32_MAX;
+
+    for (uint32_t i = 0; i < ELEMENTS(pThis->aTxBufs); i++)
     {
-        /* We expect a connect request here. */
-        if (pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_CONNECT)
+        PPSPSTUBTXBUF pTxBuf = &pThis->aTxBufs[i];
+
+        if (   pTxBuf->enmState == PSPSTUBTXBUFSTATE_FREE
+            && pTxBuf->cbPayloadMax >= cbPayload
+            && (   idxTxBuf == UINT32_MAX
+                || pTxBuf->cbPayloadMax < pThis->aTxBufs[idxTxBuf].cbPayloadMax))
+            idxTxBuf = i;
+    }
+
+    return idxTxBuf;
+}
+
+
+/**
+ * Acquires a free transmit buffer, waiting for the oldest queued PDU to be written if none is free.
+ *
+ * @returns Index of the acquired buffer or UINT32_MAX if none is available (when called recursively while draining
+ *          or when the only buffer large enough is the staging buffer).
+ * @param   pThis                   The serial stub instance data.
+ * @param   enmState                The state to put the acquired buffer in.
+ * @param   cbPayload               The payload size the buffer must take.
+ */
+static uint32_t pspStubTxBufAcquire(PPSPSTUBSTATE pThis, PSPSTUBTXBUFSTATE enmState, size_t cbPayload)
+{
+    for (;;)
+    {
+        uint32_t idxTxBuf = pspStubTxBufFindFree(pThis, cbPayload);
+        if (idxTxBuf != UINT32_MAX)
         {
-            /* Send our response with some information. */
-            PSPSERIALCONNECTRESP Resp;
+            pThis->aTxBufs[idxTxBuf].enmState = enmState;
+            pThis->aTxBufs[idxTxBuf].cbPdu    = 0;
+            pThis->aTxBufs[idxTxBuf].offXmit  = 0;
+            return idxTxBuf;
+        }
 
-            Resp.cbPduMax       = sizeof(pThis->abPdu);
-            Resp.cbScratch      = sizeof(pThis->abScratch);
-            Resp.PspAddrScratch = (PSPADDR)(uintptr_t)&pThis->abScratch[0];
-            Resp.cSysSockets    = 1; /** @todo */
-            Resp.cCcdsPerSocket = 1; /** @todo */
-            Resp.au32Pad0       = 0;
+        if (   pThis->fTxDraining
+            || !pThis->cTxQueued)
+            return UINT32_MAX;
 
-            /* Reset the PDU counter. */
-            pThis->cPdusSent     = 0;
+        /* Free up the oldest buffer, errors are ignored as the buffer is released anyway. */
+        PPSPSTUBTXBUF pTxBuf = &pThis->aTxBufs[pThis->aidxTxQueue[pThis->idxTxQueueHead]];
+        pspStubTxQueueDrain(pThis, pTxBuf->cbPdu - pTxBuf->offXmit);
+    }
+}
 
-            rc = pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_RESPONSE_CONNECT, &Resp, sizeof(Resp));
+
+/**
+ * Returns the payload area of the staging transmit buffer for the request currently being processed,
+ * passing it as the payload to pspStubPduSend()/pspStubPduSend2() avoids copying the data.
+ *
+ * @returns Pointer to the payload area of PSP_SERIAL_STUB_TX_PAYLOAD_MAX bytes or NULL if no transmit buffer
+ *          could be freed up (the caller fails the request with ERR_BUFFER_OVERFLOW).
+ * @param   pThis                   The serial stub instance data.
+ *
+ * @note Must not be called while draining the transmit queue.
+ */
+static void *pspStubPduRespBufGet(PPSPSTUBSTATE pThis)
+{
+    if (pThis->idxTxBufStaging == UINT32_MAX)
+    {
+        uint32_t idxTxBuf = pspStubTxBufAcquire(pThis, PSPSTUBTXBUFSTATE_STAGING, PSP_SERIAL_STUB_TX_PAYLOAD_MAX);
+        if (idxTxBuf == UINT32_MAX)
+            return NULL;
+
+        pThis->idxTxBufStaging = idxTxBuf;
+    }
+
+    return &pThis->aTxBufs[pThis->idxTxBufStaging].pbPdu[sizeof(PSPSERIALPDUHDR)];
+}
+
+
+/**
+ * Releases the staging transmit buffer if the request didn't use it for its response.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ */
+static void pspStubPduRespBufRelease(PPSPSTUBSTATE pThis)
+{
+    if (pThis->idxTxBufStaging != UINT32_MAX)
+    {
+        pThis->aTxBufs[pThis->idxTxBufStaging].enmState = PSPSTUBTXBUFSTATE_FREE;
+        pThis->idxTxBufStaging = UINT32_MAX;
+    }
+}
+
+
+/**
+ * Fills in the header, padding and footer of a PDU whose payload is in place already.
+ *
+ * @returns Size of the complete PDU in bytes.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pPduHdr                 The PDU header, followed by the payload.
+ * @param   cPdus                   The PDU counter value for this PDU.
+ * @param   rcReq                   Status code for a sresponse PDU.
+ * @param   idCcd                   The CCD ID the PDU is designated for.
+ * @param   enmPduRrnId             The Request/Response/Notification ID.
+ * @param   cbPayload               Size of the PDU payload in bytes.
+ */
+static size_t pspStubPduFinalize(PPSPSTUBSTATE pThis, PPSPSERIALPDUHDR pPduHdr, uint32_t cPdus, int32_t rcReq, uint32_t idCcd,
+                                 PSPSERIALPDURRNID enmPduRrnId, size_t cbPayload)
+{
+    uint8_t *pbPayload = (uint8_t *)(pPduHdr + 1);
+    size_t cbPad = ((cbPayload + 7) & ~7) - cbPayload; /* Pad the payload to an 8 byte alignment so the footer is properly aligned. */
+
+    if (cbPad)
+        memset(pbPayload + cbPayload, 0, cbPad);
+
+    /* Initialize header and footer. */
+    pPduHdr->u32Magic           = PSP_SERIAL_PSP_2_EXT_PDU_START_MAGIC;
+    pPduHdr->u.Fields.cbPdu     = cbPayload;
+    pPduHdr->u.Fields.cPdus     = cPdus;
+    pPduHdr->u.Fields.enmRrnId  = enmPduRrnId;
+    pPduHdr->u.Fields.idCcd     = idCcd;
+    pPduHdr->u.Fields.rcReq     = rcReq;
+    pPduHdr->u.Fields.tsMillies = pspStubGetMillies(pThis);
+
+    uint32_t uChkSum = 0;
+    for (uint32_t i = 0; i < ELEMENTS(pPduHdr->u.ab); i++)
+        uChkSum += pPduHdr->u.ab[i];
+
+    for (size_t i = 0; i < cbPayload; i++)
+        uChkSum += pbPayload[i];
+
+    /* The padding needs no checksum during generation as it is always 0. */
+
+    PPSPSERIALPDUFOOTER pPduFooter = (PPSPSERIALPDUFOOTER)(pbPayload + cbPayload + cbPad);
+    pPduFooter->u32ChkSum = (0xffffffff - uChkSum) + 1;
+    pPduFooter->u32Magic  = PSP_SERIAL_PSP_2_EXT_PDU_END_MAGIC;
+
+    return sizeof(*pPduHdr) + cbPayload + cbPad + sizeof(*pPduFooter);
+}
+
+
+/**
+ * Sends the given PDU - two payload parts.
+ *
+ * The PDU is assembled in a transmit buffer and queued, it is written to the transport in the background
+ * while the stub continues receiving and processing requests.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   rcReq                   Status code for a sresponse PDU.
+ * @param   idCcd                   The CCD ID the PDU is designated for.
+ * @param   enmPduRrnId             The Request/Response/Notification ID.
+ * @param   pvPayload1              Pointer to the PDU payload to send, optional.
+ * @param   cbPayload1              Size of the PDU payload in bytes.
+ * @param   pvPayload2              Pointer to the PDU payload to send, optional.
+ * @param   cbPayload2              Size of the PDU payload in bytes.
+ */
+static int pspStubPduSend2(PPSPSTUBSTATE pThis, int32_t rcReq, uint32_t idCcd, PSPSERIALPDURRNID enmPduRrnId,
+                           const void *pvPayload1, size_t cbPayload1, const void *pvPayload2, size_t cbPayload2)
+{
+    size_t cbPayload = cbPayload1 + cbPayload2;
+
+    if (cbPayload > PSP_SERIAL_STUB_TX_PAYLOAD_MAX)
+        return ERR_BUFFER_OVERFLOW;
+
+    /* Take over the staging buffer if the payload was staged there already, get a new one otherwise. */
+    uint32_t idxTxBuf = UINT32_MAX;
+    if (   pThis->idxTxBufStaging != UINT32_MAX
+        && pvPayload1 == &pThis->aTxBufs[pThis->idxTxBufStaging].pbPdu[sizeof(PSPSERIALPDUHDR)])
+    {
+        idxTxBuf = pThis->idxTxBufStaging;
+        pThis->idxTxBufStaging = UINT32_MAX;
+    }
+    else
+    {
+        idxTxBuf = pspStubTxBufAcquire(pThis, PSPSTUBTXBUFSTATE_STAGING, cbPayload);
+        if (idxTxBuf == UINT32_MAX)
+            return ERR_BUFFER_OVERFLOW;
+
+        if (pvPayload1 && cbPayload1)
+            memcpy(&pThis->aTxBufs[idxTxBuf].pbPdu[sizeof(PSPSERIALPDUHDR)], pvPayload1, cbPayload1);
+    }
+
+    PPSPSTUBTXBUF pTxBuf = &pThis->aTxBufs[idxTxBuf];
+    PPSPSERIALPDUHDR pPduHdr = (PPSPSERIALPDUHDR)&pTxBuf->pbPdu[0];
+    uint8_t *pbPayload = (uint8_t *)(pPduHdr + 1);
+
+    if (pvPayload2 && cbPayload2)
+        memcpy(pbPayload + cbPayload1, pvPayload2, cbPayload2);
+
+    /* Remember how the current request went for the journal. */
+    if (   rcReq != INF_SUCCESS
+        && pThis->rcReqCur == INF_SUCCESS)
+        pThis->rcReqCur = rcReq;
+
+    /* Hand the buffer over to the transmit path. */
+    pTxBuf->cbPdu    = pspStubPduFinalize(pThis, pPduHdr, ++pThis->cPdusSent, rcReq, idCcd, enmPduRrnId, cbPayload);
+    pTxBuf->offXmit  = 0;
+    pTxBuf->enmState = PSPSTUBTXBUFSTATE_QUEUED;
+    pThis->aidxTxQueue[(pThis->idxTxQueueHead + pThis->cTxQueued) % ELEMENTS(pThis->aidxTxQueue)] = idxTxBuf;
+    pThis->cTxQueued++;
+
+    /* Get the transmission going right away, the rest is drained while waiting for the next request. */
+    return pspStubTxQueueDrain(pThis, PSP_SERIAL_STUB_TX_DRAIN_CHUNK);
+}
+
+
+/**
+ * Sends the given PDU.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   rcReq                   Status code for a sresponse PDU.
+ * @param   idCcd                   The CCD ID the PDU is designated for.
+ * @param   enmPduRrnId             The Request/Response/Notification ID.
+ * @param   pvPayload               Pointer to the PDU payload to send, optional.
+ * @param   cbPayload               Size of the PDU payload in bytes.
+ */
+static int pspStubPduSend(PPSPSTUBSTATE pThis, int32_t rcReq, uint32_t idCcd, PSPSERIALPDURRNID enmPduRrnId, const void *pvPayload, size_t cbPayload)
+{
+    return pspStubPduSend2(pThis, rcReq, idCcd, enmPduRrnId, pvPayload, cbPayload, NULL /*pvPayload2*/, 0 /*cbPayload2*/);
+}
+
+
+/**
+ * Resets the PDU receive state machine.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ */
+static void pspStubPduRecvReset(PPSPSTUBSTATE pThis)
+{
+    pThis->enmPduRecvState = PSPSERIALPDURECVSTATE_HDR;
+    pThis->cbPduRecvLeft   = sizeof(PSPSERIALPDUHDR);
+    pThis->offPduRecv      = 0;
+}
+
+
+/**
+ * Validates the given PDU header.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pHdr                    PDU header to validate.
+ */
+static int pspStubPduHdrValidate(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR pHdr)
+{
+    if (pHdr->u32Magic != PSP_SERIAL_EXT_2_PSP_PDU_START_MAGIC)
+        return -1;
+    if (pHdr->u.Fields.cbPdu > sizeof(pThis->abPdu) - sizeof(PSPSERIALPDUHDR) - sizeof(PSPSERIALPDUFOOTER))
+        return -1;
+    if (   (   pHdr->u.Fields.enmRrnId < PSPSERIALPDURRNID_REQUEST_FIRST
+            || pHdr->u.Fields.enmRrnId >= PSPSERIALPDURRNID_REQUEST_INVALID_FIRST)
+        && (   pHdr->u.Fields.enmRrnId < PSPSERIALPDURRNID_EXT_REQUEST_FIRST
+            || pHdr->u.Fields.enmRrnId >= PSPSERIALPDURRNID_EXT_REQUEST_INVALID_FIRST))
+        return -1;
+    if (pHdr->u.Fields.cPdus != pThis->cPduRecvNext)
+        return -1;
+    if (pHdr->u.Fields.idCcd >= pThis->cCcds)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * Validates the complete PDU, the header was validated mostly at an earlier stage already.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pHdr                    The header of the PDU to validate.
+ */
+static int pspStubPduValidate(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR pHdr)
+{
+    uint32_t uChkSum = 0;
+    size_t cbPad = ((pHdr->u.Fields.cbPdu + 7) & ~7) - pHdr->u.Fields.cbPdu;
+
+    for (uint32_t i = 0; i < ELEMENTS(pHdr->u.ab); i++)
+        uChkSum += pHdr->u.ab[i];
+
+    /* Verify padding is all 0 by including it in the checksum. */
+    uint8_t *pbPayload = (uint8_t *)(pHdr + 1);
+    for (uint32_t i = 0; i < pHdr->u.Fields.cbPdu + cbPad; i++)
+        uChkSum += *pbPayload++;
+
+    /* Check whether the footer magic and checksum are valid. */
+    PCPSPSERIALPDUFOOTER pFooter = (PCPSPSERIALPDUFOOTER)pbPayload;
+    if (   uChkSum + pFooter->u32ChkSum != 0
+        || pFooter->u32Magic != PSP_SERIAL_EXT_2_PSP_PDU_END_MAGIC)
+        return -1;
+
+    return 0;
+}
+
+
+/**
+ * Processes the current state and advances to the next one.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   ppPduRcvd               Where to store the pointer to the received complete PDU on success.
+ */
+static int pspStubPduRecvAdvance(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR *ppPduRcvd)
+{
+    int rc = INF_SUCCESS;
+
+    *ppPduRcvd = NULL;
+
+    switch (pThis->enmPduRecvState)
+    {
+        case PSPSERIALPDURECVSTATE_HDR:
+        {
+            /* Validate header. */
+            PCPSPSERIALPDUHDR pHdr = (PCPSPSERIALPDUHDR)&pThis->abPdu[0];
+
+            int rc2 = pspStubPduHdrValidate(pThis, pHdr);
+            if (!rc2)
+            {
+                /* No payload means going directly to the footer. */
+                if (pHdr->u.Fields.cbPdu)
+                {
+                    size_t cbPad = ((pHdr->u.Fields.cbPdu + 7) & ~7) - pHdr->u.Fields.cbPdu;
+                    pThis->enmPduRecvState = PSPSERIALPDURECVSTATE_PAYLOAD;
+                    pThis->cbPduRecvLeft   = pHdr->u.Fields.cbPdu + cbPad;
+                }
+                else
+                {
+                    pThis->enmPduRecvState = PSPSERIALPDURECVSTATE_FOOTER;
+                    pThis->cbPduRecvLeft   = sizeof(PSPSERIALPDUFOOTER);
+                }
+            }
+            else
+            {
+                /** @todo Send out of band error. */
+                pspStubPduRecvReset(pThis);
+            }
+            break;
+        }
+        case PSPSERIALPDURECVSTATE_PAYLOAD:
+        {
+            /* Just advance to the next state. */
+            pThis->enmPduRecvState = PSPSERIALPDURECVSTATE_FOOTER;
+            pThis->cbPduRecvLeft   = sizeof(PSPSERIALPDUFOOTER);
+            break;
+        }
+        case PSPSERIALPDURECVSTATE_FOOTER:
+        {
+            /* Validate the footer and complete PDU. */
+            PCPSPSERIALPDUHDR pHdr = (PCPSPSERIALPDUHDR)&pThis->abPdu[0];
+
+            rc = pspStubPduValidate(pThis, pHdr);
             if (!rc)
             {
-                LogRel("Someone connected to us \\o/...\n");
-                pThis->fConnected = true;
+                pThis->cPduRecvNext++;
+                *ppPduRcvd = pHdr;
             }
+            /** @todo Send out of band error. */
+            /* Start receiving a new PDU in any case. */
+            pspStubPduRecvReset(pThis);
+            break;
+        }
+        default:
+            rc = ERR_INVALID_STATE;
+    }
+
+    return rc;
+}
+
+
+/**
+ * Waits for a PDU to be received or until the given timeout elapsed.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   ppPduRcvd               Where to store the pointer to the received complete PDU on success.
+ * @param   cMillies                Amount of milliseconds to wait until a timeout is returned.
+ */
+static int pspStubPduRecv(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR *ppPduRcvd, uint32_t cMillies)
+{
+    int rc = INF_SUCCESS;
+    uint32_t tsStartMs = pspStubGetMillies(pThis);
+
+    do
+    {
+        /*
+         * Check for pending interrupts and send a notification (needs to be done here
+         * as this is the core runloop during PDU processing and when code modules are executed).
+         */
+        pspStubIrqProcess(pThis);
+
+        /* Keep the transmit queue moving while waiting for input. */
+        pspStubTxQueueDrain(pThis, PSP_SERIAL_STUB_TX_DRAIN_CHUNK);
+
+        size_t cbAvail = pspStubTranspPeek(pThis);
+        if (cbAvail)
+        {
+            /* Only read what is required for the current state. */
+            /** @todo If the connection turns out to be unreliable we have to do a marker search first. */
+            size_t cbThisRecv = MIN(cbAvail, pThis->cbPduRecvLeft);
+
+            rc = pspStubTranspRead(pThis, &pThis->abPdu[pThis->offPduRecv], cbThisRecv);
+            if (!rc)
+            {
+                pThis->offPduRecv    += cbThisRecv;
+                pThis->cbPduRecvLeft -= cbThisRecv;
+
+                /* Advance state machine and process the data if this state is complete. */
+                if (!pThis->cbPduRecvLeft)
+                {
+                    rc = pspStubPduRecvAdvance(pThis, ppPduRcvd);
+                    if (   !rc
+                        && *ppPduRcvd != NULL)
+                        break; /* We received a complete and valid PDU. */
+                }
+            }
+        }
+    } while (   !rc
+             && (   pspStubGetMillies(pThis) - tsStartMs < cMillies
+                 || cMillies == PSP_SERIAL_STUB_INDEFINITE_WAIT));
+
+    if (   !rc
+        && !*ppPduRcvd
+        && tsStartMs + pspStubGetMillies(pThis) >= cMillies)
+        rc = INF_TRY_AGAIN;
+
+    return rc;
+}
+
+
+/**
+ * Exchanges the link in use with the given additional link.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   idxLink                 Index of the additional link.
+ */
+static void pspStubLinkSwap(PPSPSTUBSTATE pThis, uint32_t idxLink)
+{
+    PPSPSTUBLINK pLink = pspStubLinkGet(pThis, idxLink);
+
+    /* Only the handles move, the transport instance data stays where it was initialized. */
+    PCPSPPDUTRANSPIF pIfTransp = pThis->pIfTransp;
+    PSPPDUTRANSP hPduTransp = pThis->hPduTransp;
+    PSPSTUBLINKTPUT Tput = pThis->TputTransp;
+
+    pThis->pIfTransp  = pLink->pIfTransp;
+    pThis->hPduTransp = pLink->hPduTransp;
+    pThis->TputTransp = pLink->Tput;
+    pLink->pIfTransp  = pIfTransp;
+    pLink->hPduTransp = hPduTransp;
+    pLink->Tput       = Tput;
+}
+
+
+/**
+ * Moves the connection over to the given link, falling back to the current one
+ * if the host doesn't send a request on the new link in time.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   idLink                  The link to move to (1 based index of the additional link).
+ * @param   cMillisVerify           How long to wait for the first request on the new link.
+ */
+static int pspStubLinkSwitch(PPSPSTUBSTATE pThis, uint32_t idLink, uint32_t cMillisVerify)
+{
+    if (   !idLink
+        || idLink > pspStubLinksCount(pThis))
+        return ERR_INVALID_PARAMETER;
+    if (pThis->fTranspIrq)
+        return ERR_INVALID_STATE; /* The interrupt routing is tied to the transport in use. */
+
+    /* Everything queued so far goes out on the current link. */
+    int rc = pspStubTxQueueFlush(pThis);
+    if (rc)
+        return rc;
+
+    pspStubLinkSwap(pThis, idLink - 1);
+    pspStubPduRecvReset(pThis);
+
+    PCPSPSERIALPDUHDR pPdu = NULL;
+    rc = pspStubPduRecv(pThis, &pPdu, cMillisVerify);
+    if (   !rc
+        && pPdu)
+    {
+        LogRel("pspStubLinkSwitch: Moved to link %u\n", idLink);
+        pThis->pPduPending = pPdu; /* Processed next by pspStubPduRecvProcessSingle(), not from down here. */
+        return INF_SUCCESS;
+    }
+
+    LogRel("pspStubLinkSwitch: No request on link %u, falling back\n", idLink);
+    pspStubLinkSwap(pThis, idLink - 1);
+    pspStubPduRecvReset(pThis);
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Returns the transport ID of the given transport.
+ *
+ * @returns Transport ID, see PSP_SERIAL_TRANSP_ID_XXX.
+ * @param   pIfTransp               The transport channel interface.
+ */
+static uint32_t pspStubTranspId(PCPSPPDUTRANSPIF pIfTransp)
+{
+#ifdef PSP_SERIAL_STUB_HOST
+    return pIfTransp == &g_LoopbackTransp ? PSP_SERIAL_TRANSP_ID_LOOPBACK : UINT32_MAX;
+#else
+    for (uint32_t i = 0; i < ELEMENTS(g_aPduTransp); i++)
+    {
+        if (g_aPduTransp[i] == pIfTransp)
+            return i;
+    }
+
+    return UINT32_MAX;
+#endif
+}
+
+
+#ifdef PSP_SERIAL_STUB_TRANSP_AUTO
+
+
+/**
+ * Writes a probe PDU to the given transport without waiting beyond the given deadline.
+ *
+ * @returns Status code, INF_TRY_AGAIN if the PDU couldn't be written completely until the deadline.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pIfTransp               The transport channel interface.
+ * @param   hPduTransp              Handle to the PDU transport channel.
+ * @param   pvPdu                   The complete PDU.
+ * @param   cbPdu                   Size of the PDU in bytes.
+ * @param   usDeadline              Timestamp in microseconds the PDU has to be written by.
+ */
+static int pspStubLinkProbeXmit(PPSPSTUBSTATE pThis, PCPSPPDUTRANSPIF pIfTransp, PSPPDUTRANSP hPduTransp,
+                                const void *pvPdu, size_t cbPdu, uint64_t usDeadline)
+{
+    const uint8_t *pbPdu = (const uint8_t *)pvPdu;
+    int rc = INF_SUCCESS;
+
+    while (cbPdu)
+    {
+        size_t cbWritten = 0;
+
+        if (pIfTransp->pfnPoll)
+            pIfTransp->pfnPoll(hPduTransp);
+
+        pIfTransp->pfnBegin(hPduTransp);
+        rc = pIfTransp->pfnWriteNB(hPduTransp, pbPdu, cbPdu, &cbWritten);
+        pIfTransp->pfnEnd(hPduTransp);
+        if (rc == INF_TRY_AGAIN)
+        {
+            rc = INF_SUCCESS;
+            cbWritten = 0;
+        }
+        if (rc)
+            break;
+
+        pbPdu += cbWritten;
+        cbPdu -= cbWritten;
+        if (   cbPdu
+            && pspStubGetMicros(pThis) >= usDeadline)
+        {
+            rc = INF_TRY_AGAIN;
+            break;
+        }
+    }
+
+    return rc;
+}
+
+
+/**
+ * Waits for the host to acknowledge the given probe on the link requests arrive on.
+ *
+ * @returns Status code, INF_TRY_AGAIN if the acknowledge didn't arrive until the deadline.
+ * @param   pThis                   The serial stub instance data.
+ * @param   idLink                  The link the probe was sent on.
+ * @param   idxProbe                The probe to wait for.
+ * @param   usDeadline              Timestamp in microseconds to give up waiting at.
+ */
+static int pspStubLinkProbeAckWait(PPSPSTUBSTATE pThis, uint32_t idLink, uint32_t idxProbe, uint64_t usDeadline)
+{
+    for (;;)
+    {
+        uint64_t usNow = pspStubGetMicros(pThis);
+        if (usNow >= usDeadline)
+            return INF_TRY_AGAIN;
+
+        PCPSPSERIALPDUHDR pPdu = NULL;
+        int rc = pspStubPduRecv(pThis, &pPdu, MAX((uint32_t)((usDeadline - usNow) / 1000), 1));
+        if (   rc
+            && rc != INF_TRY_AGAIN)
+            return rc;
+
+        /* Anything else, like the acknowledge of a probe which timed out already, is dropped. */
+        if (   !rc
+            && pPdu
+            && pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_LINK_PROBE_ACK
+            && pPdu->u.Fields.cbPdu == sizeof(PSPSERIALLINKPROBEACKREQ))
+        {
+            PCPSPSERIALLINKPROBEACKREQ pAck = (PCPSPSERIALLINKPROBEACKREQ)(pPdu + 1);
+            if (   pAck->idLink == idLink
+                && pAck->idxProbe == idxProbe)
+                return INF_SUCCESS;
+        }
+    }
+}
+
+
+/**
+ * Measures the latency and throughput of a single link, both as seen by the host.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pIfTransp               The transport channel interface of the link.
+ * @param   hPduTransp              Handle to the PDU transport channel.
+ * @param   idLink                  The link ID.
+ * @param   pPduHdr                 Buffer for assembling the probe PDUs.
+ * @param   pProbe                  Where to store the results.
+ */
+static void pspStubLinkProbe(PPSPSTUBSTATE pThis, PCPSPPDUTRANSPIF pIfTransp, PSPPDUTRANSP hPduTransp,
+                             uint32_t idLink, PPSPSERIALPDUHDR pPduHdr, PPSPSERIALLINKPROBE pProbe)
+{
+    PPSPSERIALLINKPROBENOT pNot = (PPSPSERIALLINKPROBENOT)(pPduHdr + 1);
+    PSPSERIALPDURRNID enmNot = PSPSERIALPDURRNID_NOTIFICATION_LINK_PROBE;
+
+    pProbe->idLink     = idLink;
+    pProbe->idTransp   = pspStubTranspId(pIfTransp);
+    pProbe->cbPerSec   = 0;
+    pProbe->cUsLatency = UINT32_MAX;
+
+    /* Without a non blocking write the time spent on the link can't be bounded. */
+    if (!pIfTransp->pfnWriteNB)
+        return;
+
+    /* The latency is the round trip of a minimal probe until the host acknowledged it. */
+    pNot->idLink   = idLink;
+    pNot->idxProbe = 0;
+    pNot->fFlags   = PSP_SERIAL_LINK_PROBE_NOT_F_ACK;
+    pNot->u32Pad0  = 0;
+    size_t cbPdu = pspStubPduFinalize(pThis, pPduHdr, 0 /*cPdus*/, INF_SUCCESS, 0 /*idCcd*/, enmNot, sizeof(*pNot));
+    uint64_t usStart = pspStubGetMicros(pThis);
+    uint64_t usDeadline = usStart + PSP_SERIAL_STUB_LINK_PROBE_ACK_MS * 1000;
+    int rc = pspStubLinkProbeXmit(pThis, pIfTransp, hPduTransp, pPduHdr, cbPdu, usDeadline);
+    if (!rc)
+        rc = pspStubLinkProbeAckWait(pThis, idLink, 0 /*idxProbe*/, usDeadline);
+    if (rc)
+        return;
+    uint64_t cUsLatency = pspStubGetMicros(pThis) - usStart;
+    pProbe->cUsLatency = MIN(cUsLatency, UINT32_MAX);
+
+    /*
+     * Stream filler PDUs for a while and finish with a minimal probe the host acknowledges,
+     * the link is in order so the acknowledge means everything before arrived as well.
+     */
+    uint32_t idxProbe = 1;
+    uint64_t cbXmit = 0;
+    usStart    = pspStubGetMicros(pThis);
+    usDeadline = usStart + (PSP_SERIAL_STUB_LINK_PROBE_MS + PSP_SERIAL_STUB_LINK_PROBE_ACK_MS) * 1000;
+    pNot->fFlags = 0;
+    memset(pNot + 1, 0x55, PSP_SERIAL_STUB_LINK_PROBE_PAYLOAD - sizeof(*pNot));
+    do
+    {
+        pNot->idxProbe = idxProbe++;
+        cbPdu = pspStubPduFinalize(pThis, pPduHdr, 0 /*cPdus*/, INF_SUCCESS, 0 /*idCcd*/, enmNot, PSP_SERIAL_STUB_LINK_PROBE_PAYLOAD);
+        rc = pspStubLinkProbeXmit(pThis, pIfTransp, hPduTransp, pPduHdr, cbPdu, usDeadline);
+        cbXmit += cbPdu;
+    } while (   !rc
+             && idxProbe <= PSP_SERIAL_STUB_LINK_PROBE_PDUS
+             && pspStubGetMicros(pThis) - usStart < PSP_SERIAL_STUB_LINK_PROBE_MS * 1000);
+
+    if (!rc)
+    {
+        pNot->idxProbe = idxProbe;
+        pNot->fFlags   = PSP_SERIAL_LINK_PROBE_NOT_F_ACK;
+        cbPdu = pspStubPduFinalize(pThis, pPduHdr, 0 /*cPdus*/, INF_SUCCESS, 0 /*idCcd*/, enmNot, sizeof(*pNot));
+        rc = pspStubLinkProbeXmit(pThis, pIfTransp, hPduTransp, pPduHdr, cbPdu, usDeadline);
+        cbXmit += cbPdu;
+    }
+    if (!rc)
+        rc = pspStubLinkProbeAckWait(pThis, idLink, idxProbe, usDeadline);
+
+    if (!rc)
+    {
+        /* The round trip of the final probe was measured already and is no transfer time. */
+        uint64_t cUs = pspStubGetMicros(pThis) - usStart;
+        if (cUs > cUsLatency)
+            cUs -= cUsLatency;
+        pProbe->cbPerSec = MIN((cbXmit * 1000000) / MAX(cUs, 1), UINT32_MAX);
+    }
+}
+
+
+/**
+ * Probes all links and selects the one with the highest throughput (the lowest latency on a tie).
+ *
+ * @returns ID of the selected link.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pResp                   The connect response to fill in the measurement results.
+ */
+static uint32_t pspStubLinksProbe(PPSPSTUBSTATE pThis, PPSPSERIALCONNECTRESPEXT pResp)
+{
+    uint32_t idLinkSelected = 0;
+
+    /* Nothing to choose from with a single link. */
+    if (!pThis->cLinks)
+        return 0;
+
+    /* Probes go directly to the transports, nothing must be queued. */
+    if (pspStubTxQueueFlush(pThis))
+        return 0;
+
+    uint32_t idxTxBuf = pspStubTxBufAcquire(pThis, PSPSTUBTXBUFSTATE_STAGING, PSP_SERIAL_STUB_LINK_PROBE_PAYLOAD);
+    if (idxTxBuf == UINT32_MAX)
+        return 0;
+
+    PPSPSERIALPDUHDR pPduHdr = (PPSPSERIALPDUHDR)&pThis->aTxBufs[idxTxBuf].pbPdu[0];
+    pResp->cLinks = MIN(1 + pThis->cLinks, ELEMENTS(pResp->aLinks));
+    for (uint32_t i = 0; i < pResp->cLinks; i++)
+    {
+        PPSPSERIALLINKPROBE pProbe = &pResp->aLinks[i];
+        PPSPSTUBLINKTPUT pTput = i ? &pThis->aLinks[i - 1].Tput : &pThis->TputTransp;
+
+        if (i)
+            pspStubLinkProbe(pThis, pThis->aLinks[i - 1].pIfTransp, pThis->aLinks[i - 1].hPduTransp, i, pPduHdr, pProbe);
+        else
+            pspStubLinkProbe(pThis, pThis->pIfTransp, pThis->hPduTransp, i, pPduHdr, pProbe);
+
+        LogRel("pspStubLinksProbe: Link %u (transport %u): %u bytes/s, %u us latency\n",
+               i, pProbe->idTransp, pProbe->cbPerSec, pProbe->cUsLatency);
+
+        if (pProbe->cbPerSec)
+            pTput->cbPerSec = pProbe->cbPerSec;
+
+        PCPSPSERIALLINKPROBE pBest = &pResp->aLinks[idLinkSelected];
+        if (   pProbe->cbPerSec > pBest->cbPerSec
+            || (   pProbe->cbPerSec == pBest->cbPerSec
+                && pProbe->cUsLatency < pBest->cUsLatency))
+            idLinkSelected = i;
+    }
+
+    pThis->aTxBufs[idxTxBuf].enmState = PSPSTUBTXBUFSTATE_FREE;
+    return idLinkSelected;
+}
+#endif
+
+
+/**
+ * Queries the link information from the given transport.
+ *
+ * @returns nothing.
+ * @param   pIfTransp               The transport channel interface.
+ * @param   hPduTransp              Handle to the PDU transport channel.
+ * @param   pLink                   Where to store the link information.
+ */
+static void pspStubLinkInfoQuery(PCPSPPDUTRANSPIF pIfTransp, PSPPDUTRANSP hPduTransp, PPSPSERIALLINKINFO pLink)
+{
+    uint32_t uBps = 0;
+    uint32_t cbPerSec = 0;
+    bool fCalibrated = false;
+
+    if (   !pIfTransp->pfnLinkSpeedGet
+        || pIfTransp->pfnLinkSpeedGet(hPduTransp, &uBps, &cbPerSec, &fCalibrated))
+    {
+        uBps        = 0;
+        fCalibrated = false;
+    }
+
+    pLink->uLinkBps = uBps;
+    pLink->fLink    = fCalibrated ? PSP_SERIAL_LINK_INFO_F_CALIBRATED : 0;
+}
+
+
+/**
+ * Waits for a connect request PDU.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   cMillies                Amount of milliseconds to wait.
+ */
+static int pspStubCheckConnection(PPSPSTUBSTATE pThis, uint32_t cMillies)
+{
+    PCPSPSERIALPDUHDR pPdu;
+    int rc = pspStubPduRecv(pThis, &pPdu, cMillies);
+    if (rc == INF_SUCCESS)
+    {
+        /* We expect a connect request here. */
+        if (pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_CONNECT)
+        {
+            /* Send our response with some information. */
+            PSPSERIALCONNECTRESPEXT Resp;
+            uint32_t idLinkSelected = 0;
+
+            Resp.Core.cbPduMax       = sizeof(pThis->abPdu);
+            Resp.Core.cbScratch      = sizeof(pThis->abScratch);
+            Resp.Core.PspAddrScratch = pspStubPlatPtrToPspAddr(&pThis->abScratch[0]);
+            Resp.Core.cSysSockets    = 1; /** @todo */
+            Resp.Core.cCcdsPerSocket = 1; /** @todo */
+            Resp.Core.au32Pad0       = 0;
+            Resp.cbExt               = sizeof(Resp) - sizeof(Resp.Core);
+            Resp.u32Pad0             = 0;
+            Resp.cLinks              = 0;
+            memset(&Resp.aLinks[0], 0, sizeof(Resp.aLinks));
+#ifdef PSP_SERIAL_STUB_TRANSP_AUTO
+            if (!pThis->fTranspIrq)
+                idLinkSelected = pspStubLinksProbe(pThis, &Resp);
+#endif
+            Resp.idLinkSelected      = idLinkSelected;
+            if (idLinkSelected)
+            {
+                PPSPSTUBLINK pLink = pspStubLinkGet(pThis, idLinkSelected - 1);
+                pspStubLinkInfoQuery(pLink->pIfTransp, pLink->hPduTransp, &Resp.Link);
+            }
+            else
+                pspStubLinkInfoQuery(pThis->pIfTransp, pThis->hPduTransp, &Resp.Link);
+
+            /* Reset the PDU counter. */
+            pThis->cPdusSent     = 0;
+
+            rc = pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_RESPONSE_CONNECT, &Resp, sizeof(Resp));
+            if (!rc)
+            {
+                LogRel("Someone connected to us \\o/...\n");
+                pThis->fConnected = true;
+
+                /* The connect response announced the selected link, falls back to this one if the host doesn't follow. */
+                if (idLinkSelected)
+                    pspStubLinkSwitch(pThis, idLinkSelected, PSP_SERIAL_STUB_LINK_SWITCH_VERIFY_MS);
+            }
+        }
+        /** @todo else Send out of band error. */
+    }
+    /* else Timeout -> return */
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Waits for single PDU to arrive in the given timespan and processes it.
+ *
+ * A request received while finishing a link change is processed right away instead, the handler
+ * of the link change hands it back here so processing never nests on the stack.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   cMillies                Amount of milliseconds to wait.
+ */
+static int pspStubPduRecvProcessSingle(PPSPSTUBSTATE pThis, uint32_t cMillies)
+{
+    PCPSPSERIALPDUHDR pPdu = pThis->pPduPending;
+    int rc = INF_SUCCESS;
+
+    if (pPdu)
+        pThis->pPduPending = NULL;
+    else
+        rc = pspStubPduRecv(pThis, &pPdu, cMillies);
+    if (!rc)
+        rc = pspStubPduProcess(pThis, pPdu);
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{CMIF,pfnInBufPeek}
+ */
+size_t pspStubCmIfInBufPeek(PCCMIF pCmIf, uint32_t idInBuf)
+{
+    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
+    PPSPSTUBSTATE pThis = pExec->pStub;
+
+    size_t cbAvail = 0;
+    if (idInBuf < ELEMENTS(pThis->aInBufs))
+    {
+        PPSPINBUF pInBuf = &pThis->aInBufs[idInBuf];
+        if (!pInBuf->offInBuf) /* One check whether we can receive a new PDU. */
+            pspStubPduRecvProcessSingle(pThis, 0 /*cMillies*/);
+
+        cbAvail = pInBuf->offInBuf;
+    }
+
+    return cbAvail;
+}
+
+
+/**
+ * @copydoc{CMIF,pfnInBufPoll}
+ */
+int pspStubCmIfInBufPoll(PCCMIF pCmIf, uint32_t idInBuf, uint32_t cMillies)
+{
+    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
+    PPSPSTUBSTATE pThis = pExec->pStub;
+
+    int rc = INF_SUCCESS;
+    if (idInBuf < ELEMENTS(pThis->aInBufs))
+    {
+        PPSPINBUF pInBuf = &pThis->aInBufs[idInBuf];
+
+        if (!pInBuf->offInBuf)
+        {
+            do
+            {
+                uint32_t tsStart = pspStubGetMillies(pThis);
+                rc = pspStubPduRecvProcessSingle(pThis, cMillies);
+                cMillies -= MIN(pspStubGetMillies(pThis) - tsStart, cMillies);
+            } while (   !rc
+                     && !pInBuf->offInBuf);
+        }
+    }
+    else
+        rc = ERR_INVALID_PARAMETER;
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{CMIF,pfnInBufRead}
+ */
+int pspStubCmIfInBufRead(PCCMIF pCmIf, uint32_t idInBuf, void *pvBuf, size_t cbRead, size_t *pcbRead)
+{
+    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
+    PPSPSTUBSTATE pThis = pExec->pStub;
+
+    int rc = INF_SUCCESS;
+    if (idInBuf < ELEMENTS(pThis->aInBufs))
+    {
+        PPSPINBUF pInBuf = &pThis->aInBufs[idInBuf];
+
+        if (pcbRead)
+        {
+            /* Can handle partial reads. */
+            if (pspStubCmIfInBufPeek(pCmIf, idInBuf))
+            {
+                size_t cbThisRead = MIN(pInBuf->offInBuf, cbRead);
+                memcpy(pvBuf, pInBuf->pvInBuf, cbThisRead);
+
+                /* Move everyting to the front. */
+                if (cbThisRead < pInBuf->offInBuf)
+                {
+                    uint8_t *pbInBuf = (uint8_t *)pInBuf->pvInBuf;
+                    size_t cbLeft = pInBuf->offInBuf - cbThisRead;
+
+                    /** @todo memmove. */
+                    for (uint32_t i = 0; i < cbLeft; i++)
+                        pbInBuf[i] = pbInBuf[cbThisRead + i];
+
+                    pInBuf->offInBuf -= cbThisRead;
+                }
+                *pcbRead = cbThisRead;
+            }
+            else
+                *pcbRead = 0;
+        }
+        else
+        {
+            /* Loop until we've read all requested data. */
+            uint8_t *pbBuf = (uint8_t *)pvBuf;
+
+            do
+            {
+                rc = pspStubCmIfInBufPoll(pCmIf, idInBuf, CM_WAIT_INDEFINITE);
+                if (!rc)
+                {
+                    size_t cbThisRead = MIN(cbRead, pInBuf->offInBuf);
+
+                    memcpy(pbBuf, pInBuf->pvInBuf, cbThisRead);
+                    if (cbThisRead < pInBuf->offInBuf)
+                    {
+                        uint8_t *pbInBuf = (uint8_t *)pInBuf->pvInBuf;
+                        size_t cbLeft = pInBuf->offInBuf - cbThisRead;
+
+                        /* Move everything to the front. */
+                        for (uint32_t i = 0; i < cbLeft; i++)
+                            pbInBuf[i] = pbInBuf[cbThisRead + i];
+                    }
+
+                    pInBuf->offInBuf -= cbThisRead;
+                    pbBuf            += cbThisRead;
+                    cbRead           -= cbThisRead;
+                }
+            } while (   !rc
+                     && cbRead);
+        }
+    }
+    else
+        rc = ERR_INVALID_PARAMETER;
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{CMIF,pfnOutBufWrite}
+ */
+int pspStubCmIfOutBufWrite(PCCMIF pCmIf, uint32_t idOutBuf, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
+    PPSPSTUBSTATE pThis = pExec->pStub;
+
+    PSPSERIALOUTBUFNOT OutBufNot;
+    OutBufNot.idOutBuf = idOutBuf;
+    OutBufNot.u32Pad0  = 0;
+    int rc = pspStubPduSend2(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_NOTIFICATION_OUT_BUF,
+                             &OutBufNot, sizeof(OutBufNot), pvBuf, cbWrite);
+    if (   !rc
+        && pcbWritten)
+        *pcbWritten = cbWrite;
+
+    return rc;
+}
+
+
+/**
+ * @copydoc{CMIF,pfnDelayMs}
+ */
+void pspStubCmIfDelayMs(PCCMIF pCmIf, uint32_t cMillies)
+{
+    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
+    PPSPSTUBSTATE pThis = pExec->pStub;
+
+    pspStubDelayMs(pThis, cMillies);
+}
+
+
+/**
+ * @copydoc{CMIF,pfnTsGetMilli}
+ */
+uint32_t pspStubCmIfTsGetMilli(PCCMIF pCmIf)
+{
+    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
+    PPSPSTUBSTATE pThis = pExec->pStub;
+
+    return pspStubGetMillies(pThis);
+}
+
+
+/**
+ * Converts the given excpetion to a string literal.
+ *
+ * @returns Pointer to string.
+ * @param   enmExcp                 The exception to convert to a string.
+ */
+static const char *pspStubExcpToStr(PSPSTUBEXCP enmExcp)
+{
+    switch (enmExcp)
+    {
+        case PSPSTUBEXCP_INVALID:
+            return "INVALID";
+        case PSPSTUBEXCP_NONE:
+            return "NONE";
+        case PSPSTUBEXCP_DATA_ABRT:
+            return "DATA_ABRT";
+        case PSPSTUBEXCP_PREFETCH_ABRT:
+            return "PREFETCH_ABRT";
+        case PSPSTUBEXCP_UNDEF_INSN:
+            return "UNDEF_INSN";
+        default:
+            break;
+    }
+
+    return "<UNKNOWN>";
+}
+
+
+/**
+ * Checks that there is no exception pending currently, otherwise it will halt the stub
+ * (double exceptions should never happen). If none is pending it will set the new one.
+ *
+ * @returns Nothing.
+ * @param   pThis                   The stub instance data.
+ * @param   enmExcpNew              The new exception which will be pending.
+ */
+static void pspStubExcpSetCheckNonePending(PPSPSTUBSTATE pThis, PSPSTUBEXCP enmExcpNew)
+{
+    if (pThis->enmExcpPending != PSPSTUBEXCP_NONE)
+    {
+        LogRel("EXCP: Got new exception '%s' while '%s' is still pending. The stub will stop now...!!\n",
+               pspStubExcpToStr(enmExcpNew), pspStubExcpToStr(pThis->enmExcpPending));
+        for (;;);
+    }
+
+    pThis->enmExcpPending = enmExcpNew;
+}
+
+
+/**
+ * Checks for any pending exception returning the appropriate return code and adjusting the returned payload.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   prcReq                  Where to store the status code to return in the response.
+ * @param   ppvRespPayload          The payload pointer, which will get reset to NULL if the request caused an exception.
+ * @param   pcbPayload              Pointer to the payload size, which will get reset to 0 if the request caused an exception.
+ */
+static int pspStubPduCheckForExcp(PPSPSTUBSTATE pThis, PSPSTS *prcReq, const void **ppvRespPayload, size_t *pcbPayload)
+{
+    if (pThis->enmExcpPending != PSPSTUBEXCP_NONE)
+    {
+        *ppvRespPayload = NULL;
+        *pcbPayload     = 0;
+
+        switch (pThis->enmExcpPending)
+        {
+            case PSPSTUBEXCP_DATA_ABRT:
+                *prcReq = STS_ERR_PSP_PDU_REQ_DATA_ABORT_EXCEPTION;
+                break;
+            case PSPSTUBEXCP_PREFETCH_ABRT:
+                *prcReq = STS_ERR_PSP_PDU_REQ_PREFETCH_ABORT_EXCEPTION;
+                break;
+            case PSPSTUBEXCP_UNDEF_INSN:
+                *prcReq = STS_ERR_PSP_PDU_REQ_UNDEF_INSN_EXCEPTION;
+                break;
+            case PSPSTUBEXCP_INVALID:
+            case PSPSTUBEXCP_NONE:
+            default:
+                *prcReq = STS_ERR_INVALID_PARAMETER;
+                break;
+        }
+
+        pThis->enmExcpPending = PSPSTUBEXCP_NONE;
+    }
+
+    return STS_INF_SUCCESS;
+}
+
+
+/**
+ * Reads/writes data in local PSP SRAM.
+ *
+ * @returns Stauts code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ * @param   fWrite                  Flag whether this is rad or write request.
+ */
+static int pspStubPduProcessPspMemXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+{
+    int rc = INF_SUCCESS;
+    PCPSPSERIALPSPMEMXFERREQ pReq = (PCPSPSERIALPSPMEMXFERREQ)pvPayload;
+
+    if (cbPayload < sizeof(*pReq))
+        return ERR_INVALID_PARAMETER;
+
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_INVALID;
+    size_t cbXfer = pReq->cbXfer;
+    const void *pvRespPayload = NULL;
+    size_t cbResPayload = 0;
+    if (fWrite)
+    {
+        enmResponse = PSPSERIALPDURRNID_RESPONSE_PSP_MEM_WRITE;
+        void *pvDst = pspStubPlatPspAddrToPtr(pReq->PspAddrStart);
+        const void *pvSrc = (pReq + 1);
+        memcpy(pvDst, pvSrc, cbXfer);
+
+        /* Invalidate and clean memory. */
+        pspStubPlatDCacheCleanInvalidate(pvDst, cbXfer);
+    }
+    else
+    {
+        enmResponse   = PSPSERIALPDURRNID_RESPONSE_PSP_MEM_READ;
+        pvRespPayload = pspStubPlatPspAddrToPtr(pReq->PspAddrStart);
+        cbResPayload  = cbXfer;
+        /** @todo Need to copy into temporary buffer for proper exception handling. */
+    }
+
+    PSPSTS rcReq = STS_INF_SUCCESS;
+    pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbPayload);
+    return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbResPayload);
+}
+
+
+/**
+ * Does a MMIO read/write of the given length.
+ *
+ * @returns nothing.
+ * @param   pvDst               The destination.
+ * @param   pvSrc               The source.
+ * @param   cb                  Number of bytes to access.
+ */
+static void pspStubMmioAccess(void *pvDst, const void *pvSrc, size_t cb)
+{
+    switch (cb)
+    {
+        case 1:
+            *(volatile uint8_t *)pvDst = *(volatile const uint8_t *)pvSrc;
+            break;
+        case 2:
+            *(volatile uint16_t *)pvDst = *(volatile const uint16_t *)pvSrc;
+            break;
+        case 4:
+            *(volatile uint32_t *)pvDst = *(volatile const uint32_t *)pvSrc;
+            break;
+        case 8:
+            *(volatile uint64_t *)pvDst = *(volatile const uint64_t *)pvSrc;
+            break;
+        default:
+            break;
+    }
+}
+
+
+/**
+ * Reads/writes data in local PSP MMIO space.
+ *
+ * @returns Stauts code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ * @param   fWrite                  Flag whether this is rad or write request.
+ */
+static int pspStubPduProcessPspMmioXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+{
+    int rc = INF_SUCCESS;
+    PCPSPSERIALPSPMEMXFERREQ pReq = (PCPSPSERIALPSPMEMXFERREQ)pvPayload;
+
+    if (   cbPayload < sizeof(*pReq)
+        || (   pReq->cbXfer != 1
+            && pReq->cbXfer != 2
+            && pReq->cbXfer != 4
+            && pReq->cbXfer != 8))
+        return ERR_INVALID_PARAMETER;
+
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_INVALID;
+    size_t cbXfer = pReq->cbXfer;
+    const void *pvRespPayload = NULL;
+    uint8_t abRead[8];
+    size_t cbResPayload = 0;
+    const void *pvSrc = NULL;
+    void *pvDst = NULL;
+    if (fWrite)
+    {
+        enmResponse = PSPSERIALPDURRNID_RESPONSE_PSP_MMIO_WRITE;
+        pvDst = pspStubPlatPspAddrToPtr(pReq->PspAddrStart);
+        pvSrc = (pReq + 1);
+        pspStubMmioAccess(pvDst, (pReq + 1), cbXfer);
+    }
+    else
+    {
+        enmResponse   = PSPSERIALPDURRNID_RESPONSE_PSP_MMIO_READ;
+        pvSrc = pspStubPlatPspAddrToPtr(pReq->PspAddrStart);
+        pvDst = &abRead[0];
+        pspStubMmioAccess(&abRead[0], pvSrc, cbXfer);
+        pvRespPayload = &abRead[0];
+        cbResPayload  = cbXfer;
+    }
+
+    PSPSTS rcReq = STS_INF_SUCCESS;
+    pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbPayload);
+    return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbResPayload);
+}
+
+
+/**
+ * Reads/writes data in the SMN address space.
+ *
+ * @returns Stauts code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ * @param   fWrite                  Flag whether this is rad or write request.
+ */
+static int pspStubPduProcessPspSmnXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+{
+    PCPSPSERIALSMNMEMXFERREQ pReq = (PCPSPSERIALSMNMEMXFERREQ)pvPayload;
+
+    if (cbPayload < sizeof(*pReq))
+        return ERR_INVALID_PARAMETER;
+
+    PSPSERIALPDURRNID enmResponse =   fWrite
+                                    ? PSPSERIALPDURRNID_RESPONSE_PSP_SMN_WRITE
+                                    : PSPSERIALPDURRNID_RESPONSE_PSP_SMN_READ;
+    void *pvMap = NULL;
+    int rc = pspStubSmnMap(pThis, pReq->SmnAddrStart, &pvMap);
+    if (!rc)
+    {
+        const void *pvRespPayload = NULL;
+        uint8_t abRead[8];
+        size_t cbRespPayload = 0;
+
+        if (   pReq->cbXfer == 1
+            || pReq->cbXfer == 2
+            || pReq->cbXfer == 4)
+        {
+            if (fWrite)
+                pspStubMmioAccess(pvMap, (pReq + 1), pReq->cbXfer);
+            else
+            {
+                pspStubMmioAccess(&abRead[0], pvMap, pReq->cbXfer);
+                pvRespPayload = &abRead[0];
+                cbRespPayload = pReq->cbXfer;
+            }
+        }
+        else
+        {
+            if (fWrite)
+            {
+                const void *pvSrc = (pReq + 1);
+                memcpy(pvMap, pvSrc, pReq->cbXfer);
+            }
+            else
+            {
+                pvRespPayload = pspStubPduRespBufGet(pThis);
+                if (pvRespPayload)
+                {
+                    memcpy((void *)pvRespPayload, pvMap, pReq->cbXfer);
+                    cbRespPayload = pReq->cbXfer;
+                }
+                else
+                    rc = ERR_BUFFER_OVERFLOW;
+            }
+        }
+
+        pspStubSmnUnmapByPtr(pThis, pvMap);
+
+        PSPSTS rcReq = rc ? rc : STS_INF_SUCCESS;
+        pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
+        return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
+    }
+    else
+        rc = pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    return rc;
+}
+
+
+/**
+ * Maps the given address from the given address space.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   enmAddrSpace            The address space the address belongs to.
+ * @param   u64Addr                 The address to map.
+ * @param   ppv                     Where to store the pointer to the mapping on success.
+ */
+static int pspStubAddrSpaceMap(PPSPSTUBSTATE pThis, PSPADDRSPACE enmAddrSpace, uint64_t u64Addr, void **ppv)
+{
+    int rc = 0;
+
+    switch (enmAddrSpace)
+    {
+        case PSPADDRSPACE_PSP_MEM:
+        case PSPADDRSPACE_PSP_MMIO:
+            *ppv = pspStubPlatPspAddrToPtr((PSPADDR)u64Addr);
+            break;
+        case PSPADDRSPACE_SMN:
+            rc = pspStubSmnMap(pThis, (SMNADDR)u64Addr, ppv);
+            break;
+        case PSPADDRSPACE_X86_MEM:
+            rc = pspStubX86PhysMap(pThis, (X86PADDR)u64Addr, false /*fMmio*/, ppv);
+            /** @todo Caching flags. */
+            break;
+        case PSPADDRSPACE_X86_MMIO:
+            rc = pspStubX86PhysMap(pThis, (X86PADDR)u64Addr, true /*fMmio*/, ppv);
+            /** @todo Caching flags. */
+            break;
+        default:
+            rc = -1;
+            break;
+    }
+
+    return rc;
+}
+
+
+/**
+ * Unmaps the given pointer returned by a previous call to pspStubAddrSpaceMap().
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   enmAddrSpace            The address space the mapping belongs to.
+ * @param   pv                      Pointer to the address to unmap.
+ */
+static void pspStubAddrSpaceUnmapByPtr(PPSPSTUBSTATE pThis, PSPADDRSPACE enmAddrSpace, void *pv)
+{
+    switch (enmAddrSpace)
+    {
+        case PSPADDRSPACE_PSP_MEM:
+        case PSPADDRSPACE_PSP_MMIO:
+            break;
+        case PSPADDRSPACE_SMN:
+            pspStubSmnUnmapByPtr(pThis, pv);
+            break;
+        case PSPADDRSPACE_X86_MEM:
+        case PSPADDRSPACE_X86_MMIO:
+            pspStubX86PhysUnmapByPtr(pThis, pv);
+            break;
+        default:
+            break;
+    }
+}
+
+
+/**
+ * Returns the size of the mapping windows of the given address space.
+ *
+ * @returns Window size in bytes, 0 for an invalid address space.
+ * @param   enmAddrSpace            The address space.
+ */
+static uint64_t pspStubAddrSpaceWindowSz(PSPADDRSPACE enmAddrSpace)
+{
+    switch (enmAddrSpace)
+    {
+        case PSPADDRSPACE_PSP_MEM:
+        case PSPADDRSPACE_PSP_MMIO:
+        case PSPADDRSPACE_X86_MEM:
+        case PSPADDRSPACE_X86_MMIO:
+            return _64M;
+        case PSPADDRSPACE_SMN:
+            return _1M;
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * Initializes an iterator walking the given address range window by window.
+ *
+ * @returns Status code.
+ * @param   pIter                   The iterator to initialize, must be terminated with pspStubAddrIterTerm()
+ *                                  even if this fails.
+ * @param   enmAddrSpace            The address space the range belongs to.
+ * @param   u64Addr                 Start address of the range.
+ * @param   cb                      Size of the range in bytes.
+ * @param   cbUnit                  Size of the accesses a chunk must never split, power of two.
+ */
+static int pspStubAddrIterInit(PPSPSTUBADDRITER pIter, PSPADDRSPACE enmAddrSpace, uint64_t u64Addr, uint64_t cb, uint32_t cbUnit)
+{
+    pIter->enmAddrSpace = enmAddrSpace;
+    pIter->cbUnit       = cbUnit;
+    pIter->cbWindow     = pspStubAddrSpaceWindowSz(enmAddrSpace);
+    pIter->u64AddrNext  = u64Addr;
+    pIter->cbLeft       = cb;
+    pIter->pvChunk      = NULL;
+    pIter->cbChunk      = 0;
+
+    if (   !pIter->cbWindow
+        || (cb & (cbUnit - 1)))
+        return ERR_INVALID_PARAMETER;
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Releases the mapping of the current chunk of the given iterator if there is one.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pIter                   The iterator.
+ */
+static void pspStubAddrIterTerm(PPSPSTUBSTATE pThis, PPSPSTUBADDRITER pIter)
+{
+    if (pIter->cbChunk)
+    {
+        pspStubAddrSpaceUnmapByPtr(pThis, pIter->enmAddrSpace, pIter->pvChunk);
+        pIter->pvChunk = NULL;
+        pIter->cbChunk = 0;
+    }
+}
+
+
+/**
+ * Maps the next chunk of the range, releasing the current one.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pIter                   The iterator.
+ * @param   ppvChunk                Where to store the pointer to the mapped chunk.
+ * @param   pcbChunk                Where to store the size of the chunk, 0 once the whole range was walked.
+ */
+static int pspStubAddrIterNext(PPSPSTUBSTATE pThis, PPSPSTUBADDRITER pIter, void **ppvChunk, size_t *pcbChunk)
+{
+    pspStubAddrIterTerm(pThis, pIter);
+
+    *ppvChunk = NULL;
+    *pcbChunk = 0;
+    if (!pIter->cbLeft)
+        return INF_SUCCESS;
+
+    /*
+     * Consecutive windows are not necessarily mapped back to back in the PSP address space,
+     * so an access straddling the end of a window can't be done.
+     */
+    uint64_t cbChunk = pIter->cbWindow - (pIter->u64AddrNext & (pIter->cbWindow - 1));
+    if (cbChunk >= pIter->cbLeft)
+        cbChunk = pIter->cbLeft;
+    else if (cbChunk & (pIter->cbUnit - 1))
+        return ERR_INVALID_PARAMETER;
+
+    void *pvChunk = NULL;
+    int rc = pspStubAddrSpaceMap(pThis, pIter->enmAddrSpace, pIter->u64AddrNext, &pvChunk);
+    if (!rc)
+    {
+        pIter->pvChunk      = pvChunk;
+        pIter->cbChunk      = (size_t)cbChunk;
+        pIter->u64AddrNext += cbChunk;
+        pIter->cbLeft      -= cbChunk;
+
+        *ppvChunk = pvChunk;
+        *pcbChunk = (size_t)cbChunk;
+    }
+
+    return rc;
+}
+
+
+/**
+ * Reads/writes data to normal memory in x86 address space.
+ *
+ * @returns Stauts code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ * @param   fWrite                  Flag whether this is rad or write request.
+ */
+static int pspStubPduProcessPspX86MemXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+{
+    PCPSPSERIALX86MEMXFERREQ pReq = (PCPSPSERIALX86MEMXFERREQ)pvPayload;
+
+    if (   cbPayload < sizeof(*pReq)
+        || (   fWrite
+            && cbPayload - sizeof(*pReq) < pReq->cbXfer)
+        || (   !fWrite
+            && pReq->cbXfer > PSP_SERIAL_STUB_TX_PAYLOAD_MAX))
+        return ERR_INVALID_PARAMETER;
+
+    PSPSERIALPDURRNID enmResponse =   fWrite
+                                    ? PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_WRITE
+                                    : PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ;
+    size_t cbXfer = pReq->cbXfer;
+    const uint8_t *pbSrc = (const uint8_t *)(pReq + 1);
+    uint8_t *pbResp = fWrite ? NULL : (uint8_t *)pspStubPduRespBufGet(pThis);
+    uint8_t *pbDst = pbResp;
+    PSPSTUBADDRITER Iter;
+    void *pvChunk = NULL;
+    size_t cbChunk = 0;
+
+    if (   !fWrite
+        && !pbResp)
+        return pspStubPduSend(pThis, ERR_BUFFER_OVERFLOW, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    /* The range may span several windows, reads go through the response buffer so an exception doesn't leak stale data. */
+    int rc = pspStubAddrIterInit(&Iter, PSPADDRSPACE_X86_MEM, pReq->PhysX86Start, cbXfer, 1 /*cbUnit*/);
+    if (!rc)
+        rc = pspStubAddrIterNext(pThis, &Iter, &pvChunk, &cbChunk);
+    while (   !rc
+           && cbChunk)
+    {
+        if (fWrite)
+        {
+            memcpy(pvChunk, pbSrc, cbChunk);
+            pbSrc += cbChunk;
+        }
+        else
+        {
+            memcpy(pbDst, pvChunk, cbChunk);
+            pbDst += cbChunk;
+        }
+
+        rc = pspStubAddrIterNext(pThis, &Iter, &pvChunk, &cbChunk);
+    }
+    pspStubAddrIterTerm(pThis, &Iter);
+
+    if (!rc)
+    {
+        const void *pvRespPayload = pbResp;
+        size_t cbRespPayload = fWrite ? 0 : cbXfer;
+
+        PSPSTS rcReq = STS_INF_SUCCESS;
+        pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
+        rc = pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
+    }
+    else
+        rc = pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    return rc;
+}
+
+
+/**
+ * Reads/writes data to MMIO in x86 address space.
+ *
+ * @returns Stauts code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ * @param   fWrite                  Flag whether this is rad or write request.
+ */
+static int pspStubPduProcessPspX86MmioXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+{
+    PCPSPSERIALX86MEMXFERREQ pReq = (PCPSPSERIALX86MEMXFERREQ)pvPayload;
+
+    if (   cbPayload < sizeof(*pReq)
+        || (   pReq->cbXfer != 1
+            && pReq->cbXfer != 2
+            && pReq->cbXfer != 4
+            && pReq->cbXfer != 8))
+        return ERR_INVALID_PARAMETER;
+
+    PSPSERIALPDURRNID enmResponse =   fWrite
+                                    ? PSPSERIALPDURRNID_RESPONSE_PSP_X86_MMIO_WRITE
+                                    : PSPSERIALPDURRNID_RESPONSE_PSP_X86_MMIO_READ;
+    void *pvMap = NULL;
+    int rc = pspStubX86PhysMap(pThis, pReq->PhysX86Start, true /*fMmio*/, &pvMap);
+    if (!rc)
+    {
+        const void *pvRespPayload = NULL;
+        uint8_t abRead[8];
+        size_t cbRespPayload = 0;
+        const void *pvSrc = NULL;
+        void *pvDst = NULL;
+        if (fWrite)
+            pspStubMmioAccess(pvMap, (pReq + 1), pReq->cbXfer);
+        else
+        {
+            pspStubMmioAccess(&abRead[0], pvMap, pReq->cbXfer);
+            pvRespPayload = &abRead[0];
+            cbRespPayload = pReq->cbXfer;
+        }
+
+        pspStubX86PhysUnmapByPtr(pThis, pvMap);
+        PSPSTS rcReq = STS_INF_SUCCESS;
+        pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
+        rc = pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
+    }
+    else
+        rc = pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    return rc;
+}
+
+
+/**
+ * Reads/writes to a Co-Processor.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ * @param   fWrite                  Flag whether this is read or write request.
+ */
+static int pspStubPduProcessCoProcRw(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+{
+    PCPSPSERIALCOPROCRWREQ pReq = (PCPSPSERIALCOPROCRWREQ)pvPayload;
+
+    if (cbPayload < sizeof(*pReq))
+        return ERR_INVALID_PARAMETER;
+
+    PSPSERIALPDURRNID enmResponse =   fWrite
+                                    ? PSPSERIALPDURRNID_RESPONSE_COPROC_WRITE
+                                    : PSPSERIALPDURRNID_RESPONSE_COPROC_READ;
+    const void *pvRespPayload = NULL;
+    uint32_t uVal = 0;
+    size_t cbRespPayload = 0;
+    if (fWrite)
+        uVal = *(uint32_t *)(pReq + 1);
+    else
+    {
+        pvRespPayload = &uVal;
+        cbRespPayload = sizeof(uVal);
+    }
+
+    PSPSTS rcReq = pspStubPlatCoProcRw(pReq->u8CoProc, pReq->u8Crn, pReq->u8Crm, pReq->u8Opc1, pReq->u8Opc2,
+                                       fWrite, &uVal);
+    if (rcReq)
+    {
+        pvRespPayload = NULL;
+        cbRespPayload = 0;
+    }
+    pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
+    return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
+}
+
+
+/**
+ * Returns the start address of the given data xfer request.
+ *
+ * @returns Start address, 0 for an invalid address space.
+ * @param   pReq                    The data xfer request.
+ */
+static uint64_t pspStubPduDataXferAddrStartGet(PCPSPSERIALDATAXFERREQ pReq)
+{
+    switch (pReq->enmAddrSpace)
+    {
+        case PSPADDRSPACE_PSP_MEM:
+        case PSPADDRSPACE_PSP_MMIO:
+            return pReq->u.PspAddrStart;
+        case PSPADDRSPACE_SMN:
+            return pReq->u.SmnAddrStart;
+        case PSPADDRSPACE_X86_MEM:
+        case PSPADDRSPACE_X86_MMIO:
+            return pReq->u.X86.PhysX86AddrStart;
+        default:
+            return 0;
+    }
+}
+
+
+/**
+ * Memset operation with a single value.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pReq                    The data xfer request.
+ * @param   pv                      The mapped address.
+ * @param   cbXfer                  Number of bytes to write.
+ */
+static void pspStubPduDataXferMemset(PPSPSTUBSTATE pThis, PCPSPSERIALDATAXFERREQ pReq, void *pv, size_t cbXfer)
+{
+    void *pvVal = (void *)(pReq + 1);
+    size_t cbWrLeft = cbXfer;
+    size_t cbStride = pReq->cbStride;
+    bool fIncrAddr = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_INCR_ADDR) ? true : false;
+
+    uint8_t *pb = (uint8_t *)pv;
+    while (cbWrLeft)
+    {
+        pspStubMmioAccess(pb, pvVal, cbStride);
+        if (fIncrAddr)
+            pb += cbStride;
+
+        cbWrLeft -= cbStride;
+    }
+}
+
+
+/**
+ * Reads from the given PSP mapping into the supplied buffer.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pReq                    The data xfer request.
+ * @param   pvSrc                   The mapped address to read from.
+ * @param   pvDst                   Where to store the read data.
+ * @param   cbXfer                  Number of bytes to read.
+ */
+static void pspStubPduDataXferRead(PPSPSTUBSTATE pThis, PCPSPSERIALDATAXFERREQ pReq, const void *pvSrc, void *pvDst, size_t cbXfer)
+{
+    size_t cbRdLeft = cbXfer;
+    size_t cbStride = pReq->cbStride;
+    bool fIncrAddr = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_INCR_ADDR) ? true : false;
+
+    uint8_t *pbDst = (uint8_t *)pvDst;
+    uint8_t *pbSrc = (uint8_t *)pvSrc;
+    while (cbRdLeft)
+    {
+        pspStubMmioAccess(pbDst, pbSrc, cbStride);
+        if (fIncrAddr)
+            pbSrc += cbStride;
+
+        pbDst    += cbStride;
+        cbRdLeft -= cbStride;
+    }
+}
+
+
+/**
+ * Writes to the given PSP mapping from the supplied buffer.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pReq                    The data xfer request.
+ * @param   pvDst                   The mapped address to write to.
+ * @param   pvSrc                   The data to write.
+ * @param   cbXfer                  Number of bytes to write.
+ */
+static void pspStubPduDataXferWrite(PPSPSTUBSTATE pThis, PCPSPSERIALDATAXFERREQ pReq, void *pvDst, const void *pvSrc, size_t cbXfer)
+{
+    size_t cbWrLeft = cbXfer;
+    size_t cbStride = pReq->cbStride;
+    bool fIncrAddr = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_INCR_ADDR) ? true : false;
+
+    uint8_t *pbDst = (uint8_t *)pvDst;
+    uint8_t *pbSrc = (uint8_t *)pvSrc;
+    while (cbWrLeft)
+    {
+        pspStubMmioAccess(pbDst, pbSrc, cbStride);
+        if (fIncrAddr)
+            pbDst += cbStride;
+
+        pbSrc    += cbStride;
+        cbWrLeft -= cbStride;
+    }
+}
+
+
+/**
+ * Extended data transfer mechanism.
+ *
+ * @returns Stauts code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ */
+static int pspStubPduProcessDataXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
+{
+    PCPSPSERIALDATAXFERREQ pReq = (PCPSPSERIALDATAXFERREQ)pvPayload;
+
+    if (   cbPayload < sizeof(*pReq)
+        || (   pReq->cbStride != 1
+            && pReq->cbStride != 2
+            && pReq->cbStride != 4)
+        || (pReq->cbXfer & (pReq->cbStride - 1))
+        || (   (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_READ)
+            && pReq->cbXfer > PSP_SERIAL_STUB_TX_PAYLOAD_MAX)
+        /* The data to write (or the single value for a memset) must be completely contained in the payload. */
+        || (   (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_MEMSET)
+            && cbPayload - sizeof(*pReq) < pReq->cbStride)
+        || (   (pReq->fFlags & (PSP_SERIAL_DATA_XFER_F_MEMSET | PSP_SERIAL_DATA_XFER_F_READ | PSP_SERIAL_DATA_XFER_F_WRITE)) == PSP_SERIAL_DATA_XFER_F_WRITE
+            && cbPayload - sizeof(*pReq) < pReq->cbXfer))
+        return ERR_INVALID_PARAMETER;
+
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_PSP_DATA_XFER;
+
+    bool fIncrAddr = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_INCR_ADDR) ? true : false;
+    void *pvRespPayload = NULL;
+    size_t cbRespPayload = 0;
+    uint8_t *pbBuf = (uint8_t *)(pReq + 1);
+
+    if (   !(pReq->fFlags & PSP_SERIAL_DATA_XFER_F_MEMSET)
+        && (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_READ))
+    {
+        pvRespPayload = pspStubPduRespBufGet(pThis);
+        cbRespPayload = pReq->cbXfer;
+        pbBuf         = (uint8_t *)pvRespPayload;
+        if (!pbBuf)
+            return pspStubPduSend(pThis, ERR_BUFFER_OVERFLOW, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    }
+
+    /* Without incrementing the address only a single stride is accessed over and over again. */
+    PSPSTUBADDRITER Iter;
+    void *pvChunk = NULL;
+    size_t cbChunk = 0;
+    int rc = pspStubAddrIterInit(&Iter, pReq->enmAddrSpace, pspStubPduDataXferAddrStartGet(pReq),
+                                 fIncrAddr ? pReq->cbXfer : pReq->cbStride, pReq->cbStride);
+    if (!rc)
+        rc = pspStubAddrIterNext(pThis, &Iter, &pvChunk, &cbChunk);
+    while (   !rc
+           && cbChunk)
+    {
+        size_t cbThisXfer = fIncrAddr ? cbChunk : pReq->cbXfer;
+
+        if (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_MEMSET)
+            pspStubPduDataXferMemset(pThis, pReq, pvChunk, cbThisXfer);
+        else if (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_READ)
+            pspStubPduDataXferRead(pThis, pReq, pvChunk, pbBuf, cbThisXfer);
+        else if (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_WRITE)
+            pspStubPduDataXferWrite(pThis, pReq, pvChunk, pbBuf, cbThisXfer);
+
+        pbBuf += cbThisXfer;
+        rc = pspStubAddrIterNext(pThis, &Iter, &pvChunk, &cbChunk);
+    }
+    pspStubAddrIterTerm(pThis, &Iter);
+
+    if (!rc)
+    {
+        PSPSTS rcReq = STS_INF_SUCCESS;
+        pspStubPduCheckForExcp(pThis, &rcReq, (const void **)&pvRespPayload, &cbRespPayload);
+        rc = pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
+    }
+    else
+        rc = pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    return rc;
+}
+
+
+/**
+ * Reads the given range page by page skipping all pages causing a data abort.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ */
+static int pspStubPduProcessSparseRead(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
+{
+    PCPSPSERIALSPARSEREADREQ pReq = (PCPSPSERIALSPARSEREADREQ)pvPayload;
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_SPARSE_READ;
+
+    if (   cbPayload < sizeof(*pReq)
+        || pReq->cbPage < sizeof(uint32_t)
+        || (pReq->cbPage & (pReq->cbPage - 1)))
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    /* A page must never cross a mapping window. */
+    uint64_t u64AddrStart = 0;
+    uint32_t cbPageMax = 0;
+    switch (pReq->enmAddrSpace)
+    {
+        case PSPADDRSPACE_PSP_MEM:
+        case PSPADDRSPACE_PSP_MMIO:
+            u64AddrStart = pReq->u.PspAddrStart;
+            cbPageMax    = _64M;
+            break;
+        case PSPADDRSPACE_SMN:
+            u64AddrStart = pReq->u.SmnAddrStart;
+            cbPageMax    = _1M;
+            break;
+        case PSPADDRSPACE_X86_MEM:
+        case PSPADDRSPACE_X86_MMIO:
+            u64AddrStart = pReq->u.PhysX86AddrStart;
+            cbPageMax    = _64M;
+            break;
+        default:
+            break;
+    }
+
+    bool fProbeOnly = (pReq->fFlags & PSP_SERIAL_SPARSE_READ_F_PROBE_ONLY) ? true : false;
+    PPSPSERIALSPARSEREADRESP pResp = (PPSPSERIALSPARSEREADRESP)pspStubPduRespBufGet(pThis);
+    if (!pResp)
+        return pspStubPduSend(pThis, ERR_BUFFER_OVERFLOW, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    uint32_t *pau32Bitmap = (uint32_t *)(pResp + 1);
+    size_t cbAvail = PSP_SERIAL_STUB_TX_PAYLOAD_MAX - sizeof(*pResp);
+
+    /* Limit the number of pages so the bitmap and the data of all pages fit into the response even if everything is readable. */
+    uint32_t cPages = pReq->cPages;
+    if (fProbeOnly)
+        cPages = MIN(cPages, (cbAvail & ~(size_t)3) * 8); /* The bitmap is written in whole words. */
+    else
+    {
+        cPages = MIN(cPages, cbAvail / pReq->cbPage);
+        while (   cPages
+               && ((cPages + 31) / 32) * sizeof(uint32_t) + cPages * pReq->cbPage > cbAvail)
+            cPages--;
+    }
+
+    if (   !cbPageMax
+        || pReq->cbPage > cbPageMax
+        || (u64AddrStart & (pReq->cbPage - 1))
+        || !cPages)
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    size_t cbBitmap = ((cPages + 31) / 32) * sizeof(uint32_t);
+    uint8_t *pbData = (uint8_t *)pau32Bitmap + cbBitmap;
+    uint32_t cPagesReadable = 0;
+    int rc = INF_SUCCESS;
+
+    memset(pau32Bitmap, 0, cbBitmap);
+    for (uint32_t i = 0; i < cPages && !rc; i++)
+    {
+        void *pvPage = NULL;
+        rc = pspStubAddrSpaceMap(pThis, pReq->enmAddrSpace, u64AddrStart + (uint64_t)i * pReq->cbPage, &pvPage);
+        if (!rc)
+        {
+            /* Faulting pages are skipped, the data abort handler makes the copy return early. */
+            uint32_t u32Probe = 0;
+            int rcProbe =   fProbeOnly
+                          ? pspStubPlatMemCopyProbe(&u32Probe, pvPage, sizeof(u32Probe))
+                          : pspStubPlatMemCopyProbe(pbData, pvPage, pReq->cbPage);
+            if (!rcProbe)
+            {
+                pau32Bitmap[i / 32] |= BIT(i % 32);
+                cPagesReadable++;
+                if (!fProbeOnly)
+                    pbData += pReq->cbPage;
+            }
+
+            pspStubAddrSpaceUnmapByPtr(pThis, pReq->enmAddrSpace, pvPage);
         }
-        /** @todo else Send out of band error. */
     }
-    /* else Timeout -> return */
 
-    return INF_SUCCESS;
+    if (!rc)
+    {
+        const void *pvRespPayload = pResp;
+        size_t cbRespPayload = sizeof(*pResp) + cbBitmap;
+
+        pResp->cPages         = cPages;
+        pResp->cPagesReadable = cPagesReadable;
+        if (!fProbeOnly)
+            cbRespPayload += cPagesReadable * pReq->cbPage;
+
+        PSPSTS rcReq = STS_INF_SUCCESS;
+        pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
+        rc = pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
+    }
+    else
+        rc = pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    return rc;
 }
 
 
 /**
- * Waits for single PDU to arrive in the given timespan and processes it.
+ * Returns the number of bytes waiting in the transmit queue.
  *
- * @returns Status code.
+ * @returns Number of bytes not yet written to the transport.
  * @param   pThis                   The serial stub instance data.
- * @param   cMillies                Amount of milliseconds to wait.
  */
-static int pspStubPduRecvProcessSingle(PPSPSTUBSTATE pThis, uint32_t cMillies)
+static size_t pspStubTxQueueBacklog(PPSPSTUBSTATE pThis)
 {
-    PCPSPSERIALPDUHDR pPdu;
+    size_t cbBacklog = 0;
 
-    int rc = pspStubPduRecv(pThis, &pPdu, cMillies);
-    if (!rc)
-        rc = pspStubPduProcess(pThis, pPdu);
+    for (uint32_t i = 0; i < pThis->cTxQueued; i++)
+    {
+        PPSPSTUBTXBUF pTxBuf = &pThis->aTxBufs[pThis->aidxTxQueue[(pThis->idxTxQueueHead + i) % ELEMENTS(pThis->aidxTxQueue)]];
+        cbBacklog += pTxBuf->cbPdu - pTxBuf->offXmit;
+    }
 
-    return rc;
+    return cbBacklog;
 }
 
 
 /**
- * @copydoc{CMIF,pfnInBufPeek}
+ * Accounts for data handed to a link.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pTput                   The throughput estimation of the link.
+ * @param   cb                      Number of bytes handed to the link.
  */
-size_t pspStubCmIfInBufPeek(PCCMIF pCmIf, uint32_t idInBuf)
+static void pspStubLinkTputBusy(PPSPSTUBSTATE pThis, PPSPSTUBLINKTPUT pTput, size_t cb)
 {
-    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
-    PPSPSTUBSTATE pThis = pExec->pStub;
-
-    size_t cbAvail = 0;
-    if (idInBuf < ELEMENTS(pThis->aInBufs))
+    if (!pTput->fBusy)
     {
-        PPSPINBUF pInBuf = &pThis->aInBufs[idInBuf];
-        if (!pInBuf->offInBuf) /* One check whether we can receive a new PDU. */
-            pspStubPduRecvProcessSingle(pThis, 0 /*cMillies*/);
-
-        cbAvail = pInBuf->offInBuf;
+        pTput->fBusy       = true;
+        pTput->cbBusy      = 0;
+        pTput->usBusyStart = pspStubGetMicros(pThis);
     }
 
-    return cbAvail;
+    pTput->cbBusy += cb;
 }
 
 
 /**
- * @copydoc{CMIF,pfnInBufPoll}
+ * Updates the throughput estimation of a link once it has nothing to transmit anymore.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pTput                   The throughput estimation of the link.
+ * @param   cbBacklog               Number of bytes the link still has to transmit.
  */
-int pspStubCmIfInBufPoll(PCCMIF pCmIf, uint32_t idInBuf, uint32_t cMillies)
+static void pspStubLinkTputUpdate(PPSPSTUBSTATE pThis, PPSPSTUBLINKTPUT pTput, size_t cbBacklog)
 {
-    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
-    PPSPSTUBSTATE pThis = pExec->pStub;
+    if (   !pTput->fBusy
+        || cbBacklog)
+        return;
 
-    int rc = INF_SUCCESS;
-    if (idInBuf < ELEMENTS(pThis->aInBufs))
-    {
-        PPSPINBUF pInBuf = &pThis->aInBufs[idInBuf];
+    pTput->fBusy = false;
 
-        if (!pInBuf->offInBuf)
-        {
-            do
-            {
-                uint32_t tsStart = pspStubGetMillies(pThis);
-                rc = pspStubPduRecvProcessSingle(pThis, cMillies);
-                cMillies -= MIN(pspStubGetMillies(pThis) - tsStart, cMillies);
-            } while (   !rc
-                     && !pInBuf->offInBuf);
-        }
+    uint64_t cUs = pspStubGetMicros(pThis) - pTput->usBusyStart;
+    if (cUs)
+    {
+        /* Smooth the estimation as a single sample is easily off due to the coarse timer. */
+        uint64_t cbPerSec = ((uint64_t)pTput->cbBusy * 1000000) / cUs;
+        cbPerSec = (3 * (uint64_t)pTput->cbPerSec + MIN(cbPerSec, UINT32_MAX)) / 4;
+        pTput->cbPerSec = MAX(cbPerSec, 1);
     }
-    else
-        rc = ERR_INVALID_PARAMETER;
-
-    return rc;
 }
 
 
 /**
- * @copydoc{CMIF,pfnInBufRead}
+ * Writes as much of the pending PDU of an additional link to its transport as it takes without waiting.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pLink                   The link.
  */
-int pspStubCmIfInBufRead(PCCMIF pCmIf, uint32_t idInBuf, void *pvBuf, size_t cbRead, size_t *pcbRead)
+static int pspStubLinkPump(PPSPSTUBSTATE pThis, PPSPSTUBLINK pLink)
 {
-    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
-    PPSPSTUBSTATE pThis = pExec->pStub;
-
+    PCPSPPDUTRANSPIF pIfTransp = pLink->pIfTransp;
     int rc = INF_SUCCESS;
-    if (idInBuf < ELEMENTS(pThis->aInBufs))
+
+    if (pIfTransp->pfnPoll)
+        pIfTransp->pfnPoll(pLink->hPduTransp);
+
+    if (pLink->offXmit < pLink->cbPdu)
     {
-        PPSPINBUF pInBuf = &pThis->aInBufs[idInBuf];
+        size_t cbThisXmit = pLink->cbPdu - pLink->offXmit;
+        size_t cbWritten = cbThisXmit;
 
-        if (pcbRead)
+        pIfTransp->pfnBegin(pLink->hPduTransp);
+        if (pIfTransp->pfnWriteNB)
         {
-            /* Can handle partial reads. */
-            if (pspStubCmIfInBufPeek(pCmIf, idInBuf))
+            rc = pIfTransp->pfnWriteNB(pLink->hPduTransp, &pLink->abPdu[pLink->offXmit], cbThisXmit, &cbWritten);
+            if (rc == INF_TRY_AGAIN)
             {
-                size_t cbThisRead = MIN(pInBuf->offInBuf, cbRead);
-                memcpy(pvBuf, pInBuf->pvInBuf, cbThisRead);
-
-                /* Move everyting to the front. */
-                if (cbThisRead < pInBuf->offInBuf)
-                {
-                    uint8_t *pbInBuf = (uint8_t *)pInBuf->pvInBuf;
-                    size_t cbLeft = pInBuf->offInBuf - cbThisRead;
-
-                    /** @todo memmove. */
-                    for (uint32_t i = 0; i < cbLeft; i++)
-                        pbInBuf[i] = pbInBuf[cbThisRead + i];
-
-                    pInBuf->offInBuf -= cbThisRead;
-                }
-                *pcbRead = cbThisRead;
+                rc = INF_SUCCESS;
+                cbWritten = 0;
             }
-            else
-                *pcbRead = 0;
         }
         else
-        {
-            /* Loop until we've read all requested data. */
-            uint8_t *pbBuf = (uint8_t *)pvBuf;
-
-            do
-            {
-                rc = pspStubCmIfInBufPoll(pCmIf, idInBuf, CM_WAIT_INDEFINITE);
-                if (!rc)
-                {
-                    size_t cbThisRead = MIN(cbRead, pInBuf->offInBuf);
-
-                    memcpy(pbBuf, pInBuf->pvInBuf, cbThisRead);
-                    if (cbThisRead < pInBuf->offInBuf)
-                    {
-                        uint8_t *pbInBuf = (uint8_t *)pInBuf->pvInBuf;
-                        size_t cbLeft = pInBuf->offInBuf - cbThisRead;
-
-                        /* Move everything to the front. */
-                        for (uint32_t i = 0; i < cbLeft; i++)
-                            pbInBuf[i] = pbInBuf[cbThisRead + i];
-                    }
+            rc = pIfTransp->pfnWrite(pLink->hPduTransp, &pLink->abPdu[pLink->offXmit], cbThisXmit, NULL /*pcbWritten*/);
+        pIfTransp->pfnEnd(pLink->hPduTransp);
 
-                    pInBuf->offInBuf -= cbThisRead;
-                    pbBuf            += cbThisRead;
-                    cbRead           -= cbThisRead;
-                }
-            } while (   !rc
-                     && cbRead);
-        }
+        if (!rc)
+            pLink->offXmit += cbWritten;
     }
-    else
-        rc = ERR_INVALID_PARAMETER;
 
+    pspStubLinkTputUpdate(pThis, &pLink->Tput, pLink->cbPdu - pLink->offXmit);
     return rc;
 }
 
 
 /**
- * @copydoc{CMIF,pfnOutBufWrite}
+ * Moves data along on all links.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
  */
-int pspStubCmIfOutBufWrite(PCCMIF pCmIf, uint32_t idOutBuf, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+static int pspStubLinksPump(PPSPSTUBSTATE pThis)
 {
-    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
-    PPSPSTUBSTATE pThis = pExec->pStub;
+    int rc = pspStubTxQueueDrain(pThis, PSP_SERIAL_STUB_TX_DRAIN_CHUNK);
+    pspStubLinkTputUpdate(pThis, &pThis->TputTransp, pspStubTxQueueBacklog(pThis));
 
-    PSPSERIALOUTBUFNOT OutBufNot;
-    OutBufNot.idOutBuf = idOutBuf;
-    OutBufNot.u32Pad0  = 0;
-    int rc = pspStubPduSend2(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_NOTIFICATION_OUT_BUF,
-                             &OutBufNot, sizeof(OutBufNot), pvBuf, cbWrite);
-    if (   !rc
-        && pcbWritten)
-        *pcbWritten = cbWrite;
+    for (uint32_t i = 0; i < pspStubLinksCount(pThis) && !rc; i++)
+        rc = pspStubLinkPump(pThis, pspStubLinkGet(pThis, i));
 
     return rc;
 }
 
 
 /**
- * @copydoc{CMIF,pfnDelayMs}
+ * Selects the link a chunk of the given size would arrive first on, considering what each link has queued
+ * and its throughput, which spreads the chunks over the links in proportion to their throughput.
+ *
+ * @returns Link ID, 0 for the link requests arrive on, i + 1 for additional link i.
+ * @param   pThis                   The serial stub instance data.
+ * @param   cbChunk                 Size of the chunk.
  */
-void pspStubCmIfDelayMs(PCCMIF pCmIf, uint32_t cMillies)
+static uint32_t pspStubLinkSelect(PPSPSTUBSTATE pThis, size_t cbChunk)
 {
-    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
-    PPSPSTUBSTATE pThis = pExec->pStub;
-
-    pspStubDelayMs(pThis, cMillies);
-}
+    uint32_t idLink = 0;
+    uint64_t usBest = ((pspStubTxQueueBacklog(pThis) + cbChunk) * 1000000ULL) / pThis->TputTransp.cbPerSec;
 
+    for (uint32_t i = 0; i < pspStubLinksCount(pThis); i++)
+    {
+        PPSPSTUBLINK pLink = pspStubLinkGet(pThis, i);
+        uint64_t us = ((pLink->cbPdu - pLink->offXmit + cbChunk) * 1000000ULL) / pLink->Tput.cbPerSec;
+        if (us < usBest)
+        {
+            idLink = i + 1;
+            usBest = us;
+        }
+    }
 
-/**
- * @copydoc{CMIF,pfnTsGetMilli}
- */
-uint32_t pspStubCmIfTsGetMilli(PCCMIF pCmIf)
-{
-    PCCMEXEC pExec = (PCCMEXEC)pCmIf;
-    PPSPSTUBSTATE pThis = pExec->pStub;
-
-    return pspStubGetMillies(pThis);
+    return idLink;
 }
 
 
 /**
- * Converts the given excpetion to a string literal.
+ * Reads the given range spreading the data over all links.
  *
- * @returns Pointer to string.
- * @param   enmExcp                 The exception to convert to a string.
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
  */
-static const char *pspStubExcpToStr(PSPSTUBEXCP enmExcp)
+static int pspStubPduProcessStripedRead(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
 {
-    switch (enmExcp)
+    PCPSPSERIALSTRIPEDREADREQ pReq = (PCPSPSERIALSTRIPEDREADREQ)pvPayload;
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_STRIPED_READ;
+
+    if (cbPayload != sizeof(*pReq))
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    /* A chunk must never cross a mapping window. */
+    uint64_t u64AddrStart = 0;
+    uint32_t cbWindow = 0;
+    switch (pReq->enmAddrSpace)
     {
-        case PSPSTUBEXCP_INVALID:
-            return "INVALID";
-        case PSPSTUBEXCP_NONE:
-            return "NONE";
-        case PSPSTUBEXCP_DATA_ABRT:
-            return "DATA_ABRT";
-        case PSPSTUBEXCP_PREFETCH_ABRT:
-            return "PREFETCH_ABRT";
-        case PSPSTUBEXCP_UNDEF_INSN:
-            return "UNDEF_INSN";
+        case PSPADDRSPACE_PSP_MEM:
+        case PSPADDRSPACE_PSP_MMIO:
+            u64AddrStart = pReq->u.PspAddrStart;
+            cbWindow     = _64M;
+            break;
+        case PSPADDRSPACE_SMN:
+            u64AddrStart = pReq->u.SmnAddrStart;
+            cbWindow     = _1M;
+            break;
+        case PSPADDRSPACE_X86_MEM:
+        case PSPADDRSPACE_X86_MMIO:
+            u64AddrStart = pReq->u.PhysX86AddrStart;
+            cbWindow     = _64M;
+            break;
         default:
             break;
     }
 
-    return "<UNKNOWN>";
+    if (!cbWindow)
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    /* The request lives in the receive buffer which might get overwritten by logging through the transport. */
+    PSPADDRSPACE enmAddrSpace = pReq->enmAddrSpace;
+    uint64_t cbRead = pReq->cbRead;
+    uint32_t cbChunkMax = pReq->cbChunk ? MIN(pReq->cbChunk, PSP_SERIAL_STUB_STRIPE_CHUNK_MAX) : PSP_SERIAL_STUB_STRIPE_CHUNK_MAX;
+    uint64_t acbSent[1 + PSP_SERIAL_STUB_LINKS_MAX];
+    uint64_t offRead = 0;
+    PSPSTS rcReq = STS_INF_SUCCESS;
+    int rc = INF_SUCCESS;
+
+    memset(&acbSent[0], 0, sizeof(acbSent));
+    while (   offRead < cbRead
+           && !rc
+           && rcReq == STS_INF_SUCCESS)
+    {
+        uint64_t u64Addr = u64AddrStart + offRead;
+        size_t cbChunk = MIN(cbRead - offRead, cbChunkMax);
+        cbChunk = MIN(cbChunk, cbWindow - (u64Addr & (cbWindow - 1)));
+
+        /* Wait for the selected link to be able to take the chunk, the others keep transmitting meanwhile. */
+        uint32_t idLink = pspStubLinkSelect(pThis, cbChunk);
+        PPSPSTUBLINK pLink = idLink ? pspStubLinkGet(pThis, idLink - 1) : NULL;
+        if (  pLink
+            ? pLink->offXmit < pLink->cbPdu
+            : pspStubTxBufFindFree(pThis, PSP_SERIAL_STUB_TX_PAYLOAD_MAX) == UINT32_MAX)
+        {
+            rc = pspStubLinksPump(pThis);
+            continue;
+        }
+
+        PPSPSERIALSTRIPEDREADDATANOT pNot =   pLink
+                                            ? (PPSPSERIALSTRIPEDREADDATANOT)&pLink->abPdu[sizeof(PSPSERIALPDUHDR)]
+                                            : (PPSPSERIALSTRIPEDREADDATANOT)pspStubPduRespBufGet(pThis);
+        void *pvChunk = NULL;
+        rc = pspStubAddrSpaceMap(pThis, enmAddrSpace, u64Addr, &pvChunk);
+        if (!rc)
+        {
+            /* A faulting access ends the read, the data abort handler makes the copy return early. */
+            int rcProbe = pspStubPlatMemCopyProbe(pNot + 1, pvChunk, cbChunk);
+            pspStubAddrSpaceUnmapByPtr(pThis, enmAddrSpace, pvChunk);
+            if (rcProbe)
+            {
+                const void *pvIgnored = NULL;
+                size_t cbIgnored = 0;
+
+                rcReq = STS_ERR_INVALID_PARAMETER;
+                pspStubPduCheckForExcp(pThis, &rcReq, &pvIgnored, &cbIgnored);
+                break;
+            }
+
+            pNot->offChunk = offRead;
+            pNot->cbChunk  = cbChunk;
+            pNot->idLink   = idLink;
+            if (pLink)
+            {
+                pLink->cbPdu   = pspStubPduFinalize(pThis, (PPSPSERIALPDUHDR)&pLink->abPdu[0], ++pLink->cPdusSent, INF_SUCCESS,
+                                                    0 /*idCcd*/, PSPSERIALPDURRNID_NOTIFICATION_STRIPED_READ_DATA,
+                                                    sizeof(*pNot) + cbChunk);
+                pLink->offXmit = 0;
+                pspStubLinkTputBusy(pThis, &pLink->Tput, pLink->cbPdu);
+                rc = pspStubLinkPump(pThis, pLink);
+            }
+            else
+            {
+                pspStubLinkTputBusy(pThis, &pThis->TputTransp, sizeof(PSPSERIALPDUHDR) + sizeof(*pNot) + cbChunk);
+                rc = pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_NOTIFICATION_STRIPED_READ_DATA,
+                                    pNot, sizeof(*pNot) + cbChunk);
+            }
+
+            acbSent[idLink] += cbChunk;
+            offRead         += cbChunk;
+        }
+    }
+
+    /* Everything must have left the links before the response tells the host the read is complete. */
+    if (!rc)
+    {
+        rc = pspStubTxQueueFlush(pThis);
+        pspStubLinkTputUpdate(pThis, &pThis->TputTransp, 0 /*cbBacklog*/);
+    }
+
+    for (uint32_t i = 0; i < pspStubLinksCount(pThis) && !rc; i++)
+    {
+        PPSPSTUBLINK pLink = pspStubLinkGet(pThis, i);
+
+        while (   pLink->offXmit < pLink->cbPdu
+               && !rc)
+            rc = pspStubLinkPump(pThis, pLink);
+        if (   !rc
+            && pLink->pIfTransp->pfnFlush)
+            rc = pLink->pIfTransp->pfnFlush(pLink->hPduTransp);
+    }
+
+    if (rc)
+    {
+        LogRel("pspStubPduProcessStripedRead: Transmitting failed with %d after %u bytes\n", rc, (uint32_t)offRead);
+        rcReq = rc;
+    }
+
+    PPSPSERIALSTRIPEDREADRESP pResp = (PPSPSERIALSTRIPEDREADRESP)pspStubPduRespBufGet(pThis);
+    if (!pResp)
+        return pspStubPduSend(pThis, ERR_BUFFER_OVERFLOW, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    PPSPSERIALSTRIPEDREADLINK paLinks = (PPSPSERIALSTRIPEDREADLINK)(pResp + 1);
+
+    pResp->cbRead  = offRead;
+    pResp->cLinks  = 1 + pspStubLinksCount(pThis);
+    pResp->u32Pad0 = 0;
+    for (uint32_t i = 0; i < pResp->cLinks; i++)
+    {
+        paLinks[i].idLink   = i;
+        paLinks[i].cbPerSec = i ? pspStubLinkGet(pThis, i - 1)->Tput.cbPerSec : pThis->TputTransp.cbPerSec;
+        paLinks[i].cbSent   = acbSent[i];
+    }
+
+    return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pResp, sizeof(*pResp) + pResp->cLinks * sizeof(*paLinks));
 }
 
 
 /**
- * Checks that there is no exception pending currently, otherwise it will halt the stub
- * (double exceptions should never happen). If none is pending it will set the new one.
- *
- * @returns Nothing.
- * @param   pThis                   The stub instance data.
- * @param   enmExcpNew              The new exception which will be pending.
+ * March C- memory test passes.
+ */
+static const PSPSTUBMEMTESTPASS g_aMemTestMarchC[] =
+{
+    /* fDescending, fVerify, fWrite, fAddrInAddr, u32Expected, u32Write,   fWalkingOnes */
+    { false,        false,   true,   false,       0x00000000,  0x00000000, false },
+    { false,        true,    true,   false,       0x00000000,  0xffffffff, false },
+    { false,        true,    true,   false,       0xffffffff,  0x00000000, false },
+    { true,         true,    true,   false,       0x00000000,  0xffffffff, false },
+    { true,         true,    true,   false,       0xffffffff,  0x00000000, false },
+    { false,        true,    false,  false,       0x00000000,  0x00000000, false }
+};
+
+
+/**
+ * Address in address memory test passes.
+ */
+static const PSPSTUBMEMTESTPASS g_aMemTestAddrInAddr[] =
+{
+    /* fDescending, fVerify, fWrite, fAddrInAddr, u32Expected, u32Write,   fWalkingOnes */
+    { false,        false,   true,   true,        0x00000000,  0x00000000, false },
+    { false,        true,    false,  true,        0x00000000,  0x00000000, false },
+    { true,         false,   true,   true,        0x00000000,  0xffffffff, false },
+    { true,         true,    false,  true,        0xffffffff,  0x00000000, false }
+};
+
+
+/**
+ * Passes making up the walking ones test.
  */
-static void pspStubExcpSetCheckNonePending(PPSPSTUBSTATE pThis, PSPSTUBEXCP enmExcpNew)
+static const PSPSTUBMEMTESTPASS g_aMemTestWalkingOnes[] =
 {
-    if (pThis->enmExcpPending != PSPSTUBEXCP_NONE)
-    {
-        LogRel("EXCP: Got new exception '%s' while '%s' is still pending. The stub will stop now...!!\n",
-               pspStubExcpToStr(enmExcpNew), pspStubExcpToStr(pThis->enmExcpPending));
-        for (;;);
-    }
+    /* fDescending, fVerify, fWrite, fAddrInAddr, u32Expected, u32Write,   fWalkingOnes */
+    { false,        false,   false,  false,       0x00000000,  0x00000000, true }
+};
 
-    pThis->enmExcpPending = enmExcpNew;
-}
+
+/**
+ * Patterns used for the moving inversions test.
+ */
+static const uint32_t g_au32MemTestMovingInvPatterns[] =
+{
+    0x00000000,
+    0x55555555,
+    0x33333333,
+    0x0f0f0f0f
+};
 
 
 /**
- * Checks for any pending exception returning the appropriate return code and adjusting the returned payload.
+ * Records a memory test failure.
  *
- * @returns Status code.
- * @param   pThis                   The serial stub instance data.
- * @param   prcReq                  Where to store the status code to return in the response.
- * @param   ppvRespPayload          The payload pointer, which will get reset to NULL if the request caused an exception.
- * @param   pcbPayload              Pointer to the payload size, which will get reset to 0 if the request caused an exception.
+ * @returns nothing.
+ * @param   pMemTest                The memory test state.
+ * @param   u64Addr                 The failing address.
+ * @param   u32Expected             The expected value.
+ * @param   u32Actual               The value actually read.
  */
-static int pspStubPduCheckForExcp(PPSPSTUBSTATE pThis, PSPSTS *prcReq, const void **ppvRespPayload, size_t *pcbPayload)
+static void pspStubMemTestFailure(PPSPSTUBMEMTEST pMemTest, uint64_t u64Addr, uint32_t u32Expected, uint32_t u32Actual)
 {
-    if (pThis->enmExcpPending != PSPSTUBEXCP_NONE)
+    if (pMemTest->cFailuresRecorded < pMemTest->cFailuresRecordMax)
     {
-        *ppvRespPayload = NULL;
-        *pcbPayload     = 0;
-
-        switch (pThis->enmExcpPending)
-        {
-            case PSPSTUBEXCP_DATA_ABRT:
-                *prcReq = STS_ERR_PSP_PDU_REQ_DATA_ABORT_EXCEPTION;
-                break;
-            case PSPSTUBEXCP_PREFETCH_ABRT:
-                *prcReq = STS_ERR_PSP_PDU_REQ_PREFETCH_ABORT_EXCEPTION;
-                break;
-            case PSPSTUBEXCP_UNDEF_INSN:
-                *prcReq = STS_ERR_PSP_PDU_REQ_UNDEF_INSN_EXCEPTION;
-                break;
-            case PSPSTUBEXCP_INVALID:
-            case PSPSTUBEXCP_NONE:
-            default:
-                *prcReq = STS_ERR_INVALID_PARAMETER;
-                break;
-        }
+        PPSPSERIALMEMTESTFAILURE pFailure = &pMemTest->paFailures[pMemTest->cFailuresRecorded++];
 
-        pThis->enmExcpPending = PSPSTUBEXCP_NONE;
+        pFailure->u64Addr     = u64Addr;
+        pFailure->u32Expected = u32Expected;
+        pFailure->u32Actual   = u32Actual;
+        pFailure->fTest       = pMemTest->fTest;
+        pFailure->u32Pad0     = 0;
     }
 
-    return STS_INF_SUCCESS;
+    pMemTest->cFailures++;
 }
 
 
 /**
- * Reads/writes data in local PSP SRAM.
+ * Returns whether the memory test should be aborted because the maximum number of failures was reached.
  *
- * @returns Stauts code.
- * @param   pThis                   The serial stub instance data.
- * @param   pvPayload               PDU payload.
- * @param   cbPayload               Payload size in bytes.
- * @param   fWrite                  Flag whether this is rad or write request.
+ * @returns Flag whether to abort the memory test.
+ * @param   pMemTest                The memory test state.
  */
-static int pspStubPduProcessPspMemXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+static inline bool pspStubMemTestIsAborted(PPSPSTUBMEMTEST pMemTest)
 {
-    int rc = INF_SUCCESS;
-    PCPSPSERIALPSPMEMXFERREQ pReq = (PCPSPSERIALPSPMEMXFERREQ)pvPayload;
-
-    if (cbPayload < sizeof(*pReq))
-        return ERR_INVALID_PARAMETER;
-
-    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_INVALID;
-    size_t cbXfer = pReq->cbXfer;
-    const void *pvRespPayload = NULL;
-    size_t cbResPayload = 0;
-    if (fWrite)
-    {
-        enmResponse = PSPSERIALPDURRNID_RESPONSE_PSP_MEM_WRITE;
-        void *pvDst = (void *)(uintptr_t)pReq->PspAddrStart;
-        const void *pvSrc = (pReq + 1);
-        memcpy(pvDst, pvSrc, cbXfer);
-
-        /* Invalidate and clean memory. */
-        while (cbXfer)
-        {
-            asm volatile("mcr p15, 0x0, %0, cr7, cr14, 0x1\n": : "r" (pvDst) :"memory");
-            pvDst = (uint8_t *)pvDst + 32;
-            cbXfer -= MIN(cbXfer, 32);
-        }
-    }
-    else
-    {
-        enmResponse   = PSPSERIALPDURRNID_RESPONSE_PSP_MEM_READ;
-        pvRespPayload = (void *)(uintptr_t)pReq->PspAddrStart;
-        cbResPayload  = cbXfer;
-        /** @todo Need to copy into temporary buffer for proper exception handling. */
-    }
-
-    PSPSTS rcReq = STS_INF_SUCCESS;
-    pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbPayload);
-    return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbResPayload);
+    return    pMemTest->pReq->cFailuresMax
+           && pMemTest->cFailures >= pMemTest->pReq->cFailuresMax;
 }
 
 
 /**
- * Does a MMIO read/write of the given length.
+ * Executes the given pass on a single mapped chunk.
  *
  * @returns nothing.
- * @param   pvDst               The destination.
- * @param   pvSrc               The source.
- * @param   cb                  Number of bytes to access.
+ * @param   pMemTest                The memory test state.
+ * @param   pPass                   The pass to execute.
+ * @param   pu32                    The mapped chunk.
+ * @param   u64Addr                 The address of the chunk.
+ * @param   cWords                  Number of 32bit words in the chunk.
  */
-static void pspStubMmioAccess(void *pvDst, const void *pvSrc, size_t cb)
+static void pspStubMemTestChunk(PPSPSTUBMEMTEST pMemTest, PCPSPSTUBMEMTESTPASS pPass, volatile uint32_t *pu32,
+                                uint64_t u64Addr, uint32_t cWords)
 {
-    switch (cb)
+    for (uint32_t i = 0; i < cWords; i++)
     {
-        case 1:
-            *(volatile uint8_t *)pvDst = *(volatile const uint8_t *)pvSrc;
-            break;
-        case 2:
-            *(volatile uint16_t *)pvDst = *(volatile const uint16_t *)pvSrc;
-            break;
-        case 4:
-            *(volatile uint32_t *)pvDst = *(volatile const uint32_t *)pvSrc;
-            break;
-        case 8:
-            *(volatile uint64_t *)pvDst = *(volatile const uint64_t *)pvSrc;
-            break;
-        default:
-            break;
+        uint32_t idxWord = pPass->fDescending ? cWords - i - 1 : i;
+        uint64_t u64AddrWord = u64Addr + idxWord * sizeof(uint32_t);
+        uint32_t u32Addr = pPass->fAddrInAddr ? (uint32_t)u64AddrWord : 0;
+
+        if (pPass->fWalkingOnes)
+        {
+            /* A stuck or shorted data line shows up as soon as the bit reaches it, report only the first one per word. */
+            for (uint32_t iBit = 0; iBit < 32; iBit++)
+            {
+                pu32[idxWord] = BIT(iBit);
+                uint32_t u32Actual = pu32[idxWord];
+                if (u32Actual != BIT(iBit))
+                {
+                    pspStubMemTestFailure(pMemTest, u64AddrWord, BIT(iBit), u32Actual);
+                    break;
+                }
+            }
+            continue;
+        }
+
+        if (pPass->fVerify)
+        {
+            uint32_t u32Expected = pPass->u32Expected ^ u32Addr;
+            uint32_t u32Actual = pu32[idxWord];
+            if (u32Actual != u32Expected)
+                pspStubMemTestFailure(pMemTest, u64AddrWord, u32Expected, u32Actual);
+        }
+
+        if (pPass->fWrite)
+            pu32[idxWord] = pPass->u32Write ^ u32Addr;
     }
 }
 
 
 /**
- * Reads/writes data in local PSP MMIO space.
+ * Sends a progress notification if one is due.
  *
- * @returns Stauts code.
+ * @returns nothing.
  * @param   pThis                   The serial stub instance data.
- * @param   pvPayload               PDU payload.
- * @param   cbPayload               Payload size in bytes.
- * @param   fWrite                  Flag whether this is rad or write request.
+ * @param   pMemTest                The memory test state.
  */
-static int pspStubPduProcessPspMmioXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+static void pspStubMemTestProgress(PPSPSTUBSTATE pThis, PPSPSTUBMEMTEST pMemTest)
 {
-    int rc = INF_SUCCESS;
-    PCPSPSERIALPSPMEMXFERREQ pReq = (PCPSPSERIALPSPMEMXFERREQ)pvPayload;
+    if (   pMemTest->pReq->cbProgressInterval
+        && pMemTest->cbProcessed >= pMemTest->cbProgressNext)
+    {
+        PSPSERIALMEMTESTPROGRESSNOT ProgressNot;
 
-    if (   cbPayload < sizeof(*pReq)
-        || (   pReq->cbXfer != 1
-            && pReq->cbXfer != 2
-            && pReq->cbXfer != 4
-            && pReq->cbXfer != 8))
-        return ERR_INVALID_PARAMETER;
+        ProgressNot.fTest       = pMemTest->fTest;
+        ProgressNot.cFailures   = pMemTest->cFailures;
+        ProgressNot.cbProcessed = pMemTest->cbProcessed;
+        pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_NOTIFICATION_MEMTEST_PROGRESS,
+                       &ProgressNot, sizeof(ProgressNot));
 
-    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_INVALID;
-    size_t cbXfer = pReq->cbXfer;
-    const void *pvRespPayload = NULL;
-    uint8_t abRead[8];
-    size_t cbResPayload = 0;
-    const void *pvSrc = NULL;
-    void *pvDst = NULL;
-    if (fWrite)
-    {
-        enmResponse = PSPSERIALPDURRNID_RESPONSE_PSP_MMIO_WRITE;
-        pvDst = (void *)(uintptr_t)pReq->PspAddrStart;
-        pvSrc = (pReq + 1);
-        pspStubMmioAccess(pvDst, (pReq + 1), cbXfer);
-    }
-    else
-    {
-        enmResponse   = PSPSERIALPDURRNID_RESPONSE_PSP_MMIO_READ;
-        pvSrc = (void *)(uintptr_t)pReq->PspAddrStart;
-        pvDst = &abRead[0];
-        pspStubMmioAccess(&abRead[0], pvSrc, cbXfer);
-        pvRespPayload = &abRead[0];
-        cbResPayload  = cbXfer;
+        pMemTest->cbProgressNext = pMemTest->cbProcessed + pMemTest->pReq->cbProgressInterval;
     }
-
-    PSPSTS rcReq = STS_INF_SUCCESS;
-    pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbPayload);
-    return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbResPayload);
 }
 
 
 /**
- * Reads/writes data in the SMN address space.
+ * Executes a single pass over the complete range.
  *
- * @returns Stauts code.
+ * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   pvPayload               PDU payload.
- * @param   cbPayload               Payload size in bytes.
- * @param   fWrite                  Flag whether this is rad or write request.
+ * @param   pMemTest                The memory test state.
+ * @param   pPass                   The pass to execute.
  */
-static int pspStubPduProcessPspSmnXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+static int pspStubMemTestPass(PPSPSTUBSTATE pThis, PPSPSTUBMEMTEST pMemTest, PCPSPSTUBMEMTESTPASS pPass)
 {
-    PCPSPSERIALSMNMEMXFERREQ pReq = (PCPSPSERIALSMNMEMXFERREQ)pvPayload;
-
-    if (cbPayload < sizeof(*pReq))
-        return ERR_INVALID_PARAMETER;
+    PCPSPSERIALMEMTESTREQ pReq = pMemTest->pReq;
+    uint64_t cbLeft = pReq->cbTest;
+    int rc = INF_SUCCESS;
 
-    PSPSERIALPDURRNID enmResponse =   fWrite
-                                    ? PSPSERIALPDURRNID_RESPONSE_PSP_SMN_WRITE
-                                    : PSPSERIALPDURRNID_RESPONSE_PSP_SMN_READ;
-    void *pvMap = NULL;
-    int rc = pspStubSmnMap(pThis, pReq->SmnAddrStart, &pvMap);
-    if (!rc)
+    while (   cbLeft
+           && !rc
+           && !pspStubMemTestIsAborted(pMemTest))
     {
-        const void *pvRespPayload = NULL;
-        uint8_t abRead[8];
-        size_t cbRespPayload = 0;
-
-        if (   pReq->cbXfer == 1
-            || pReq->cbXfer == 2
-            || pReq->cbXfer == 4)
+        /* Work on chunks never crossing a mapping window. */
+        uint64_t u64AddrChunk = 0;
+        uint32_t cbChunk = 0;
+        if (!pPass->fDescending)
         {
-            if (fWrite)
-                pspStubMmioAccess(pvMap, (pReq + 1), pReq->cbXfer);
-            else
-            {
-                pspStubMmioAccess(&abRead[0], pvMap, pReq->cbXfer);
-                pvRespPayload = &abRead[0];
-                cbRespPayload = pReq->cbXfer;
-            }
+            u64AddrChunk = pMemTest->u64AddrStart + (pReq->cbTest - cbLeft);
+            cbChunk      = PSP_SERIAL_STUB_MEMTEST_CHUNK_SZ - (u64AddrChunk & (PSP_SERIAL_STUB_MEMTEST_CHUNK_SZ - 1));
+            cbChunk      = MIN(cbLeft, cbChunk);
         }
         else
         {
-            if (fWrite)
-            {
-                const void *pvSrc = (pReq + 1);
-                memcpy(pvMap, pvSrc, pReq->cbXfer);
-            }
-            else
-            {
-                memcpy(&pThis->abPduResp[0], pvMap, pReq->cbXfer);
-                pvRespPayload = &pThis->abPduResp[0];
-                cbRespPayload = pReq->cbXfer;
-            }
+            uint64_t u64AddrEnd = pMemTest->u64AddrStart + cbLeft;
+            cbChunk      = ((u64AddrEnd - 1) & (PSP_SERIAL_STUB_MEMTEST_CHUNK_SZ - 1)) + 1;
+            cbChunk      = MIN(cbLeft, cbChunk);
+            u64AddrChunk = u64AddrEnd - cbChunk;
         }
 
-        pspStubSmnUnmapByPtr(pThis, pvMap);
+        void *pvChunk = NULL;
+        rc = pspStubAddrSpaceMap(pThis, pReq->enmAddrSpace, u64AddrChunk, &pvChunk);
+        if (!rc)
+        {
+            pspStubMemTestChunk(pMemTest, pPass, (volatile uint32_t *)pvChunk, u64AddrChunk, cbChunk / sizeof(uint32_t));
+            pspStubAddrSpaceUnmapByPtr(pThis, pReq->enmAddrSpace, pvChunk);
 
-        PSPSTS rcReq = STS_INF_SUCCESS;
-        pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
-        return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
+            cbLeft                -= cbChunk;
+            pMemTest->cbProcessed += cbChunk;
+            pspStubMemTestProgress(pThis, pMemTest);
+        }
     }
-    else
-        rc = pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
 
     return rc;
 }
 
 
 /**
- * Reads/writes data to normal memory in x86 address space.
+ * Executes the given set of passes.
  *
- * @returns Stauts code.
+ * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   pvPayload               PDU payload.
- * @param   cbPayload               Payload size in bytes.
- * @param   fWrite                  Flag whether this is rad or write request.
+ * @param   pMemTest                The memory test state.
+ * @param   paPasses                The passes to execute in order.
+ * @param   cPasses                 Number of passes.
  */
-static int pspStubPduProcessPspX86MemXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+static int pspStubMemTestPasses(PPSPSTUBSTATE pThis, PPSPSTUBMEMTEST pMemTest, PCPSPSTUBMEMTESTPASS paPasses, uint32_t cPasses)
 {
-    PCPSPSERIALX86MEMXFERREQ pReq = (PCPSPSERIALX86MEMXFERREQ)pvPayload;
+    int rc = INF_SUCCESS;
 
-    if (cbPayload < sizeof(*pReq))
-        return ERR_INVALID_PARAMETER;
+    for (uint32_t i = 0; i < cPasses && !rc; i++)
+        rc = pspStubMemTestPass(pThis, pMemTest, &paPasses[i]);
 
-    PSPSERIALPDURRNID enmResponse =   fWrite
-                                    ? PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_WRITE
-                                    : PSPSERIALPDURRNID_RESPONSE_PSP_X86_MEM_READ;
-    void *pvMap = NULL;
-    int rc = pspStubX86PhysMap(pThis, pReq->PhysX86Start, false /*fMmio*/, &pvMap);
-    if (!rc)
+    return rc;
+}
+
+
+/**
+ * Runs the given memory test.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pMemTest                The memory test state.
+ * @param   fTest                   The test to run (one of PSP_SERIAL_MEMTEST_F_XXX).
+ */
+static int pspStubMemTestRun(PPSPSTUBSTATE pThis, PPSPSTUBMEMTEST pMemTest, uint32_t fTest)
+{
+    int rc = INF_SUCCESS;
+
+    pMemTest->fTest = fTest;
+    switch (fTest)
     {
-        size_t cbXfer = pReq->cbXfer;
-        const void *pvRespPayload = NULL;
-        size_t cbRespPayload = 0;
-        if (fWrite)
-        {
-            const void *pvSrc = (pReq + 1);
-            memcpy(pvMap, pvSrc, cbXfer);
-        }
-        else
+        case PSP_SERIAL_MEMTEST_F_WALKING_ONES:
+            rc = pspStubMemTestPasses(pThis, pMemTest, &g_aMemTestWalkingOnes[0], ELEMENTS(g_aMemTestWalkingOnes));
+            break;
+        case PSP_SERIAL_MEMTEST_F_ADDR_IN_ADDR:
+            rc = pspStubMemTestPasses(pThis, pMemTest, &g_aMemTestAddrInAddr[0], ELEMENTS(g_aMemTestAddrInAddr));
+            break;
+        case PSP_SERIAL_MEMTEST_F_MOVING_INV:
         {
-            pvRespPayload = pvMap;
-            cbRespPayload = cbXfer;
-            /** @todo Need to copy into temporary buffer for proper exception handling. */
+            for (uint32_t i = 0; i < ELEMENTS(g_au32MemTestMovingInvPatterns) && !rc; i++)
+            {
+                uint32_t u32Pattern = g_au32MemTestMovingInvPatterns[i];
+                PSPSTUBMEMTESTPASS aPasses[3];
+
+                /* Fill with the pattern, then invert it bottom up and restore it top down verifying every word on the way. */
+                memset(&aPasses[0], 0, sizeof(aPasses));
+                aPasses[0].fWrite      = true;
+                aPasses[0].u32Write    = u32Pattern;
+                aPasses[1].fVerify     = true;
+                aPasses[1].fWrite      = true;
+                aPasses[1].u32Expected = u32Pattern;
+                aPasses[1].u32Write    = ~u32Pattern;
+                aPasses[2].fDescending = true;
+                aPasses[2].fVerify     = true;
+                aPasses[2].fWrite      = true;
+                aPasses[2].u32Expected = ~u32Pattern;
+                aPasses[2].u32Write    = u32Pattern;
+                rc = pspStubMemTestPasses(pThis, pMemTest, &aPasses[0], ELEMENTS(aPasses));
+            }
+            break;
         }
-
-        PSPSTS rcReq = STS_INF_SUCCESS;
-        pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
-        rc = pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
-        pspStubX86PhysUnmapByPtr(pThis, pvMap);
+        case PSP_SERIAL_MEMTEST_F_MARCH_C:
+            rc = pspStubMemTestPasses(pThis, pMemTest, &g_aMemTestMarchC[0], ELEMENTS(g_aMemTestMarchC));
+            break;
+        default:
+            rc = ERR_INVALID_PARAMETER;
+            break;
     }
-    else
-        rc = pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
 
     return rc;
 }
 
 
 /**
- * Reads/writes data to MMIO in x86 address space.
+ * Runs the requested memory tests on the given range.
  *
- * @returns Stauts code.
+ * @returns Status code.
  * @param   pThis                   The serial stub instance data.
  * @param   pvPayload               PDU payload.
  * @param   cbPayload               Payload size in bytes.
- * @param   fWrite                  Flag whether this is rad or write request.
  */
-static int pspStubPduProcessPspX86MmioXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+static int pspStubPduProcessMemTest(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
 {
-    PCPSPSERIALX86MEMXFERREQ pReq = (PCPSPSERIALX86MEMXFERREQ)pvPayload;
+    PCPSPSERIALMEMTESTREQ pReq = (PCPSPSERIALMEMTESTREQ)pvPayload;
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_MEMTEST;
 
     if (   cbPayload < sizeof(*pReq)
-        || (   pReq->cbXfer != 1
-            && pReq->cbXfer != 2
-            && pReq->cbXfer != 4
-            && pReq->cbXfer != 8))
-        return ERR_INVALID_PARAMETER;
+        || !pReq->fTests
+        || (pReq->fTests & ~PSP_SERIAL_MEMTEST_F_VALID_MASK)
+        || !pReq->cbTest
+        || (pReq->cbTest & (sizeof(uint32_t) - 1)))
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
 
-    PSPSERIALPDURRNID enmResponse =   fWrite
-                                    ? PSPSERIALPDURRNID_RESPONSE_PSP_X86_MMIO_WRITE
-                                    : PSPSERIALPDURRNID_RESPONSE_PSP_X86_MMIO_READ;
-    void *pvMap = NULL;
-    int rc = pspStubX86PhysMap(pThis, pReq->PhysX86Start, true /*fMmio*/, &pvMap);
-    if (!rc)
+    uint64_t u64AddrStart = 0;
+    switch (pReq->enmAddrSpace)
     {
-        const void *pvRespPayload = NULL;
-        uint8_t abRead[8];
-        size_t cbRespPayload = 0;
-        const void *pvSrc = NULL;
-        void *pvDst = NULL;
-        if (fWrite)
-            pspStubMmioAccess(pvMap, (pReq + 1), pReq->cbXfer);
-        else
+        case PSPADDRSPACE_PSP_MEM:
         {
-            pspStubMmioAccess(&abRead[0], pvMap, pReq->cbXfer);
-            pvRespPayload = &abRead[0];
-            cbRespPayload = pReq->cbXfer;
+            /*
+             * Only the SRAM not occupied by the stub, everything above is MMIO including the
+             * mapping control registers and windows the stub depends on.
+             */
+            u64AddrStart = pReq->u.PspAddrStart;
+            if (   u64AddrStart < pspStubPlatStubEndGet()
+                || u64AddrStart >= pspStubPlatSramEndGet()
+                || pReq->cbTest > pspStubPlatSramEndGet() - u64AddrStart)
+                return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+            break;
         }
+        case PSPADDRSPACE_X86_MEM:
+            u64AddrStart = pReq->u.PhysX86AddrStart;
+            break;
+        default:
+            return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    }
+
+    if (u64AddrStart & (sizeof(uint32_t) - 1))
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    /* The failures are recorded directly in the response buffer. */
+    PPSPSERIALMEMTESTRESP pResp = (PPSPSERIALMEMTESTRESP)pspStubPduRespBufGet(pThis);
+    if (!pResp)
+        return pspStubPduSend(pThis, ERR_BUFFER_OVERFLOW, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    PSPSTUBMEMTEST MemTest;
+
+    MemTest.pReq               = pReq;
+    MemTest.u64AddrStart       = u64AddrStart;
+    MemTest.fTest              = 0;
+    MemTest.cFailures          = 0;
+    MemTest.cFailuresRecorded  = 0;
+    MemTest.cFailuresRecordMax = (PSP_SERIAL_STUB_TX_PAYLOAD_MAX - sizeof(*pResp)) / sizeof(PSPSERIALMEMTESTFAILURE);
+    MemTest.paFailures         = (PPSPSERIALMEMTESTFAILURE)(pResp + 1);
+    MemTest.cbProcessed        = 0;
+    MemTest.cbProgressNext     = pReq->cbProgressInterval;
+
+    int rc = INF_SUCCESS;
+    for (uint32_t i = 0; i < 32 && !rc && !pspStubMemTestIsAborted(&MemTest); i++)
+    {
+        if (pReq->fTests & BIT(i))
+            rc = pspStubMemTestRun(pThis, &MemTest, BIT(i));
+    }
+
+    if (!rc)
+    {
+        const void *pvRespPayload = pResp;
+        size_t cbRespPayload = sizeof(*pResp) + MemTest.cFailuresRecorded * sizeof(PSPSERIALMEMTESTFAILURE);
+
+        pResp->cFailures         = MemTest.cFailures;
+        pResp->cFailuresReported = MemTest.cFailuresRecorded;
+        pResp->cbProcessed       = MemTest.cbProcessed;
 
-        pspStubX86PhysUnmapByPtr(pThis, pvMap);
         PSPSTS rcReq = STS_INF_SUCCESS;
         pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
         rc = pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
@@ -1698,271 +4252,501 @@ static int pspStubPduProcessPspX86MmioXfer(PPSPSTUBSTATE pThis, const void *pvPa
 
 
 /**
- * Reads/writes to a Co-Processor.
+ * Fills in the given journal entry for a request about to be executed.
  *
- * @returns Status code.
- * @param   pThis                   The serial stub instance data.
- * @param   pvPayload               PDU payload.
- * @param   cbPayload               Payload size in bytes.
- * @param   fWrite                  Flag whether this is read or write request.
+ * @returns nothing.
+ * @param   pEntry                  The entry to fill in.
+ * @param   pPdu                    The validated request PDU about to be executed.
+ * @param   enmAddrSpace            The address space being modified.
+ * @param   u64Addr                 The address being modified.
+ * @param   cb                      Number of bytes being modified.
+ * @param   cbReqHdr                Size of the request header preceding the data in bytes.
  */
-static int pspStubPduProcessCoProcRw(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload, bool fWrite)
+static void pspStubJournalEntryInit(PPSPSTUBJOURNALENTRY pEntry, PCPSPSERIALPDUHDR pPdu, PSPADDRSPACE enmAddrSpace,
+                                    uint64_t u64Addr, uint32_t cb, size_t cbReqHdr)
 {
-    PCPSPSERIALCOPROCRWREQ pReq = (PCPSPSERIALCOPROCRWREQ)pvPayload;
+    const uint8_t *pbReq = (const uint8_t *)(pPdu + 1);
+    size_t cbReq = pPdu->u.Fields.cbPdu;
 
-    if (cbPayload < sizeof(*pReq))
-        return ERR_INVALID_PARAMETER;
+    pEntry->enmReqId     = pPdu->u.Fields.enmRrnId;
+    pEntry->tsMillies    = 0;
+    pEntry->u64Addr      = u64Addr;
+    pEntry->cb           = cb;
+    pEntry->rcReq        = INF_SUCCESS;
+    pEntry->cMillies     = PSP_SERIAL_JOURNAL_MILLIES_PENDING;
+    pEntry->enmAddrSpace = enmAddrSpace;
 
-    PSPSERIALPDURRNID enmResponse =   fWrite
-                                    ? PSPSERIALPDURRNID_RESPONSE_COPROC_WRITE
-                                    : PSPSERIALPDURRNID_RESPONSE_COPROC_READ;
-    const void *pvRespPayload = NULL;
-    uint32_t uValRead = 0;
-    size_t cbRespPayload = 0;
-    if (fWrite)
+    /*
+     * Small values are stored directly. Anything larger is identified by the (32-bit FNV-1a) hash of the request header
+     * and the PDU checksum validated during receive, hashing up to 4K of data would cost far more than the request itself.
+     */
+    if (cbReq - cbReqHdr <= sizeof(uint32_t))
     {
-        uint32_t uVal = *(uint32_t *)(pReq + 1);
-
-        /* Insert the parameters into the template */
-        volatile uint32_t *pu32Insn = (volatile uint32_t *)((uintptr_t)pspSerialStubCoProcWriteAsm);
-        *pu32Insn =   (0xee << 24)
-                    | (pReq->u8Opc1 & 0x7) << 21
-                    | (pReq->u8Crn & 0xf) << 16
-                    | (0) << 12 /* Rt (r0) */
-                    | (pReq->u8CoProc & 0xf) << 8
-                    | (pReq->u8Opc2 & 0x7) << 5
-                    | BIT(4)
-                    | (pReq->u8Crm & 0xf);
-        asm volatile("mcr p15, 0x0, %0, cr7, cr5, 0x1\n": : "r" (pu32Insn) :"memory");
-        asm volatile("dsb #0xf\nisb #0xf\n": : :"memory");
-        pspSerialStubCoProcWriteAsm(uVal);
+        uint32_t u32Val = 0;
+        memcpy(&u32Val, pbReq + cbReqHdr, cbReq - cbReqHdr);
+        pEntry->u32ValOrHash = u32Val;
     }
     else
     {
-        pvRespPayload = &uValRead;
-        cbRespPayload = sizeof(uValRead);
-
-        /* Insert the parameters into the template */
-        volatile uint32_t *pu32Insn = (volatile uint32_t *)((uintptr_t)pspSerialStubCoProcReadAsm);
-        *pu32Insn =   (0xee << 24)
-                    | (pReq->u8Opc1 & 0x7) << 21
-                    | BIT(20)
-                    | (pReq->u8Crn & 0xf) << 16
-                    | (0) << 12 /* Rt (r0) */
-                    | (pReq->u8CoProc & 0xf) << 8
-                    | (pReq->u8Opc2 & 0x7) << 5
-                    | BIT(4)
-                    | (pReq->u8Crm & 0xf);
-        asm volatile("mcr p15, 0x0, %0, cr7, cr5, 0x1\n": : "r" (pu32Insn) :"memory");
-        asm volatile("dsb #0xf\nisb #0xf\n": : :"memory");
-        uValRead = pspSerialStubCoProcReadAsm();
-    }
+        PCPSPSERIALPDUFOOTER pFooter = (PCPSPSERIALPDUFOOTER)(pbReq + ((cbReq + 7) & ~7));
+        uint32_t uHash = 0x811c9dc5;
 
-    PSPSTS rcReq = STS_INF_SUCCESS;
-    pspStubPduCheckForExcp(pThis, &rcReq, &pvRespPayload, &cbRespPayload);
-    return pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
+        for (size_t i = 0; i < cbReqHdr; i++)
+            uHash = (uHash ^ pbReq[i]) * 0x01000193;
+        for (uint32_t i = 0; i < sizeof(pFooter->u32ChkSum); i++)
+            uHash = (uHash ^ ((pFooter->u32ChkSum >> (i * 8)) & 0xff)) * 0x01000193;
+
+        pEntry->u32ValOrHash = uHash;
+    }
 }
 
 
 /**
- * Maps the given address from the data xfer request start address.
+ * Prepares a journal entry for the given request if it modifies state.
  *
- * @returns Status code.
- * @param   pThis                   The serial stub instance data.
- * @param   pReq                    The data xfer request.
- * @param   ppv                     Where to store the pointer to the mapping on success.
+ * @returns Flag whether the request gets journaled.
+ * @param   pEntry                  Where to store the prepared entry.
+ * @param   pPdu                    The request PDU about to be executed.
  */
-static int pspStubPduDataXferAddressMap(PPSPSTUBSTATE pThis, PCPSPSERIALDATAXFERREQ pReq, void **ppv)
+static bool pspStubJournalPrepare(PPSPSTUBJOURNALENTRY pEntry, PCPSPSERIALPDUHDR pPdu)
 {
-    int rc = 0;
+    const uint8_t *pbReq = (const uint8_t *)(pPdu + 1);
+    size_t cbReq = pPdu->u.Fields.cbPdu;
+    PSPADDRSPACE enmAddrSpace = PSPADDRSPACE_INVALID;
+    uint64_t u64Addr = 0;
+    uint32_t cb = 0;
+    size_t cbReqHdr = 0;
 
-    switch (pReq->enmAddrSpace)
+    switch (pPdu->u.Fields.enmRrnId)
     {
-        case PSPADDRSPACE_PSP_MEM:
-        case PSPADDRSPACE_PSP_MMIO:
-            *ppv = (void *)pReq->u.PspAddrStart;
+        case PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE:
+        case PSPSERIALPDURRNID_REQUEST_PSP_MMIO_WRITE:
+        {
+            PCPSPSERIALPSPMEMXFERREQ pReq = (PCPSPSERIALPSPMEMXFERREQ)pbReq;
+            cbReqHdr = sizeof(*pReq);
+            if (cbReq < cbReqHdr)
+                return false;
+
+            enmAddrSpace =   pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_MEM_WRITE
+                           ? PSPADDRSPACE_PSP_MEM
+                           : PSPADDRSPACE_PSP_MMIO;
+            u64Addr      = pReq->PspAddrStart;
+            cb           = pReq->cbXfer;
             break;
-        case PSPADDRSPACE_SMN:
-            rc = pspStubSmnMap(pThis, pReq->u.SmnAddrStart, ppv);
+        }
+        case PSPSERIALPDURRNID_REQUEST_PSP_SMN_WRITE:
+        {
+            PCPSPSERIALSMNMEMXFERREQ pReq = (PCPSPSERIALSMNMEMXFERREQ)pbReq;
+            cbReqHdr = sizeof(*pReq);
+            if (cbReq < cbReqHdr)
+                return false;
+
+            enmAddrSpace = PSPADDRSPACE_SMN;
+            u64Addr      = pReq->SmnAddrStart;
+            cb           = pReq->cbXfer;
             break;
-        case PSPADDRSPACE_X86_MEM:
-            rc = pspStubX86PhysMap(pThis, pReq->u.X86.PhysX86AddrStart, false /*fMmio*/, ppv);
-            /** @todo Caching flags. */
+        }
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE:
+        case PSPSERIALPDURRNID_REQUEST_PSP_X86_MMIO_WRITE:
+        {
+            PCPSPSERIALX86MEMXFERREQ pReq = (PCPSPSERIALX86MEMXFERREQ)pbReq;
+            cbReqHdr = sizeof(*pReq);
+            if (cbReq < cbReqHdr)
+                return false;
+
+            enmAddrSpace =   pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_PSP_X86_MEM_WRITE
+                           ? PSPADDRSPACE_X86_MEM
+                           : PSPADDRSPACE_X86_MMIO;
+            u64Addr      = pReq->PhysX86Start;
+            cb           = pReq->cbXfer;
             break;
-        case PSPADDRSPACE_X86_MMIO:
-            rc = pspStubX86PhysMap(pThis, pReq->u.X86.PhysX86AddrStart, true /*fMmio*/, ppv);
-            /** @todo Caching flags. */
+        }
+        case PSPSERIALPDURRNID_REQUEST_PSP_DATA_XFER:
+        {
+            PCPSPSERIALDATAXFERREQ pReq = (PCPSPSERIALDATAXFERREQ)pbReq;
+            cbReqHdr = sizeof(*pReq);
+            if (   cbReq < cbReqHdr
+                || !(pReq->fFlags & (PSP_SERIAL_DATA_XFER_F_WRITE | PSP_SERIAL_DATA_XFER_F_MEMSET)))
+                return false;
+
+            enmAddrSpace = pReq->enmAddrSpace;
+            cb           = pReq->cbXfer;
+            if (   enmAddrSpace == PSPADDRSPACE_X86_MEM
+                || enmAddrSpace == PSPADDRSPACE_X86_MMIO)
+                u64Addr = pReq->u.X86.PhysX86AddrStart;
+            else if (enmAddrSpace == PSPADDRSPACE_SMN)
+                u64Addr = pReq->u.SmnAddrStart;
+            else
+                u64Addr = pReq->u.PspAddrStart;
             break;
-        default:
-            rc = -1;
+        }
+        case PSPSERIALPDURRNID_REQUEST_COPROC_WRITE:
+        {
+            PCPSPSERIALCOPROCRWREQ pReq = (PCPSPSERIALCOPROCRWREQ)pbReq;
+            cbReqHdr = sizeof(*pReq);
+            if (cbReq < cbReqHdr)
+                return false;
+
+            /* Encode the register like the mcr instruction does. */
+            u64Addr =   (pReq->u8Opc1 & 0x7) << 21
+                      | (pReq->u8Crn & 0xf) << 16
+                      | (pReq->u8CoProc & 0xf) << 8
+                      | (pReq->u8Opc2 & 0x7) << 5
+                      | (pReq->u8Crm & 0xf);
+            cb      = sizeof(uint32_t);
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_INPUT_BUF_WRITE:
+        {
+            PCPSPSERIALINBUFWRREQ pReq = (PCPSPSERIALINBUFWRREQ)pbReq;
+            cbReqHdr = sizeof(*pReq);
+            if (cbReq < cbReqHdr)
+                return false;
+
+            u64Addr = pReq->idInBuf;
+            cb      = cbReq - cbReqHdr;
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_LOAD_CODE_MOD:
+        case PSPSERIALPDURRNID_REQUEST_EXEC_CODE_MOD:
+            enmAddrSpace = PSPADDRSPACE_PSP_MEM;
+            u64Addr      = CM_FLAT_BINARY_LOAD_ADDR;
+            break;
+        case PSPSERIALPDURRNID_REQUEST_BRANCH_TO:
+        {
+            PCPSPSERIALBRANCHTOREQ pReq = (PCPSPSERIALBRANCHTOREQ)pbReq;
+            cbReqHdr = sizeof(*pReq);
+            if (cbReq < cbReqHdr)
+                return false;
+
+            enmAddrSpace = PSPADDRSPACE_PSP_MEM;
+            u64Addr      = pReq->PspAddrDst;
+            break;
+        }
+        case PSPSERIALPDURRNID_REQUEST_MEMTEST:
+        {
+            PCPSPSERIALMEMTESTREQ pReq = (PCPSPSERIALMEMTESTREQ)pbReq;
+            cbReqHdr = sizeof(*pReq);
+            if (cbReq < cbReqHdr)
+                return false;
+
+            enmAddrSpace = pReq->enmAddrSpace;
+            u64Addr      =   enmAddrSpace == PSPADDRSPACE_X86_MEM
+                           ? pReq->u.PhysX86AddrStart
+                           : pReq->u.PspAddrStart;
+            cb           = MIN(pReq->cbTest, UINT32_MAX);
             break;
+        }
+        default:
+            /* Doesn't modify anything. */
+            return false;
     }
 
-    return rc;
+    pspStubJournalEntryInit(pEntry, pPdu, enmAddrSpace, u64Addr, cb, cbReqHdr);
+    return true;
+}
+
+
+/**
+ * Records the given request in the journal before it executes if it modifies state.
+ *
+ * The entry is committed up front so requests which never return (BRANCH_TO, a hanging code module or an access
+ * wedging the system) are still recorded, pspStubJournalEnd() fills in the status and duration afterwards.
+ *
+ * @returns Sequence number of the entry or 0 if the request isn't journaled.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pPdu                    The request PDU about to be executed.
+ */
+static uint32_t pspStubJournalBegin(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR pPdu)
+{
+    PSPSTUBJOURNALENTRY Entry;
+
+    if (!pspStubJournalPrepare(&Entry, pPdu))
+        return 0;
+
+    uint32_t uSeq = pThis->uJournalSeqNext++;
+    Entry.tsMillies = pspStubGetMillies(pThis);
+    pThis->aJournal[uSeq & (PSP_SERIAL_STUB_JOURNAL_ENTRIES - 1)] = Entry;
+    return uSeq;
 }
 
 
 /**
- * Unmaps the given pointer returned by a previous call to pspStubPduDataXferAddressMap().
+ * Completes the journal entry of a request which returned.
  *
  * @returns nothing.
  * @param   pThis                   The serial stub instance data.
- * @param   pReq                    The data xfer request.
- * @param   pv                      Pointer to the address to unmap.
+ * @param   uSeq                    Sequence number of the entry as returned by pspStubJournalBegin().
+ * @param   rcReq                   The status code the request completed with.
  */
-static void pspStubPduDataXferAddressUnmapByPtr(PPSPSTUBSTATE pThis, PCPSPSERIALDATAXFERREQ pReq, void *pv)
+static void pspStubJournalEnd(PPSPSTUBSTATE pThis, uint32_t uSeq, int32_t rcReq)
 {
-    switch (pReq->enmAddrSpace)
+    /* Requests processed while a code module executes might have pushed the entry out of the ring meanwhile. */
+    if (pThis->uJournalSeqNext - uSeq > PSP_SERIAL_STUB_JOURNAL_ENTRIES)
+        return;
+
+    PPSPSTUBJOURNALENTRY pEntry = &pThis->aJournal[uSeq & (PSP_SERIAL_STUB_JOURNAL_ENTRIES - 1)];
+    pEntry->cMillies = pspStubGetMillies(pThis) - pEntry->tsMillies;
+    pEntry->rcReq    = rcReq;
+}
+
+
+/**
+ * Returns the most recent entries of the request journal.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ */
+static int pspStubPduProcessJournalRead(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
+{
+    PCPSPSERIALJOURNALREADREQ pReq = (PCPSPSERIALJOURNALREADREQ)pvPayload;
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_JOURNAL_READ;
+
+    if (cbPayload != sizeof(*pReq))
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    PPSPSERIALJOURNALREADRESP pResp = (PPSPSERIALJOURNALREADRESP)pspStubPduRespBufGet(pThis);
+    if (!pResp)
+        return pspStubPduSend(pThis, ERR_BUFFER_OVERFLOW, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    PPSPSERIALJOURNALENTRY paEntries = (PPSPSERIALJOURNALENTRY)(pResp + 1);
+    uint32_t cEntriesTotal = pThis->uJournalSeqNext - 1;
+    uint32_t cEntries = MIN(pReq->cEntriesMax, MIN(cEntriesTotal, PSP_SERIAL_STUB_JOURNAL_ENTRIES));
+    cEntries = MIN(cEntries, (PSP_SERIAL_STUB_TX_PAYLOAD_MAX - sizeof(*pResp)) / sizeof(*paEntries));
+
+    /* Oldest first. */
+    uint32_t uSeq = pThis->uJournalSeqNext - cEntries;
+    for (uint32_t i = 0; i < cEntries; i++, uSeq++)
     {
-        case PSPADDRSPACE_PSP_MEM:
-        case PSPADDRSPACE_PSP_MMIO:
-            break;
-        case PSPADDRSPACE_SMN:
-            pspStubSmnUnmapByPtr(pThis, pv);
-            break;
-        case PSPADDRSPACE_X86_MEM:
-        case PSPADDRSPACE_X86_MMIO:
-            pspStubX86PhysUnmapByPtr(pThis, pv);
-            break;
-        default:
-            break;
+        PCPSPSTUBJOURNALENTRY pEntry = &pThis->aJournal[uSeq & (PSP_SERIAL_STUB_JOURNAL_ENTRIES - 1)];
+
+        paEntries[i].uSeq         = uSeq;
+        paEntries[i].tsMillies    = pEntry->tsMillies;
+        paEntries[i].enmReqId     = pEntry->enmReqId;
+        paEntries[i].enmAddrSpace = pEntry->enmAddrSpace;
+        paEntries[i].u64Addr      = pEntry->u64Addr;
+        paEntries[i].cb           = pEntry->cb;
+        paEntries[i].u32ValOrHash = pEntry->u32ValOrHash;
+        paEntries[i].rcReq        = pEntry->rcReq;
+        paEntries[i].cMillies     = pEntry->cMillies;
     }
+
+    pResp->cEntries      = cEntries;
+    pResp->cEntriesTotal = cEntriesTotal;
+    return pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, enmResponse, pResp, sizeof(*pResp) + cEntries * sizeof(*paEntries));
 }
 
 
 /**
- * Memset operation with a single value.
+ * Changes the link speed of the transport and verifies the new speed works, falling back to the old one otherwise.
  *
- * @returns nothing.
+ * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   pReq                    The data xfer request.
- * @param   pv                      The mapped address.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
  */
-static void pspStubPduDataXferMemset(PPSPSTUBSTATE pThis, PCPSPSERIALDATAXFERREQ pReq, void *pv)
+static int pspStubPduProcessSetLinkParams(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
 {
-    void *pvVal = (void *)(pReq + 1);
-    size_t cbWrLeft = pReq->cbXfer;
-    size_t cbStride = pReq->cbStride;
-    bool fIncrAddr = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_INCR_ADDR) ? true : false;
+    PCPSPSERIALSETLINKPARAMSREQ pReq = (PCPSPSERIALSETLINKPARAMSREQ)pvPayload;
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_SET_LINK_PARAMS;
 
-    uint8_t *pb = (uint8_t *)pv;
-    while (cbWrLeft)
+    if (cbPayload != sizeof(*pReq))
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    if (!pThis->pIfTransp->pfnLinkSpeedSet)
+        return pspStubPduSend(pThis, ERR_NOT_IMPLEMENTED, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    /* The request lives in the receive buffer which gets overwritten by the verification. */
+    uint32_t uBps = pReq->uBps;
+    uint32_t cMillisVerify = pReq->cMillisVerify;
+    uint32_t uBpsOld = 0;
+
+    /*
+     * Try the new speed first so a rate the transport can't do gets rejected while the host still listens
+     * at the old one, switching back is harmless as nothing is transmitted in between.
+     */
+    int rc = pspStubTxQueueFlush(pThis);
+    if (!rc)
     {
-        pspStubMmioAccess(pb, pvVal, cbStride);
-        if (fIncrAddr)
-            pb += cbStride;
+        rc = pThis->pIfTransp->pfnLinkSpeedSet(pThis->hPduTransp, uBps, &uBpsOld);
+        if (rc)
+            return pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+        rc = pThis->pIfTransp->pfnLinkSpeedSet(pThis->hPduTransp, uBpsOld, NULL /*puBpsOld*/);
+    }
 
-        cbWrLeft -= cbStride;
+    /* Acknowledge at the old speed, the transport only switches after everything was transmitted. */
+    if (!rc)
+        rc = pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    if (!rc)
+        rc = pspStubTxQueueFlush(pThis);
+    if (!rc)
+        rc = pThis->pIfTransp->pfnLinkSpeedSet(pThis->hPduTransp, uBps, NULL /*puBpsOld*/);
+    if (rc)
+        return rc;
+
+    /* Wait for the verification ping at the new speed and answer it. */
+    PCPSPSERIALPDUHDR pPdu = NULL;
+    pspStubPduRecvReset(pThis);
+    rc = pspStubPduRecv(pThis, &pPdu, cMillisVerify);
+    if (   !rc
+        && pPdu
+        && pPdu->u.Fields.enmRrnId == PSPSERIALPDURRNID_REQUEST_LINK_VERIFY
+        && pPdu->u.Fields.cbPdu == sizeof(PSPSERIALLINKVERIFY))
+    {
+        rc = pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_RESPONSE_LINK_VERIFY,
+                            (pPdu + 1), sizeof(PSPSERIALLINKVERIFY));
+        if (!rc)
+            rc = pspStubTxQueueFlush(pThis);
+
+        /* The next request confirms the host got our answer. */
+        pPdu = NULL;
+        if (!rc)
+            rc = pspStubPduRecv(pThis, &pPdu, cMillisVerify);
+        if (   !rc
+            && pPdu)
+        {
+            LogRel("pspStubPduProcessSetLinkParams: Switched link speed from %u to %u\n", uBpsOld, uBps);
+            pThis->pPduPending = pPdu; /* Processed next by pspStubPduRecvProcessSingle(), not from down here. */
+            return INF_SUCCESS;
+        }
     }
+
+    LogRel("pspStubPduProcessSetLinkParams: Verifying link speed %u failed, falling back to %u\n", uBps, uBpsOld);
+    pspStubPduRecvReset(pThis);
+    return pThis->pIfTransp->pfnLinkSpeedSet(pThis->hPduTransp, uBpsOld, NULL /*puBpsOld*/);
 }
 
 
 /**
- * Reads from the given PSP mapping into the supplied buffer.
+ * Recalibrates the link of the transport, for example after the cabling changed.
  *
- * @returns nothing.
+ * @returns Status code.
  * @param   pThis                   The serial stub instance data.
- * @param   pReq                    The data xfer request.
- * @param   pvSrc                   The mapped address to read from.
- * @param   pvDst                   Where to store the read data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
  */
-static void pspStubPduDataXferRead(PPSPSTUBSTATE pThis, PCPSPSERIALDATAXFERREQ pReq, const void *pvSrc, void *pvDst)
+static int pspStubPduProcessLinkCalibrate(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
 {
-    void *pvVal = (void *)(pReq + 1);
-    size_t cbRdLeft = pReq->cbXfer;
-    size_t cbStride = pReq->cbStride;
-    bool fIncrAddr = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_INCR_ADDR) ? true : false;
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_LINK_CALIBRATE;
 
-    uint8_t *pbDst = (uint8_t *)pvDst;
-    uint8_t *pbSrc = (uint8_t *)pvSrc;
-    while (cbRdLeft)
-    {
-        pspStubMmioAccess(pbDst, pbSrc, cbStride);
-        if (fIncrAddr)
-            pbSrc += cbStride;
+    if (cbPayload)
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    if (!pThis->pIfTransp->pfnLinkCalibrate)
+        return pspStubPduSend(pThis, ERR_NOT_IMPLEMENTED, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
 
-        pbDst    += cbStride;
-        cbRdLeft -= cbStride;
-    }
+    /* Nothing may be in flight while the link is reconfigured. */
+    int rc = pspStubTxQueueFlush(pThis);
+    if (rc)
+        return rc;
+
+    uint32_t uBps = 0;
+    int rcCalib = pThis->pIfTransp->pfnLinkCalibrate(pThis->hPduTransp, &uBps);
+    LogRel("pspStubPduProcessLinkCalibrate: Calibration returned %d, link speed is %u\n", rcCalib, uBps);
+
+    PSPSERIALLINKINFO Link;
+    pspStubLinkInfoQuery(pThis->pIfTransp, pThis->hPduTransp, &Link);
+    return pspStubPduSend(pThis, rcCalib, 0 /*idCcd*/, enmResponse, &Link, sizeof(Link));
 }
 
 
 /**
- * Writes to the given PSP mapping from the supplied buffer.
+ * Fills in the statistics of the given link.
  *
  * @returns nothing.
- * @param   pThis                   The serial stub instance data.
- * @param   pReq                    The data xfer request.
- * @param   pvDst                   The mapped address to write to.
- * @param   pvSrc                   The data to write.
+ * @param   pIfTransp               The transport channel interface of the link.
+ * @param   hPduTransp              Handle to the PDU transport channel.
+ * @param   idLink                  The link ID.
+ * @param   fReset                  Flag whether to reset the statistics of the transport afterwards.
+ * @param   pStats                  Where to store the statistics.
  */
-static void pspStubPduDataXferWrite(PPSPSTUBSTATE pThis, PCPSPSERIALDATAXFERREQ pReq, void *pvDst, const void *pvSrc)
+static void pspStubLinkStatsQuery(PCPSPPDUTRANSPIF pIfTransp, PSPPDUTRANSP hPduTransp, uint32_t idLink, bool fReset,
+                                  PPSPSERIALTRANSPSTATS pStats)
 {
-    void *pvVal = (void *)(pReq + 1);
-    size_t cbWrLeft = pReq->cbXfer;
-    size_t cbStride = pReq->cbStride;
-    bool fIncrAddr = (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_INCR_ADDR) ? true : false;
+    PSPPDUTRANSPSTATS Stats;
 
-    uint8_t *pbDst = (uint8_t *)pvDst;
-    uint8_t *pbSrc = (uint8_t *)pvSrc;
-    while (cbWrLeft)
+    memset(pStats, 0, sizeof(*pStats));
+    pStats->idLink   = idLink;
+    pStats->idTransp = pspStubTranspId(pIfTransp);
+    if (   pIfTransp->pfnStatsQuery
+        && !pIfTransp->pfnStatsQuery(hPduTransp, &Stats, fReset))
     {
-        pspStubMmioAccess(pbDst, pbSrc, cbStride);
-        if (fIncrAddr)
-            pbDst += cbStride;
-
-        pbSrc    += cbStride;
-        cbWrLeft -= cbStride;
+        pStats->fValid           = 1;
+        pStats->cReads           = Stats.cReads;
+        pStats->cWrites          = Stats.cWrites;
+        pStats->cErrors          = Stats.cErrors;
+        pStats->cRetries         = Stats.cRetries;
+        pStats->cbRead           = Stats.cbRead;
+        pStats->cbWritten        = Stats.cbWritten;
+        pStats->cTicksStallRead  = Stats.cTicksStallRead;
+        pStats->cTicksStallWrite = Stats.cTicksStallWrite;
     }
 }
 
 
 /**
- * Extended data transfer mechanism.
+ * Returns the statistics of all links.
  *
- * @returns Stauts code.
+ * @returns Status code.
  * @param   pThis                   The serial stub instance data.
  * @param   pvPayload               PDU payload.
  * @param   cbPayload               Payload size in bytes.
  */
-static int pspStubPduProcessDataXfer(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
+static int pspStubPduProcessTranspStats(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
 {
-    PCPSPSERIALDATAXFERREQ pReq = (PCPSPSERIALDATAXFERREQ)pvPayload;
-
-    if (   cbPayload < sizeof(*pReq)
-        || (   pReq->cbStride != 1
-            && pReq->cbStride != 2
-            && pReq->cbStride != 4))
-        return ERR_INVALID_PARAMETER;
-
-    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_PSP_DATA_XFER;
-    void *pvMap = NULL;
-    int rc = pspStubPduDataXferAddressMap(pThis, pReq, &pvMap);
-    if (!rc)
+    PCPSPSERIALTRANSPSTATSREQ pReq = (PCPSPSERIALTRANSPSTATSREQ)pvPayload;
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_TRANSP_STATS;
+
+    if (   cbPayload != sizeof(*pReq)
+        || (pReq->fFlags & ~PSP_SERIAL_TRANSP_STATS_F_RESET))
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    bool fReset = (pReq->fFlags & PSP_SERIAL_TRANSP_STATS_F_RESET) != 0;
+    PPSPSERIALTRANSPSTATSRESP pResp = (PPSPSERIALTRANSPSTATSRESP)pspStubPduRespBufGet(pThis);
+    if (!pResp)
+        return pspStubPduSend(pThis, ERR_BUFFER_OVERFLOW, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    PPSPSERIALTRANSPSTATS paLinks = (PPSPSERIALTRANSPSTATS)(pResp + 1);
+
+    pResp->cLinks  = 1 + pspStubLinksCount(pThis);
+    pResp->u32Pad0 = 0;
+    pspStubLinkStatsQuery(pThis->pIfTransp, pThis->hPduTransp, 0 /*idLink*/, fReset, &paLinks[0]);
+    for (uint32_t i = 0; i < pspStubLinksCount(pThis); i++)
     {
-        void *pvRespPayload = NULL;
-        size_t cbRespPayload = 0;
-
-        if (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_MEMSET)
-            pspStubPduDataXferMemset(pThis, pReq, pvMap);
-        else if (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_READ)
-        {
-            pvRespPayload = &pThis->abPduResp[0];
-            cbRespPayload  = pReq->cbXfer;
+        PPSPSTUBLINK pLink = pspStubLinkGet(pThis, i);
+        pspStubLinkStatsQuery(pLink->pIfTransp, pLink->hPduTransp, i + 1, fReset, &paLinks[i + 1]);
+    }
 
-            pspStubPduDataXferRead(pThis, pReq, pvMap, pvRespPayload);
-        }
-        else if (pReq->fFlags & PSP_SERIAL_DATA_XFER_F_WRITE)
-            pspStubPduDataXferWrite(pThis, pReq, pvMap, (void *)(pReq + 1));
+    return pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, enmResponse, pResp, sizeof(*pResp) + pResp->cLinks * sizeof(*paLinks));
+}
 
-        pspStubPduDataXferAddressUnmapByPtr(pThis, pReq, pvMap);
 
-        PSPSTS rcReq = STS_INF_SUCCESS;
-        pspStubPduCheckForExcp(pThis, &rcReq, (const void **)&pvRespPayload, &cbRespPayload);
-        rc = pspStubPduSend(pThis, rcReq, 0 /*idCcd*/, enmResponse, pvRespPayload, cbRespPayload);
-    }
-    else
-        rc = pspStubPduSend(pThis, rc, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+/**
+ * Moves the connection to another link.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pvPayload               PDU payload.
+ * @param   cbPayload               Payload size in bytes.
+ */
+static int pspStubPduProcessLinkSelect(PPSPSTUBSTATE pThis, const void *pvPayload, size_t cbPayload)
+{
+    PCPSPSERIALLINKSELECTREQ pReq = (PCPSPSERIALLINKSELECTREQ)pvPayload;
+    PSPSERIALPDURRNID enmResponse = PSPSERIALPDURRNID_RESPONSE_LINK_SELECT;
+
+    if (   cbPayload != sizeof(*pReq)
+        || !pReq->idLink
+        || pReq->idLink > pspStubLinksCount(pThis))
+        return pspStubPduSend(pThis, ERR_INVALID_PARAMETER, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    if (pThis->fTranspIrq)
+        return pspStubPduSend(pThis, ERR_INVALID_STATE, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+
+    /* The request lives in the receive buffer which gets overwritten while waiting on the new link. */
+    uint32_t idLink = pReq->idLink;
+    uint32_t cMillisVerify = pReq->cMillisVerify;
+
+    /* Acknowledge on the current link, the switch flushes it out before moving. */
+    int rc = pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, enmResponse, NULL /*pvRespPayload*/, 0 /*cbRespPayload*/);
+    if (!rc)
+        rc = pspStubLinkSwitch(pThis, idLink, cMillisVerify);
 
     return rc;
 }
@@ -2023,7 +4807,7 @@ static int pspStubPduProcessLoadCodeMod(PPSPSTUBSTATE pThis, const void *pvPaylo
         if (pReq->enmCmType == PSPSERIALCMTYPE_FLAT_BINARY)
         {
             PPSPINBUF pInBuf = &pThis->aInBufs[pReq->u32Pad0];
-            pInBuf->pvInBuf  = (void *)CM_FLAT_BINARY_LOAD_ADDR;
+            pInBuf->pvInBuf  = pspStubPlatPspAddrToPtr(CM_FLAT_BINARY_LOAD_ADDR);
             pInBuf->cbInBuf  = 0x3f000 - CM_FLAT_BINARY_LOAD_ADDR;
             pInBuf->offInBuf = 0;
             memset(pInBuf->pvInBuf, 0, pInBuf->cbInBuf);
@@ -2066,12 +4850,6 @@ static int pspStubPduProcessExecCodeMod(PPSPSTUBSTATE pThis, const void *pvPaylo
             CMEXEC CmExec;
 
             CmExec.pStub               = pThis;
-            CmExec.CmIf.pfnInBufPeek   = pspStubCmIfInBufPeekAsm;
-            CmExec.CmIf.pfnInBufPoll   = pspStubCmIfInBufPollAsm;
-            CmExec.CmIf.pfnInBufRead   = pspStubCmIfInBufReadAsm;
-            CmExec.CmIf.pfnOutBufWrite = pspStubCmIfOutBufWriteAsm;
-            CmExec.CmIf.pfnDelayMs     = pspStubCmIfDelayMsAsm;
-            CmExec.CmIf.pfnTsGetMilli  = pspStubCmIfTsGetMilliAsm;
 
             /* Reset the stdin buffer. */
             PPSPINBUF pInBuf = &pThis->aInBufs[0];
@@ -2079,9 +4857,12 @@ static int pspStubPduProcessExecCodeMod(PPSPSTUBSTATE pThis, const void *pvPaylo
             pInBuf->cbInBuf  = sizeof(pThis->abScratch);
             pInBuf->offInBuf = 0;
 
-            /* Call the module. */
-            PFNCMENTRY pfnEntry = (PFNCMENTRY)CM_FLAT_BINARY_LOAD_ADDR;
-            uint32_t u32CmRet = pfnEntry(&CmExec.CmIf, u32Arg0, u32Arg1, u32Arg2, u32Arg3);
+            /* The module might not return for a while, get the response out first. */
+            pspStubTxQueueFlush(pThis);
+
+            /* Call the module, the platform fills in the callbacks. */
+            uint32_t u32CmRet = 0;
+            rc = pspStubPlatCmExec(&CmExec.CmIf, CM_FLAT_BINARY_LOAD_ADDR, u32Arg0, u32Arg1, u32Arg2, u32Arg3, &u32CmRet);
 
             /* The code moudle finished, send the notification. */
             PSPSERIALEXECCMFINISHEDNOT ExecFinishedNot;
@@ -2120,8 +4901,9 @@ static int pspStubPduProcessBranchTo(PPSPSTUBSTATE pThis, const void *pvPayload,
             if (pReq->u32Flags & PSP_SERIAL_BRANCH_TO_F_THUMB)
                 PspAddrDst |= 1; /* switches to thumb in our assembly helper. */
 
+            pspStubTxQueueFlush(pThis); /* The response must be out before the transport goes away. */
             pspStubTranspTerm(pThis); /* Terminate the transport layer. */
-            pspStubBranchToAsm(PspAddrDst, &pReq->au32Gprs[0]); /* This will NOT return!. */
+            pspStubPlatBranchTo(PspAddrDst, &pReq->au32Gprs[0]); /* This will NOT return!. */
         }
     }
     else
@@ -2141,7 +4923,10 @@ static int pspStubPduProcessBranchTo(PPSPSTUBSTATE pThis, const void *pvPayload,
 static int pspStubPduProcess(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR pPdu)
 {
     int rc = INF_SUCCESS;
+    int32_t rcReqOuter = pThis->rcReqCur; /* Requests get processed nested while a code module executes. */
+    uint32_t uJournalSeq = pspStubJournalBegin(pThis, pPdu);
 
+    pThis->rcReqCur = INF_SUCCESS;
     switch (pPdu->u.Fields.enmRrnId)
     {
         case PSPSERIALPDURRNID_REQUEST_PSP_MEM_READ:
@@ -2195,55 +4980,50 @@ static int pspStubPduProcess(PPSPSTUBSTATE pThis, PCPSPSERIALPDUHDR pPdu)
         case PSPSERIALPDURRNID_REQUEST_BRANCH_TO:
             rc = pspStubPduProcessBranchTo(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
             break;
+        case PSPSERIALPDURRNID_REQUEST_SPARSE_READ:
+            rc = pspStubPduProcessSparseRead(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_MEMTEST:
+            rc = pspStubPduProcessMemTest(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_JOURNAL_READ:
+            rc = pspStubPduProcessJournalRead(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_STRIPED_READ:
+            rc = pspStubPduProcessStripedRead(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_SET_LINK_PARAMS:
+            rc = pspStubPduProcessSetLinkParams(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_LINK_CALIBRATE:
+            rc = pspStubPduProcessLinkCalibrate(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_LINK_SELECT:
+            rc = pspStubPduProcessLinkSelect(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_TRANSP_STATS:
+            rc = pspStubPduProcessTranspStats(pThis, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_LINK_VERIFY:
+            /* Outside of a link speed change this is just a ping. */
+            rc = pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_RESPONSE_LINK_VERIFY, (pPdu + 1), pPdu->u.Fields.cbPdu);
+            break;
+        case PSPSERIALPDURRNID_REQUEST_LINK_PROBE_ACK:
+            /* Arrived after the probe timed out, there is no response. */
+            break;
         default:
             /* Should never happen as the ID was already checked during PDU validation. */
             break;
     }
 
-    return rc;
-}
-
-
-/**
- * Checks the status of the IRQ and FIQ line by reading the ISR.
- *
- * @returns nothing.
- * @param   pfIrq       Where to store the status of the IRQ line.
- * @param   pfFiq       Where to store the status of the FIQ line.
- */
-static inline void pspStubIrqCheck(bool *pfIrq, bool *pfFiq)
-{
-    uint32_t u32Reg = 0;
-    asm volatile("mrc p15, 0x0, %0, cr12, cr1, 0x0\n": "=r" (u32Reg) : :"memory");
-
-    *pfIrq = (u32Reg & BIT(7)) ? true : false;
-    *pfFiq = (u32Reg & BIT(6)) ? true : false;
-}
-
-
-/**
- * Enables interrupts of the PSP again.
- *
- * @returns nothing.
- */
-static inline void pspStubIrqEnable(void)
-{
-    asm volatile("dsb #0xf\n"
-                 "isb #0xf\n"
-                 "cpsie if\n": : :"memory");
-}
-
+    /* Requests which were rejected without a response count as failed as well. */
+    if (uJournalSeq)
+        pspStubJournalEnd(pThis, uJournalSeq, rc != INF_SUCCESS ? rc : pThis->rcReqCur);
+    pThis->rcReqCur = rcReqOuter;
 
-/**
- * Disables interrupts of the PSP again.
- *
- * @returns nothing.
- */
-static inline void pspStubIrqDisable(void)
-{
-    asm volatile("dsb #0xf\n"
-                 "isb #0xf\n"
-                 "cpsid if\n": : :"memory");
+    /* The request might have staged a response it didn't send (errors, exceptions), the buffer is free again. */
+    pspStubPduRespBufRelease(pThis);
+    return rc;
 }
 
 
@@ -2258,7 +5038,7 @@ static void pspStubIrqProcess(PPSPSTUBSTATE pThis)
 #if 1
     bool fIrq = false;
     bool fFiq = false;
-    pspStubIrqCheck(&fIrq, &fFiq);
+    pspStubPlatIrqCheck(&fIrq, &fFiq);
     if (   pThis->fIrqLast != fIrq
         || pThis->fFiqLast != fFiq)
     {
@@ -2311,49 +5091,32 @@ static void pspStubIrqProcess(PPSPSTUBSTATE pThis)
             LogRel("pspStubIrqProcess: Interrupts processed, re-enable IRQs\n");
             pThis->fIrqPending          = false;
             pThis->fIrqNotificationSent = false;
-            pspStubIrqEnable();
+            pspStubPlatIrqEnable();
         }
     }
 #endif
 }
 
 
-static void pspStubMmioWrU32(PSPADDR PspAddrMmio, uint32_t uVal)
-{
-    pspStubMmioAccess((void *)PspAddrMmio, &uVal, sizeof(uint32_t));
-}
-
-
 static void pspStubMmioSetU32(PSPADDR PspAddrMmio, uint32_t fSet)
 {
     uint32_t uVal;
-    pspStubMmioAccess(&uVal, (void *)PspAddrMmio, sizeof(uint32_t));
+    pspStubMmioAccess(&uVal, pspStubPlatPspAddrToPtr(PspAddrMmio), sizeof(uint32_t));
     LogRel("pspStubMmioSetU32: PspAddrMmio=%#x fSet=%#x uVal=%#x\n",
            PspAddrMmio, fSet, uVal);
     uVal |= fSet;
-    pspStubMmioAccess((void *)PspAddrMmio, &uVal, sizeof(uint32_t));
+    pspStubMmioAccess(pspStubPlatPspAddrToPtr(PspAddrMmio), &uVal, sizeof(uint32_t));
 }
 
 
 static void pspStubMmioClearU32(PSPADDR PspAddrMmio, uint32_t fClr)
 {
     uint32_t uVal;
-    pspStubMmioAccess(&uVal, (void *)PspAddrMmio, sizeof(uint32_t));
+    pspStubMmioAccess(&uVal, pspStubPlatPspAddrToPtr(PspAddrMmio), sizeof(uint32_t));
     LogRel("pspStubMmioClearU32: PspAddrMmio=%#x fClr=%#x uVal=%#x\n",
            PspAddrMmio, fClr, uVal);
     uVal &= ~fClr;
-    pspStubMmioAccess((void *)PspAddrMmio, &uVal, sizeof(uint32_t));
-}
-
-
-static void pspStubMmioWaitOnClrU32(PSPADDR PspAddrMmio, uint32_t fWait)
-{
-    uint32_t uVal = 0;
-
-    do
-    {
-        pspStubMmioAccess(&uVal, (void *)PspAddrMmio, sizeof(uint32_t));
-    } while (uVal & fWait != 0);
+    pspStubMmioAccess(pspStubPlatPspAddrToPtr(PspAddrMmio), &uVal, sizeof(uint32_t));
 }
 
 
@@ -2363,216 +5126,404 @@ static void pspStubSmnSetU32(PPSPSTUBSTATE pThis, SMNADDR SmnAddr, uint32_t fSet
     int rc = pspStubSmnMap(pThis, SmnAddr, &pvMap);
     if (!rc)
     {
-        pspStubMmioSetU32((PSPADDR)pvMap, fSet);
+        uint32_t uVal;
+        pspStubMmioAccess(&uVal, pvMap, sizeof(uint32_t));
+        LogRel("pspStubSmnSetU32: SmnAddr=%#x fSet=%#x uVal=%#x\n",
+               SmnAddr, fSet, uVal);
+        uVal |= fSet;
+        pspStubMmioAccess(pvMap, &uVal, sizeof(uint32_t));
         pspStubSmnUnmapByPtr(pThis, pvMap);
     }
 }
 
 
-static void pspStubSmnWrU32(PPSPSTUBSTATE pThis, SMNADDR SmnAddr, uint32_t u32Val)
+/**
+ * Releases the mapping window held by the hardware init engine.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pWnd                    The mapping window state of the engine.
+ */
+static void pspStubInitWndRelease(PPSPSTUBSTATE pThis, PPSPSTUBINITWND pWnd)
 {
-    void *pvMap = NULL;
-    int rc = pspStubSmnMap(pThis, SmnAddr, &pvMap);
-    if (!rc)
+    if (pWnd->enmSpace == PSPSTUBINITSPACE_SMN)
+        pspStubSmnUnmapByPtr(pThis, pWnd->pvWindow);
+    else if (pWnd->enmSpace == PSPSTUBINITSPACE_X86_MMIO)
+        pspStubX86PhysUnmapByPtr(pThis, pWnd->pvWindow);
+
+    pWnd->enmSpace = PSPSTUBINITSPACE_INVALID;
+    pWnd->pvWindow = NULL;
+}
+
+
+/**
+ * Looks up the pointer for the address of the given init table entry, mapping the window
+ * containing it unless it is the one mapped for the previous entry.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pWnd                    The mapping window state of the engine.
+ * @param   pEntry                  The table entry.
+ * @param   ppv                     Where to store the pointer on success.
+ */
+static int pspStubInitAddrResolve(PPSPSTUBSTATE pThis, PPSPSTUBINITWND pWnd, PCPSPSTUBINITENTRY pEntry, void **ppv)
+{
+    if (pEntry->enmSpace == PSPSTUBINITSPACE_PSP_MMIO)
     {
-        pspStubMmioWrU32((PSPADDR)pvMap, u32Val);
-        pspStubSmnUnmapByPtr(pThis, pvMap);
+        *ppv = pspStubPlatPspAddrToPtr((PSPADDR)pEntry->u64Addr);
+        return INF_SUCCESS;
     }
+
+    uint64_t cbWindow = pEntry->enmSpace == PSPSTUBINITSPACE_SMN ? _1M : _64M;
+    uint64_t u64AddrBase = pEntry->u64Addr & ~(cbWindow - 1);
+    if (   pWnd->enmSpace != pEntry->enmSpace
+        || pWnd->u64AddrBase != u64AddrBase)
+    {
+        pspStubInitWndRelease(pThis, pWnd);
+
+        int rc = pEntry->enmSpace == PSPSTUBINITSPACE_SMN
+               ? pspStubSmnMap(pThis, (SMNADDR)u64AddrBase, &pWnd->pvWindow)
+               : pspStubX86PhysMap(pThis, (X86PADDR)u64AddrBase, true /*fMmio*/, &pWnd->pvWindow);
+        if (rc)
+            return rc;
+
+        pWnd->enmSpace    = pEntry->enmSpace;
+        pWnd->u64AddrBase = u64AddrBase;
+        pWnd->cMaps++;
+    }
+
+    *ppv = (uint8_t *)pWnd->pvWindow + (pEntry->u64Addr - u64AddrBase);
+    return INF_SUCCESS;
 }
 
 
-static void pspStubSmnAndOrU32(PPSPSTUBSTATE pThis, SMNADDR SmnAddr, uint32_t fAnd, uint32_t fOr)
+/**
+ * Executes a single hardware init table entry.
+ *
+ * @returns Status code.
+ * @param   pThis                   The serial stub instance data.
+ * @param   pWnd                    The mapping window state of the engine.
+ * @param   pEntry                  The table entry.
+ */
+static int pspStubInitEntryExec(PPSPSTUBSTATE pThis, PPSPSTUBINITWND pWnd, PCPSPSTUBINITENTRY pEntry)
 {
-    void *pvMap = NULL;
-    int rc = pspStubSmnMap(pThis, SmnAddr, &pvMap);
-    if (!rc)
+    if (pEntry->enmOp == PSPSTUBINITOP_DELAY)
     {
-        uint32_t uVal;
-        pspStubMmioAccess(&uVal, (void *)pvMap, sizeof(uint32_t));
-        uint32_t uValNew = (uVal & fAnd) | fOr;
-        LogRel("pspStubSmnAndOrU32: SmnAddr=%#x fAnd=%#x fOr=%#x uVal=%#x uValNew=%#x\n",
-               SmnAddr, fAnd, fOr, uVal, uValNew);
-        pspStubMmioAccess((void *)pvMap, &uValNew, sizeof(uint32_t));
-        pspStubSmnUnmapByPtr(pThis, pvMap);
+        pspStubDelayMs(pThis, pEntry->cMsWait);
+        return INF_SUCCESS;
     }
-}
 
+    void *pv = NULL;
+    int rc = pspStubInitAddrResolve(pThis, pWnd, pEntry, &pv);
+    if (rc)
+        return rc;
 
-static SMNADDR s_aSmnAddrSet[] =
-{
-    0x2f00404,
-    0x2f00c04,
-    0x2f01004,
-    0x2f01404,
-    0x2f01804,
-    0x2f01c04,
-    0x2f02804,
-    0x2f03404,
-    0x2f04c04,
-    0x2f05004,
-    0x2f06004,
-    0x2f07004,
-    0x2f09004,
-    0x2f09404,
-    0x2f09c04,
-    0x2f0b404,
-    0x2f0b804,
-    0x2f0c004,
-    0x2f0c404,
-    0x2f0c804,
-    0x2f0cc04,
-    0x2f0d004,
-    0x2f0d404,
-    0x2f10804,
-    0x2f11804,
-    0x2f11c04,
-    0x2f14004,
-    0x2f14404,
-    0x2f14804,
-    0x2f14c04,
-    0x2f15004,
-    0x2f15404,
-    0x2f15804,
-    0x2f15c04,
-    0x2f16804,
-    0x2f16c04,
-    0x2f19004,
-    0x2f1b004,
-    0x2f1b404,
-    0x2f1b804,
-    0x2f1f004,
-    0x2f20004,
-    0x2f20404,
-    0x2f24004,
-    0x2f25804,
-    0x2f25c04,
-    0x2f2a004,
-    0x2f2a804,
-    0x2f2c004,
-    0x2f2c404,
-    0x2f36004,
-    0x2f38004,
-    0x2f38404,
-    0x2f38804,
-    0x2f38c04,
-    0x2f39004,
-    0x2f39404,
-    0x2f39804,
-    0x2f3fc04
-};
+    switch (pEntry->enmOp)
+    {
+        case PSPSTUBINITOP_WR_U8:
+        {
+            uint8_t bVal = (uint8_t)pEntry->uVal;
+            pspStubMmioAccess(pv, &bVal, sizeof(bVal));
+            break;
+        }
+        case PSPSTUBINITOP_WR_U32:
+            pspStubMmioAccess(pv, &pEntry->uVal, sizeof(uint32_t));
+            break;
+        case PSPSTUBINITOP_AND_OR_U32:
+        {
+            uint32_t uVal;
+            pspStubMmioAccess(&uVal, pv, sizeof(uVal));
+            uVal = (uVal & pEntry->fMask) | pEntry->uVal;
+            pspStubMmioAccess(pv, &uVal, sizeof(uVal));
+            break;
+        }
+        case PSPSTUBINITOP_POLL_U32:
+        {
+            uint64_t tsStart = pspStubGetMicros(pThis);
+            uint32_t uVal;
+            for (;;)
+            {
+                pspStubMmioAccess(&uVal, pv, sizeof(uVal));
+                if ((uVal & pEntry->fMask) == pEntry->uVal)
+                    break;
+                if (pspStubGetMicros(pThis) - tsStart > pEntry->cMsWait * 1000ULL)
+                {
+                    LogRel("pspStubInitEntryExec: Polling %#X for %#x/%#x timed out after %u ms (last %#x)\n",
+                           pEntry->u64Addr, pEntry->uVal, pEntry->fMask, pEntry->cMsWait, uVal);
+                    rc = ERR_INVALID_STATE;
+                    break;
+                }
+            }
+            break;
+        }
+        default:
+            rc = ERR_INVALID_PARAMETER;
+            break;
+    }
 
-static void pspStubInitHwUnkSmnRanges(PPSPSTUBSTATE pThis)
+    return rc;
+}
+
+
+/**
+ * Runs the given hardware init steps, logging the time each step took.
+ *
+ * Consecutive entries within the same window share the mapping, the order of the entries
+ * is kept as is as the hardware sequences depend on it. A failing entry is logged and the
+ * step continues, the stub has no way to report it to anyone this early.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ * @param   paSteps                 The steps to run.
+ * @param   cSteps                  Number of steps.
+ */
+static void pspStubInitStepsRun(PPSPSTUBSTATE pThis, PCPSPSTUBINITSTEP paSteps, uint32_t cSteps)
 {
-    for (uint32_t i = 0; i < ELEMENTS(s_aSmnAddrSet); i++)
-        pspStubSmnAndOrU32(pThis, s_aSmnAddrSet[i], 0xffffffff, 0x4);
+    PSPSTUBINITWND Wnd;
+
+    Wnd.enmSpace    = PSPSTUBINITSPACE_INVALID;
+    Wnd.u64AddrBase = 0;
+    Wnd.pvWindow    = NULL;
+    Wnd.cMaps       = 0;
+
+    uint64_t tsStart = pspStubGetMicros(pThis);
+    for (uint32_t i = 0; i < cSteps; i++)
+    {
+        PCPSPSTUBINITSTEP pStep = &paSteps[i];
+        uint64_t tsStepStart = pspStubGetMicros(pThis);
+        uint32_t cMapsStart = Wnd.cMaps;
+        uint32_t cMsBudget = 0;
+        uint32_t cErrors = 0;
+
+        for (uint32_t idxEntry = 0; idxEntry < pStep->cEntries; idxEntry++)
+        {
+            PCPSPSTUBINITENTRY pEntry = &pStep->paEntries[idxEntry];
+
+            cMsBudget += pEntry->cMsWait;
+            int rc = pspStubInitEntryExec(pThis, &Wnd, pEntry);
+            if (rc)
+            {
+                LogRel("pspStubInitStepsRun: %s: Entry %u (%#X) failed with %d\n",
+                       pStep->pszDesc, idxEntry, pEntry->u64Addr, rc);
+                cErrors++;
+            }
+        }
+
+        LogRel("pspStubInitStepsRun: %s: %u entries, %u window maps, %u errors, %u us (budget %u ms)\n",
+               pStep->pszDesc, pStep->cEntries, Wnd.cMaps - cMapsStart, cErrors,
+               (uint32_t)(pspStubGetMicros(pThis) - tsStepStart), cMsBudget);
+    }
+
+    pspStubInitWndRelease(pThis, &Wnd);
+    LogRel("pspStubInitStepsRun: %u steps took %u us\n", cSteps, (uint32_t)(pspStubGetMicros(pThis) - tsStart));
 }
 
 
-static void pspStubInitHw(PPSPSTUBSTATE pThis)
+/**
+ * Unknown SMN registers getting bit 2 set, all within the same 1MB window.
+ */
+static const PSPSTUBINITENTRY g_aInitHwUnkSmnRanges[] =
+{
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f00404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f00c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f01004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f01404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f01804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f01c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f02804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f03404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f04c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f05004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f06004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f07004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f09004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f09404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f09c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f0b404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f0b804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f0c004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f0c404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f0c804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f0cc04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f0d004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f0d404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f10804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f11804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f11c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f14004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f14404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f14804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f14c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f15004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f15404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f15804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f15c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f16804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f16c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f19004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f1b004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f1b404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f1b804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f1f004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f20004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f20404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f24004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f25804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f25c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f2a004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f2a804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f2c004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f2c404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f36004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f38004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f38404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f38804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f38c04, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f39004, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f39404, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f39804, 0xffffffff, 0x4),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2f3fc04, 0xffffffff, 0x4)
+};
+
+
+/**
+ * Misc PSP and SMN setup, the resets toggled have no known status bit so their budgets are waited in full.
+ */
+static const PSPSTUBINITENTRY g_aInitHwMisc[] =
 {
-    pspStubMmioWaitOnClrU32(0x32000f0, 0x80000000);
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x3010618, 0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x301061c, 0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x3010620, 0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x3010624, 0),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2d013ec,  0xffffffff, 0x14),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x2d01344,  0xf7ffffff, 0x80000000),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x17400404, 0xffffffff, 0x3ff),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x17500404, 0xffffffff, 0x3ff),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x0105a008, 0xfffffffe, 0),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x0105b008, 0xfffffffe, 0),
+    PSP_STUB_INIT_DELAY(100),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x0105b008, 0xffffffff, 1),
+    PSP_STUB_INIT_AND_OR_U32(PSPSTUBINITSPACE_SMN, 0x0105a008, 0xffffffff, 1),
+    PSP_STUB_INIT_DELAY(1000),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x301003c, 1),
+    /* Clearing base addresses of x86 mapping control registers, runs before the first x86 mapping is set up. */
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x3230000, 0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x3230004, 0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x3230008, 0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x323000c, 0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x32303e0, 0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x32304d8, 0)
+};
 
+
+/**
+ * Waits for whatever the bit in 0x32000f0 signals.
+ */
+static const PSPSTUBINITENTRY g_aInitHwWait[] =
+{
     /* Missing something here... */
+    PSP_STUB_INIT_POLL_U32(PSPSTUBINITSPACE_PSP_MMIO, 0x32000f0, 0x80000000, 0, 1000)
+};
 
-    pspStubInitHwUnkSmnRanges(pThis);
-    pspStubMmioWrU32(0x3010618, 0);
-    pspStubMmioWrU32(0x301061c, 0);
-    pspStubMmioWrU32(0x3010620, 0);
-    pspStubMmioWrU32(0x3010624, 0);
 
-    pspStubSmnAndOrU32(pThis, 0x2d013ec, 0xffffffff, 0x14);
-    pspStubSmnAndOrU32(pThis, 0x2d01344, 0xf7ffffff, 0x80000000);
-    pspStubSmnAndOrU32(pThis, 0x17400404, 0xffffffff, 0x3ff);
-    pspStubSmnAndOrU32(pThis, 0x17500404, 0xffffffff, 0x3ff);
-    pspStubSmnAndOrU32(pThis, 0x0105a008, 0xfffffffe, 0);
-    pspStubSmnAndOrU32(pThis, 0x0105b008, 0xfffffffe, 0);
-    pspStubDelayMs(pThis, 100);
-    pspStubSmnAndOrU32(pThis, 0x0105b008, 0xffffffff, 1);
-    pspStubSmnAndOrU32(pThis, 0x0105a008, 0xffffffff, 1);
+/**
+ * The hardware init steps.
+ */
+static const PSPSTUBINITSTEP g_aInitHwSteps[] =
+{
+    PSP_STUB_INIT_STEP("Wait",             g_aInitHwWait),
+    PSP_STUB_INIT_STEP("Unknown SMN bits", g_aInitHwUnkSmnRanges),
+    PSP_STUB_INIT_STEP("Misc",             g_aInitHwMisc)
+};
 
-    pspStubDelayMs(pThis, 1000);
-    pspStubMmioWrU32(0x301003c, 1);
 
-    /* Clearing base addresses of x86 mapping control registers. */
-    pspStubMmioWrU32(0x3230000, 0);
-    pspStubMmioWrU32(0x3230004, 0);
-    pspStubMmioWrU32(0x3230008, 0);
-    pspStubMmioWrU32(0x323000c, 0);
-    pspStubMmioWrU32(0x32303e0, 0);
-    pspStubMmioWrU32(0x32304d8, 0);
-}
+/**
+ * Sets up the FCH decoding of the legacy I/O ranges the Super I/O lives in.
+ */
+static const PSPSTUBINITENTRY g_aInitSuperIoDecode[] =
+{
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a3048, 0x0020ff00),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a30d0, 0x08fdff86),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfed81e77,     0x27),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfec20040,     0x0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a3044, 0xc0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a3048, 0x20ff07),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a3064, 0x1640),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a3000, 0xffffff00),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a30a0, 0xfec10002),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfed80300,     0xe3020b11),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc000072, 0x6),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc000072, 0x7),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_SMN,      0x2dc58d0,      0x0c7c17cf),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a3044, 0xc0),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a3048, 0x20ff07),
+    PSP_STUB_INIT_WR_U32(PSPSTUBINITSPACE_X86_MMIO, 0xfffe000a3064, 0x1640)
+};
 
 
-static void pspStubX86MmioWriteU32(PPSPSTUBSTATE pThis, X86PADDR PhysX86Addr, uint32_t u32Val)
+/**
+ * Configures the UART of the Super I/O through its index/data ports.
+ */
+static const PSPSTUBINITENTRY g_aInitSuperIoUart[] =
 {
-    volatile uint32_t *pu32 = NULL;
-    int rc = pspStubX86PhysMap(pThis, PhysX86Addr, true /*fMmio*/, (void **)&pu32);
-    if (STS_SUCCESS(rc))
-    {
-        *pu32 = u32Val;
-        pspStubX86PhysUnmapByPtr(pThis, (void *)pu32);
-    }
-}
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x87),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x01),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x55),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x55),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x07),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x07),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x24),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x00),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x10),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x02),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x02),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x87),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x01),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x55),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x55),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x23),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x40),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x40),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x07),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x01),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x61),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0xf8),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x60),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x03),
+#ifdef PSP_SERIAL_STUB_UART_RX_IRQ
+    /* Route the UART interrupt to IRQ4 (the legacy COM1 line). */
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x70),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x04),
+#endif
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x30),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x01),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002e, 0x02),
+    PSP_STUB_INIT_WR_U8(PSPSTUBINITSPACE_X86_MMIO, 0xfffdfc00002f, 0x02)
+};
+
 
-static void pspStubX86MmioWriteU8(PPSPSTUBSTATE pThis, X86PADDR PhysX86Addr, uint8_t bVal)
+/**
+ * The Super I/O init steps.
+ */
+static const PSPSTUBINITSTEP g_aInitSuperIoSteps[] =
 {
-    volatile uint8_t *pb = NULL;
-    int rc = pspStubX86PhysMap(pThis, PhysX86Addr, true /*fMmio*/, (void **)&pb);
-    if (STS_SUCCESS(rc))
-    {
-        *pb = bVal;
-        pspStubX86PhysUnmapByPtr(pThis, (void *)pb);
-    }
+    PSP_STUB_INIT_STEP("Super I/O decode", g_aInitSuperIoDecode),
+    PSP_STUB_INIT_STEP("Super I/O UART",   g_aInitSuperIoUart)
+};
+
+
+static void pspStubInitHw(PPSPSTUBSTATE pThis)
+{
+    pspStubInitStepsRun(pThis, &g_aInitHwSteps[0], ELEMENTS(g_aInitHwSteps));
 }
 
+
 static void pspStubSerialSuperIoInit(PPSPSTUBSTATE pThis)
 {
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a3048, 0x0020ff00);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a30d0, 0x08fdff86);
-    pspStubX86MmioWriteU8(pThis, 0xfed81e77, 0x27);
-    pspStubX86MmioWriteU32(pThis, 0xfec20040, 0x0);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a3044, 0xc0);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a3048, 0x20ff07);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a3064, 0x1640);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a3000, 0xffffff00);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a30a0, 0xfec10002);
-    pspStubX86MmioWriteU32(pThis, 0xfed80300,     0xe3020b11);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc000072, 0x6);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc000072, 0x7);
-    pspStubSmnWrU32(pThis, 0x2dc58d0, 0x0c7c17cf);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a3044, 0xc0);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a3048, 0x20ff07);
-    pspStubX86MmioWriteU32(pThis, 0xfffe000a3064, 0x1640);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x87);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x01);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x55);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x55);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x07);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x07);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x24);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x00);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x10);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x02);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x02);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x87);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x01);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x55);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x55);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x23);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x40);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x40);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x07);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x01);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x61);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0xf8);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x60);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x03);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x30);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x01);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002e, 0x02);
-    pspStubX86MmioWriteU8(pThis, 0xfffdfc00002f, 0x02);
+    pspStubInitStepsRun(pThis, &g_aInitSuperIoSteps[0], ELEMENTS(g_aInitSuperIoSteps));
 }
 
+
 static uint32_t pspStubGetPhysDieId(PPSPSTUBSTATE pThis)
 {
     void *pvMap = NULL;
@@ -2678,11 +5629,22 @@ static void pspStubLogFlush(void *pvUser, uint8_t *pbBuf, size_t cbBuf)
             }
         }
         else
-            pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_NOTIFICATION_LOG_MSG, pbBuf, cbBuf);
+        {
+            /* Split the buffer up so it fits the short transmit buffers. */
+            while (cbBuf)
+            {
+                size_t cbThisSend = MIN(cbBuf, PSP_SERIAL_STUB_TX_PAYLOAD_SHORT_MAX);
+
+                pspStubPduSend(pThis, INF_SUCCESS, 0 /*idCcd*/, PSPSERIALPDURRNID_NOTIFICATION_LOG_MSG, pbBuf, cbThisSend);
+                pbBuf += cbThisSend;
+                cbBuf -= cbThisSend;
+            }
+        }
     }
 }
 
 
+#ifndef PSP_SERIAL_STUB_HOST
 void ExcpUndefInsn(PPSPIRQREGFRAME pRegFrame)
 {
     PPSPSTUBSTATE pThis = &g_StubState;
@@ -2711,6 +5673,15 @@ void ExcpPrefAbrt(PPSPIRQREGFRAME pRegFrame)
 void ExcpDataAbrt(PPSPIRQREGFRAME pRegFrame)
 {
     PPSPSTUBSTATE pThis = &g_StubState;
+    uintptr_t PspAddrPcFault = pRegFrame->uRegLr - 8;
+
+    /* Aborts inside the probing copy helper are expected, resume at its fixup label. */
+    if (   PspAddrPcFault >= ((uintptr_t)pspStubMemCopyProbeAsmStart & ~1)
+        && PspAddrPcFault <  ((uintptr_t)pspStubMemCopyProbeAsmEnd & ~1))
+    {
+        pRegFrame->uRegLr = (uintptr_t)pspStubMemCopyProbeAsmFixup & ~1;
+        return;
+    }
 
     LogRel("ExcpDataAbrt: pc=%#x cpsr=%#x r0=%#x r1=%#x r2=%#x r3=%#x r4=%#x r5=%#xr6=%#x r7=%#x\n",
            pRegFrame->uRegLr -= 8, pRegFrame->uRegSpsr, pRegFrame->aGprs[0], pRegFrame->aGprs[1], pRegFrame->aGprs[2],
@@ -2723,6 +5694,27 @@ void ExcpDataAbrt(PPSPIRQREGFRAME pRegFrame)
 
 void ExcpIrq(PPSPIRQREGFRAME pRegFrame)
 {
+    PPSPSTUBSTATE pThis = &g_StubState;
+
+    if (pThis->fTranspIrq)
+    {
+        if (pThis->pIfTransp->pfnIrq(pThis->hPduTransp))
+            pThis->cTranspIrqs++;
+        else
+        {
+            /*
+             * Something else fired which we can't service, go back to polling and
+             * return with interrupts masked like it was before.
+             */
+            pThis->pIfTransp->pfnIrqSet(pThis->hPduTransp, false /*fEnable*/);
+            pThis->fTranspIrq = false;
+            pRegFrame->uRegSpsr |= BIT(7) | BIT(6);
+        }
+
+        pRegFrame->uRegLr -= 4; /* Continue with executing the instruction being interrupted by the IRQ. */
+        return;
+    }
+
 #if 0
     /*
      * Set the interrupt pending global flag and disable interrupts
@@ -2746,16 +5738,20 @@ void ExcpFiq(void)
     LogRel("ExcpFiq:\n");
     for (;;);
 }
+#endif
 
 
-void main(void)
+/**
+ * Initializes the stub state, the timekeeping and the logger.
+ *
+ * @returns nothing.
+ * @param   pThis                   The serial stub instance data.
+ */
+static void pspStubInit(PPSPSTUBSTATE pThis)
 {
-    /* Init the stub state and create the UART driver instances. */
-    PPSPSTUBSTATE pThis = &g_StubState;
-
     off           = 0;
 
-    pspStubIrqDisable();
+    pspStubPlatIrqDisable();
     pThis->cCcds                       = 1; /** @todo Determine the amount of available CCDs (can't be read from boot ROM service page at all times) */
     pThis->fConnected                  = false;
 #if 0
@@ -2765,10 +5761,19 @@ void main(void)
     pThis->fFiqLast                    = false;
 #endif
     pThis->enmExcpPending              = PSPSTUBEXCP_NONE;
-#ifdef PSP_SERIAL_STUB_SPI_MSG_CHAN
+    pThis->fTranspIrq                  = false;
+    pThis->cTranspIrqs                 = 0;
+#ifdef PSP_SERIAL_STUB_MULTIPATH
+    pThis->cLinks                      = 0;
+#endif
+#if defined(PSP_SERIAL_STUB_SPI_MSG_CHAN)
     pThis->fSpiMsgChan                 = true;
     pThis->fEarlyLogOverSpi            = false;
     pThis->fLogEnabled                 = false;
+#elif defined(PSP_SERIAL_STUB_HOST)
+    pThis->fSpiMsgChan                 = false;
+    pThis->fEarlyLogOverSpi            = false;
+    pThis->fLogEnabled                 = false;
 #else
     pThis->fSpiMsgChan                 = false;
     pThis->fEarlyLogOverSpi            = true;
@@ -2777,11 +5782,37 @@ void main(void)
     pThis->cBeaconsSent                = 0;
     pThis->cPdusSent                   = 0;
     pThis->cPduRecvNext                = 1;
+    pThis->pPduPending                 = NULL;
+    pThis->idxTxQueueHead              = 0;
+    pThis->cTxQueued                   = 0;
+    pThis->idxTxBufStaging             = UINT32_MAX;
+    pThis->fTxDraining                 = false;
+    pThis->rcReqCur                    = INF_SUCCESS;
+    pThis->uJournalSeqNext             = 1;
+    memset(&pThis->aJournal[0], 0, sizeof(pThis->aJournal));
+    for (uint32_t i = 0; i < ELEMENTS(pThis->aTxBufs); i++)
+    {
+        pThis->aTxBufs[i].enmState     = PSPSTUBTXBUFSTATE_FREE;
+        if (i < PSP_SERIAL_STUB_TX_BUF_FULL_COUNT)
+        {
+            pThis->aTxBufs[i].cbPayloadMax = PSP_SERIAL_STUB_TX_PAYLOAD_MAX;
+            pThis->aTxBufs[i].pbPdu        = &pThis->aabTxPdu[i][0];
+        }
+        else
+        {
+            pThis->aTxBufs[i].cbPayloadMax = PSP_SERIAL_STUB_TX_PAYLOAD_SHORT_MAX;
+            pThis->aTxBufs[i].pbPdu        = &pThis->aabTxPduShort[i - PSP_SERIAL_STUB_TX_BUF_FULL_COUNT][0];
+        }
+    }
     pspStubPduRecvReset(pThis);
     memset(&pThis->aX86MapSlots[0], 0, sizeof(pThis->aX86MapSlots));
     memset(&pThis->aSmnMapSlots[0], 0, sizeof(pThis->aSmnMapSlots));
     for (uint32_t i = 0; i < ELEMENTS(pThis->aX86MapSlots); i++)
         pThis->aX86MapSlots[i].PhysX86AddrBase = NIL_X86PADDR;
+    pThis->idxX86MapLast   = 0;
+    pThis->uX86MapLruClock = 0;
+    pThis->idxSmnMapLast   = 0;
+    pThis->uSmnMapLruClock = 0;
 
     if (pThis->fEarlyLogOverSpi)
         pspStubSmnMap(pThis, 0xa0000000 + PSP_SERIAL_STUB_EARLY_SPI_LOG_OFF, &pThis->pvEarlySpiLog);
@@ -2792,6 +5823,32 @@ void main(void)
     LOGLoggerInit(&pThis->Logger, pspStubLogFlush, pThis,
                   "PspSerialStub", pThis->pTm, LOG_LOGGER_INIT_FLAGS_TS_FMT_HHMMSS);
     LOGLoggerSetDefaultInstance(&pThis->Logger);
+}
+
+
+#ifdef PSP_SERIAL_STUB_HOST
+int pspSerialStubHostMain(void)
+{
+    PPSPSTUBSTATE pThis = &g_StubState;
+
+    pspStubInit(pThis);
+
+    int rc = pspStubTranspInit(pThis);
+    if (!rc)
+    {
+        pThis->fLogEnabled = true;
+        rc = pspStubMainloop(pThis);
+    }
+
+    return rc;
+}
+#else
+void main(void)
+{
+    /* Init the stub state and create the UART driver instances. */
+    PPSPSTUBSTATE pThis = &g_StubState;
+
+    pspStubInit(pThis);
 
     /* Don't do anything if this is not the master PSP. */
     if (pspStubGetPhysDieId(pThis) != 0)
@@ -2801,7 +5858,7 @@ void main(void)
 
     /*pspStubInitHw(pThis);*/
 
-#ifndef PSP_SERIAL_STUB_SPI_MSG_CHAN
+#if !defined(PSP_SERIAL_STUB_SPI_MSG_CHAN) || defined(PSP_SERIAL_STUB_MULTIPATH)
     pspStubSerialSuperIoInit(pThis);
 #endif
 
@@ -2821,4 +5878,5 @@ void main(void)
     /* Do not return on error. */
     for (;;);
 }
+#endif
 
@@ -30,6 +30,9 @@
 
 #include "pdu-transp.h"
 #include "psp-serial-stub-internal.h"
+#ifdef PSP_SERIAL_STUB_HOST
+# include "spi-em100.h"
+#endif
 
 
 #define PSP_SPI_MASTER_SMN_ADDR         0x02dc4000
@@ -44,11 +47,45 @@
 #define PSP_SPI_MASTER_STATUS           0x4c
 # define PSP_SPI_MASTER_STATUS_BSY      BIT(31)
 #define PSP_SPI_FIFO_START              0x80
+/** Size of the SPI master FIFO shared by the transmitted and received bytes of a transaction (0x80 - 0xc6). */
+#define PSP_SPI_MASTER_FIFO_SZ          71
 
 
+/** Chunk size the host uses for the dFIFO, the EM100 clears the dFIFO on every read. */
 #define PSP_SPI_MASTER_CHUNK_SZ         64
+/** Minimum idle polling interval in microseconds, used while data is flowing. */
+#define PSP_EM100_POLL_US_MIN           10
+/** Maximum idle polling interval in microseconds the link backs off to when idle. */
+#define PSP_EM100_POLL_US_MAX           250
+/** Number of identifier reads which must succeed at a SPI clock during calibration. */
+#define PSP_EM100_CALIB_ROUNDS          64
+/** Size of the test pattern echoed by the host for every SPI clock during calibration. */
+#define PSP_EM100_CALIB_ECHO_SZ         32
+/** How long to wait for the host to echo the test pattern in microseconds. */
+#define PSP_EM100_CALIB_ECHO_TIMEOUT_US 10000
+/** Number of timer ticks (100MHz) per microsecond. */
+#define PSP_EM100_TICKS_PER_US          100
+/** The identifier the EM100 returns in register 3. */
+#define EM100_ID                       0xaa
+/** uFIFO tag of a data frame, followed by the length and the data. */
+#define EM100_UFIFO_TAG_DATA           0xef
+/** uFIFO tag of a calibration frame, followed by the length and a test pattern the host writes back to the dFIFO unchanged. */
+#define EM100_UFIFO_TAG_ECHO           0xcf
 /** Upload FIFO size of the Dediprog EM100 in bytes. */
 #define EM100_UFIFO_SZ                 512
+/** Framing overhead of a data write to the uFIFO (tag and length byte). */
+#define EM100_UFIFO_WRITE_HDR_SZ       2
+/** Maximum payload of a single data write to the uFIFO, limited by the SPI master FIFO (command bytes + data). */
+#define EM100_UFIFO_WRITE_MAX          (PSP_SPI_MASTER_FIFO_SZ - 4)
+/** Number of bytes data writes leave free in the uFIFO, keeps room for the dFIFO clear notifications. */
+#define EM100_UFIFO_RESERVE            (PSP_SPI_MASTER_CHUNK_SZ + EM100_UFIFO_WRITE_HDR_SZ)
+/** Interval in microseconds the host software is assumed to drain the uFIFO in, for the throughput estimate. */
+#define EM100_HOST_POLL_US_ESTIMATE    1000
+
+/* The FIFO of the FCH SPI controller ends at 0xc6, a uFIFO write puts 4 command bytes in front of the data. */
+_Static_assert(PSP_SPI_FIFO_START + PSP_SPI_MASTER_FIFO_SZ == 0xc7);
+_Static_assert(EM100_UFIFO_WRITE_MAX + 4 <= PSP_SPI_MASTER_FIFO_SZ);
+
 
 /**
  * SPI flash transport channel.
@@ -59,19 +96,97 @@ typedef struct PSPPDUTRANSPINT
     volatile void               *pvSmnMap;
     /** Amount of data available for reading. */
     size_t                      cbAvail;
+    /** Local estimate of the free space in the uFIFO, only refreshed from the EM100 when it runs out. */
+    size_t                      cbUFifoCredit;
+    /** Number of bytes the dFIFO held when last queried by the peek callback. */
+    size_t                      cbDFifoSeen;
     /** The read chunk. */
     uint8_t                     abChunk[PSP_SPI_MASTER_CHUNK_SZ];
     /** Offset into the chunk buffer. */
     uint8_t                     offChunk;
     /** Chip select register value read during initialization. */
     uint8_t                     bRegCs;
+    /** Flag whether a transmit only transaction was started and not waited for yet. */
+    bool                        fXactPending;
+    /** Current idle polling interval in microseconds. */
+    uint32_t                    cUsPollIdle;
     /** */
     uint32_t                    fSpiBridgeDisable;
+    /** Index into g_aEm100SpiClks of the SPI clock in use. */
+    uint32_t                    idxSpiClk;
+    /** Flag whether the SPI clock was determined by calibration. */
+    bool                        fSpiClkCalibrated;
+    /** Transport channel statistics. */
+    PSPPDUTRANSPSTATS           Stats;
 } PSPPDUTRANSPINT;
 /** Pointer to the x86 UART PDU transport channel instance. */
 typedef PSPPDUTRANSPINT *PPSPPDUTRANSPINT;
 
 
+/**
+ * SPI master clock setting.
+ */
+typedef struct PSPEM100SPICLK
+{
+    /** The speed selector written to all fields of the speed config register. */
+    uint8_t                     uSpeedSel;
+    /** The resulting SPI clock in Hz. */
+    uint32_t                    uHz;
+} PSPEM100SPICLK;
+/** Pointer to a const SPI master clock setting. */
+typedef const PSPEM100SPICLK *PCPSPEM100SPICLK;
+
+
+/**
+ * SPI master clock settings tried during calibration, slowest first
+ * (the first one serves as the fallback).
+ */
+static const PSPEM100SPICLK g_aEm100SpiClks[] =
+{
+    { 0x5,    800000 },
+    { 0x3,  16666666 },
+    { 0x2,  22222222 },
+    { 0x1,  33333333 },
+    { 0x0,  66666666 },
+    { 0x4, 100000000 }
+};
+
+
+#ifdef PSP_SERIAL_STUB_HOST
+/* There is no SPI master on the host, the EM100 model provides the registers. */
+static inline void pspStubSpiMasterWriteRegU8(PPSPPDUTRANSPINT pThis, uint32_t offReg, uint8_t bVal)
+{
+    PSPIoDevRegWrite(pspStubHostSpiMasterIoDevGet(), offReg, &bVal, sizeof(bVal));
+}
+
+
+static inline uint8_t pspStubSpiMasterReadRegU8(PPSPPDUTRANSPINT pThis, uint32_t offReg)
+{
+    uint8_t bVal = 0;
+    PSPIoDevRegRead(pspStubHostSpiMasterIoDevGet(), offReg, &bVal, sizeof(bVal));
+    return bVal;
+}
+
+
+static inline void pspStubSpiMasterWriteRegU16(PPSPPDUTRANSPINT pThis, uint32_t offReg, uint16_t u16Val)
+{
+    PSPIoDevRegWrite(pspStubHostSpiMasterIoDevGet(), offReg, &u16Val, sizeof(u16Val));
+}
+
+
+static inline void pspStubSpiMasterWriteRegU32(PPSPPDUTRANSPINT pThis, uint32_t offReg, uint32_t u32Val)
+{
+    PSPIoDevRegWrite(pspStubHostSpiMasterIoDevGet(), offReg, &u32Val, sizeof(u32Val));
+}
+
+
+static inline uint32_t pspStubSpiMasterReadRegU32(PPSPPDUTRANSPINT pThis, uint32_t offReg)
+{
+    uint32_t u32Val = 0;
+    PSPIoDevRegRead(pspStubHostSpiMasterIoDevGet(), offReg, &u32Val, sizeof(u32Val));
+    return u32Val;
+}
+#else
 static inline void pspStubSpiMasterWriteRegU8(PPSPPDUTRANSPINT pThis, uint32_t offReg, uint8_t bVal)
 {
     *((volatile uint8_t *)pThis->pvSmnMap + offReg) = bVal;
@@ -100,6 +215,7 @@ static inline uint32_t pspStubSpiMasterReadRegU32(PPSPPDUTRANSPINT pThis, uint32
 {
     return *(volatile uint32_t *)((volatile uint8_t *)pThis->pvSmnMap + offReg);
 }
+#endif
 
 
 /**
@@ -116,6 +232,16 @@ static inline uint32_t pspStubSpiMasterReadRegU32(PPSPPDUTRANSPINT pThis, uint32
 static int pspStubSpiMasterXact(PPSPPDUTRANSPINT pThis, uint8_t bCmd, uint8_t *pbTx, size_t cbTx,
                                 uint8_t *pbRx, size_t cbRx)
 {
+    if (cbTx + cbRx > PSP_SPI_MASTER_FIFO_SZ)
+        return ERR_INVALID_PARAMETER;
+
+    /* The master can't queue transactions, wait for the previous one before touching the FIFO. */
+    if (pThis->fXactPending)
+    {
+        while (pspStubSpiMasterReadRegU32(pThis, PSP_SPI_MASTER_STATUS) & PSP_SPI_MASTER_STATUS_BSY);
+        pThis->fXactPending = false;
+    }
+
     pspStubSpiMasterWriteRegU8(pThis, PSP_SPI_MASTER_CMD_CODE, bCmd);
     pspStubSpiMasterWriteRegU8(pThis, PSP_SPI_MASTER_TX_CNT,   (uint8_t)cbTx);
     pspStubSpiMasterWriteRegU8(pThis, PSP_SPI_MASTER_RX_CNT,   (uint8_t)cbRx);
@@ -125,6 +251,16 @@ static int pspStubSpiMasterXact(PPSPPDUTRANSPINT pThis, uint8_t bCmd, uint8_t *p
 
     pspStubSpiMasterWriteRegU8(pThis, PSP_SPI_MASTER_CMD_TRIG, PSP_SPI_MASTER_CMD_TRIG_BIT); /* Issues the transaction */
 
+    /*
+     * Nothing to receive means the caller can prepare the next transaction while this one
+     * is clocked out, completion is waited for when the master is needed again.
+     */
+    if (!cbRx)
+    {
+        pThis->fXactPending = true;
+        return INF_SUCCESS;
+    }
+
     /* Wait until the master is idling. */
     while (pspStubSpiMasterReadRegU32(pThis, PSP_SPI_MASTER_STATUS) & PSP_SPI_MASTER_STATUS_BSY);
 
@@ -165,11 +301,11 @@ static int pspStubEm100RegWrite(PPSPPDUTRANSPINT pThis, uint8_t idxReg, uint8_t
 static int pspStubEm100RegRead(PPSPPDUTRANSPINT pThis, uint8_t idxReg, uint8_t *pbReg)
 {
     uint8_t abCmd[2] = { 0 };
-    uint8_t abRecv[4] = { 0 };
+    uint8_t abRecv[sizeof(abCmd) + 4] = { 0 }; /* Received bytes are stored after the transmitted ones. */
     abCmd[1] = 0xb0 | (idxReg & 0xf);
 
     int rc = pspStubSpiMasterXact(pThis, 0x11, &abCmd[0], sizeof(abCmd),
-                                  &abRecv[0], sizeof(abRecv));
+                                  &abRecv[0], sizeof(abRecv) - sizeof(abCmd));
     if (!rc)
         *pbReg = abRecv[3];
 
@@ -256,30 +392,69 @@ static int pspStubEm100DFifoQueryAvail(PPSPPDUTRANSPINT pThis, size_t *pcbAvail)
 }
 
 
+/**
+ * Makes sure there is at least the given amount of uFIFO credit, only querying
+ * the EM100 if the local estimate doesn't cover it.
+ *
+ * @returns Status code.
+ * @param   pThis               The EM100 transport channel instance.
+ * @param   cbNeeded            Number of free bytes required.
+ */
+static int pspStubEm100UFifoCreditAcquire(PPSPPDUTRANSPINT pThis, size_t cbNeeded)
+{
+    int rc = INF_SUCCESS;
+
+    while (pThis->cbUFifoCredit < cbNeeded)
+    {
+        /* The host only ever drains the uFIFO, so what we get here is a lower bound until we write again. */
+        size_t cbFree = 0;
+        rc = pspStubEm100UFifoQueryFree(pThis, &cbFree);
+        if (rc)
+            break;
+
+        pThis->cbUFifoCredit = cbFree;
+        if (cbFree < cbNeeded)
+        {
+            uint32_t tsStart = pspSerialStubTicksGet();
+            pspSerialStubDelayUs(10);
+            pThis->Stats.cTicksStallWrite += pspSerialStubTicksGet() - tsStart;
+            pThis->Stats.cRetries++;
+        }
+    }
+
+    return rc;
+}
+
+
 /**
  * Writes to the upload FIFO of the em100.
  *
  * @returns Status code.
  * @param   pThis               The EM100 transport channel instance.
+ * @param   bTag                The frame tag, EM100_UFIFO_TAG_XXX.
  * @param   pbBuf               The data to write.
  * @param   cbWrite             Number of bytes to write.
  */
-static int pspStubEm100UFifoWrite(PPSPPDUTRANSPINT pThis, const uint8_t *pbBuf, size_t cbWrite)
+static int pspStubEm100UFifoWrite(PPSPPDUTRANSPINT pThis, uint8_t bTag, const uint8_t *pbBuf, size_t cbWrite)
 {
-    uint8_t abData[PSP_SPI_MASTER_CHUNK_SZ + 2 + 2];
+    uint8_t abData[EM100_UFIFO_WRITE_MAX + 2 + 2];
 
-    if (cbWrite > PSP_SPI_MASTER_CHUNK_SZ)
+    if (cbWrite > EM100_UFIFO_WRITE_MAX)
         return ERR_INVALID_PARAMETER;
 
     abData[0] = 0x0;
     abData[1] = 0xc0;
-    abData[2] = 0xef;
+    abData[2] = bTag;
     abData[3] = (uint8_t)cbWrite;
     for (uint32_t i = 0; i < cbWrite; i++)
         abData[i + 4] = pbBuf[i];
 
-    return pspStubSpiMasterXact(pThis, 0x11, &abData[0], cbWrite + 4,
-                                NULL /*pbRx*/, 0 /*cbRx*/);
+    int rc = pspStubSpiMasterXact(pThis, 0x11, &abData[0], cbWrite + 4,
+                                  NULL /*pbRx*/, 0 /*cbRx*/);
+    if (!rc)
+        pThis->cbUFifoCredit -= MIN(pThis->cbUFifoCredit, cbWrite + EM100_UFIFO_WRITE_HDR_SZ);
+
+    return rc;
 }
 
 
@@ -297,7 +472,7 @@ static int pspStubEm100DFifoRead(PPSPPDUTRANSPINT pThis, uint8_t *pbBuf, size_t
         return ERR_INVALID_PARAMETER;
 
     uint8_t abCmd[3];
-    uint8_t abRecv[PSP_SPI_MASTER_CHUNK_SZ + sizeof(abCmd)];
+    uint8_t abRecv[sizeof(abCmd) + PSP_SPI_MASTER_CHUNK_SZ + sizeof(abCmd)]; /* Received bytes are stored after the transmitted ones. */
     abCmd[0] = 0x0;
     abCmd[1] = 0xd0;
 
@@ -309,17 +484,9 @@ static int pspStubEm100DFifoRead(PPSPPDUTRANSPINT pThis, uint8_t *pbBuf, size_t
             pbBuf[i] = abRecv[i + sizeof(abCmd)];
     }
 
-    /* Wait for at least one free byte in the UFifo. */
-    for (;;)
-    {
-        size_t cbFree = 0;
-        rc = pspStubEm100UFifoQueryFree(pThis, &cbFree);
-        if (   rc
-            || cbFree)
-            break;
-
-        pspSerialStubDelayUs(10);
-    }
+    /* Need at least one free byte in the UFifo, may dip into the reserve. */
+    if (!rc)
+        rc = pspStubEm100UFifoCreditAcquire(pThis, 1);
 
     if (!rc)
     {
@@ -329,6 +496,8 @@ static int pspStubEm100DFifoRead(PPSPPDUTRANSPINT pThis, uint8_t *pbBuf, size_t
         abCmd[2] = 0xdf;
         rc = pspStubSpiMasterXact(pThis, 0x11, &abCmd[0], sizeof(abCmd),
                                   NULL /*pbRx*/, 0 /*cbRx*/);
+        if (!rc)
+            pThis->cbUFifoCredit--;
     }
 
     return rc;
@@ -356,11 +525,13 @@ static int pspStubEm100FetchChunk(PPSPPDUTRANSPINT pThis)
      * read less than what is actually inside the dFIFO which is cleared
      * afterwards.
      */
-    size_t cbAvail = 0;
+    size_t cbAvail = pThis->cbDFifoSeen; /* The peek before counts as the first sample. */
     int rc = INF_SUCCESS;
+    pThis->cbDFifoSeen = 0;
     for (;;)
     {
-        pspSerialStubDelayUs(10);
+        /* Back off while the link is idle, only the short delay is needed once data shows up. */
+        pspSerialStubDelayUs(cbAvail ? PSP_EM100_POLL_US_MIN : pThis->cUsPollIdle);
 
         size_t cbThisAvail = 0;
         rc = pspStubEm100DFifoQueryAvail(pThis, &cbThisAvail);
@@ -375,6 +546,11 @@ static int pspStubEm100FetchChunk(PPSPPDUTRANSPINT pThis)
         cbAvail = cbThisAvail;
     }
 
+    if (!cbAvail)
+        pThis->cUsPollIdle = MIN(pThis->cUsPollIdle * 2, PSP_EM100_POLL_US_MAX);
+    else
+        pThis->cUsPollIdle = PSP_EM100_POLL_US_MIN;
+
     /* We should never have more than chunk size here. */
     if (   !rc
         && cbAvail)
@@ -391,6 +567,196 @@ static int pspStubEm100FetchChunk(PPSPPDUTRANSPINT pThis)
 }
 
 
+/**
+ * Switches the SPI master to the given clock setting.
+ *
+ * @returns nothing.
+ * @param   pThis               The EM100 transport channel instance.
+ * @param   idxSpiClk           Index into g_aEm100SpiClks.
+ */
+static void pspStubEm100SpiClkSet(PPSPPDUTRANSPINT pThis, uint32_t idxSpiClk)
+{
+    uint16_t u16SpeedSel = g_aEm100SpiClks[idxSpiClk].uSpeedSel;
+
+    /* Don't change the clock under a running transaction. */
+    while (pspStubSpiMasterReadRegU32(pThis, PSP_SPI_MASTER_STATUS) & PSP_SPI_MASTER_STATUS_BSY);
+    pThis->fXactPending = false;
+
+    pspStubSpiMasterWriteRegU8(pThis, PSP_SPI_MASTER_SPEED_EN, 1);
+    pspStubSpiMasterWriteRegU16(pThis, PSP_SPI_MASTER_SPEED_CFG, u16SpeedSel * 0x1111);
+    pThis->idxSpiClk = idxSpiClk;
+}
+
+
+/**
+ * Checks whether register reads from the EM100 work reliably at the current clock.
+ *
+ * @returns Flag whether all test rounds passed.
+ * @param   pThis               The EM100 transport channel instance.
+ */
+static bool pspStubEm100SpiClkTestRegs(PPSPPDUTRANSPINT pThis)
+{
+    for (uint32_t i = 0; i < PSP_EM100_CALIB_ROUNDS; i++)
+    {
+        uint8_t bId = 0;
+        int rc = pspStubEm100RegRead(pThis, 3, &bId);
+        if (   rc
+            || bId != EM100_ID)
+            return false;
+    }
+
+    return true;
+}
+
+
+/**
+ * Sends a test pattern through the uFIFO and checks that the host echoes it back through the dFIFO unchanged.
+ *
+ * The pattern has walking ones and zeros and alternating bits, the identifier register alone only ever puts
+ * the same byte on the bus.
+ *
+ * @returns Status code.
+ * @retval  INF_SUCCESS if the pattern came back intact.
+ * @retval  INF_TRY_AGAIN if nothing came back in time.
+ * @retval  ERR_INVALID_STATE if the pattern came back corrupted.
+ * @param   pThis               The EM100 transport channel instance.
+ */
+static int pspStubEm100SpiClkTestEcho(PPSPPDUTRANSPINT pThis)
+{
+    uint8_t abPattern[PSP_EM100_CALIB_ECHO_SZ];
+    uint8_t abEcho[PSP_EM100_CALIB_ECHO_SZ];
+
+    for (uint32_t i = 0; i < 8; i++)
+    {
+        abPattern[i]      = (uint8_t)BIT(i);          /* Walking one. */
+        abPattern[i + 8]  = (uint8_t)~BIT(i);         /* Walking zero. */
+        abPattern[i + 16] = (i & 1) ? 0xaa : 0x55;    /* Alternating bits. */
+        abPattern[i + 24] = (i & 1) ? 0xff : 0x00;    /* Every bit toggling between bytes. */
+    }
+
+    int rc = pspStubEm100UFifoCreditAcquire(pThis, sizeof(abPattern) + EM100_UFIFO_WRITE_HDR_SZ + EM100_UFIFO_RESERVE);
+    if (!rc)
+        rc = pspStubEm100UFifoWrite(pThis, EM100_UFIFO_TAG_ECHO, &abPattern[0], sizeof(abPattern));
+    if (rc)
+        return rc;
+
+    /* The host might split the echo up into several dFIFO chunks. */
+    size_t cbEcho = 0;
+    uint32_t tsStart = pspSerialStubTicksGet();
+    while (cbEcho < sizeof(abEcho))
+    {
+        rc = pspStubEm100FetchChunk(pThis);
+        if (rc)
+            return rc;
+
+        size_t cbThisEcho = MIN(pThis->cbAvail, sizeof(abEcho) - cbEcho);
+        if (cbThisEcho)
+        {
+            memcpy(&abEcho[cbEcho], &pThis->abChunk[pThis->offChunk], cbThisEcho);
+            pThis->offChunk += cbThisEcho;
+            pThis->cbAvail  -= cbThisEcho;
+            cbEcho          += cbThisEcho;
+        }
+        else if (pspSerialStubTicksGet() - tsStart >= PSP_EM100_CALIB_ECHO_TIMEOUT_US * PSP_EM100_TICKS_PER_US)
+            return cbEcho ? ERR_INVALID_STATE : INF_TRY_AGAIN;
+    }
+
+    /* The echo fills the chunks exactly, anything left over means the lengths were garbled. */
+    if (pThis->cbAvail)
+        return ERR_INVALID_STATE;
+
+    for (uint32_t i = 0; i < sizeof(abPattern); i++)
+    {
+        if (abEcho[i] != abPattern[i])
+            return ERR_INVALID_STATE;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+/**
+ * Throws away whatever is left in the dFIFO after a failed echo, only called while the host has nothing
+ * else in flight.
+ *
+ * @returns nothing.
+ * @param   pThis               The EM100 transport channel instance.
+ */
+static void pspStubEm100DFifoDiscard(PPSPPDUTRANSPINT pThis)
+{
+    uint32_t tsStart = pspSerialStubTicksGet();
+
+    pThis->cbAvail  = 0;
+    pThis->offChunk = 0;
+    while (pspSerialStubTicksGet() - tsStart < PSP_EM100_CALIB_ECHO_TIMEOUT_US * PSP_EM100_TICKS_PER_US)
+    {
+        if (pspStubEm100FetchChunk(pThis))
+            break;
+        if (pThis->cbAvail)
+        {
+            /* Restart the wait, the host might still have parts of the echo queued. */
+            pThis->cbAvail = 0;
+            tsStart = pspSerialStubTicksGet();
+        }
+    }
+}
+
+
+/**
+ * Steps the SPI clock up until the link fails and selects the fastest working
+ * setting minus one step as margin.
+ *
+ * Every step has to pass the identifier register reads and, if the host echoes calibration frames,
+ * a test pattern round trip through the uFIFO and dFIFO. Whether the host echoes is determined at the
+ * slowest clock, if it doesn't only the register reads are checked.
+ *
+ * @returns Status code.
+ * @param   pThis               The EM100 transport channel instance.
+ */
+static int pspStubEm100SpiClkCalibrate(PPSPPDUTRANSPINT pThis)
+{
+    uint32_t cClksOk = 0;
+    bool fEcho = true;
+    bool fEchoFailed = false;
+
+    for (uint32_t i = 0; i < ELEMENTS(g_aEm100SpiClks); i++)
+    {
+        pspStubEm100SpiClkSet(pThis, i);
+        if (!pspStubEm100SpiClkTestRegs(pThis))
+            break;
+
+        if (fEcho)
+        {
+            int rc = pspStubEm100SpiClkTestEcho(pThis);
+            if (   rc == INF_TRY_AGAIN
+                && !i)
+                fEcho = false; /* The host doesn't echo, can't be a problem of the slowest clock. */
+            else if (rc)
+            {
+                fEchoFailed = true;
+                break;
+            }
+        }
+
+        cClksOk++;
+    }
+
+    if (!cClksOk)
+    {
+        /* Not even the slowest setting works, keep it anyway as it is the best guess. */
+        pspStubEm100SpiClkSet(pThis, 0);
+        pThis->fSpiClkCalibrated = false;
+        return ERR_INVALID_STATE;
+    }
+
+    pspStubEm100SpiClkSet(pThis, cClksOk > 1 ? cClksOk - 2 : 0);
+    if (fEchoFailed)
+        pspStubEm100DFifoDiscard(pThis);
+    pThis->fSpiClkCalibrated = true;
+    return INF_SUCCESS;
+}
+
+
 static int pspStubEm100TranspWrite(PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
 {
     PPSPPDUTRANSPINT pThis = hPduTransp;
@@ -400,30 +766,71 @@ static int pspStubEm100TranspWrite(PSPPDUTRANSP hPduTransp, const void *pvBuf, s
     while (   cbWrite
            && rc == INF_SUCCESS)
     {
-        size_t cbFree = 0;
-        rc = pspStubEm100UFifoQueryFree(pThis, &cbFree);
+        /* Send the largest burst possible, the credit is only refreshed from the EM100 when it runs out. */
+        size_t cbThisWrite = MIN(cbWrite, EM100_UFIFO_WRITE_MAX);
+        rc = pspStubEm100UFifoCreditAcquire(pThis, cbThisWrite + EM100_UFIFO_WRITE_HDR_SZ + EM100_UFIFO_RESERVE);
+        if (!rc)
+            rc = pspStubEm100UFifoWrite(pThis, EM100_UFIFO_TAG_DATA, pbBuf, cbThisWrite);
         if (!rc)
         {
-            if (cbFree >= 2 * (PSP_SPI_MASTER_CHUNK_SZ + 2))
-            {
-                size_t cbThisWrite = MIN(cbWrite, PSP_SPI_MASTER_CHUNK_SZ - 2);
-                cbThisWrite = MIN(cbThisWrite, cbFree);
-
-                rc = pspStubEm100UFifoWrite(pThis, pbBuf, cbThisWrite);
-                if (!rc)
-                {
-                    pbBuf   += cbThisWrite;
-                    cbWrite -= cbThisWrite;
-                }
-            }
-#if 0
-            else
-                pspSerialStubDelayMs(1); /* Wait for a moment to let the host empty the uFIFO. */
-#endif
+            pbBuf   += cbThisWrite;
+            cbWrite -= cbThisWrite;
+            pThis->Stats.cbWritten += cbThisWrite;
         }
     }
 
-    return INF_SUCCESS;
+    pThis->Stats.cWrites++;
+    if (rc)
+        pThis->Stats.cErrors++;
+    return rc;
+}
+
+
+static int pspStubEm100TranspWriteNB(PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    size_t cbWritten = 0;
+    int rc = INF_SUCCESS;
+    while (   cbWrite
+           && rc == INF_SUCCESS)
+    {
+        size_t cbThisWrite = MIN(cbWrite, EM100_UFIFO_WRITE_MAX);
+        size_t cbNeeded = cbThisWrite + EM100_UFIFO_WRITE_HDR_SZ + EM100_UFIFO_RESERVE;
+
+        /* Refresh the credit when it runs out but never wait for the host to drain the uFIFO. */
+        if (pThis->cbUFifoCredit < cbNeeded)
+        {
+            rc = pspStubEm100UFifoQueryFree(pThis, &pThis->cbUFifoCredit);
+            if (   !rc
+                && pThis->cbUFifoCredit < cbNeeded)
+                break;
+        }
+
+        if (!rc)
+            rc = pspStubEm100UFifoWrite(pThis, EM100_UFIFO_TAG_DATA, pbBuf, cbThisWrite);
+        if (!rc)
+        {
+            pbBuf     += cbThisWrite;
+            cbWrite   -= cbThisWrite;
+            cbWritten += cbThisWrite;
+        }
+    }
+
+    pThis->Stats.cWrites++;
+    pThis->Stats.cbWritten += cbWritten;
+    if (rc)
+        pThis->Stats.cErrors++;
+    else if (!cbWritten)
+    {
+        pThis->Stats.cRetries++;
+        rc = INF_TRY_AGAIN;
+    }
+    else
+        *pcbWritten = cbWritten;
+
+    return rc;
 }
 
 
@@ -437,10 +844,18 @@ static int pspStubEm100TranspRead(PSPPDUTRANSP hPduTransp, void *pvBuf, size_t c
     while (   cbReadLeft
            && rc == INF_SUCCESS)
     {
-        /* fetch a new chunk if we're out of data. */
+        /* fetch a new chunk if we're out of data, polls coming back empty count as stalled. */
         while (   !pThis->cbAvail
                && rc == INF_SUCCESS)
+        {
+            uint32_t tsStart = pspSerialStubTicksGet();
             rc = pspStubEm100FetchChunk(pThis);
+            if (!pThis->cbAvail)
+            {
+                pThis->Stats.cTicksStallRead += pspSerialStubTicksGet() - tsStart;
+                pThis->Stats.cRetries++;
+            }
+        }
 
         size_t cbThisRead = MIN(cbReadLeft, pThis->cbAvail);
         memcpy(pbBuf, &pThis->abChunk[pThis->offChunk], cbThisRead);
@@ -450,6 +865,12 @@ static int pspStubEm100TranspRead(PSPPDUTRANSP hPduTransp, void *pvBuf, size_t c
         pThis->offChunk += cbThisRead;
     }
 
+    pThis->Stats.cReads++;
+    pThis->Stats.cbRead += cbRead - cbReadLeft;
+    if (rc)
+        pThis->Stats.cErrors++;
+    else if (pcbRead)
+        *pcbRead = cbRead;
     return rc;
 }
 
@@ -463,6 +884,7 @@ static size_t pspStubEm100TranspPeek(PSPPDUTRANSP hPduTransp)
 
     size_t cbAvail = 0;
     pspStubEm100DFifoQueryAvail(pThis, &cbAvail);
+    pThis->cbDFifoSeen = cbAvail;
     return cbAvail;
 }
 
@@ -488,9 +910,53 @@ static int pspStubEm100TranspBegin(PSPPDUTRANSP hPduTransp)
 }
 
 
+static int pspStubEm100TranspLinkSpeedGet(PSPPDUTRANSP hPduTransp, uint32_t *puBps, uint32_t *pcbPerSec, bool *pfCalibrated)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+    uint32_t uHz = g_aEm100SpiClks[pThis->idxSpiClk].uHz;
+
+    /*
+     * The SPI clock is rarely the limit, every byte in the uFIFO has to be picked up by the host software
+     * which can't be faster than one uFIFO worth of data every time it polls.
+     */
+    uint32_t cbPerSecSpi = (uHz / 8) / (EM100_UFIFO_WRITE_MAX + 5) * EM100_UFIFO_WRITE_MAX;
+    uint32_t cbPerSecHost = (EM100_UFIFO_SZ - EM100_UFIFO_RESERVE) * (1000000 / EM100_HOST_POLL_US_ESTIMATE);
+
+    *puBps        = uHz;
+    *pcbPerSec    = MIN(cbPerSecSpi, cbPerSecHost);
+    *pfCalibrated = pThis->fSpiClkCalibrated;
+    return INF_SUCCESS;
+}
+
+
+static int pspStubEm100TranspLinkCalibrate(PSPPDUTRANSP hPduTransp, uint32_t *puBps)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    int rc = pspStubEm100SpiClkCalibrate(pThis);
+    *puBps = g_aEm100SpiClks[pThis->idxSpiClk].uHz;
+    return rc;
+}
+
+
+static int pspStubEm100TranspStatsQuery(PSPPDUTRANSP hPduTransp, PPSPPDUTRANSPSTATS pStats, bool fReset)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    *pStats = pThis->Stats;
+    if (fReset)
+        memset(&pThis->Stats, 0, sizeof(pThis->Stats));
+    return INF_SUCCESS;
+}
+
+
 static void pspStubEm100TranspTerm(PSPPDUTRANSP hPduTransp)
 {
     PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    /* Let the last transaction finish before the mapping goes away. */
+    if (pThis->fXactPending)
+        while (pspStubSpiMasterReadRegU32(pThis, PSP_SPI_MASTER_STATUS) & PSP_SPI_MASTER_STATUS_BSY);
     pspSerialStubSmnUnmapByPtr((void *)pThis->pvSmnMap);
 }
 
@@ -501,15 +967,16 @@ static int pspStubEm100TranspInit(void *pvMem, size_t cbMem, PPSPPDUTRANSP phPdu
         return ERR_INVALID_PARAMETER;
 
     PPSPPDUTRANSPINT pThis = (PPSPPDUTRANSPINT)pvMem;
+    pThis->fXactPending = false;
+    pThis->cUsPollIdle  = PSP_EM100_POLL_US_MIN;
+    memset(&pThis->Stats, 0, sizeof(pThis->Stats));
+
     int rc = pspSerialStubSmnMap(PSP_SPI_MASTER_SMN_ADDR, (void **)&pThis->pvSmnMap);
     if (!rc)
     {
-#if 1 /** @todo Doesn't has any effect. */
-        pspStubSpiMasterWriteRegU8(pThis, PSP_SPI_MASTER_SPEED_EN, 1);
-        pspStubSpiMasterWriteRegU16(pThis, PSP_SPI_MASTER_SPEED_CFG, 0x1111); /* Switches everything to 800kHz mode. */
-#endif
-
-        while (pspStubSpiMasterReadRegU32(pThis, PSP_SPI_MASTER_STATUS) & PSP_SPI_MASTER_STATUS_BSY);
+        /* Start with the conservative clock, calibrated once the EM100 was found. */
+        pThis->fSpiClkCalibrated = false;
+        pspStubEm100SpiClkSet(pThis, 0);
         pThis->bRegCs = pspStubSpiMasterReadRegU8(pThis, PSP_SPI_MASTER_ALT_CS);
         pThis->fSpiBridgeDisable = pspStubSpiMasterReadRegU32(pThis, 0) & BIT(27);
 
@@ -518,10 +985,15 @@ static int pspStubEm100TranspInit(void *pvMem, size_t cbMem, PPSPPDUTRANSP phPdu
         rc = pspStubEm100RegRead(pThis, 3, &bId);
         if (!rc)
         {
-            if (bId == 0xaa)
+            if (bId == EM100_ID)
             {
-                pThis->cbAvail  = 0;
-                pThis->offChunk = 0;
+                pThis->cbAvail       = 0;
+                pThis->offChunk      = 0;
+                pThis->cbUFifoCredit = 0; /* Forces a query on the first write. */
+                pThis->cbDFifoSeen   = 0;
+
+                /* A failed calibration leaves the slowest clock configured, reported as uncalibrated. */
+                pspStubEm100SpiClkCalibrate(pThis);
                 *phPduTransp = pThis;
                 return INF_SUCCESS;
             }
@@ -553,6 +1025,24 @@ const PSPPDUTRANSPIF g_SpiFlashTranspEm100 =
     /** pfnRead */
     pspStubEm100TranspRead,
     /** pfnWrite */
-    pspStubEm100TranspWrite
+    pspStubEm100TranspWrite,
+    /** pfnLinkSpeedSet */
+    NULL,
+    /** pfnWriteNB */
+    pspStubEm100TranspWriteNB,
+    /** pfnPoll */
+    NULL,
+    /** pfnFlush */
+    NULL,
+    /** pfnIrqSet */
+    NULL,
+    /** pfnIrq */
+    NULL,
+    /** pfnLinkSpeedGet */
+    pspStubEm100TranspLinkSpeedGet,
+    /** pfnLinkCalibrate */
+    pspStubEm100TranspLinkCalibrate,
+    /** pfnStatsQuery */
+    pspStubEm100TranspStatsQuery
 };
 
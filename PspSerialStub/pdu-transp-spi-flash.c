@@ -34,56 +34,111 @@
 
 #define PSP_SPI_FLASH_SMN_ADDR          0x0a000000
 
-#define PSP_SPI_FLASH_LOCK_WAIT         50
-
+/*
+ * The message channel consists of two single producer/single consumer rings in the emulated flash,
+ * one for each direction. Every index is a free running byte offset written only by its owner,
+ * so neither side ever has to lock the channel:
+ *
+ *     SPI_MSG_RING_HDR_OFF          magic, written by the host once all indices were reset
+ *     SPI_MSG_RING_H2P_HEAD_OFF     host to PSP write offset, owned by the host
+ *     SPI_MSG_RING_H2P_TAIL_OFF     host to PSP read offset, owned by the PSP
+ *     SPI_MSG_RING_P2H_HEAD_OFF     PSP to host write offset, owned by the PSP
+ *     SPI_MSG_RING_P2H_TAIL_OFF     PSP to host read offset, owned by the host
+ *     SPI_MSG_RING_H2P_DATA_OFF     host to PSP ring data
+ *     SPI_MSG_RING_P2H_DATA_OFF     PSP to host ring data
+ *
+ * Each index sits in its own SPI read cache line (256 bytes, which covers x86 cache lines as well),
+ * so polling the index of the other side never drags in a stale copy of our own and vice versa.
+ * The data is always written before the index publishing it.
+ */
+/** Size of an SPI flash read cache line. */
+#define SPI_FLASH_CACHE_LINE_SZ         256
 /** Where in the flash the message channel is located. */
-#define SPI_MSG_CHAN_HDR_OFF            0xaab000
-#define SPI_MSG_CHAN_AVAIL_OFF          0xaaa000
-#define SPI_MSG_CHAN_AVAIL_F_OFF        0xaac000
-#define SPI_MSG_CHAN_STS_OFF            0xaad000
-#define SPI_FLASH_LOCK_OFF              0xaa0000
-#define SPI_FLASH_LOCK_UNLOCK_REQ_MAGIC 0x19570528 /* (Frank Schaetzing) */
-#define SPI_FLASH_LOCK_UNLOCKED_MAGIC   0x18280208 /* (Jules Verne) */
-#define SPI_FLASH_LOCK_LOCK_REQ_MAGIC   0x19380110 /* (Donald E Knuth) */
-#define SPI_FLASH_LOCK_LOCKED_MAGIC     0x18990223 /* (Erich Kaestner) */
-
-#define SPI_MSG_CHAN_AVAIL_MAGIC        0x19640522 /* (Dan Brown) */
+#define SPI_MSG_RING_HDR_OFF            0xaa0000
+#define SPI_MSG_RING_H2P_HEAD_OFF       (SPI_MSG_RING_HDR_OFF + 1 * SPI_FLASH_CACHE_LINE_SZ)
+#define SPI_MSG_RING_H2P_TAIL_OFF       (SPI_MSG_RING_HDR_OFF + 2 * SPI_FLASH_CACHE_LINE_SZ)
+#define SPI_MSG_RING_P2H_HEAD_OFF       (SPI_MSG_RING_HDR_OFF + 3 * SPI_FLASH_CACHE_LINE_SZ)
+#define SPI_MSG_RING_P2H_TAIL_OFF       (SPI_MSG_RING_HDR_OFF + 4 * SPI_FLASH_CACHE_LINE_SZ)
+/** Line never read otherwise, reading it evicts whatever line the read cache holds. */
+#define SPI_MSG_RING_EVICT_OFF          (SPI_MSG_RING_HDR_OFF + 5 * SPI_FLASH_CACHE_LINE_SZ)
+#define SPI_MSG_RING_H2P_DATA_OFF       0xaa1000
+#define SPI_MSG_RING_P2H_DATA_OFF       0xaa2000
+/** Size of each ring in bytes (power of two). */
+#define SPI_MSG_RING_SZ                 _4K
+
+/** End of the message channel, everything must be reachable through a single 1MB SMN mapping. */
+#define SPI_MSG_RING_END_OFF            (SPI_MSG_RING_P2H_DATA_OFF + SPI_MSG_RING_SZ)
+
+#define SPI_MSG_RING_MAGIC              0x19210912 /* (Stanislaw Lem) */
+/** Number of timer ticks (100MHz) per millisecond. */
+#define SPI_FLASH_TICKS_PER_MS          100000
+/** How long to wait for the host to set up the rings, the transport fails to initialize afterwards. */
+#define SPI_FLASH_INIT_TIMEOUT_MS       1000
+
+/** Marks the read cache as not holding any known line. */
+#define SPI_FLASH_CACHE_LINE_INVALID    UINT32_MAX
 
 /**
  * SPI flash transport channel.
  */
 typedef struct PSPPDUTRANSPINT
 {
-    /** Number of times the SPI flash was locked. */
-    uint32_t                    cSpiFlashLock;
-    /** Last accessed offset for reading (top optimize the cache wiping). */
-    uint32_t                    offReadLast;
-    /** Number of bytes available for reading. */
-    size_t                      cbReadAvail;
+    /** Free running write offset of the PSP to host ring (owned by us). */
+    uint32_t                    offTxHead;
+    /** Last seen read offset of the PSP to host ring (owned by the host). */
+    uint32_t                    offTxTail;
+    /** Free running read offset of the host to PSP ring (owned by us). */
+    uint32_t                    offRxTail;
+    /** Last seen write offset of the host to PSP ring (owned by the host). */
+    uint32_t                    offRxHead;
+    /** Flash offset of the line the read cache holds (SPI_FLASH_CACHE_LINE_INVALID if unknown). */
+    uint32_t                    offLineCached;
+    /** The SMN mapping of the message channel, kept for the lifetime of the transport. */
+    volatile uint8_t            *pbMsgChan;
+    /** Transport channel statistics. */
+    PSPPDUTRANSPSTATS           Stats;
 } PSPPDUTRANSPINT;
 /** Pointer to the x86 UART PDU transport channel instance. */
 typedef PSPPDUTRANSPINT *PPSPPDUTRANSPINT;
 
 
+/* The message channel must not cross a 1MB SMN mapping boundary. */
+_Static_assert((SPI_MSG_RING_HDR_OFF & ~(_1M - 1)) == ((SPI_MSG_RING_END_OFF - 1) & ~(_1M - 1)));
+
 static size_t pspStubSpiFlashTranspPeek(PSPPDUTRANSP hPduTransp);
 
 
 /**
- * Wipe the read cache of the SPI flash.
+ * Returns the pointer to the given flash offset in the message channel mapping.
+ *
+ * @returns Pointer into the mapping.
+ * @param   pThis                   SPI flash transport instance data.
+ * @param   off                     The flash offset.
+ */
+static inline volatile uint8_t *pspStubSpiFlashPtr(PPSPPDUTRANSPINT pThis, uint32_t off)
+{
+    return pThis->pbMsgChan + (off - SPI_MSG_RING_HDR_OFF);
+}
+
+
+/**
+ * Makes sure the next read of the given range goes to the flash and not the read cache.
  *
  * @returns nothing.
  * @param   pThis                   SPI flash transport instance data.
+ * @param   off                     Start offset of the range about to be read.
+ * @param   cb                      Size of the range in bytes.
  */
-static void pspStubSpiFlashWipeCache(PPSPPDUTRANSPINT pThis)
+static void pspStubSpiFlashCacheInval(PPSPPDUTRANSPINT pThis, uint32_t off, size_t cb)
 {
-    /* Map the SMN region. */
-    void *pvMap;
-    int rc = pspSerialStubSmnMap(PSP_SPI_FLASH_SMN_ADDR, &pvMap);
-    if (!rc)
+    /* Only the line the cache holds can be stale, evict it if the range touches it. */
+    if (   pThis->offLineCached == SPI_FLASH_CACHE_LINE_INVALID
+        || (   pThis->offLineCached + SPI_FLASH_CACHE_LINE_SZ > off
+            && pThis->offLineCached < off + cb))
     {
-        /* Make sure we don't read cached data by issuing a read to a non accecssed region. */
-        uint32_t uIgnored = *(volatile uint32_t *)pvMap;
-        pspSerialStubSmnUnmapByPtr(pvMap);
+        uint32_t uIgnored = *(volatile uint32_t *)pspStubSpiFlashPtr(pThis, SPI_MSG_RING_EVICT_OFF);
+        (void)uIgnored;
+        pThis->offLineCached = SPI_MSG_RING_EVICT_OFF;
     }
 }
 
@@ -99,20 +154,9 @@ static void pspStubSpiFlashWipeCache(PPSPPDUTRANSPINT pThis)
  */
 static void pspStubSpiFlashRead(PPSPPDUTRANSPINT pThis, uint32_t off, void *pvBuf, size_t cbRead)
 {
-    if (   pThis->offReadLast == 0xffff0000
-        || (   off >= pThis->offReadLast
-            && off < pThis->offReadLast + 256 /* cache size */))
-        pspStubSpiFlashWipeCache(pThis);
-
-    /* Map the SMN region. */
-    void *pvMap;
-    int rc = pspSerialStubSmnMap(PSP_SPI_FLASH_SMN_ADDR + off, &pvMap);
-    if (!rc)
-    {
-        memcpy(pvBuf, pvMap, cbRead);
-        pspSerialStubSmnUnmapByPtr(pvMap);
-        pThis->offReadLast = off;
-    }
+    pspStubSpiFlashCacheInval(pThis, off, cbRead);
+    memcpy(pvBuf, (const void *)pspStubSpiFlashPtr(pThis, off), cbRead);
+    pThis->offLineCached = (off + cbRead - 1) & ~(SPI_FLASH_CACHE_LINE_SZ - 1);
 }
 
 
@@ -127,128 +171,61 @@ static void pspStubSpiFlashRead(PPSPPDUTRANSPINT pThis, uint32_t off, void *pvBu
  */
 static void pspStubSpiFlashWrite(PPSPPDUTRANSPINT pThis, uint32_t off, const void *pvBuf, size_t cbWrite)
 {
-    /* Map the SMN region. */
-    void *pvMap;
-    int rc = pspSerialStubSmnMap(PSP_SPI_FLASH_SMN_ADDR + off, &pvMap);
-    if (!rc)
-    {
-        volatile uint8_t *pbDst = (volatile uint8_t *)pvMap;
-        const uint8_t *pbSrc = (const uint8_t *)pvBuf;
+    volatile uint8_t *pbDst = pspStubSpiFlashPtr(pThis, off);
+    const uint8_t *pbSrc = (const uint8_t *)pvBuf;
 
-        while (cbWrite >= sizeof(uint32_t))
-        {
-            *(volatile uint32_t *)pbDst = *(uint32_t *)pbSrc;
-            pbDst   += sizeof(uint32_t);
-            pbSrc   += sizeof(uint32_t);
-            cbWrite -= sizeof(uint32_t);
-        }
-
-        if (cbWrite)
-            memcpy((uint8_t *)pbDst, pbSrc, cbWrite);
-        pspSerialStubSmnUnmapByPtr(pvMap);
+    /* Neither side needs to be aligned (ring offsets are byte granular), get the flash side aligned first. */
+    while (   cbWrite
+           && ((uintptr_t)pbDst & (sizeof(uint32_t) - 1)))
+    {
+        *pbDst++ = *pbSrc++;
+        cbWrite--;
     }
-}
 
-
-/**
- * Write status code to the respective port.
- *
- * @returns nothing.
- * @param   uSts                    Status code to write.
- */
-static inline void pspStubSpiFlashStsWr(uint32_t uSts)
-{
-    void *pvMap;
-    int rc = pspSerialStubSmnMap(PSP_SPI_FLASH_SMN_ADDR + SPI_MSG_CHAN_STS_OFF, &pvMap);
-    if (!rc)
+    while (cbWrite >= sizeof(uint32_t))
     {
-        *(volatile uint32_t *)pvMap = uSts;
-        uint32_t uIgnored = *((volatile uint32_t *)pvMap + 1);
-        pspSerialStubSmnUnmapByPtr(pvMap);
+        uint32_t u32;
+        memcpy(&u32, pbSrc, sizeof(u32));
+        *(volatile uint32_t *)pbDst = u32;
+        pbDst   += sizeof(uint32_t);
+        pbSrc   += sizeof(uint32_t);
+        cbWrite -= sizeof(uint32_t);
     }
+
+    if (cbWrite)
+        memcpy((uint8_t *)pbDst, pbSrc, cbWrite);
 }
 
 
 /**
- * Lock the SPI flash for access.
+ * Reads an index owned by the host, bypassing the read cache.
  *
- * @returns nothing.
+ * @returns The index value.
  * @param   pThis                   SPI flash transport instance data.
+ * @param   offIdx                  Flash offset of the index.
  */
-static void pspStubSpiFlashLock(PPSPPDUTRANSPINT pThis)
+static uint32_t pspStubSpiFlashRingIdxRead(PPSPPDUTRANSPINT pThis, uint32_t offIdx)
 {
-    if (!pThis->cSpiFlashLock)
-    {
-        /* Write the lock request until we see the magic value for the locked case. */
-        uint32_t u32Read = 0;
+    /* The host updates the index behind our back, evict its line if cached and fetch the word in one go. */
+    pspStubSpiFlashCacheInval(pThis, offIdx, sizeof(uint32_t));
 
-        uint32_t u32Write = SPI_FLASH_LOCK_LOCK_REQ_MAGIC;
-        pspStubSpiFlashWrite(pThis, SPI_FLASH_LOCK_OFF, &u32Write, sizeof(u32Write));
-        pspStubSpiFlashRead(pThis, 0, &u32Write, sizeof(u32Write)); /* Dummy */
-
-#if 1
-        uint32_t cRounds = 0;
-#endif
-        do
-        {
-            pspSerialStubDelayMs(PSP_SPI_FLASH_LOCK_WAIT); /* Wait a moment for the emulator process the request. */
-            pspStubSpiFlashRead(pThis, SPI_FLASH_LOCK_OFF, &u32Read, sizeof(u32Read));
-
-#if 1 /* Debug code for a hang where the locked magic is never read after a lock request. */
-            cRounds++;
-            if (cRounds >= 10)
-            {
-                pspStubSpiFlashStsWr(SPI_FLASH_LOCK_LOCK_REQ_MAGIC);
-                pspStubSpiFlashWipeCache(pThis);
-                cRounds = 0;
-            }
-#endif
-        }
-        while (u32Read != SPI_FLASH_LOCK_LOCKED_MAGIC);
-    }
-
-    pThis->cSpiFlashLock++;
+    uint32_t u32Idx = *(volatile uint32_t *)pspStubSpiFlashPtr(pThis, offIdx);
+    pThis->offLineCached = offIdx;
+    return u32Idx;
 }
 
 
 /**
- * Unlock the SPI flash for access.
+ * Publishes an index owned by us.
  *
  * @returns nothing.
  * @param   pThis                   SPI flash transport instance data.
+ * @param   offIdx                  Flash offset of the index.
+ * @param   u32Idx                  The index value.
  */
-static void pspStubSpiFlashUnlock(PPSPPDUTRANSPINT pThis)
+static void pspStubSpiFlashRingIdxWrite(PPSPPDUTRANSPINT pThis, uint32_t offIdx, uint32_t u32Idx)
 {
-    pThis->cSpiFlashLock--;
-    if (!pThis->cSpiFlashLock)
-    {
-        /* Write the unlock request and wait till we see the magic value for the unlocked case. */
-        uint32_t u32Read = 0;
-
-        uint32_t u32Write = SPI_FLASH_LOCK_UNLOCK_REQ_MAGIC;
-        pspStubSpiFlashWrite(pThis, SPI_FLASH_LOCK_OFF, &u32Write, sizeof(u32Write));
-        pspStubSpiFlashRead(pThis, 0, &u32Write, sizeof(u32Write)); /* Dummy */
-
-#if 1
-        uint32_t cRounds = 0;
-#endif
-        do
-        {
-            pspSerialStubDelayMs(PSP_SPI_FLASH_LOCK_WAIT); /* Wait a moment for the emulator process the request. */
-            pspStubSpiFlashRead(pThis, SPI_FLASH_LOCK_OFF, &u32Read, sizeof(u32Read));
-
-#if 1 /* Debug code for a hang where the unlocked magic is never read after a unlock request. */
-            cRounds++;
-            if (cRounds >= 10)
-            {
-                pspStubSpiFlashStsWr(SPI_FLASH_LOCK_UNLOCK_REQ_MAGIC);
-                pspStubSpiFlashWipeCache(pThis);
-                cRounds = 0;
-            }
-#endif
-        }
-        while (u32Read != SPI_FLASH_LOCK_UNLOCKED_MAGIC);
-    }
+    *(volatile uint32_t *)pspStubSpiFlashPtr(pThis, offIdx) = u32Idx;
 }
 
 
@@ -256,19 +233,40 @@ static int pspStubSpiFlashTranspWrite(PSPPDUTRANSP hPduTransp, const void *pvBuf
 {
     PPSPPDUTRANSPINT pThis = hPduTransp;
 
-    pspStubSpiFlashLock(pThis);
     size_t cbWriteLeft = cbWrite;
-    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
 
     while (cbWriteLeft)
     {
-        size_t cbThisWrite = MIN(256, cbWriteLeft);
+        /* Only go to the flash for the host read offset if the ring looks full from what we know. */
+        uint32_t cbFree = SPI_MSG_RING_SZ - (pThis->offTxHead - pThis->offTxTail);
+        if (!cbFree)
+        {
+            uint32_t tsStart = pspSerialStubTicksGet();
+            do
+            {
+                pThis->offTxTail = pspStubSpiFlashRingIdxRead(pThis, SPI_MSG_RING_P2H_TAIL_OFF);
+                cbFree = SPI_MSG_RING_SZ - (pThis->offTxHead - pThis->offTxTail);
+            } while (!cbFree);
+            pThis->Stats.cTicksStallWrite += pspSerialStubTicksGet() - tsStart;
+            pThis->Stats.cRetries++;
+        }
+
+        uint32_t offRing = pThis->offTxHead & (SPI_MSG_RING_SZ - 1);
+        size_t cbThisWrite = MIN(cbWriteLeft, MIN(cbFree, SPI_MSG_RING_SZ - offRing));
+
+        pspStubSpiFlashWrite(pThis, SPI_MSG_RING_P2H_DATA_OFF + offRing, pbBuf, cbThisWrite);
+        pThis->offTxHead += cbThisWrite;
+        pspStubSpiFlashRingIdxWrite(pThis, SPI_MSG_RING_P2H_HEAD_OFF, pThis->offTxHead);
 
-        pspStubSpiFlashWrite(pThis, SPI_MSG_CHAN_HDR_OFF, pbBuf, cbThisWrite);
         pbBuf       += cbThisWrite;
         cbWriteLeft -= cbThisWrite;
     }
-    pspStubSpiFlashUnlock(pThis);
+
+    pThis->Stats.cWrites++;
+    pThis->Stats.cbWritten += cbWrite;
+    if (pcbWritten)
+        *pcbWritten = cbWrite;
 
     return INF_SUCCESS;
 }
@@ -283,28 +281,31 @@ static int pspStubSpiFlashTranspRead(PSPPDUTRANSP hPduTransp, void *pvBuf, size_
 
     while (cbReadLeft)
     {
-        pspStubSpiFlashLock(pThis);
-
-        /* Simple case, read the number of bytes available and get them. */
-        size_t cbThisRead = MIN(pspStubSpiFlashTranspPeek(pThis), cbReadLeft);
-        if (cbThisRead)
+        size_t cbAvail = pspStubSpiFlashTranspPeek(pThis);
+        if (!cbAvail)
         {
-            pspStubSpiFlashRead(pThis, SPI_MSG_CHAN_HDR_OFF, pbBuf, cbThisRead);
-            pbBuf       += cbThisRead;
-            cbReadLeft  -= cbThisRead;
-            pspStubSpiFlashWrite(pThis, SPI_MSG_CHAN_AVAIL_OFF, &cbThisRead, sizeof(cbThisRead));
-            pspStubSpiFlashRead(pThis, 0, &cbThisRead, sizeof(cbThisRead)); /* Dummy */
+            uint32_t tsStart = pspSerialStubTicksGet();
+            while (!(cbAvail = pspStubSpiFlashTranspPeek(pThis)));
+            pThis->Stats.cTicksStallRead += pspSerialStubTicksGet() - tsStart;
+            pThis->Stats.cRetries++;
         }
 
-#if 0
-        pThis->cbReadAvail -= cbThisRead;
-        /* Update the amount of data we can read here under the lock if we've read everything. */
-        if (!pThis->cbReadAvail)
-            pThis->cbReadAvail = pspStubSpiFlashTranspPeek(pThis);
-#endif
-        pspStubSpiFlashUnlock(pThis);
+        uint32_t offRing = pThis->offRxTail & (SPI_MSG_RING_SZ - 1);
+        size_t cbThisRead = MIN(cbReadLeft, MIN(cbAvail, SPI_MSG_RING_SZ - offRing));
+
+        pspStubSpiFlashRead(pThis, SPI_MSG_RING_H2P_DATA_OFF + offRing, pbBuf, cbThisRead);
+        pThis->offRxTail += cbThisRead;
+        pspStubSpiFlashRingIdxWrite(pThis, SPI_MSG_RING_H2P_TAIL_OFF, pThis->offRxTail);
+
+        pbBuf      += cbThisRead;
+        cbReadLeft -= cbThisRead;
     }
 
+    pThis->Stats.cReads++;
+    pThis->Stats.cbRead += cbRead;
+    if (pcbRead)
+        *pcbRead = cbRead;
+
     return INF_SUCCESS;
 }
 
@@ -313,50 +314,45 @@ static size_t pspStubSpiFlashTranspPeek(PSPPDUTRANSP hPduTransp)
 {
     PPSPPDUTRANSPINT pThis = hPduTransp;
 
-#if 0
-    /* Don't bother with checking if there is still something left. */
-    if (pThis->cbReadAvail)
-        return pThis->cbReadAvail;
-#endif
-
-    uint32_t u32Avail = 0;
-    uint32_t u32ReadAvailMagic = 0;
-    pspStubSpiFlashRead(pThis, SPI_MSG_CHAN_AVAIL_F_OFF, &u32ReadAvailMagic, sizeof(u32ReadAvailMagic));
-    if (u32ReadAvailMagic == SPI_MSG_CHAN_AVAIL_MAGIC)
-    {
-        /*
-         * The magic indicates something is available for reading, now do the locking and get the actual
-         * number of bytes available.
-         */
-        pspStubSpiFlashLock(pThis);
-        pspStubSpiFlashRead(pThis, SPI_MSG_CHAN_AVAIL_OFF, &u32Avail, sizeof(u32Avail));
-        pspStubSpiFlashUnlock(pThis);
-        pThis->cbReadAvail = u32Avail;
-    }
+    /* Only go to the flash for the host write offset once everything known to be there was consumed. */
+    if (pThis->offRxHead == pThis->offRxTail)
+        pThis->offRxHead = pspStubSpiFlashRingIdxRead(pThis, SPI_MSG_RING_H2P_HEAD_OFF);
 
-    return u32Avail;
+    return pThis->offRxHead - pThis->offRxTail;
 }
 
 
 static int pspStubSpiFlashTranspEnd(PSPPDUTRANSP hPduTransp)
 {
-    PPSPPDUTRANSPINT pThis = hPduTransp;
-    pspStubSpiFlashUnlock(pThis);
+    /* Nothing to do, the rings don't need any locking. */
     return INF_SUCCESS;
 }
 
 
 static int pspStubSpiFlashTranspBegin(PSPPDUTRANSP hPduTransp)
+{
+    /* Nothing to do, the rings don't need any locking. */
+    return INF_SUCCESS;
+}
+
+
+static int pspStubSpiFlashTranspStatsQuery(PSPPDUTRANSP hPduTransp, PPSPPDUTRANSPSTATS pStats, bool fReset)
 {
     PPSPPDUTRANSPINT pThis = hPduTransp;
-    pspStubSpiFlashLock(pThis);
+
+    *pStats = pThis->Stats;
+    if (fReset)
+        memset(&pThis->Stats, 0, sizeof(pThis->Stats));
     return INF_SUCCESS;
 }
 
 
 static void pspStubSpiFlashTranspTerm(PSPPDUTRANSP hPduTransp)
 {
-    /* Nothing to do. */
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    pspSerialStubSmnUnmapByPtr((void *)pThis->pbMsgChan);
+    pThis->pbMsgChan = NULL;
 }
 
 
@@ -367,17 +363,32 @@ static int pspStubSpiFlashTranspInit(void *pvMem, size_t cbMem, PPSPPDUTRANSP ph
 
     PPSPPDUTRANSPINT pThis = (PPSPPDUTRANSPINT)pvMem;
 
-    pThis->cSpiFlashLock = 0;
-    pThis->offReadLast   = 0xffff0000; /* Invalid, this will always wipe the cache. */
-    pThis->cbReadAvail   = 0;
+    pThis->offLineCached = SPI_FLASH_CACHE_LINE_INVALID;
+    memset(&pThis->Stats, 0, sizeof(pThis->Stats));
 
-    uint32_t u32Magic;
-    do
+    /* Map the message channel once, it stays mapped until the transport is terminated. */
+    void *pvMap = NULL;
+    int rc = pspSerialStubSmnMap(PSP_SPI_FLASH_SMN_ADDR + SPI_MSG_RING_HDR_OFF, &pvMap);
+    if (rc)
+        return rc;
+    pThis->pbMsgChan = (volatile uint8_t *)pvMap;
+
+    /* Wait for the host to set up the rings, give up if there is nobody so another transport can be used. */
+    uint32_t tsStart = pspSerialStubTicksGet();
+    while (pspStubSpiFlashRingIdxRead(pThis, SPI_MSG_RING_HDR_OFF) != SPI_MSG_RING_MAGIC)
     {
-        pspStubSpiFlashRead(pThis, 0, &u32Magic, sizeof(u32Magic)); /* Read some dummy first, to flush the SPI read cache. */
-        pspStubSpiFlashRead(pThis, SPI_FLASH_LOCK_OFF, &u32Magic, sizeof(u32Magic));
+        if (pspSerialStubTicksGet() - tsStart >= SPI_FLASH_INIT_TIMEOUT_MS * SPI_FLASH_TICKS_PER_MS)
+        {
+            pspStubSpiFlashTranspTerm(pThis);
+            return ERR_INVALID_STATE;
+        }
     }
-    while (u32Magic != SPI_FLASH_LOCK_UNLOCKED_MAGIC);
+
+    /* Pick up where the indices are, the stub might have been restarted without the host resetting the rings. */
+    pThis->offTxHead = pspStubSpiFlashRingIdxRead(pThis, SPI_MSG_RING_P2H_HEAD_OFF);
+    pThis->offTxTail = pspStubSpiFlashRingIdxRead(pThis, SPI_MSG_RING_P2H_TAIL_OFF);
+    pThis->offRxTail = pspStubSpiFlashRingIdxRead(pThis, SPI_MSG_RING_H2P_TAIL_OFF);
+    pThis->offRxHead = pThis->offRxTail;
 
     *phPduTransp = pThis;
     return INF_SUCCESS;
@@ -401,6 +412,24 @@ const PSPPDUTRANSPIF g_SpiFlashTransp =
     /** pfnRead */
     pspStubSpiFlashTranspRead,
     /** pfnWrite */
-    pspStubSpiFlashTranspWrite
+    pspStubSpiFlashTranspWrite,
+    /** pfnLinkSpeedSet */
+    NULL,
+    /** pfnWriteNB */
+    NULL,
+    /** pfnPoll */
+    NULL,
+    /** pfnFlush */
+    NULL,
+    /** pfnIrqSet */
+    NULL,
+    /** pfnIrq */
+    NULL,
+    /** pfnLinkSpeedGet */
+    NULL,
+    /** pfnLinkCalibrate */
+    NULL,
+    /** pfnStatsQuery */
+    pspStubSpiFlashTranspStatsQuery
 };
 
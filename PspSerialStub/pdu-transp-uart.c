@@ -21,6 +21,7 @@
  */
 #include <types.h>
 #include <cdefs.h>
+#include <string.h>
 #include <err.h>
 #include <log.h>
 
@@ -29,6 +30,21 @@
 
 #include "pdu-transp.h"
 #include "psp-serial-stub-internal.h"
+#ifdef PSP_SERIAL_STUB_HOST
+# include "uart-16550.h"
+#endif
+
+
+/**
+ * Input clock of the UART in Hz, the divisors for all baud rates are derived from it.
+ * Defaults to the standard 1.8432MHz clock which tops out at 115200 baud. Override it (UART_CLK_HZ= in the Makefile)
+ * when the Super I/O was set up with a high speed clock, 24MHz for example allows up to 1.5Mbit/s.
+ */
+#ifndef PSP_SERIAL_STUB_UART_CLK_HZ
+# define PSP_SERIAL_STUB_UART_CLK_HZ    PSP_UART_CLOCK_HZ_DEFAULT
+#endif
+/** Baud rate used by the transport, everything the clock allows with less than 3% error is possible. */
+#define PSP_SERIAL_STUB_UART_BPS        115200
 
 
 /**
@@ -44,6 +60,10 @@ typedef struct PSPPDUTRANSPINT
     volatile void               *pvUart;
     /** UART device instance. */
     PSPUART                     Uart;
+    /** The currently configured baud rate. */
+    uint32_t                    uBps;
+    /** Transport channel statistics. */
+    PSPPDUTRANSPSTATS           Stats;
 } PSPPDUTRANSPINT;
 /** Pointer to the x86 UART PDU transport channel instance. */
 typedef PSPPDUTRANSPINT *PPSPPDUTRANSPINT;
@@ -80,18 +100,133 @@ static int pspStubX86UartRegWrite(PCPSPIODEVIF pIfIoDev, uint32_t offReg, const
 
 
 static int pspStubUartTranspWrite(PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    size_t cbWritten = 0;
+    int rc = INF_SUCCESS;
+
+    /* Same as PSPUartWrite() but accounts for the time spent waiting for room in the transmit ring. */
+    pThis->Stats.cWrites++;
+    while (cbWrite)
+    {
+        if (!PSPUartGetTxSpaceAvail(&pThis->Uart))
+        {
+            uint32_t tsStart = pspSerialStubTicksGet();
+            while (   rc == INF_SUCCESS
+                   && !PSPUartGetTxSpaceAvail(&pThis->Uart))
+                rc = PSPUartTxPump(&pThis->Uart);
+            pThis->Stats.cTicksStallWrite += pspSerialStubTicksGet() - tsStart;
+            pThis->Stats.cRetries++;
+            if (rc != INF_SUCCESS)
+                break;
+        }
+
+        size_t cbThisWritten = 0;
+        rc = PSPUartWriteNB(&pThis->Uart, pbBuf, cbWrite, &cbThisWritten);
+        if (rc != INF_SUCCESS)
+            break;
+
+        pbBuf     += cbThisWritten;
+        cbWrite   -= cbThisWritten;
+        cbWritten += cbThisWritten;
+    }
+
+    pThis->Stats.cbWritten += cbWritten;
+    if (rc != INF_SUCCESS)
+        pThis->Stats.cErrors++;
+    else if (pcbWritten)
+        *pcbWritten = cbWritten;
+
+    return rc;
+}
+
+
+static int pspStubUartTranspWriteNB(PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    int rc = PSPUartWriteNB(&pThis->Uart, pvBuf, cbWrite, pcbWritten);
+    pThis->Stats.cWrites++;
+    if (rc == INF_SUCCESS)
+        pThis->Stats.cbWritten += *pcbWritten;
+    else if (rc == INF_TRY_AGAIN)
+        pThis->Stats.cRetries++;
+    else
+        pThis->Stats.cErrors++;
+
+    return rc;
+}
+
+
+static int pspStubUartTranspPoll(PSPPDUTRANSP hPduTransp)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    return PSPUartTxPump(&pThis->Uart);
+}
+
+
+static int pspStubUartTranspFlush(PSPPDUTRANSP hPduTransp)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    return PSPUartTxFlush(&pThis->Uart);
+}
+
+
+static int pspStubUartTranspIrqSet(PSPPDUTRANSP hPduTransp, bool fEnable)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    return PSPUartRxIrqSet(&pThis->Uart, fEnable);
+}
+
+
+static bool pspStubUartTranspIrq(PSPPDUTRANSP hPduTransp)
 {
     PPSPPDUTRANSPINT pThis = hPduTransp;
 
-    return PSPUartWrite(&pThis->Uart, pvBuf, cbWrite, pcbWritten);
+    return PSPUartIrqHandler(&pThis->Uart);
 }
 
 
 static int pspStubUartTranspRead(PSPPDUTRANSP hPduTransp, void *pvBuf, size_t cbRead, size_t *pcbRead)
 {
     PPSPPDUTRANSPINT pThis = hPduTransp;
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    size_t cbActuallyRead = 0;
+    int rc = INF_SUCCESS;
+
+    /* Same as PSPUartRead() but accounts for the time spent waiting for data to arrive. */
+    pThis->Stats.cReads++;
+    while (cbRead)
+    {
+        if (!PSPUartGetDataAvail(&pThis->Uart))
+        {
+            uint32_t tsStart = pspSerialStubTicksGet();
+            while (!PSPUartGetDataAvail(&pThis->Uart));
+            pThis->Stats.cTicksStallRead += pspSerialStubTicksGet() - tsStart;
+            pThis->Stats.cRetries++;
+        }
+
+        size_t cbThisRead = 0;
+        rc = PSPUartReadNB(&pThis->Uart, pbBuf, cbRead, &cbThisRead);
+        if (rc != INF_SUCCESS)
+            break;
+
+        pbBuf          += cbThisRead;
+        cbRead         -= cbThisRead;
+        cbActuallyRead += cbThisRead;
+    }
 
-    return PSPUartRead(&pThis->Uart, pvBuf, cbRead, pcbRead);
+    pThis->Stats.cbRead += cbActuallyRead;
+    if (rc != INF_SUCCESS)
+        pThis->Stats.cErrors++;
+    else if (pcbRead)
+        *pcbRead = cbActuallyRead;
+
+    return rc;
 }
 
 
@@ -117,9 +252,52 @@ static int pspStubUartTranspBegin(PSPPDUTRANSP hPduTransp)
 }
 
 
+static int pspStubUartTranspLinkSpeedSet(PSPPDUTRANSP hPduTransp, uint32_t uBps, uint32_t *puBpsOld)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    /* Rates the input clock can't hit within the divisor tolerance are rejected by the driver. */
+    int rc = PSPUartParamsSet(&pThis->Uart, uBps, PSPUARTDATABITS_8BITS, PSPUARTPARITY_NONE, PSPUARTSTOPBITS_1BIT);
+    if (!rc)
+    {
+        if (puBpsOld)
+            *puBpsOld = pThis->uBps;
+        pThis->uBps = uBps;
+    }
+
+    return rc;
+}
+
+
+static int pspStubUartTranspLinkSpeedGet(PSPPDUTRANSP hPduTransp, uint32_t *puBps, uint32_t *pcbPerSec, bool *pfCalibrated)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    *puBps        = pThis->uBps;
+    *pcbPerSec    = pThis->uBps / 10; /* 8N1 takes 10 bits for every byte. */
+    *pfCalibrated = false;
+    return INF_SUCCESS;
+}
+
+
+static int pspStubUartTranspStatsQuery(PSPPDUTRANSP hPduTransp, PPSPPDUTRANSPSTATS pStats, bool fReset)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    *pStats = pThis->Stats;
+    if (fReset)
+        memset(&pThis->Stats, 0, sizeof(pThis->Stats));
+    return INF_SUCCESS;
+}
+
+
 static void pspStubUartTranspTerm(PSPPDUTRANSP hPduTransp)
 {
-    /* Nothing to do. */
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    /* Don't cut off anything still queued and leave the UART polled for whoever comes next. */
+    PSPUartTxFlush(&pThis->Uart);
+    PSPUartRxIrqSet(&pThis->Uart, false /*fEnable*/);
 }
 
 
@@ -132,18 +310,30 @@ static int pspStubUartTranspInit(void *pvMem, size_t cbMem, PPSPPDUTRANSP phPduT
 
     pThis->PhysX86UartBase     = 0xfffdfc0003f8;
     pThis->pvUart              = NULL;
+    memset(&pThis->Stats, 0, sizeof(pThis->Stats));
     pThis->IfIoDev.pfnRegRead  = pspStubX86UartRegRead;
     pThis->IfIoDev.pfnRegWrite = pspStubX86UartRegWrite;
 
+#ifdef PSP_SERIAL_STUB_HOST
+    /* There is no UART to map on the host, the 16550 model provides the registers. */
+    PCPSPIODEVIF pIfIoDev = pspStubHostUartIoDevGet();
+    int rc = INF_SUCCESS;
+#else
+    PCPSPIODEVIF pIfIoDev = &pThis->IfIoDev;
     int rc = pspSerialStubX86PhysMap(pThis->PhysX86UartBase, true /*fMmio*/, (void **)&pThis->pvUart);
+#endif
     if (!rc)
     {
-        rc = PSPUartCreate(&pThis->Uart, &pThis->IfIoDev);
+        rc = PSPUartCreate(&pThis->Uart, pIfIoDev);
         if (!rc)
         {
-            rc = PSPUartParamsSet(&pThis->Uart, 115200, PSPUARTDATABITS_8BITS, PSPUARTPARITY_NONE, PSPUARTSTOPBITS_1BIT);
+            PSPUartClockSet(&pThis->Uart, PSP_SERIAL_STUB_UART_CLK_HZ);
+            rc = PSPUartParamsSet(&pThis->Uart, PSP_SERIAL_STUB_UART_BPS, PSPUARTDATABITS_8BITS, PSPUARTPARITY_NONE, PSPUARTSTOPBITS_1BIT);
             if (!rc)
+            {
+                pThis->uBps  = PSP_SERIAL_STUB_UART_BPS;
                 *phPduTransp = pThis;
+            }
         }
     }
 
@@ -168,6 +358,24 @@ const PSPPDUTRANSPIF g_UartTransp =
     /** pfnRead */
     pspStubUartTranspRead,
     /** pfnWrite */
-    pspStubUartTranspWrite
+    pspStubUartTranspWrite,
+    /** pfnLinkSpeedSet */
+    pspStubUartTranspLinkSpeedSet,
+    /** pfnWriteNB */
+    pspStubUartTranspWriteNB,
+    /** pfnPoll */
+    pspStubUartTranspPoll,
+    /** pfnFlush */
+    pspStubUartTranspFlush,
+    /** pfnIrqSet */
+    pspStubUartTranspIrqSet,
+    /** pfnIrq */
+    pspStubUartTranspIrq,
+    /** pfnLinkSpeedGet */
+    pspStubUartTranspLinkSpeedGet,
+    /** pfnLinkCalibrate */
+    NULL,
+    /** pfnStatsQuery */
+    pspStubUartTranspStatsQuery
 };
 
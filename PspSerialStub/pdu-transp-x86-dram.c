@@ -0,0 +1,370 @@
+/** @file
+ * PSP app - x86 DRAM ring PDU transport channel.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <types.h>
+#include <cdefs.h>
+#include <string.h>
+#include <err.h>
+#include <log.h>
+
+#include "pdu-transp.h"
+#include "psp-serial-stub-internal.h"
+#include "x86-dram-chan.h"
+
+
+#ifndef PSP_X86_DRAM_CHAN_ADDR
+/**
+ * x86 physical address of the message channel, the x86 OS must keep the region reserved
+ * (memmap=16M$0x7f000000 on Linux for example). Can be overridden from the build.
+ */
+# define PSP_X86_DRAM_CHAN_ADDR         0x7f000000ULL
+#endif
+
+/** Orders the accesses to the channel, the data must be visible before the index publishing it. */
+#define PSP_X86_DRAM_BARRIER()          asm volatile("dmb #0xf\n": : :"memory")
+/** Number of timer ticks (100MHz) per millisecond. */
+#define PSP_X86_DRAM_TICKS_PER_MS       100000
+/** How long to wait for the host to set up the channel, the transport fails to initialize afterwards. */
+#define PSP_X86_DRAM_INIT_TIMEOUT_MS    1000
+/** How long the host may not make any progress on a ring before a blocking transfer fails. */
+#define PSP_X86_DRAM_XFER_TIMEOUT_MS    5000
+
+/**
+ * x86 DRAM transport channel.
+ */
+typedef struct PSPPDUTRANSPINT
+{
+    /** Free running write offset of the PSP to host ring (owned by us). */
+    uint32_t                    offTxHead;
+    /** Last seen read offset of the PSP to host ring (owned by the host). */
+    uint32_t                    offTxTail;
+    /** Free running read offset of the host to PSP ring (owned by us). */
+    uint32_t                    offRxTail;
+    /** Last seen write offset of the host to PSP ring (owned by the host). */
+    uint32_t                    offRxHead;
+    /** Size of each ring in bytes as configured by the host. */
+    uint32_t                    cbRing;
+    /** The x86 mapping of the message channel, kept for the lifetime of the transport. */
+    volatile uint8_t            *pbMsgChan;
+} PSPPDUTRANSPINT;
+/** Pointer to the x86 DRAM PDU transport channel instance. */
+typedef PSPPDUTRANSPINT *PPSPPDUTRANSPINT;
+
+
+static size_t pspStubX86DramTranspPeek(PSPPDUTRANSP hPduTransp);
+
+
+/**
+ * Returns whether the given amount of milliseconds passed since the given timestamp.
+ *
+ * @returns Flag whether the timeout expired.
+ * @param   tsStart                 The start timestamp in timer ticks.
+ * @param   cMillies                The timeout in milliseconds.
+ */
+static inline bool pspStubX86DramTimeoutExpired(uint32_t tsStart, uint32_t cMillies)
+{
+    return pspSerialStubTicksGet() - tsStart >= cMillies * PSP_X86_DRAM_TICKS_PER_MS;
+}
+
+
+/**
+ * Reads an index of the channel.
+ *
+ * @returns The index value.
+ * @param   pThis                   x86 DRAM transport instance data.
+ * @param   offIdx                  Channel offset of the index.
+ */
+static inline uint32_t pspStubX86DramIdxRead(PPSPPDUTRANSPINT pThis, uint32_t offIdx)
+{
+    uint32_t u32Idx = *(volatile uint32_t *)(pThis->pbMsgChan + offIdx);
+
+    /* Nothing guarded by the index may be read before the index itself. */
+    PSP_X86_DRAM_BARRIER();
+    return u32Idx;
+}
+
+
+/**
+ * Publishes an index owned by us.
+ *
+ * @returns nothing.
+ * @param   pThis                   x86 DRAM transport instance data.
+ * @param   offIdx                  Channel offset of the index.
+ * @param   u32Idx                  The index value.
+ */
+static inline void pspStubX86DramIdxWrite(PPSPPDUTRANSPINT pThis, uint32_t offIdx, uint32_t u32Idx)
+{
+    PSP_X86_DRAM_BARRIER();
+    *(volatile uint32_t *)(pThis->pbMsgChan + offIdx) = u32Idx;
+}
+
+
+static int pspStubX86DramTranspWriteNB(PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    /* Only go to the channel for the host read offset if the ring looks full from what we know. */
+    uint32_t cbFree = pThis->cbRing - (pThis->offTxHead - pThis->offTxTail);
+    if (cbFree < cbWrite)
+    {
+        pThis->offTxTail = pspStubX86DramIdxRead(pThis, X86_DRAM_CHAN_P2H_TAIL_OFF);
+        cbFree = pThis->cbRing - (pThis->offTxHead - pThis->offTxTail);
+    }
+
+    size_t cbWritten = 0;
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    uint32_t offData = X86_DRAM_CHAN_P2H_DATA_OFF(pThis->cbRing);
+    while (   cbWrite
+           && cbFree)
+    {
+        uint32_t offRing = pThis->offTxHead & (pThis->cbRing - 1);
+        size_t cbThisWrite = MIN(cbWrite, MIN(cbFree, pThis->cbRing - offRing));
+
+        memcpy((uint8_t *)pThis->pbMsgChan + offData + offRing, pbBuf, cbThisWrite);
+        pThis->offTxHead += cbThisWrite;
+
+        pbBuf     += cbThisWrite;
+        cbWrite   -= cbThisWrite;
+        cbFree    -= cbThisWrite;
+        cbWritten += cbThisWrite;
+    }
+
+    if (!cbWritten)
+        return INF_TRY_AGAIN;
+
+    /* Publish everything in one go, including the part wrapping around. */
+    pspStubX86DramIdxWrite(pThis, X86_DRAM_CHAN_P2H_HEAD_OFF, pThis->offTxHead);
+    *pcbWritten = cbWritten;
+    return INF_SUCCESS;
+}
+
+
+static int pspStubX86DramTranspWrite(PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten)
+{
+    size_t cbWriteLeft = cbWrite;
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    uint32_t tsStart = pspSerialStubTicksGet();
+
+    while (cbWriteLeft)
+    {
+        size_t cbThisWritten = 0;
+        int rc = pspStubX86DramTranspWriteNB(hPduTransp, pbBuf, cbWriteLeft, &cbThisWritten);
+        if (rc == INF_TRY_AGAIN)
+        {
+            /* The host stopped reading. */
+            if (pspStubX86DramTimeoutExpired(tsStart, PSP_X86_DRAM_XFER_TIMEOUT_MS))
+                return ERR_INVALID_STATE;
+            continue;
+        }
+
+        pbBuf       += cbThisWritten;
+        cbWriteLeft -= cbThisWritten;
+        tsStart      = pspSerialStubTicksGet();
+    }
+
+    if (pcbWritten)
+        *pcbWritten = cbWrite;
+
+    return INF_SUCCESS;
+}
+
+
+static int pspStubX86DramTranspRead(PSPPDUTRANSP hPduTransp, void *pvBuf, size_t cbRead, size_t *pcbRead)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    size_t cbReadLeft = cbRead;
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    uint32_t tsStart = pspSerialStubTicksGet();
+
+    while (cbReadLeft)
+    {
+        size_t cbAvail = pspStubX86DramTranspPeek(pThis);
+        if (!cbAvail)
+        {
+            /* The host stopped writing in the middle of something. */
+            if (pspStubX86DramTimeoutExpired(tsStart, PSP_X86_DRAM_XFER_TIMEOUT_MS))
+                return ERR_INVALID_STATE;
+            continue;
+        }
+
+        uint32_t offRing = pThis->offRxTail & (pThis->cbRing - 1);
+        size_t cbThisRead = MIN(cbReadLeft, MIN(cbAvail, pThis->cbRing - offRing));
+
+        memcpy(pbBuf, (const uint8_t *)pThis->pbMsgChan + X86_DRAM_CHAN_H2P_DATA_OFF + offRing, cbThisRead);
+        pThis->offRxTail += cbThisRead;
+        pspStubX86DramIdxWrite(pThis, X86_DRAM_CHAN_H2P_TAIL_OFF, pThis->offRxTail);
+
+        pbBuf      += cbThisRead;
+        cbReadLeft -= cbThisRead;
+        tsStart     = pspSerialStubTicksGet();
+    }
+
+    if (pcbRead)
+        *pcbRead = cbRead;
+
+    return INF_SUCCESS;
+}
+
+
+static size_t pspStubX86DramTranspPeek(PSPPDUTRANSP hPduTransp)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    /* Only go to the channel for the host write offset once everything known to be there was consumed. */
+    if (pThis->offRxHead == pThis->offRxTail)
+        pThis->offRxHead = pspStubX86DramIdxRead(pThis, X86_DRAM_CHAN_H2P_HEAD_OFF);
+
+    return pThis->offRxHead - pThis->offRxTail;
+}
+
+
+static int pspStubX86DramTranspFlush(PSPPDUTRANSP hPduTransp)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+    uint32_t tsStart = pspSerialStubTicksGet();
+
+    /* Wait for the host to consume everything. */
+    while (pThis->offTxTail != pThis->offTxHead)
+    {
+        uint32_t offTxTail = pspStubX86DramIdxRead(pThis, X86_DRAM_CHAN_P2H_TAIL_OFF);
+        if (offTxTail != pThis->offTxTail)
+        {
+            pThis->offTxTail = offTxTail;
+            tsStart = pspSerialStubTicksGet();
+        }
+        else if (pspStubX86DramTimeoutExpired(tsStart, PSP_X86_DRAM_XFER_TIMEOUT_MS))
+            return ERR_INVALID_STATE;
+    }
+
+    return INF_SUCCESS;
+}
+
+
+static int pspStubX86DramTranspEnd(PSPPDUTRANSP hPduTransp)
+{
+    /* Nothing to do, the rings don't need any locking. */
+    return INF_SUCCESS;
+}
+
+
+static int pspStubX86DramTranspBegin(PSPPDUTRANSP hPduTransp)
+{
+    /* Nothing to do, the rings don't need any locking. */
+    return INF_SUCCESS;
+}
+
+
+static void pspStubX86DramTranspTerm(PSPPDUTRANSP hPduTransp)
+{
+    PPSPPDUTRANSPINT pThis = hPduTransp;
+
+    pspSerialStubX86PhysUnmapByPtr((void *)pThis->pbMsgChan);
+    pThis->pbMsgChan = NULL;
+}
+
+
+static int pspStubX86DramTranspInit(void *pvMem, size_t cbMem, PPSPPDUTRANSP phPduTransp)
+{
+    if (cbMem < sizeof(PSPPDUTRANSPINT))
+        return ERR_INVALID_PARAMETER;
+
+    PPSPPDUTRANSPINT pThis = (PPSPPDUTRANSPINT)pvMem;
+
+    /* Map the message channel once, it stays mapped until the transport is terminated. */
+    void *pvMap = NULL;
+    int rc = pspSerialStubX86PhysMap(PSP_X86_DRAM_CHAN_ADDR, false /*fMmio*/, &pvMap);
+    if (rc)
+        return rc;
+    pThis->pbMsgChan = (volatile uint8_t *)pvMap;
+
+    /* Wait for the host to set up the rings, give up if there is nobody so another transport can be used. */
+    uint32_t tsStart = pspSerialStubTicksGet();
+    while (pspStubX86DramIdxRead(pThis, X86_DRAM_CHAN_MAGIC_OFF) != X86_DRAM_CHAN_MAGIC)
+    {
+        if (pspStubX86DramTimeoutExpired(tsStart, PSP_X86_DRAM_INIT_TIMEOUT_MS))
+        {
+            pspStubX86DramTranspTerm(pThis);
+            return ERR_INVALID_STATE;
+        }
+    }
+
+    /* The whole channel must be reachable through the single 64MB mapping window. */
+    uint32_t cbRing = pspStubX86DramIdxRead(pThis, X86_DRAM_CHAN_RING_SZ_OFF);
+    uint32_t offWindow = (uint32_t)(PSP_X86_DRAM_CHAN_ADDR & (_64M - 1));
+    if (   cbRing < X86_DRAM_CHAN_RING_SZ_MIN
+        || cbRing > X86_DRAM_CHAN_RING_SZ_MAX
+        || (cbRing & (cbRing - 1))
+        || offWindow + X86_DRAM_CHAN_SZ(cbRing) > _64M)
+    {
+        pspStubX86DramTranspTerm(pThis);
+        return ERR_INVALID_PARAMETER;
+    }
+    pThis->cbRing = cbRing;
+
+    /* Pick up where the indices are, the stub might have been restarted without the host resetting the rings. */
+    pThis->offTxHead = pspStubX86DramIdxRead(pThis, X86_DRAM_CHAN_P2H_HEAD_OFF);
+    pThis->offTxTail = pspStubX86DramIdxRead(pThis, X86_DRAM_CHAN_P2H_TAIL_OFF);
+    pThis->offRxTail = pspStubX86DramIdxRead(pThis, X86_DRAM_CHAN_H2P_TAIL_OFF);
+    pThis->offRxHead = pThis->offRxTail;
+
+    *phPduTransp = pThis;
+    return INF_SUCCESS;
+}
+
+
+const PSPPDUTRANSPIF g_X86DramTransp =
+{
+    /** cbState */
+    sizeof(PSPPDUTRANSPINT),
+    /** pfnInit */
+    pspStubX86DramTranspInit,
+    /** pfnTerm */
+    pspStubX86DramTranspTerm,
+    /** pfnBegin */
+    pspStubX86DramTranspBegin,
+    /** pfnEnd */
+    pspStubX86DramTranspEnd,
+    /** pfnPeek */
+    pspStubX86DramTranspPeek,
+    /** pfnRead */
+    pspStubX86DramTranspRead,
+    /** pfnWrite */
+    pspStubX86DramTranspWrite,
+    /** pfnLinkSpeedSet */
+    NULL,
+    /** pfnWriteNB */
+    pspStubX86DramTranspWriteNB,
+    /** pfnPoll */
+    NULL,
+    /** pfnFlush */
+    pspStubX86DramTranspFlush,
+    /** pfnIrqSet */
+    NULL,
+    /** pfnIrq */
+    NULL,
+    /** pfnLinkSpeedGet */
+    NULL,
+    /** pfnLinkCalibrate */
+    NULL,
+    /** pfnStatsQuery */
+    NULL
+};
@@ -38,6 +38,34 @@ typedef struct PSPPDUTRANSPINT *PSPPDUTRANSP;
 typedef PSPPDUTRANSP *PPSPPDUTRANSP;
 
 
+/**
+ * PDU transport channel statistics.
+ */
+typedef struct PSPPDUTRANSPSTATS
+{
+    /** Number of bytes read from the channel. */
+    uint64_t            cbRead;
+    /** Number of bytes written to the channel. */
+    uint64_t            cbWritten;
+    /** Number of read calls. */
+    uint32_t            cReads;
+    /** Number of write calls (blocking and non blocking). */
+    uint32_t            cWrites;
+    /** Time spent waiting for data to arrive in 100MHz timer ticks. */
+    uint64_t            cTicksStallRead;
+    /** Time spent waiting for room to transmit in 100MHz timer ticks. */
+    uint64_t            cTicksStallWrite;
+    /** Number of calls which failed. */
+    uint32_t            cErrors;
+    /** Number of times a call had to wait for the other side before it could continue. */
+    uint32_t            cRetries;
+} PSPPDUTRANSPSTATS;
+/** Pointer to PDU transport channel statistics. */
+typedef PSPPDUTRANSPSTATS *PPSPPDUTRANSPSTATS;
+/** Pointer to const PDU transport channel statistics. */
+typedef const PSPPDUTRANSPSTATS *PCPSPPDUTRANSPSTATS;
+
+
 /** Pointer to a PDU transport channel interface. */
 typedef struct PSPPDUTRANSPIF *PPSPPDUTRANSPIF;
 /** Pointer to a const PDU transport channel interface. */
@@ -114,6 +142,98 @@ typedef struct PSPPDUTRANSPIF
      */
     int         (*pfnWrite) (PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten);
 
+    /**
+     * Changes the link speed, optional (NULL if the transport has no configurable link speed).
+     *
+     * @returns Status code.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     * @param   uBps                The new link speed in bits per second.
+     * @param   puBpsOld            Where to store the link speed in effect before the change, optional.
+     *
+     * @note Everything written so far is transmitted at the old speed before switching.
+     */
+    int         (*pfnLinkSpeedSet) (PSPPDUTRANSP hPduTransp, uint32_t uBps, uint32_t *puBpsOld);
+
+    /**
+     * Data write callback - non blocking, optional (NULL if the transport only supports blocking writes).
+     *
+     * @returns Status code, INF_TRY_AGAIN if nothing could be written currently.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     * @param   pvBuf               The data to write.
+     * @param   cbWrite             How much to write.
+     * @param   pcbWritten          Where to store the number of bytes queued for transmission.
+     */
+    int         (*pfnWriteNB) (PSPPDUTRANSP hPduTransp, const void *pvBuf, size_t cbWrite, size_t *pcbWritten);
+
+    /**
+     * Makes progress on queued transmissions without blocking, optional.
+     * Gets called from the stub delay helpers, so it must not use them itself.
+     *
+     * @returns Status code.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     */
+    int         (*pfnPoll) (PSPPDUTRANSP hPduTransp);
+
+    /**
+     * Waits until everything written was transmitted completely, optional.
+     *
+     * @returns Status code.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     */
+    int         (*pfnFlush) (PSPPDUTRANSP hPduTransp);
+
+    /**
+     * Switches between interrupt driven and polled reception, optional (NULL if the transport can only poll).
+     *
+     * @returns Status code.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     * @param   fEnable             Flag whether to enable interrupt driven reception.
+     *
+     * @note The transport raises an interrupt right after enabling, so the caller can verify the routing.
+     */
+    int         (*pfnIrqSet) (PSPPDUTRANSP hPduTransp, bool fEnable);
+
+    /**
+     * Services pending interrupts of the transport, called from the IRQ exception handler, optional.
+     *
+     * @returns Flag whether the transport had an interrupt pending.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     */
+    bool        (*pfnIrq) (PSPPDUTRANSP hPduTransp);
+
+    /**
+     * Returns the current link speed, optional.
+     *
+     * @returns Status code.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     * @param   puBps               Where to store the link speed in bits per second (the clock for SPI based transports).
+     * @param   pcbPerSec           Where to store the payload throughput in bytes per second the link speed translates to,
+     *                              accounting for framing and protocol overhead of the transport.
+     * @param   pfCalibrated        Where to store whether the speed was determined by calibration.
+     */
+    int         (*pfnLinkSpeedGet) (PSPPDUTRANSP hPduTransp, uint32_t *puBps, uint32_t *pcbPerSec, bool *pfCalibrated);
+
+    /**
+     * Determines the fastest reliable link speed and switches to it, optional.
+     *
+     * @returns Status code.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     * @param   puBps               Where to store the selected link speed in bits per second.
+     *
+     * @note Must only be called when nothing is in flight, the link to the host is unusable while calibrating.
+     */
+    int         (*pfnLinkCalibrate) (PSPPDUTRANSP hPduTransp, uint32_t *puBps);
+
+    /**
+     * Returns the statistics collected by the transport channel, optional.
+     *
+     * @returns Status code.
+     * @param   hPduTransp          PDU transport channel instance handle.
+     * @param   pStats              Where to store the statistics.
+     * @param   fReset              Flag whether to reset the statistics after they were returned.
+     */
+    int         (*pfnStatsQuery) (PSPPDUTRANSP hPduTransp, PPSPPDUTRANSPSTATS pStats, bool fReset);
+
 } PSPPDUTRANSPIF;
 
 
@@ -0,0 +1,276 @@
+/** @file
+ * PSP serial stub - Platform layer for the real PSP.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <types.h>
+#include <cdefs.h>
+#include <err.h>
+
+#include "psp-serial-stub-plat.h"
+
+
+/** Start of the x86 mapping windows in the PSP address space. */
+#define PSP_PLAT_X86_WINDOW_BASE        0x04000000
+/** Number of x86 mapping windows. */
+#define PSP_PLAT_X86_WINDOW_COUNT       15
+/** Start of the SMN mapping windows in the PSP address space. */
+#define PSP_PLAT_SMN_WINDOW_BASE        0x01000000
+/** Number of SMN mapping windows. */
+#define PSP_PLAT_SMN_WINDOW_COUNT       32
+/** End of the PSP SRAM (256KB on Zen/Zen+, later generations have more but this is the common part). */
+#define PSP_PLAT_SRAM_END               (256 * _1K)
+
+
+extern size_t pspStubCmIfInBufPeekAsm(PCCMIF pCmIf, uint32_t idInBuf);
+extern int pspStubCmIfInBufPollAsm(PCCMIF pCmIf, uint32_t idInBuf, uint32_t cMillies);
+extern int pspStubCmIfInBufReadAsm(PCCMIF pCmIf, uint32_t idInBuf, void *pvBuf, size_t cbRead, size_t *pcbRead);
+extern int pspStubCmIfOutBufWriteAsm(PCCMIF pCmIf, uint32_t idOutBuf, const void *pvBuf, size_t cbWrite, size_t *pcbWritten);
+extern void pspStubCmIfDelayMsAsm(PCCMIF pCmIf, uint32_t cMillies);
+extern uint32_t pspStubCmIfTsGetMilliAsm(PCCMIF pCmIf);
+
+extern void pspSerialStubCoProcWriteAsm(uint32_t u32Val);
+extern uint32_t pspSerialStubCoProcReadAsm(void);
+
+extern void pspStubBranchToAsm(uint32_t PspAddrPc, const uint32_t *pau32Gprs) __attribute__((noreturn));
+
+extern int pspStubMemCopyProbeAsm(void *pvDst, const void *pvSrc, size_t cb);
+
+/** End of the RAM occupied by the stub (from the linker script). */
+extern uint8_t _ram_end[];
+
+
+void *pspStubPlatX86WindowMap(uint32_t idxSlot, X86PADDR PhysX86AddrBase, uint32_t uMemType)
+{
+    /* Program base address. */
+    PSPADDR PspAddrSlotBase = 0x03230000 + idxSlot * 4 * sizeof(uint32_t);
+    *(volatile uint32_t *)PspAddrSlotBase        = ((PhysX86AddrBase >> 32) << 6) | ((PhysX86AddrBase >> 26) & 0x3f);
+    *(volatile uint32_t *)(PspAddrSlotBase + 4)  = 0x12; /* Unknown but fixed value. */
+    *(volatile uint32_t *)(PspAddrSlotBase + 8)  = uMemType;
+    *(volatile uint32_t *)(PspAddrSlotBase + 12) = uMemType;
+    *(volatile uint32_t *)(0x032303e0 + idxSlot * sizeof(uint32_t)) = 0xffffffff;
+    *(volatile uint32_t *)(0x032304d8 + idxSlot * sizeof(uint32_t)) = 0xc0000000;
+    *(volatile uint32_t *)0x32305ec = 0x3333;
+
+    return (void *)(PSP_PLAT_X86_WINDOW_BASE + idxSlot * _64M);
+}
+
+
+void pspStubPlatX86WindowUnmap(uint32_t idxSlot)
+{
+    PSPADDR PspAddrSlotBase = 0x03230000 + idxSlot * 4 * sizeof(uint32_t);
+    *(volatile uint32_t *)PspAddrSlotBase        = 0;
+    *(volatile uint32_t *)(PspAddrSlotBase + 4)  = 0; /* Unknown but fixed value. */
+    *(volatile uint32_t *)(PspAddrSlotBase + 8)  = 0;
+    *(volatile uint32_t *)(PspAddrSlotBase + 12) = 0;
+    *(volatile uint32_t *)(0x032303e0 + idxSlot * sizeof(uint32_t)) = 0xffffffff;
+    *(volatile uint32_t *)(0x032304d8 + idxSlot * sizeof(uint32_t)) = 0;
+}
+
+
+uint32_t pspStubPlatX86WindowFromPtr(const void *pv)
+{
+    uintptr_t PspAddr = (uintptr_t)pv;
+
+    if (   PspAddr < PSP_PLAT_X86_WINDOW_BASE
+        || PspAddr >= PSP_PLAT_X86_WINDOW_BASE + PSP_PLAT_X86_WINDOW_COUNT * _64M)
+        return UINT32_MAX;
+
+    return (PspAddr - PSP_PLAT_X86_WINDOW_BASE) / _64M;
+}
+
+
+void *pspStubPlatSmnWindowMap(uint32_t idxSlot, SMNADDR SmnAddrBase)
+{
+    /* Program base address. */
+    PSPADDR PspAddrSlotBase = 0x03220000 + (idxSlot / 2) * sizeof(uint32_t);
+    uint32_t u32RegSmnMapCtrl = *(volatile uint32_t *)PspAddrSlotBase;
+    if (idxSlot & 0x1)
+        u32RegSmnMapCtrl |= ((SmnAddrBase >> 20) << 16);
+    else
+        u32RegSmnMapCtrl |= SmnAddrBase >> 20;
+    *(volatile uint32_t *)PspAddrSlotBase = u32RegSmnMapCtrl;
+
+    return (void *)(PSP_PLAT_SMN_WINDOW_BASE + idxSlot * _1M);
+}
+
+
+void pspStubPlatSmnWindowUnmap(uint32_t idxSlot)
+{
+    PSPADDR PspAddrSlotBase = 0x03220000 + (idxSlot / 2) * sizeof(uint32_t);
+    uint32_t u32RegSmnMapCtrl = *(volatile uint32_t *)PspAddrSlotBase;
+    if (idxSlot & 0x1)
+        u32RegSmnMapCtrl &= 0xffff;
+    else
+        u32RegSmnMapCtrl &= 0xffff0000;
+    *(volatile uint32_t *)PspAddrSlotBase = u32RegSmnMapCtrl;
+}
+
+
+uint32_t pspStubPlatSmnWindowFromPtr(const void *pv)
+{
+    uintptr_t PspAddr = (uintptr_t)pv;
+
+    if (   PspAddr < PSP_PLAT_SMN_WINDOW_BASE
+        || PspAddr >= PSP_PLAT_SMN_WINDOW_BASE + PSP_PLAT_SMN_WINDOW_COUNT * _1M)
+        return UINT32_MAX;
+
+    return (PspAddr - PSP_PLAT_SMN_WINDOW_BASE) / _1M;
+}
+
+
+void *pspStubPlatPspAddrToPtr(PSPADDR PspAddr)
+{
+    return (void *)(uintptr_t)PspAddr;
+}
+
+
+PSPADDR pspStubPlatPtrToPspAddr(const void *pv)
+{
+    return (PSPADDR)(uintptr_t)pv;
+}
+
+
+PSPADDR pspStubPlatStubEndGet(void)
+{
+    return (PSPADDR)(uintptr_t)&_ram_end[0];
+}
+
+
+PSPADDR pspStubPlatSramEndGet(void)
+{
+    return PSP_PLAT_SRAM_END;
+}
+
+
+void pspStubPlatMemBarrier(void)
+{
+    asm volatile("dsb #0xf\nisb #0xf\n": : :"memory");
+}
+
+
+void pspStubPlatDCacheCleanInvalidate(void *pv, size_t cb)
+{
+    uint8_t *pb = (uint8_t *)pv;
+
+    while (cb)
+    {
+        asm volatile("mcr p15, 0x0, %0, cr7, cr14, 0x1\n": : "r" (pb) :"memory");
+        pb += 32;
+        cb -= MIN(cb, 32);
+    }
+}
+
+
+void pspStubPlatTimerStart(void)
+{
+    /* Uses the 2nd timer which was so far only used by the on chip bootloader. */
+    *(volatile uint32_t *)(0x03010424 + 32) = 0;     /* Counter value. */
+    *(volatile uint32_t *)(0x03010424)      = 0x101; /* This starts the timer. */
+}
+
+
+uint32_t pspStubPlatTimerRead(void)
+{
+    return *(volatile uint32_t *)(0x03010424 + 32);
+}
+
+
+void pspStubPlatIrqEnable(void)
+{
+    asm volatile("dsb #0xf\n"
+                 "isb #0xf\n"
+                 "cpsie if\n": : :"memory");
+}
+
+
+void pspStubPlatIrqDisable(void)
+{
+    asm volatile("dsb #0xf\n"
+                 "isb #0xf\n"
+                 "cpsid if\n": : :"memory");
+}
+
+
+void pspStubPlatIrqCheck(bool *pfIrq, bool *pfFiq)
+{
+    /* Read the ISR. */
+    uint32_t u32Reg = 0;
+    asm volatile("mrc p15, 0x0, %0, cr12, cr1, 0x0\n": "=r" (u32Reg) : :"memory");
+
+    *pfIrq = (u32Reg & BIT(7)) ? true : false;
+    *pfFiq = (u32Reg & BIT(6)) ? true : false;
+}
+
+
+int pspStubPlatCoProcRw(uint8_t u8CoProc, uint8_t u8Crn, uint8_t u8Crm, uint8_t u8Opc1, uint8_t u8Opc2,
+                        bool fWrite, uint32_t *pu32Val)
+{
+    /* Insert the parameters into the template */
+    volatile uint32_t *pu32Insn =   fWrite
+                                  ? (volatile uint32_t *)((uintptr_t)pspSerialStubCoProcWriteAsm)
+                                  : (volatile uint32_t *)((uintptr_t)pspSerialStubCoProcReadAsm);
+    *pu32Insn =   (0xee << 24)
+                | (u8Opc1 & 0x7) << 21
+                | (fWrite ? 0 : BIT(20))
+                | (u8Crn & 0xf) << 16
+                | (0) << 12 /* Rt (r0) */
+                | (u8CoProc & 0xf) << 8
+                | (u8Opc2 & 0x7) << 5
+                | BIT(4)
+                | (u8Crm & 0xf);
+    asm volatile("mcr p15, 0x0, %0, cr7, cr5, 0x1\n": : "r" (pu32Insn) :"memory");
+    asm volatile("dsb #0xf\nisb #0xf\n": : :"memory");
+
+    if (fWrite)
+        pspSerialStubCoProcWriteAsm(*pu32Val);
+    else
+        *pu32Val = pspSerialStubCoProcReadAsm();
+
+    return INF_SUCCESS;
+}
+
+
+int pspStubPlatMemCopyProbe(void *pvDst, const void *pvSrc, size_t cb)
+{
+    return pspStubMemCopyProbeAsm(pvDst, pvSrc, cb);
+}
+
+
+int pspStubPlatCmExec(CMIF *pCmIf, PSPADDR PspAddrEntry, uint32_t u32Arg0, uint32_t u32Arg1,
+                      uint32_t u32Arg2, uint32_t u32Arg3, uint32_t *pu32CmRet)
+{
+    /* The module calls back through the interworking helpers. */
+    pCmIf->pfnInBufPeek   = pspStubCmIfInBufPeekAsm;
+    pCmIf->pfnInBufPoll   = pspStubCmIfInBufPollAsm;
+    pCmIf->pfnInBufRead   = pspStubCmIfInBufReadAsm;
+    pCmIf->pfnOutBufWrite = pspStubCmIfOutBufWriteAsm;
+    pCmIf->pfnDelayMs     = pspStubCmIfDelayMsAsm;
+    pCmIf->pfnTsGetMilli  = pspStubCmIfTsGetMilliAsm;
+
+    PFNCMENTRY pfnEntry = (PFNCMENTRY)PspAddrEntry;
+    *pu32CmRet = pfnEntry(pCmIf, u32Arg0, u32Arg1, u32Arg2, u32Arg3);
+    return INF_SUCCESS;
+}
+
+
+void pspStubPlatBranchTo(PSPADDR PspAddrPc, const uint32_t *pau32Gprs)
+{
+    pspStubBranchToAsm(PspAddrPc, pau32Gprs);
+}
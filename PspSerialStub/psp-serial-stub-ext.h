@@ -0,0 +1,690 @@
+/** @file
+ * PSP serial stub - PDU protocol extensions.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in all
+ * copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+#ifndef __include_psp_serial_stub_ext_h
+#define __include_psp_serial_stub_ext_h
+
+#if defined(IN_PSP)
+# include <common/types.h>
+#else
+# error "Invalid environment"
+#endif
+
+#include <psp-stub/psp-serial-stub.h>
+
+/*
+ * The requests, responses and notifications defined here live in a separate ID range
+ * so they can't collide with the base protocol from psp-stub/psp-serial-stub.h.
+ * Each extension response ID is the request ID offset by PSPSERIALPDURRNID_EXT_RESPONSE_OFF.
+ */
+
+/** First extension request ID. */
+#define PSPSERIALPDURRNID_EXT_REQUEST_FIRST             0x00010000
+/** Offset to get from an extension request ID to the matching response ID. */
+#define PSPSERIALPDURRNID_EXT_RESPONSE_OFF              0x00010000
+/** First extension notification ID. */
+#define PSPSERIALPDURRNID_EXT_NOTIFICATION_FIRST        0x00030000
+
+/** Generates the extension request ID for the given index. */
+#define PSPSERIALPDURRNID_EXT_REQUEST(a_idx)            ((PSPSERIALPDURRNID)(PSPSERIALPDURRNID_EXT_REQUEST_FIRST + (a_idx)))
+/** Generates the extension response ID for the given index. */
+#define PSPSERIALPDURRNID_EXT_RESPONSE(a_idx)           ((PSPSERIALPDURRNID)(PSPSERIALPDURRNID_EXT_REQUEST_FIRST + PSPSERIALPDURRNID_EXT_RESPONSE_OFF + (a_idx)))
+/** Generates the extension notification ID for the given index. */
+#define PSPSERIALPDURRNID_EXT_NOTIFICATION(a_idx)       ((PSPSERIALPDURRNID)(PSPSERIALPDURRNID_EXT_NOTIFICATION_FIRST + (a_idx)))
+
+/** Sparse read request, see PSPSERIALSPARSEREADREQ. */
+#define PSPSERIALPDURRNID_REQUEST_SPARSE_READ           PSPSERIALPDURRNID_EXT_REQUEST(0)
+/** Sparse read response, see PSPSERIALSPARSEREADRESP. */
+#define PSPSERIALPDURRNID_RESPONSE_SPARSE_READ          PSPSERIALPDURRNID_EXT_RESPONSE(0)
+/** Memory test request, see PSPSERIALMEMTESTREQ. */
+#define PSPSERIALPDURRNID_REQUEST_MEMTEST               PSPSERIALPDURRNID_EXT_REQUEST(1)
+/** Memory test response, see PSPSERIALMEMTESTRESP. */
+#define PSPSERIALPDURRNID_RESPONSE_MEMTEST              PSPSERIALPDURRNID_EXT_RESPONSE(1)
+/** Journal read request, see PSPSERIALJOURNALREADREQ. */
+#define PSPSERIALPDURRNID_REQUEST_JOURNAL_READ          PSPSERIALPDURRNID_EXT_REQUEST(2)
+/** Journal read response, see PSPSERIALJOURNALREADRESP. */
+#define PSPSERIALPDURRNID_RESPONSE_JOURNAL_READ         PSPSERIALPDURRNID_EXT_RESPONSE(2)
+/** Set link parameters request, see PSPSERIALSETLINKPARAMSREQ. */
+#define PSPSERIALPDURRNID_REQUEST_SET_LINK_PARAMS       PSPSERIALPDURRNID_EXT_REQUEST(3)
+/** Set link parameters response, no payload. */
+#define PSPSERIALPDURRNID_RESPONSE_SET_LINK_PARAMS      PSPSERIALPDURRNID_EXT_RESPONSE(3)
+/** Link verification request, see PSPSERIALLINKVERIFY. */
+#define PSPSERIALPDURRNID_REQUEST_LINK_VERIFY           PSPSERIALPDURRNID_EXT_REQUEST(4)
+/** Link verification response, see PSPSERIALLINKVERIFY. */
+#define PSPSERIALPDURRNID_RESPONSE_LINK_VERIFY          PSPSERIALPDURRNID_EXT_RESPONSE(4)
+/** Link calibration request, no payload. On the EM100 link the host has to write the payload of calibration frames
+ * in the uFIFO (tag 0xcf instead of 0xef) back to the dFIFO unchanged until the response arrives, otherwise the
+ * calibration only checks register reads. */
+#define PSPSERIALPDURRNID_REQUEST_LINK_CALIBRATE        PSPSERIALPDURRNID_EXT_REQUEST(5)
+/** Link calibration response, see PSPSERIALLINKINFO. */
+#define PSPSERIALPDURRNID_RESPONSE_LINK_CALIBRATE       PSPSERIALPDURRNID_EXT_RESPONSE(5)
+/** Striped read request, see PSPSERIALSTRIPEDREADREQ. */
+#define PSPSERIALPDURRNID_REQUEST_STRIPED_READ          PSPSERIALPDURRNID_EXT_REQUEST(6)
+/** Striped read response, see PSPSERIALSTRIPEDREADRESP. */
+#define PSPSERIALPDURRNID_RESPONSE_STRIPED_READ         PSPSERIALPDURRNID_EXT_RESPONSE(6)
+/** Link select request, see PSPSERIALLINKSELECTREQ. */
+#define PSPSERIALPDURRNID_REQUEST_LINK_SELECT           PSPSERIALPDURRNID_EXT_REQUEST(7)
+/** Link select response, no payload. */
+#define PSPSERIALPDURRNID_RESPONSE_LINK_SELECT          PSPSERIALPDURRNID_EXT_RESPONSE(7)
+/** Transport statistics request, see PSPSERIALTRANSPSTATSREQ. */
+#define PSPSERIALPDURRNID_REQUEST_TRANSP_STATS          PSPSERIALPDURRNID_EXT_REQUEST(8)
+/** Transport statistics response, see PSPSERIALTRANSPSTATSRESP. */
+#define PSPSERIALPDURRNID_RESPONSE_TRANSP_STATS         PSPSERIALPDURRNID_EXT_RESPONSE(8)
+/** Link probe acknowledge request, see PSPSERIALLINKPROBEACKREQ, there is no response. */
+#define PSPSERIALPDURRNID_REQUEST_LINK_PROBE_ACK        PSPSERIALPDURRNID_EXT_REQUEST(9)
+/** First invalid extension request ID. */
+#define PSPSERIALPDURRNID_EXT_REQUEST_INVALID_FIRST     PSPSERIALPDURRNID_EXT_REQUEST(10)
+
+/** Memory test progress notification, see PSPSERIALMEMTESTPROGRESSNOT. */
+#define PSPSERIALPDURRNID_NOTIFICATION_MEMTEST_PROGRESS PSPSERIALPDURRNID_EXT_NOTIFICATION(0)
+/** Striped read data notification, see PSPSERIALSTRIPEDREADDATANOT. */
+#define PSPSERIALPDURRNID_NOTIFICATION_STRIPED_READ_DATA PSPSERIALPDURRNID_EXT_NOTIFICATION(1)
+/** Link probe notification, see PSPSERIALLINKPROBENOT. */
+#define PSPSERIALPDURRNID_NOTIFICATION_LINK_PROBE       PSPSERIALPDURRNID_EXT_NOTIFICATION(2)
+
+
+/**
+ * Sparse read request.
+ *
+ * Reads the given range page by page, pages which can't be accessed because
+ * they cause a data abort are skipped and reported as such in the bitmap.
+ */
+typedef struct PSPSERIALSPARSEREADREQ
+{
+    /** The address space to read from. */
+    PSPADDRSPACE                enmAddrSpace;
+    /** Flags controlling the request, see PSP_SERIAL_SPARSE_READ_F_XXX. */
+    uint32_t                    fFlags;
+    /** Size of a page in bytes (power of two and at least 4 bytes). */
+    uint32_t                    cbPage;
+    /** Number of pages to read. */
+    uint32_t                    cPages;
+    /** The start address (aligned to the page size). */
+    union
+    {
+        /** PSP address. */
+        PSPADDR                 PspAddrStart;
+        /** SMN address. */
+        SMNADDR                 SmnAddrStart;
+        /** x86 physical address. */
+        X86PADDR                PhysX86AddrStart;
+    } u;
+} PSPSERIALSPARSEREADREQ;
+/** Pointer to a sparse read request. */
+typedef PSPSERIALSPARSEREADREQ *PPSPSERIALSPARSEREADREQ;
+/** Pointer to a const sparse read request. */
+typedef const PSPSERIALSPARSEREADREQ *PCPSPSERIALSPARSEREADREQ;
+
+/** Only probe the pages for accessibility and don't return any data. */
+#define PSP_SERIAL_SPARSE_READ_F_PROBE_ONLY             BIT(0)
+
+
+/**
+ * Sparse read response.
+ *
+ * The response header is followed by the accessibility bitmap consisting of (cPages + 31) / 32
+ * 32bit words (a set bit means the page is readable) and the data of all readable pages
+ * in ascending order.
+ */
+typedef struct PSPSERIALSPARSEREADRESP
+{
+    /** Number of pages covered by this response, can be less than requested
+     * if everything doesn't fit into a single response. */
+    uint32_t                    cPages;
+    /** Number of readable pages, the data of these pages follows the bitmap
+     * unless only probing was requested. */
+    uint32_t                    cPagesReadable;
+} PSPSERIALSPARSEREADRESP;
+/** Pointer to a sparse read response. */
+typedef PSPSERIALSPARSEREADRESP *PPSPSERIALSPARSEREADRESP;
+/** Pointer to a const sparse read response. */
+typedef const PSPSERIALSPARSEREADRESP *PCPSPSERIALSPARSEREADRESP;
+
+
+/**
+ * Memory test request.
+ */
+typedef struct PSPSERIALMEMTESTREQ
+{
+    /** The address space to test, only PSPADDRSPACE_PSP_MEM (SRAM not occupied by the stub) and PSPADDRSPACE_X86_MEM are supported. */
+    PSPADDRSPACE                enmAddrSpace;
+    /** The tests to run, see PSP_SERIAL_MEMTEST_F_XXX. */
+    uint32_t                    fTests;
+    /** The start address (32bit aligned). */
+    union
+    {
+        /** PSP address. */
+        PSPADDR                 PspAddrStart;
+        /** x86 physical address. */
+        X86PADDR                PhysX86AddrStart;
+    } u;
+    /** Number of bytes to test (multiple of 4). */
+    uint64_t                    cbTest;
+    /** Number of bytes tested between two progress notifications, 0 disables progress notifications. */
+    uint32_t                    cbProgressInterval;
+    /** Number of failures after which the test is aborted, 0 to never abort. */
+    uint32_t                    cFailuresMax;
+} PSPSERIALMEMTESTREQ;
+/** Pointer to a memory test request. */
+typedef PSPSERIALMEMTESTREQ *PPSPSERIALMEMTESTREQ;
+/** Pointer to a const memory test request. */
+typedef const PSPSERIALMEMTESTREQ *PCPSPSERIALMEMTESTREQ;
+
+/** Walking ones test. */
+#define PSP_SERIAL_MEMTEST_F_WALKING_ONES               BIT(0)
+/** Address in address test. */
+#define PSP_SERIAL_MEMTEST_F_ADDR_IN_ADDR               BIT(1)
+/** Moving inversions test. */
+#define PSP_SERIAL_MEMTEST_F_MOVING_INV                 BIT(2)
+/** March C- test. */
+#define PSP_SERIAL_MEMTEST_F_MARCH_C                    BIT(3)
+/** Mask of all valid tests. */
+#define PSP_SERIAL_MEMTEST_F_VALID_MASK                 (  PSP_SERIAL_MEMTEST_F_WALKING_ONES \
+                                                         | PSP_SERIAL_MEMTEST_F_ADDR_IN_ADDR \
+                                                         | PSP_SERIAL_MEMTEST_F_MOVING_INV \
+                                                         | PSP_SERIAL_MEMTEST_F_MARCH_C)
+
+
+/**
+ * Single memory test failure.
+ */
+typedef struct PSPSERIALMEMTESTFAILURE
+{
+    /** The failing address. */
+    uint64_t                    u64Addr;
+    /** The value expected. */
+    uint32_t                    u32Expected;
+    /** The value actually read. */
+    uint32_t                    u32Actual;
+    /** The test causing the failure (one of PSP_SERIAL_MEMTEST_F_XXX). */
+    uint32_t                    fTest;
+    /** Padding. */
+    uint32_t                    u32Pad0;
+} PSPSERIALMEMTESTFAILURE;
+/** Pointer to a memory test failure. */
+typedef PSPSERIALMEMTESTFAILURE *PPSPSERIALMEMTESTFAILURE;
+/** Pointer to a const memory test failure. */
+typedef const PSPSERIALMEMTESTFAILURE *PCPSPSERIALMEMTESTFAILURE;
+
+
+/**
+ * Memory test response, followed by cFailuresReported PSPSERIALMEMTESTFAILURE entries.
+ */
+typedef struct PSPSERIALMEMTESTRESP
+{
+    /** Total number of failures detected. */
+    uint32_t                    cFailures;
+    /** Number of failures reported in this response (the first ones detected). */
+    uint32_t                    cFailuresReported;
+    /** Total number of bytes processed over all passes. */
+    uint64_t                    cbProcessed;
+} PSPSERIALMEMTESTRESP;
+/** Pointer to a memory test response. */
+typedef PSPSERIALMEMTESTRESP *PPSPSERIALMEMTESTRESP;
+/** Pointer to a const memory test response. */
+typedef const PSPSERIALMEMTESTRESP *PCPSPSERIALMEMTESTRESP;
+
+
+/**
+ * Memory test progress notification.
+ */
+typedef struct PSPSERIALMEMTESTPROGRESSNOT
+{
+    /** The test currently running (one of PSP_SERIAL_MEMTEST_F_XXX). */
+    uint32_t                    fTest;
+    /** Number of failures detected so far. */
+    uint32_t                    cFailures;
+    /** Total number of bytes processed so far over all passes. */
+    uint64_t                    cbProcessed;
+} PSPSERIALMEMTESTPROGRESSNOT;
+/** Pointer to a memory test progress notification. */
+typedef PSPSERIALMEMTESTPROGRESSNOT *PPSPSERIALMEMTESTPROGRESSNOT;
+/** Pointer to a const memory test progress notification. */
+typedef const PSPSERIALMEMTESTPROGRESSNOT *PCPSPSERIALMEMTESTPROGRESSNOT;
+
+
+/** Execution time of a journal entry whose request didn't return (yet), it is still running, branched away or wedged the stub. */
+#define PSP_SERIAL_JOURNAL_MILLIES_PENDING              UINT32_MAX
+
+
+/**
+ * Journal entry describing a single mutating request executed by the stub, recorded before the request executes.
+ */
+typedef struct PSPSERIALJOURNALENTRY
+{
+    /** Sequence number of the entry, starting at 1. */
+    uint32_t                    uSeq;
+    /** Stub timestamp in milliseconds when the request started executing. */
+    uint32_t                    tsMillies;
+    /** The request ID. */
+    PSPSERIALPDURRNID           enmReqId;
+    /** The address space being modified, PSPADDRSPACE_INVALID if the request doesn't target one. */
+    PSPADDRSPACE                enmAddrSpace;
+    /** The address being modified (request specific for requests not targeting an address space). */
+    uint64_t                    u64Addr;
+    /** Number of bytes being modified. */
+    uint32_t                    cb;
+    /** The value written if the request carries at most 4 bytes of data, otherwise the 32-bit FNV-1a hash of the
+     * request header and the PDU checksum (which covers the data). */
+    uint32_t                    u32ValOrHash;
+    /** Status code the request completed with, only valid if cMillies is not PSP_SERIAL_JOURNAL_MILLIES_PENDING. */
+    int32_t                     rcReq;
+    /** Execution time in milliseconds, PSP_SERIAL_JOURNAL_MILLIES_PENDING if the request didn't return. */
+    uint32_t                    cMillies;
+} PSPSERIALJOURNALENTRY;
+/** Pointer to a journal entry. */
+typedef PSPSERIALJOURNALENTRY *PPSPSERIALJOURNALENTRY;
+/** Pointer to a const journal entry. */
+typedef const PSPSERIALJOURNALENTRY *PCPSPSERIALJOURNALENTRY;
+
+
+/**
+ * Journal read request.
+ */
+typedef struct PSPSERIALJOURNALREADREQ
+{
+    /** Maximum number of the most recent entries to return. */
+    uint32_t                    cEntriesMax;
+    /** Padding. */
+    uint32_t                    u32Pad0;
+} PSPSERIALJOURNALREADREQ;
+/** Pointer to a journal read request. */
+typedef PSPSERIALJOURNALREADREQ *PPSPSERIALJOURNALREADREQ;
+/** Pointer to a const journal read request. */
+typedef const PSPSERIALJOURNALREADREQ *PCPSPSERIALJOURNALREADREQ;
+
+
+/**
+ * Journal read response, followed by cEntries PSPSERIALJOURNALENTRY entries, oldest first.
+ */
+typedef struct PSPSERIALJOURNALREADRESP
+{
+    /** Number of entries returned. */
+    uint32_t                    cEntries;
+    /** Total number of entries recorded since the stub started, older ones are overwritten. */
+    uint32_t                    cEntriesTotal;
+} PSPSERIALJOURNALREADRESP;
+/** Pointer to a journal read response. */
+typedef PSPSERIALJOURNALREADRESP *PPSPSERIALJOURNALREADRESP;
+/** Pointer to a const journal read response. */
+typedef const PSPSERIALJOURNALREADRESP *PCPSPSERIALJOURNALREADRESP;
+
+
+/**
+ * Set link parameters request.
+ *
+ * The stub acknowledges the request at the old link speed and switches afterwards.
+ * The host has to send a PSPSERIALPDURRNID_REQUEST_LINK_VERIFY request at the new speed
+ * within cMillisVerify milliseconds, the stub answers it at the new speed and expects
+ * the next request to arrive within cMillisVerify milliseconds as well, confirming the
+ * host received the verify response. If any of this fails the stub reverts to the old link speed,
+ * the host has to do the same if it doesn't receive the verify response.
+ * A speed the transport can't do is rejected with an error status and the link stays unchanged
+ * (the UART rejects rates its input clock can't divide down to within 3%).
+ */
+typedef struct PSPSERIALSETLINKPARAMSREQ
+{
+    /** The new link speed in bits per second. */
+    uint32_t                    uBps;
+    /** Number of milliseconds to wait for each step of the verification before falling back. */
+    uint32_t                    cMillisVerify;
+} PSPSERIALSETLINKPARAMSREQ;
+/** Pointer to a set link parameters request. */
+typedef PSPSERIALSETLINKPARAMSREQ *PPSPSERIALSETLINKPARAMSREQ;
+/** Pointer to a const set link parameters request. */
+typedef const PSPSERIALSETLINKPARAMSREQ *PCPSPSERIALSETLINKPARAMSREQ;
+
+
+/**
+ * Link verification request and response, the response echoes the request.
+ */
+typedef struct PSPSERIALLINKVERIFY
+{
+    /** Test pattern chosen by the host. */
+    uint32_t                    au32Pattern[4];
+} PSPSERIALLINKVERIFY;
+/** Pointer to a link verification request/response. */
+typedef PSPSERIALLINKVERIFY *PPSPSERIALLINKVERIFY;
+/** Pointer to a const link verification request/response. */
+typedef const PSPSERIALLINKVERIFY *PCPSPSERIALLINKVERIFY;
+
+
+/**
+ * Information about the link to the host.
+ */
+typedef struct PSPSERIALLINKINFO
+{
+    /** The link speed in bits per second (the SPI clock for SPI based transports), 0 if unknown. */
+    uint32_t                    uLinkBps;
+    /** Flags describing the link, see PSP_SERIAL_LINK_INFO_F_XXX. */
+    uint32_t                    fLink;
+} PSPSERIALLINKINFO;
+/** Pointer to link information. */
+typedef PSPSERIALLINKINFO *PPSPSERIALLINKINFO;
+/** Pointer to const link information. */
+typedef const PSPSERIALLINKINFO *PCPSPSERIALLINKINFO;
+
+/** The link speed was determined by calibration. */
+#define PSP_SERIAL_LINK_INFO_F_CALIBRATED               BIT(0)
+
+
+/** @name Transport IDs, identifying the transport a link uses.
+ * @{ */
+#define PSP_SERIAL_TRANSP_ID_UART                       0
+#define PSP_SERIAL_TRANSP_ID_SPI_FLASH                  1
+#define PSP_SERIAL_TRANSP_ID_EM100                      2
+#define PSP_SERIAL_TRANSP_ID_X86_DRAM                   3
+#define PSP_SERIAL_TRANSP_ID_LOOPBACK                   4
+/** @} */
+
+
+/**
+ * Link probe notification, followed by filler data when measuring the throughput.
+ *
+ * The stub sends these on every link while processing a connect request if it drives more than
+ * one link, the host has to read all links during that time and drop these. Probe notifications
+ * carry a PDU counter of 0 and are not part of the PDU sequence of any link.
+ *
+ * A probe with PSP_SERIAL_LINK_PROBE_NOT_F_ACK set has to be acknowledged with a
+ * PSPSERIALPDURRNID_REQUEST_LINK_PROBE_ACK request on the link the connect request arrived on
+ * as soon as it was received. A link whose probe isn't acknowledged in time is reported as not
+ * measured and the probe PDU in flight on it may be cut off.
+ */
+typedef struct PSPSERIALLINKPROBENOT
+{
+    /** The link being probed. */
+    uint32_t                    idLink;
+    /** Number of the probe on this link, starting at 0. */
+    uint32_t                    idxProbe;
+    /** Flags, see PSP_SERIAL_LINK_PROBE_NOT_F_XXX. */
+    uint32_t                    fFlags;
+    /** Padding. */
+    uint32_t                    u32Pad0;
+} PSPSERIALLINKPROBENOT;
+/** Pointer to a link probe notification. */
+typedef PSPSERIALLINKPROBENOT *PPSPSERIALLINKPROBENOT;
+/** Pointer to a const link probe notification. */
+typedef const PSPSERIALLINKPROBENOT *PCPSPSERIALLINKPROBENOT;
+
+/** The host has to acknowledge the probe. */
+#define PSP_SERIAL_LINK_PROBE_NOT_F_ACK                 BIT(0)
+
+
+/**
+ * Link probe acknowledge request.
+ */
+typedef struct PSPSERIALLINKPROBEACKREQ
+{
+    /** The link the probe arrived on. */
+    uint32_t                    idLink;
+    /** Number of the probe being acknowledged. */
+    uint32_t                    idxProbe;
+} PSPSERIALLINKPROBEACKREQ;
+/** Pointer to a link probe acknowledge request. */
+typedef PSPSERIALLINKPROBEACKREQ *PPSPSERIALLINKPROBEACKREQ;
+/** Pointer to a const link probe acknowledge request. */
+typedef const PSPSERIALLINKPROBEACKREQ *PCPSPSERIALLINKPROBEACKREQ;
+
+
+/**
+ * Measurement results of a single link.
+ */
+typedef struct PSPSERIALLINKPROBE
+{
+    /** The link ID, 0 is the link the connect request arrived on, the others are additional links. */
+    uint32_t                    idLink;
+    /** The transport the link uses, see PSP_SERIAL_TRANSP_ID_XXX. */
+    uint32_t                    idTransp;
+    /** Throughput in bytes per second the host acknowledged receiving, 0 if not measured. */
+    uint32_t                    cbPerSec;
+    /** Time in microseconds from sending a minimal probe until the host acknowledged it, UINT32_MAX if not measured. */
+    uint32_t                    cUsLatency;
+} PSPSERIALLINKPROBE;
+/** Pointer to link measurement results. */
+typedef PSPSERIALLINKPROBE *PPSPSERIALLINKPROBE;
+/** Pointer to const link measurement results. */
+typedef const PSPSERIALLINKPROBE *PCPSPSERIALLINKPROBE;
+
+/** Maximum number of links reported in the connect response. */
+#define PSP_SERIAL_CONNECT_LINKS_MAX                    4
+
+
+/**
+ * Link select request.
+ *
+ * The stub acknowledges the request on the current link and moves over to the given one,
+ * the host has to send the next request on the new link within cMillisVerify milliseconds,
+ * the stub falls back to the previous link otherwise. After the move the new link is link 0
+ * and the previous one takes over the ID of the new one.
+ */
+typedef struct PSPSERIALLINKSELECTREQ
+{
+    /** The link to move to, as reported in the connect response. */
+    uint32_t                    idLink;
+    /** Number of milliseconds to wait for the first request on the new link before falling back. */
+    uint32_t                    cMillisVerify;
+} PSPSERIALLINKSELECTREQ;
+/** Pointer to a link select request. */
+typedef PSPSERIALLINKSELECTREQ *PPSPSERIALLINKSELECTREQ;
+/** Pointer to a const link select request. */
+typedef const PSPSERIALLINKSELECTREQ *PCPSPSERIALLINKSELECTREQ;
+
+
+/**
+ * Extended connect response.
+ *
+ * The stub answers PSPSERIALPDURRNID_REQUEST_CONNECT with this, hosts only knowing
+ * the base protocol read the leading PSPSERIALCONNECTRESP and ignore the rest.
+ *
+ * If the stub selected another link than the one the connect request arrived on (idLinkSelected != 0)
+ * it moves over after sending this response, the same way as for PSPSERIALPDURRNID_REQUEST_LINK_SELECT.
+ */
+typedef struct PSPSERIALCONNECTRESPEXT
+{
+    /** The base protocol connect response. */
+    PSPSERIALCONNECTRESP        Core;
+    /** Size of everything following the core response in bytes, for future extensions. */
+    uint32_t                    cbExt;
+    /** Padding. */
+    uint32_t                    u32Pad0;
+    /** Information about the link in use (the selected one). */
+    PSPSERIALLINKINFO           Link;
+    /** The link the stub selected for the connection. */
+    uint32_t                    idLinkSelected;
+    /** Number of valid entries in aLinks, 0 if the links were not probed (the stub only drives a single link). */
+    uint32_t                    cLinks;
+    /** Measurement results of all links. */
+    PSPSERIALLINKPROBE          aLinks[PSP_SERIAL_CONNECT_LINKS_MAX];
+} PSPSERIALCONNECTRESPEXT;
+/** Pointer to an extended connect response. */
+typedef PSPSERIALCONNECTRESPEXT *PPSPSERIALCONNECTRESPEXT;
+/** Pointer to a const extended connect response. */
+typedef const PSPSERIALCONNECTRESPEXT *PCPSPSERIALCONNECTRESPEXT;
+
+
+/**
+ * Striped read request.
+ *
+ * Reads the given range in chunks which are spread over all links attached to the stub
+ * (the link the request arrived on and any additional one set up with PSP_SERIAL_STUB_MULTIPATH)
+ * in proportion to the throughput measured for each link. Every chunk is sent as a
+ * PSPSERIALPDURRNID_NOTIFICATION_STRIPED_READ_DATA notification on the link it was assigned to,
+ * the host reassembles the data by offset. Each additional link numbers its PDUs independently.
+ * The response is sent on the request link after all chunks were written to their links.
+ */
+typedef struct PSPSERIALSTRIPEDREADREQ
+{
+    /** The address space to read from. */
+    PSPADDRSPACE                enmAddrSpace;
+    /** Requested chunk size in bytes, the stub might use smaller chunks, 0 for the default. */
+    uint32_t                    cbChunk;
+    /** The start address. */
+    union
+    {
+        /** PSP address. */
+        PSPADDR                 PspAddrStart;
+        /** SMN address. */
+        SMNADDR                 SmnAddrStart;
+        /** x86 physical address. */
+        X86PADDR                PhysX86AddrStart;
+    } u;
+    /** Number of bytes to read. */
+    uint64_t                    cbRead;
+} PSPSERIALSTRIPEDREADREQ;
+/** Pointer to a striped read request. */
+typedef PSPSERIALSTRIPEDREADREQ *PPSPSERIALSTRIPEDREADREQ;
+/** Pointer to a const striped read request. */
+typedef const PSPSERIALSTRIPEDREADREQ *PCPSPSERIALSTRIPEDREADREQ;
+
+
+/**
+ * Striped read data notification, followed by the data of the chunk.
+ */
+typedef struct PSPSERIALSTRIPEDREADDATANOT
+{
+    /** Offset of the chunk from the start of the read. */
+    uint64_t                    offChunk;
+    /** Size of the chunk data in bytes. */
+    uint32_t                    cbChunk;
+    /** The link the chunk was sent on (0 is the link the request arrived on). */
+    uint32_t                    idLink;
+} PSPSERIALSTRIPEDREADDATANOT;
+/** Pointer to a striped read data notification. */
+typedef PSPSERIALSTRIPEDREADDATANOT *PPSPSERIALSTRIPEDREADDATANOT;
+/** Pointer to a const striped read data notification. */
+typedef const PSPSERIALSTRIPEDREADDATANOT *PCPSPSERIALSTRIPEDREADDATANOT;
+
+
+/**
+ * Per link statistics of a striped read.
+ */
+typedef struct PSPSERIALSTRIPEDREADLINK
+{
+    /** The link ID. */
+    uint32_t                    idLink;
+    /** Throughput of the link in bytes per second as measured by the stub. */
+    uint32_t                    cbPerSec;
+    /** Number of data bytes sent over the link for this request. */
+    uint64_t                    cbSent;
+} PSPSERIALSTRIPEDREADLINK;
+/** Pointer to per link striped read statistics. */
+typedef PSPSERIALSTRIPEDREADLINK *PPSPSERIALSTRIPEDREADLINK;
+/** Pointer to const per link striped read statistics. */
+typedef const PSPSERIALSTRIPEDREADLINK *PCPSPSERIALSTRIPEDREADLINK;
+
+
+/**
+ * Striped read response, followed by cLinks PSPSERIALSTRIPEDREADLINK entries.
+ */
+typedef struct PSPSERIALSTRIPEDREADRESP
+{
+    /** Number of bytes read, less than requested if reading failed in between
+     * (the status code of the response tells why). */
+    uint64_t                    cbRead;
+    /** Number of link entries following. */
+    uint32_t                    cLinks;
+    /** Padding. */
+    uint32_t                    u32Pad0;
+} PSPSERIALSTRIPEDREADRESP;
+/** Pointer to a striped read response. */
+typedef PSPSERIALSTRIPEDREADRESP *PPSPSERIALSTRIPEDREADRESP;
+/** Pointer to a const striped read response. */
+typedef const PSPSERIALSTRIPEDREADRESP *PCPSPSERIALSTRIPEDREADRESP;
+
+
+/**
+ * Transport statistics request.
+ */
+typedef struct PSPSERIALTRANSPSTATSREQ
+{
+    /** Flags, see PSP_SERIAL_TRANSP_STATS_F_XXX. */
+    uint32_t                    fFlags;
+} PSPSERIALTRANSPSTATSREQ;
+/** Pointer to a transport statistics request. */
+typedef PSPSERIALTRANSPSTATSREQ *PPSPSERIALTRANSPSTATSREQ;
+/** Pointer to a const transport statistics request. */
+typedef const PSPSERIALTRANSPSTATSREQ *PCPSPSERIALTRANSPSTATSREQ;
+
+/** Reset the statistics of all links after they were collected for the response. */
+#define PSP_SERIAL_TRANSP_STATS_F_RESET                 BIT(0)
+
+
+/**
+ * Statistics of a single link.
+ *
+ * Stall times are in ticks of the 100MHz PSP timer (10ns) and cover the time the transport
+ * spent waiting on the other side (data to arrive or room to transmit) instead of moving data.
+ * The counters include the traffic of the request being answered up to the point they were collected.
+ */
+typedef struct PSPSERIALTRANSPSTATS
+{
+    /** The link ID, 0 is the link the request arrived on. */
+    uint32_t                    idLink;
+    /** The transport the link uses, see PSP_SERIAL_TRANSP_ID_XXX. */
+    uint32_t                    idTransp;
+    /** Flag whether the transport collects statistics, all counters are 0 if not. */
+    uint32_t                    fValid;
+    /** Number of read calls. */
+    uint32_t                    cReads;
+    /** Number of write calls. */
+    uint32_t                    cWrites;
+    /** Number of calls which failed. */
+    uint32_t                    cErrors;
+    /** Number of times the transport had to wait for the other side. */
+    uint32_t                    cRetries;
+    /** Padding. */
+    uint32_t                    u32Pad0;
+    /** Number of bytes read. */
+    uint64_t                    cbRead;
+    /** Number of bytes written. */
+    uint64_t                    cbWritten;
+    /** Time spent waiting for data to arrive. */
+    uint64_t                    cTicksStallRead;
+    /** Time spent waiting for room to transmit. */
+    uint64_t                    cTicksStallWrite;
+} PSPSERIALTRANSPSTATS;
+/** Pointer to link statistics. */
+typedef PSPSERIALTRANSPSTATS *PPSPSERIALTRANSPSTATS;
+/** Pointer to const link statistics. */
+typedef const PSPSERIALTRANSPSTATS *PCPSPSERIALTRANSPSTATS;
+
+
+/**
+ * Transport statistics response, followed by cLinks PSPSERIALTRANSPSTATS entries.
+ */
+typedef struct PSPSERIALTRANSPSTATSRESP
+{
+    /** Number of link entries following. */
+    uint32_t                    cLinks;
+    /** Padding. */
+    uint32_t                    u32Pad0;
+} PSPSERIALTRANSPSTATSRESP;
+/** Pointer to a transport statistics response. */
+typedef PSPSERIALTRANSPSTATSRESP *PPSPSERIALTRANSPSTATSRESP;
+/** Pointer to a const transport statistics response. */
+typedef const PSPSERIALTRANSPSTATSRESP *PCPSPSERIALTRANSPSTATSRESP;
+
+#endif /* !__include_psp_serial_stub_ext_h */
+
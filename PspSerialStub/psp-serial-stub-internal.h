@@ -88,5 +88,13 @@ void pspSerialStubDelayMs(uint32_t cMillies);
  */
 void pspSerialStubDelayUs(uint64_t cMicros);
 
+
+/**
+ * Returns the current value of the free running 100MHz counter, used for accounting stall times.
+ *
+ * @returns Counter value (10ns granularity, wraps around).
+ */
+uint32_t pspSerialStubTicksGet(void);
+
 #endif /* !__include_psp_serial_stub_internal_h */
 
@@ -0,0 +1,295 @@
+/** @file
+ * PSP serial stub - Platform layer, everything the stub core needs from the hardware it runs on.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __include_psp_serial_stub_plat_h
+#define __include_psp_serial_stub_plat_h
+
+#if defined(IN_PSP)
+# include <common/types.h>
+#else
+# error "Invalid environment"
+#endif
+
+#include <psp-stub/cm-if.h>
+
+/*
+ * The stub core (main.c) doesn't touch the hardware directly, everything goes through the functions below.
+ * plat-psp.c implements them for the real PSP, Host/plat-host.c implements them on top of a simulated
+ * address space so the core can be built and exercised on a Linux host (PSP_SERIAL_STUB_HOST).
+ */
+
+
+/**
+ * Maps the given 64MB aligned x86 physical address into the given x86 mapping window.
+ *
+ * @returns Pointer to the start of the window, NULL if the address can't be mapped.
+ * @param   idxSlot                 The mapping window to use.
+ * @param   PhysX86AddrBase         The 64MB aligned x86 physical address to map.
+ * @param   uMemType                The memory type to use for the mapping.
+ */
+void *pspStubPlatX86WindowMap(uint32_t idxSlot, X86PADDR PhysX86AddrBase, uint32_t uMemType);
+
+
+/**
+ * Clears the given x86 mapping window.
+ *
+ * @returns nothing.
+ * @param   idxSlot                 The mapping window to clear.
+ */
+void pspStubPlatX86WindowUnmap(uint32_t idxSlot);
+
+
+/**
+ * Returns the x86 mapping window the given pointer belongs to.
+ *
+ * @returns Index of the mapping window or UINT32_MAX if the pointer is not inside any window.
+ * @param   pv                      The pointer to look up.
+ */
+uint32_t pspStubPlatX86WindowFromPtr(const void *pv);
+
+
+/**
+ * Maps the given 1MB aligned SMN address into the given SMN mapping window.
+ *
+ * @returns Pointer to the start of the window, NULL if the address can't be mapped.
+ * @param   idxSlot                 The mapping window to use.
+ * @param   SmnAddrBase             The 1MB aligned SMN address to map.
+ */
+void *pspStubPlatSmnWindowMap(uint32_t idxSlot, SMNADDR SmnAddrBase);
+
+
+/**
+ * Clears the given SMN mapping window.
+ *
+ * @returns nothing.
+ * @param   idxSlot                 The mapping window to clear.
+ */
+void pspStubPlatSmnWindowUnmap(uint32_t idxSlot);
+
+
+/**
+ * Returns the SMN mapping window the given pointer belongs to.
+ *
+ * @returns Index of the mapping window or UINT32_MAX if the pointer is not inside any window.
+ * @param   pv                      The pointer to look up.
+ */
+uint32_t pspStubPlatSmnWindowFromPtr(const void *pv);
+
+
+/**
+ * Converts the given PSP address to a pointer.
+ *
+ * @returns Pointer to access the PSP address through.
+ * @param   PspAddr                 The PSP address to convert.
+ */
+void *pspStubPlatPspAddrToPtr(PSPADDR PspAddr);
+
+
+/**
+ * Converts the given pointer to the PSP address it is reachable at.
+ *
+ * @returns PSP address, 0 if the pointer is not reachable through the PSP address space.
+ * @param   pv                      The pointer to convert.
+ */
+PSPADDR pspStubPlatPtrToPspAddr(const void *pv);
+
+
+/**
+ * Returns the first PSP address after the memory occupied by the stub.
+ *
+ * @returns PSP address.
+ */
+PSPADDR pspStubPlatStubEndGet(void);
+
+
+/**
+ * Returns the first PSP address after the SRAM.
+ *
+ * @returns PSP address.
+ */
+PSPADDR pspStubPlatSramEndGet(void);
+
+
+/**
+ * Makes sure all memory accesses so far completed before continuing.
+ *
+ * @returns nothing.
+ */
+void pspStubPlatMemBarrier(void);
+
+
+/**
+ * Cleans and invalidates the data cache for the given range.
+ *
+ * @returns nothing.
+ * @param   pv                      Start of the range.
+ * @param   cb                      Size of the range in bytes.
+ */
+void pspStubPlatDCacheCleanInvalidate(void *pv, size_t cb);
+
+
+/**
+ * Starts the free running 100MHz counter used for timekeeping.
+ *
+ * @returns nothing.
+ */
+void pspStubPlatTimerStart(void);
+
+
+/**
+ * Returns the current value of the free running 100MHz counter.
+ *
+ * @returns Counter value (10ns granularity, wraps around).
+ */
+uint32_t pspStubPlatTimerRead(void);
+
+
+/**
+ * Enables interrupts.
+ *
+ * @returns nothing.
+ */
+void pspStubPlatIrqEnable(void);
+
+
+/**
+ * Disables interrupts.
+ *
+ * @returns nothing.
+ */
+void pspStubPlatIrqDisable(void);
+
+
+/**
+ * Checks the status of the IRQ and FIQ line.
+ *
+ * @returns nothing.
+ * @param   pfIrq                   Where to store the status of the IRQ line.
+ * @param   pfFiq                   Where to store the status of the FIQ line.
+ */
+void pspStubPlatIrqCheck(bool *pfIrq, bool *pfFiq);
+
+
+/**
+ * Reads/writes a co-processor register.
+ *
+ * @returns Status code.
+ * @param   u8CoProc                The co-processor to access.
+ * @param   u8Crn                   The CRn field of the access.
+ * @param   u8Crm                   The CRm field of the access.
+ * @param   u8Opc1                  The opc1 field of the access.
+ * @param   u8Opc2                  The opc2 field of the access.
+ * @param   fWrite                  Flag whether to write or read the register.
+ * @param   pu32Val                 The value to write or where to store the value read.
+ */
+int pspStubPlatCoProcRw(uint8_t u8CoProc, uint8_t u8Crn, uint8_t u8Crm, uint8_t u8Opc1, uint8_t u8Opc2,
+                        bool fWrite, uint32_t *pu32Val);
+
+
+/**
+ * Copies memory word by word recovering from faults caused by reading the source.
+ *
+ * @returns 0 on success, 1 if reading the source faulted.
+ * @param   pvDst                   The destination (word aligned).
+ * @param   pvSrc                   The source (word aligned).
+ * @param   cb                      Number of bytes to copy (multiple of 4).
+ */
+int pspStubPlatMemCopyProbe(void *pvDst, const void *pvSrc, size_t cb);
+
+
+/**
+ * Runs the code module loaded at the given address.
+ *
+ * @returns Status code.
+ * @param   pCmIf                   The code module interface to fill in and pass to the module.
+ * @param   PspAddrEntry            Entry point of the code module.
+ * @param   u32Arg0                 First argument.
+ * @param   u32Arg1                 Second argument.
+ * @param   u32Arg2                 Third argument.
+ * @param   u32Arg3                 Fourth argument.
+ * @param   pu32CmRet               Where to store the value returned by the code module.
+ */
+int pspStubPlatCmExec(CMIF *pCmIf, PSPADDR PspAddrEntry, uint32_t u32Arg0, uint32_t u32Arg1,
+                      uint32_t u32Arg2, uint32_t u32Arg3, uint32_t *pu32CmRet);
+
+
+/**
+ * Branches to the given address with the given register set, this doesn't return.
+ *
+ * @returns nothing.
+ * @param   PspAddrPc               Where to branch to (bit 0 set switches to thumb).
+ * @param   pau32Gprs               The register set (r0 to r12).
+ */
+void pspStubPlatBranchTo(PSPADDR PspAddrPc, const uint32_t *pau32Gprs) __attribute__((noreturn));
+
+
+/*
+ * Code module interface callbacks implemented by the stub core.
+ */
+size_t pspStubCmIfInBufPeek(PCCMIF pCmIf, uint32_t idInBuf);
+int pspStubCmIfInBufPoll(PCCMIF pCmIf, uint32_t idInBuf, uint32_t cMillies);
+int pspStubCmIfInBufRead(PCCMIF pCmIf, uint32_t idInBuf, void *pvBuf, size_t cbRead, size_t *pcbRead);
+int pspStubCmIfOutBufWrite(PCCMIF pCmIf, uint32_t idOutBuf, const void *pvBuf, size_t cbWrite, size_t *pcbWritten);
+void pspStubCmIfDelayMs(PCCMIF pCmIf, uint32_t cMillies);
+uint32_t pspStubCmIfTsGetMilli(PCCMIF pCmIf);
+
+
+#ifdef PSP_SERIAL_STUB_HOST
+/**
+ * Runs the stub core on the host using the loopback transport, only returns on error.
+ *
+ * @returns Status code.
+ */
+int pspSerialStubHostMain(void);
+
+
+/**
+ * Sets the native function executed in place of the flat binary code module loaded by the host.
+ *
+ * @returns nothing.
+ * @param   pfnEntry                The entry point to call, NULL to fail code module execution.
+ */
+void pspStubHostCmEntrySet(PFNCMENTRY pfnEntry);
+
+
+/**
+ * Reads from the simulated x86 physical address space bypassing the mapping windows.
+ *
+ * @returns Status code.
+ * @param   PhysX86Addr             The x86 physical address to read from.
+ * @param   pvBuf                   Where to store the data.
+ * @param   cbRead                  Number of bytes to read.
+ */
+int pspStubHostX86MemRead(X86PADDR PhysX86Addr, void *pvBuf, size_t cbRead);
+
+
+/**
+ * Writes to the simulated x86 physical address space bypassing the mapping windows.
+ *
+ * @returns Status code.
+ * @param   PhysX86Addr             The x86 physical address to write to.
+ * @param   pvBuf                   The data to write.
+ * @param   cbWrite                 Number of bytes to write.
+ */
+int pspStubHostX86MemWrite(X86PADDR PhysX86Addr, const void *pvBuf, size_t cbWrite);
+#endif
+
+#endif /* !__include_psp_serial_stub_plat_h */
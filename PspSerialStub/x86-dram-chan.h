@@ -0,0 +1,67 @@
+/** @file
+ * PSP serial stub - x86 DRAM message channel layout, shared between the PSP transport and the x86 peer.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#ifndef __include_x86_dram_chan_h
+#define __include_x86_dram_chan_h
+
+/*
+ * The channel lives in a DRAM region the x86 OS reserved for it (memmap= on Linux) and consists
+ * of a header page followed by two single producer/single consumer rings, one for each direction.
+ * Every index is a free running byte offset written only by its owner, there are no doorbells,
+ * both sides poll the index of the other one:
+ *
+ *     X86_DRAM_CHAN_MAGIC_OFF       magic, written by the x86 peer once everything else was set up
+ *     X86_DRAM_CHAN_RING_SZ_OFF     size of each ring in bytes, chosen by the x86 peer
+ *     X86_DRAM_CHAN_H2P_HEAD_OFF    host to PSP write offset, owned by the host
+ *     X86_DRAM_CHAN_H2P_TAIL_OFF    host to PSP read offset, owned by the PSP
+ *     X86_DRAM_CHAN_P2H_HEAD_OFF    PSP to host write offset, owned by the PSP
+ *     X86_DRAM_CHAN_P2H_TAIL_OFF    PSP to host read offset, owned by the host
+ *     X86_DRAM_CHAN_H2P_DATA_OFF    host to PSP ring data
+ *     X86_DRAM_CHAN_P2H_DATA_OFF    PSP to host ring data
+ *
+ * Each index sits in its own cache line so the sides never write to the same line.
+ * The data is always written before the index publishing it. All fields are little endian 32bit words.
+ *
+ * This header is included by the host tooling as well, so it must only contain plain definitions.
+ */
+/** Size of a cache line (x86 and PSP). */
+#define X86_DRAM_CHAN_LINE_SZ           64
+#define X86_DRAM_CHAN_MAGIC_OFF         0
+#define X86_DRAM_CHAN_RING_SZ_OFF       4
+#define X86_DRAM_CHAN_H2P_HEAD_OFF      (1 * X86_DRAM_CHAN_LINE_SZ)
+#define X86_DRAM_CHAN_H2P_TAIL_OFF      (2 * X86_DRAM_CHAN_LINE_SZ)
+#define X86_DRAM_CHAN_P2H_HEAD_OFF      (3 * X86_DRAM_CHAN_LINE_SZ)
+#define X86_DRAM_CHAN_P2H_TAIL_OFF      (4 * X86_DRAM_CHAN_LINE_SZ)
+/** Size of the header, the rings start page aligned. */
+#define X86_DRAM_CHAN_HDR_SZ            4096
+#define X86_DRAM_CHAN_H2P_DATA_OFF      X86_DRAM_CHAN_HDR_SZ
+#define X86_DRAM_CHAN_P2H_DATA_OFF(a_cbRing) (X86_DRAM_CHAN_HDR_SZ + (a_cbRing))
+/** Size of the whole channel for the given ring size. */
+#define X86_DRAM_CHAN_SZ(a_cbRing)      (X86_DRAM_CHAN_HDR_SZ + 2 * (a_cbRing))
+
+/** Smallest supported ring size (rings must be a power of two in size). */
+#define X86_DRAM_CHAN_RING_SZ_MIN       4096
+/** Largest supported ring size. */
+#define X86_DRAM_CHAN_RING_SZ_MAX       (16 * 1024 * 1024)
+
+#define X86_DRAM_CHAN_MAGIC             0x19120623 /* (Alan Turing) */
+
+#endif /* !__include_x86_dram_chan_h */
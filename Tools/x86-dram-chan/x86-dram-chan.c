@@ -0,0 +1,536 @@
+/** @file
+ * x86 side peer of the PSP serial stub DRAM message channel (Linux userspace).
+ *
+ * Operates on an mmap'd region, either the reserved DRAM through /dev/mem on the target
+ * or a plain file on any Linux host for testing the channel without hardware.
+ *
+ *     x86-dram-chan <path> [-o <offset>] init [<ring size>]   Resets the channel and marks it ready for the PSP.
+ *     x86-dram-chan <path> [-o <offset>] bridge              Host side, stdin goes to the PSP, the PSP output to stdout.
+ *     x86-dram-chan <path> [-o <offset>] echo                PSP side, echoes everything back (testing only).
+ *     x86-dram-chan <path> [-o <offset>] bench [<MB>]        Host side, measures the round trip throughput against echo.
+ */
+
+/*
+ * Copyright (C) 2020 Alexander Eichner <alexander.eichner@campus.tu-berlin.de>
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU Lesser General Public
+ * License as published by the Free Software Foundation; either
+ * version 2.1 of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public
+ * License along with this library; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "../../PspSerialStub/x86-dram-chan.h"
+
+
+/** Number of unsuccessful polls before giving up the CPU. */
+#define X86_DRAM_CHAN_SPINS_BEFORE_YIELD    1024
+/** Size of the buffer used for shuffling data around. */
+#define X86_DRAM_CHAN_XFER_BUF_SZ           (64 * 1024)
+
+
+/**
+ * One endpoint of the channel.
+ */
+typedef struct X86DRAMCHAN
+{
+    /** The mapping of the channel. */
+    volatile uint8_t            *pbChan;
+    /** Size of the mapping in bytes. */
+    size_t                      cbMap;
+    /** Size of each ring in bytes. */
+    uint32_t                    cbRing;
+    /** Channel offset of the index we write to for transmitting. */
+    uint32_t                    offTxHeadIdx;
+    /** Channel offset of the index the other side advances when consuming what we transmitted. */
+    uint32_t                    offTxTailIdx;
+    /** Channel offset of the ring data we transmit into. */
+    uint32_t                    offTxData;
+    /** Channel offset of the index the other side advances when transmitting to us. */
+    uint32_t                    offRxHeadIdx;
+    /** Channel offset of the index we write to when consuming. */
+    uint32_t                    offRxTailIdx;
+    /** Channel offset of the ring data we receive from. */
+    uint32_t                    offRxData;
+    /** Free running transmit write offset. */
+    uint32_t                    offTxHead;
+    /** Free running receive read offset. */
+    uint32_t                    offRxTail;
+} X86DRAMCHAN;
+/** Pointer to a channel endpoint. */
+typedef X86DRAMCHAN *PX86DRAMCHAN;
+
+
+static inline uint32_t x86DramChanIdxRead(PX86DRAMCHAN pThis, uint32_t offIdx)
+{
+    return __atomic_load_n((volatile uint32_t *)(pThis->pbChan + offIdx), __ATOMIC_ACQUIRE);
+}
+
+
+static inline void x86DramChanIdxWrite(PX86DRAMCHAN pThis, uint32_t offIdx, uint32_t u32Idx)
+{
+    __atomic_store_n((volatile uint32_t *)(pThis->pbChan + offIdx), u32Idx, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * Waits a bit after an unsuccessful poll.
+ *
+ * @returns nothing.
+ * @param   pcSpins                 The spin counter of the caller.
+ */
+static void x86DramChanBackoff(uint32_t *pcSpins)
+{
+    if (++*pcSpins >= X86_DRAM_CHAN_SPINS_BEFORE_YIELD)
+    {
+        *pcSpins = 0;
+        sched_yield();
+    }
+}
+
+
+/**
+ * Maps the channel at the given offset of the given file.
+ *
+ * @returns 0 on success, -1 on failure (error printed).
+ * @param   pThis                   The channel endpoint to initialize.
+ * @param   pszPath                 The file to map (/dev/mem for the real thing).
+ * @param   offChan                 Offset of the channel in the file, page aligned.
+ * @param   cbRing                  Size of the rings, 0 to take it from the channel header.
+ */
+static int x86DramChanMap(PX86DRAMCHAN pThis, const char *pszPath, off_t offChan, uint32_t cbRing)
+{
+    int iFd = open(pszPath, O_RDWR | O_CREAT | O_SYNC, 0600);
+    if (iFd < 0)
+    {
+        fprintf(stderr, "Opening %s failed: %s\n", pszPath, strerror(errno));
+        return -1;
+    }
+
+    if (!cbRing)
+    {
+        uint32_t au32Hdr[2];
+        if (pread(iFd, &au32Hdr[0], sizeof(au32Hdr), offChan) != sizeof(au32Hdr))
+        {
+            fprintf(stderr, "Reading the channel header failed\n");
+            close(iFd);
+            return -1;
+        }
+        if (au32Hdr[X86_DRAM_CHAN_MAGIC_OFF / sizeof(uint32_t)] != X86_DRAM_CHAN_MAGIC)
+        {
+            fprintf(stderr, "The channel was not initialized (run init first)\n");
+            close(iFd);
+            return -1;
+        }
+        cbRing = au32Hdr[X86_DRAM_CHAN_RING_SZ_OFF / sizeof(uint32_t)];
+    }
+
+    if (   cbRing < X86_DRAM_CHAN_RING_SZ_MIN
+        || cbRing > X86_DRAM_CHAN_RING_SZ_MAX
+        || (cbRing & (cbRing - 1)))
+    {
+        fprintf(stderr, "Invalid ring size %u\n", cbRing);
+        close(iFd);
+        return -1;
+    }
+
+    /* Grow regular files to cover the channel, character devices like /dev/mem have no size. */
+    struct stat St;
+    size_t cbMap = X86_DRAM_CHAN_SZ(cbRing);
+    if (   !fstat(iFd, &St)
+        && S_ISREG(St.st_mode)
+        && St.st_size < offChan + (off_t)cbMap
+        && ftruncate(iFd, offChan + cbMap))
+    {
+        fprintf(stderr, "Resizing %s failed: %s\n", pszPath, strerror(errno));
+        close(iFd);
+        return -1;
+    }
+
+    void *pv = mmap(NULL, cbMap, PROT_READ | PROT_WRITE, MAP_SHARED, iFd, offChan);
+    close(iFd);
+    if (pv == MAP_FAILED)
+    {
+        fprintf(stderr, "Mapping the channel failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    memset(pThis, 0, sizeof(*pThis));
+    pThis->pbChan = (volatile uint8_t *)pv;
+    pThis->cbMap  = cbMap;
+    pThis->cbRing = cbRing;
+    return 0;
+}
+
+
+/**
+ * Sets up the endpoint for the given side of the channel.
+ *
+ * @returns nothing.
+ * @param   pThis                   The mapped channel endpoint.
+ * @param   fPsp                    Flag whether to act as the PSP side.
+ */
+static void x86DramChanAttach(PX86DRAMCHAN pThis, bool fPsp)
+{
+    if (fPsp)
+    {
+        pThis->offTxHeadIdx = X86_DRAM_CHAN_P2H_HEAD_OFF;
+        pThis->offTxTailIdx = X86_DRAM_CHAN_P2H_TAIL_OFF;
+        pThis->offTxData    = X86_DRAM_CHAN_P2H_DATA_OFF(pThis->cbRing);
+        pThis->offRxHeadIdx = X86_DRAM_CHAN_H2P_HEAD_OFF;
+        pThis->offRxTailIdx = X86_DRAM_CHAN_H2P_TAIL_OFF;
+        pThis->offRxData    = X86_DRAM_CHAN_H2P_DATA_OFF;
+    }
+    else
+    {
+        pThis->offTxHeadIdx = X86_DRAM_CHAN_H2P_HEAD_OFF;
+        pThis->offTxTailIdx = X86_DRAM_CHAN_H2P_TAIL_OFF;
+        pThis->offTxData    = X86_DRAM_CHAN_H2P_DATA_OFF;
+        pThis->offRxHeadIdx = X86_DRAM_CHAN_P2H_HEAD_OFF;
+        pThis->offRxTailIdx = X86_DRAM_CHAN_P2H_TAIL_OFF;
+        pThis->offRxData    = X86_DRAM_CHAN_P2H_DATA_OFF(pThis->cbRing);
+    }
+
+    /* Continue where the indices are. */
+    pThis->offTxHead = x86DramChanIdxRead(pThis, pThis->offTxHeadIdx);
+    pThis->offRxTail = x86DramChanIdxRead(pThis, pThis->offRxTailIdx);
+}
+
+
+/**
+ * Resets all indices and marks the channel as ready, the PSP picks it up from there.
+ *
+ * @returns nothing.
+ * @param   pThis                   The mapped channel endpoint.
+ */
+static void x86DramChanReset(PX86DRAMCHAN pThis)
+{
+    x86DramChanIdxWrite(pThis, X86_DRAM_CHAN_MAGIC_OFF, 0);
+    memset((void *)pThis->pbChan, 0, X86_DRAM_CHAN_HDR_SZ);
+    x86DramChanIdxWrite(pThis, X86_DRAM_CHAN_RING_SZ_OFF, pThis->cbRing);
+    x86DramChanIdxWrite(pThis, X86_DRAM_CHAN_MAGIC_OFF, X86_DRAM_CHAN_MAGIC);
+}
+
+
+/**
+ * Writes as much as fits into the transmit ring.
+ *
+ * @returns Number of bytes written.
+ * @param   pThis                   The channel endpoint.
+ * @param   pvBuf                   The data to write.
+ * @param   cbWrite                 Number of bytes to write.
+ */
+static size_t x86DramChanWriteNB(PX86DRAMCHAN pThis, const void *pvBuf, size_t cbWrite)
+{
+    uint32_t offTxTail = x86DramChanIdxRead(pThis, pThis->offTxTailIdx);
+    size_t cbFree = pThis->cbRing - (pThis->offTxHead - offTxTail);
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    size_t cbWritten = 0;
+
+    while (   cbWrite
+           && cbFree)
+    {
+        uint32_t offRing = pThis->offTxHead & (pThis->cbRing - 1);
+        size_t cbThisWrite = cbWrite;
+        if (cbThisWrite > cbFree)
+            cbThisWrite = cbFree;
+        if (cbThisWrite > pThis->cbRing - offRing)
+            cbThisWrite = pThis->cbRing - offRing;
+
+        memcpy((uint8_t *)pThis->pbChan + pThis->offTxData + offRing, pbBuf, cbThisWrite);
+        pThis->offTxHead += cbThisWrite;
+
+        pbBuf     += cbThisWrite;
+        cbWrite   -= cbThisWrite;
+        cbFree    -= cbThisWrite;
+        cbWritten += cbThisWrite;
+    }
+
+    if (cbWritten)
+        x86DramChanIdxWrite(pThis, pThis->offTxHeadIdx, pThis->offTxHead);
+
+    return cbWritten;
+}
+
+
+/**
+ * Reads whatever is available from the receive ring.
+ *
+ * @returns Number of bytes read.
+ * @param   pThis                   The channel endpoint.
+ * @param   pvBuf                   Where to store the data.
+ * @param   cbRead                  Maximum number of bytes to read.
+ */
+static size_t x86DramChanReadNB(PX86DRAMCHAN pThis, void *pvBuf, size_t cbRead)
+{
+    uint32_t offRxHead = x86DramChanIdxRead(pThis, pThis->offRxHeadIdx);
+    size_t cbAvail = offRxHead - pThis->offRxTail;
+    uint8_t *pbBuf = (uint8_t *)pvBuf;
+    size_t cbReadTotal = 0;
+
+    while (   cbRead
+           && cbAvail)
+    {
+        uint32_t offRing = pThis->offRxTail & (pThis->cbRing - 1);
+        size_t cbThisRead = cbRead;
+        if (cbThisRead > cbAvail)
+            cbThisRead = cbAvail;
+        if (cbThisRead > pThis->cbRing - offRing)
+            cbThisRead = pThis->cbRing - offRing;
+
+        memcpy(pbBuf, (const uint8_t *)pThis->pbChan + pThis->offRxData + offRing, cbThisRead);
+        pThis->offRxTail += cbThisRead;
+
+        pbBuf       += cbThisRead;
+        cbRead      -= cbThisRead;
+        cbAvail     -= cbThisRead;
+        cbReadTotal += cbThisRead;
+    }
+
+    if (cbReadTotal)
+        x86DramChanIdxWrite(pThis, pThis->offRxTailIdx, pThis->offRxTail);
+
+    return cbReadTotal;
+}
+
+
+/**
+ * Writes everything, waiting for the other side to make room.
+ *
+ * @returns nothing.
+ * @param   pThis                   The channel endpoint.
+ * @param   pvBuf                   The data to write.
+ * @param   cbWrite                 Number of bytes to write.
+ */
+static void x86DramChanWrite(PX86DRAMCHAN pThis, const void *pvBuf, size_t cbWrite)
+{
+    const uint8_t *pbBuf = (const uint8_t *)pvBuf;
+    uint32_t cSpins = 0;
+
+    while (cbWrite)
+    {
+        size_t cbWritten = x86DramChanWriteNB(pThis, pbBuf, cbWrite);
+        if (!cbWritten)
+            x86DramChanBackoff(&cSpins);
+
+        pbBuf   += cbWritten;
+        cbWrite -= cbWritten;
+    }
+}
+
+
+/**
+ * Host side, shuffles stdin to the PSP and the PSP output to stdout until stdin is closed.
+ *
+ * @returns Process exit code.
+ * @param   pThis                   The channel endpoint.
+ */
+static int x86DramChanBridge(PX86DRAMCHAN pThis)
+{
+    static uint8_t s_abBuf[X86_DRAM_CHAN_XFER_BUF_SZ];
+    bool fStdinOpen = true;
+    uint32_t cSpins = 0;
+
+    fcntl(STDIN_FILENO, F_SETFL, fcntl(STDIN_FILENO, F_GETFL) | O_NONBLOCK);
+    for (;;)
+    {
+        bool fProgress = false;
+
+        size_t cbRead = x86DramChanReadNB(pThis, &s_abBuf[0], sizeof(s_abBuf));
+        if (cbRead)
+        {
+            if (fwrite(&s_abBuf[0], 1, cbRead, stdout) != cbRead)
+                return 1;
+            fflush(stdout);
+            fProgress = true;
+        }
+
+        if (fStdinOpen)
+        {
+            ssize_t cbIn = read(STDIN_FILENO, &s_abBuf[0], sizeof(s_abBuf));
+            if (cbIn > 0)
+            {
+                x86DramChanWrite(pThis, &s_abBuf[0], cbIn);
+                fProgress = true;
+            }
+            else if (   !cbIn
+                     || (errno != EAGAIN && errno != EWOULDBLOCK))
+                fStdinOpen = false;
+        }
+        else if (   pThis->offTxHead == x86DramChanIdxRead(pThis, pThis->offTxTailIdx)
+                 && pThis->offRxTail == x86DramChanIdxRead(pThis, pThis->offRxHeadIdx))
+            return 0; /* The PSP took everything and has nothing more for us. */
+
+        if (!fProgress)
+            x86DramChanBackoff(&cSpins);
+    }
+}
+
+
+/**
+ * PSP side stand-in, echoes everything received back to the host.
+ *
+ * @returns Process exit code.
+ * @param   pThis                   The channel endpoint.
+ */
+static int x86DramChanEcho(PX86DRAMCHAN pThis)
+{
+    static uint8_t s_abBuf[X86_DRAM_CHAN_XFER_BUF_SZ];
+    uint32_t cSpins = 0;
+
+    for (;;)
+    {
+        size_t cbRead = x86DramChanReadNB(pThis, &s_abBuf[0], sizeof(s_abBuf));
+        if (cbRead)
+            x86DramChanWrite(pThis, &s_abBuf[0], cbRead);
+        else
+            x86DramChanBackoff(&cSpins);
+    }
+
+    return 0;
+}
+
+
+/**
+ * Host side, sends the given amount of data to an echoing peer and verifies what comes back.
+ *
+ * @returns Process exit code.
+ * @param   pThis                   The channel endpoint.
+ * @param   cbTotal                 Number of bytes to send.
+ */
+static int x86DramChanBench(PX86DRAMCHAN pThis, uint64_t cbTotal)
+{
+    static uint8_t s_abTx[X86_DRAM_CHAN_XFER_BUF_SZ];
+    static uint8_t s_abRx[X86_DRAM_CHAN_XFER_BUF_SZ];
+    uint64_t cbSent = 0;
+    uint64_t cbRecv = 0;
+    uint32_t cSpins = 0;
+    struct timespec TsStart, TsEnd;
+
+    clock_gettime(CLOCK_MONOTONIC, &TsStart);
+    while (cbRecv < cbTotal)
+    {
+        bool fProgress = false;
+
+        if (cbSent < cbTotal)
+        {
+            size_t offBuf = cbSent % sizeof(s_abTx);
+            size_t cbThisSend = sizeof(s_abTx) - offBuf;
+            if (cbThisSend > cbTotal - cbSent)
+                cbThisSend = cbTotal - cbSent;
+
+            /* The pattern is the low byte of the stream offset, cheap to verify. */
+            for (size_t i = 0; i < cbThisSend; i++)
+                s_abTx[offBuf + i] = (uint8_t)(cbSent + i);
+
+            size_t cbWritten = x86DramChanWriteNB(pThis, &s_abTx[offBuf], cbThisSend);
+            cbSent += cbWritten;
+            fProgress = cbWritten != 0;
+        }
+
+        size_t cbRead = x86DramChanReadNB(pThis, &s_abRx[0], sizeof(s_abRx));
+        for (size_t i = 0; i < cbRead; i++)
+        {
+            if (s_abRx[i] != (uint8_t)(cbRecv + i))
+            {
+                fprintf(stderr, "Data mismatch at offset %llu\n", (unsigned long long)(cbRecv + i));
+                return 1;
+            }
+        }
+        cbRecv += cbRead;
+
+        if (   !fProgress
+            && !cbRead)
+            x86DramChanBackoff(&cSpins);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &TsEnd);
+
+    double dSecs = (TsEnd.tv_sec - TsStart.tv_sec) + (TsEnd.tv_nsec - TsStart.tv_nsec) / 1e9;
+    printf("%llu bytes round trip in %.3f s: %.1f MB/s\n", (unsigned long long)cbTotal, dSecs,
+           dSecs > 0.0 ? cbTotal / dSecs / (1024.0 * 1024.0) : 0.0);
+    return 0;
+}
+
+
+static void x86DramChanUsage(const char *pszArgv0)
+{
+    fprintf(stderr, "Usage: %s <path> [-o <offset>] init [<ring size>] | bridge | echo | bench [<MB>]\n", pszArgv0);
+}
+
+
+int main(int argc, char *argv[])
+{
+    if (argc < 3)
+    {
+        x86DramChanUsage(argv[0]);
+        return 1;
+    }
+
+    const char *pszPath = argv[1];
+    off_t offChan = 0;
+    int idxArg = 2;
+    if (!strcmp(argv[idxArg], "-o"))
+    {
+        if (argc < 5)
+        {
+            x86DramChanUsage(argv[0]);
+            return 1;
+        }
+        offChan = (off_t)strtoull(argv[idxArg + 1], NULL, 0);
+        idxArg += 2;
+    }
+
+    const char *pszCmd = argv[idxArg++];
+    X86DRAMCHAN Chan;
+    if (!strcmp(pszCmd, "init"))
+    {
+        uint32_t cbRing = idxArg < argc ? (uint32_t)strtoul(argv[idxArg], NULL, 0) : 64 * 1024;
+        if (x86DramChanMap(&Chan, pszPath, offChan, cbRing))
+            return 1;
+        x86DramChanReset(&Chan);
+        return 0;
+    }
+
+    if (x86DramChanMap(&Chan, pszPath, offChan, 0 /*cbRing*/))
+        return 1;
+
+    if (!strcmp(pszCmd, "bridge"))
+    {
+        x86DramChanAttach(&Chan, false /*fPsp*/);
+        return x86DramChanBridge(&Chan);
+    }
+    else if (!strcmp(pszCmd, "echo"))
+    {
+        x86DramChanAttach(&Chan, true /*fPsp*/);
+        return x86DramChanEcho(&Chan);
+    }
+    else if (!strcmp(pszCmd, "bench"))
+    {
+        uint64_t cMb = idxArg < argc ? strtoull(argv[idxArg], NULL, 0) : 256;
+        x86DramChanAttach(&Chan, false /*fPsp*/);
+        return x86DramChanBench(&Chan, cMb * 1024 * 1024);
+    }
+
+    x86DramChanUsage(argv[0]);
+    return 1;
+}